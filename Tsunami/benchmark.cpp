@@ -0,0 +1,587 @@
+// benchmark.cpp
+#include "Bytecode.h"
+#include "BytecodeBundle.h"
+#include "BytecodeCache.h"
+#include "BytecodeWriter.h"
+#include "tsunami_state.hpp"
+#include "tsunami_value.hpp"
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Defeats dead-code elimination of benchmarked results
+static size_t g_sink = 0;
+
+template<typename Fn>
+static void bench(const char* name, size_t iterations, Fn&& fn) {
+    // Warm-up
+    for (size_t i = 0; i < iterations / 10 + 1; i++) g_sink += fn(i);
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) g_sink += fn(i);
+    auto end = std::chrono::steady_clock::now();
+
+    double ns = std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+    std::cout << "  " << std::left << std::setw(32) << name
+              << std::right << std::fixed << std::setprecision(1) << std::setw(10) << ns << " ns/op\n";
+}
+
+int main() {
+    std::cout << "=== Bytecode Generator Benchmark ===\n\n";
+
+    // Benchmark 1: Push chunk generation
+    std::cout << "1. Push chunk generation:\n";
+    const size_t N = 1000000;
+
+    bench("CreatePushNil", N, [](size_t) { return Bytecode::CreatePushNil().size(); });
+    bench("CreatePushBoolean", N, [](size_t i) { return Bytecode::CreatePushBoolean(i & 1).size(); });
+    bench("CreatePushNumber", N, [](size_t i) { return Bytecode::CreatePushNumber(i * 0.5).size(); });
+
+    std::string shortStr = "Hello World";
+    std::string longStr(256, 'x');
+    bench("CreatePushString (11 B)", N, [&](size_t) { return Bytecode::CreatePushString(shortStr).size(); });
+    bench("CreatePushString (256 B)", N, [&](size_t) { return Bytecode::CreatePushString(longStr).size(); });
+    bench("CreatePushTable", N, [](size_t) { return Bytecode::CreatePushTable(5, 3).size(); });
+
+    std::vector<std::string> items = {"sword", "shield", "potion", "bow", "arrow", "helmet", "boots", "ring"};
+    bench("CreatePushArray (8)", N / 4, [&](size_t) { return Bytecode::CreatePushArray(items).size(); });
+
+    std::vector<std::string> values = {"player1", "100", "true", "3.14", "false", "level", "42", "guild"};
+    bench("CreatePushMultiple (8)", N / 4, [&](size_t) { return Bytecode::CreatePushMultiple(values).size(); });
+
+    std::vector<Bytecode::PushValue> typed = {
+        Bytecode::PushValue::String("player1"), Bytecode::PushValue::Number(100), Bytecode::PushValue::Boolean(true),
+        Bytecode::PushValue::Number(3.14), Bytecode::PushValue::Boolean(false), Bytecode::PushValue::String("level"),
+        Bytecode::PushValue::Number(42), Bytecode::PushValue::String("guild")};
+    bench("CreatePushValues (8)", N / 4, [&](size_t) { return Bytecode::CreatePushValues(typed).size(); });
+
+    std::vector<Bytecode::PushValue> manyTyped;
+    for (size_t i = 0; i < 10000; i++) {
+        switch (i % 4) {
+            case 0: manyTyped.push_back(Bytecode::PushValue::Number(i * 0.5)); break;
+            case 1: manyTyped.push_back(Bytecode::PushValue::Boolean(i & 2)); break;
+            case 2: manyTyped.push_back(Bytecode::PushValue::String(values[i % values.size()])); break;
+            default: manyTyped.push_back(Bytecode::PushValue::Nil()); break;
+        }
+    }
+    bench("CreatePushValues (10k)", N / 1000, [&](size_t) { return Bytecode::CreatePushValues(manyTyped).size(); });
+
+    // Benchmark 2: Cache-backed generation
+    std::cout << "\n2. BytecodeCache:\n";
+    {
+        Bytecode::BytecodeCache cache;
+        bench("getNumber (repeated)", N, [&](size_t i) { return cache.getNumber((i & 15) * 0.5)->size(); });
+        bench("getNumber (distinct)", N, [&](size_t i) { return cache.getNumber(i * 0.25)->size(); });
+        bench("getString (repeated)", N, [&](size_t) { return cache.getString(shortStr)->size(); });
+
+        Bytecode::CacheStats stats = cache.stats();
+        std::cout << "  hits " << stats.hits << ", misses " << stats.misses
+                  << ", evictions " << stats.evictions << ", resident "
+                  << stats.residentBytes / 1024 << " KB of " << stats.budgetBytes / 1024 << " KB\n";
+    }
+
+    // Benchmark 3: Verifier throughput
+    std::cout << "\n3. VerifyBytecode throughput:\n";
+    {
+        std::vector<std::string> corpus;
+        size_t corpusBytes = 0;
+        for (size_t i = 0; i < 20000; i++) {
+            switch (i % 5) {
+                case 0: corpus.push_back(Bytecode::CreatePushNumber(i * 1.5)); break;
+                case 1: corpus.push_back(Bytecode::CreatePushString("value_" + std::to_string(i))); break;
+                case 2: corpus.push_back(Bytecode::CreatePushMultiple(values)); break;
+                case 3: corpus.push_back(Bytecode::CreatePushArray(items)); break;
+                default: {
+                    std::vector<std::string> wide(200, "entry" + std::to_string(i));
+                    corpus.push_back(Bytecode::CreatePushArray(wide));
+                    break;
+                }
+            }
+            corpusBytes += corpus.back().size();
+        }
+
+        const int rounds = 20;
+        size_t failures = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; r++) {
+            for (const auto& chunk : corpus) {
+                failures += Bytecode::VerifyBytecode(
+                    reinterpret_cast<const uint8_t*>(chunk.data()), chunk.size()) != Bytecode::VERIFY_OK;
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        double seconds = std::chrono::duration<double>(end - start).count();
+        double mbps = (double(corpusBytes) * rounds / (1024.0 * 1024.0)) / seconds;
+        std::cout << "  " << corpus.size() << " chunks, " << corpusBytes / 1024 << " KiB, "
+                  << failures << " rejected\n";
+        std::cout << "  " << std::fixed << std::setprecision(1) << mbps << " MB/s\n";
+    }
+
+    // Benchmark 4: Disassembler throughput
+    std::cout << "\n4. Disassemble throughput:\n";
+    {
+        std::vector<std::string> wide(200000);
+        for (size_t i = 0; i < wide.size(); i++) wide[i] = "item" + std::to_string(i);
+        std::string chunk = Bytecode::CreatePushArray(wide);
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(chunk.data());
+
+        struct CountingSink : Bytecode::DisassemblySink {
+            size_t bytes = 0;
+            void write(const char*, size_t size) override { bytes += size; }
+        };
+
+        const Bytecode::DisassemblyFormat formats[] = {Bytecode::DISASM_TEXT, Bytecode::DISASM_JSON};
+        const char* names[] = {"text", "json"};
+        for (int f = 0; f < 2; f++) {
+            const int rounds = 10;
+            CountingSink sink;
+            auto start = std::chrono::steady_clock::now();
+            for (int r = 0; r < rounds; r++) Bytecode::Disassemble(data, chunk.size(), sink, formats[f]);
+            auto end = std::chrono::steady_clock::now();
+
+            double seconds = std::chrono::duration<double>(end - start).count();
+            double mbps = (double(chunk.size()) * rounds / (1024.0 * 1024.0)) / seconds;
+            std::cout << "  " << std::left << std::setw(8) << names[f] << std::right
+                      << chunk.size() / 1024 << " KiB in, " << sink.bytes / rounds / 1024 << " KiB out, "
+                      << std::fixed << std::setprecision(1) << mbps << " MB/s\n";
+            g_sink += sink.bytes;
+        }
+    }
+
+    // Benchmark 5: Compile throughput
+    std::cout << "\n5. Compile throughput:\n";
+    {
+        // ~10k lines mixing every construct the compiler supports
+        std::string script;
+        size_t lines = 0;
+        for (int i = 0; lines < 10000; i++) {
+            std::string n = std::to_string(i);
+            script += "do\n"
+                      "local function step" + n + "(a, b)\n"
+                      "    local t = {a, b, name = \"step" + n + "\", [a] = b}\n"
+                      "    for i = 1, 10 do\n"
+                      "        if t[1] < i and t.name ~= \"x\" then\n"
+                      "            t[2] = t[2] + i * 2 - b / 3\n"
+                      "        elseif i % 3 == 0 then\n"
+                      "            counter = (counter or 0) + 1\n"
+                      "        end\n"
+                      "    end\n"
+                      "    while a > 0 do a = a - 1 end\n"
+                      "    return function() return t.name .. a end\n"
+                      "end\n"
+                      "print(step" + n + "(" + n + ", 2)())\n"
+                      "end\n";
+            lines += 15;
+        }
+
+        const int rounds = 10;
+        size_t output = 0;
+        std::string error;
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; r++) output += Bytecode::Compile(script, &error).size();
+        auto end = std::chrono::steady_clock::now();
+
+        double seconds = std::chrono::duration<double>(end - start).count();
+        double linesPerSecond = double(lines) * rounds / seconds;
+        double mbps = (double(script.size()) * rounds / (1024.0 * 1024.0)) / seconds;
+        std::cout << "  " << lines << " lines, " << script.size() / 1024 << " KiB source, "
+                  << output / rounds / 1024 << " KiB bytecode" << (error.empty() ? "" : " (" + error + ")") << "\n";
+        std::cout << "  " << std::fixed << std::setprecision(0) << linesPerSecond << " lines/s, "
+                  << std::setprecision(1) << mbps << " MB/s\n";
+        g_sink += output;
+    }
+
+    // Benchmark 6: Large arrays
+    std::cout << "\n6. Large arrays (chunk size and generation time vs N):\n";
+    for (size_t n : {1000u, 10000u, 100000u, 1000000u}) {
+        std::vector<std::string> array(n);
+        for (size_t i = 0; i < n; i++) array[i] = "item" + std::to_string(i);
+
+        auto start = std::chrono::steady_clock::now();
+        std::string direct = Bytecode::CreatePushArray(array);
+        auto mid = std::chrono::steady_clock::now();
+        Bytecode::Compiler compiler;
+        compiler.pushArray(array);
+        std::string compiled = compiler.compile();
+        auto end = std::chrono::steady_clock::now();
+
+        std::cout << "  N=" << std::left << std::setw(8) << n << std::right
+                  << "CreatePushArray " << std::setw(6) << direct.size() / 1024 << " KiB "
+                  << std::fixed << std::setprecision(2) << std::setw(8)
+                  << std::chrono::duration<double, std::milli>(mid - start).count() << " ms   "
+                  << "Compiler " << std::setw(6) << compiled.size() / 1024 << " KiB "
+                  << std::setw(8) << std::chrono::duration<double, std::milli>(end - mid).count() << " ms\n";
+        g_sink += direct.size() + compiled.size();
+    }
+
+    // Benchmark 7: Dictionaries, DUPTABLE shape vs NEWTABLE + SETTABLE
+    std::cout << "\n7. Dictionaries (DUPTABLE shape vs NEWTABLE+SETTABLE):\n";
+    // {keys, distinct values}: every value distinct, or drawn from 8 like
+    // records of flags and enums
+    const std::pair<size_t, size_t> shapes[] = {{8, 8}, {64, 64}, {64, 8}, {1024, 1024}, {1024, 8}};
+    for (auto [keys, distinct] : shapes) {
+        std::vector<std::pair<std::string, std::string>> dict;
+        for (size_t i = 0; i < keys; i++) dict.push_back({"field" + std::to_string(i), "value" + std::to_string(i % distinct)});
+
+        // NEWTABLE, then per pair LOADK key, LOADK value, SETTABLE
+        auto setTable = [&](size_t) {
+            uint32_t count = static_cast<uint32_t>(dict.size() * 2);
+            size_t constantBytes = 0;
+            for (const auto& kv : dict) {
+                constantBytes += Bytecode::BytecodeWriter::stringConstantSize(kv.first.size()) +
+                                 Bytecode::BytecodeWriter::stringConstantSize(kv.second.size());
+            }
+            uint32_t sizeCode = 2 + count / 2 * 3 + 1;
+
+            Bytecode::BytecodeWriter writer(Bytecode::BytecodeWriter::chunkSize(count, constantBytes, 3, sizeCode));
+            writer.beginChunk();
+            writer.writeVarInt(count);
+            for (const auto& kv : dict) {
+                writer.writeConstantString(kv.first);
+                writer.writeConstantString(kv.second);
+            }
+            writer.writeVarInt(1);
+            writer.beginProto(3, 0, 0, false, sizeCode);
+            writer.emitABC(Bytecode::LOP_NEWTABLE, 0, Bytecode::encodeHashSize(static_cast<uint32_t>(dict.size())), 0);
+            writer.emitAux(0);
+            for (uint32_t k = 0; k < count; k += 2) {
+                writer.emitLoadConstant(1, k);
+                writer.emitLoadConstant(2, k + 1);
+                writer.emitABC(Bytecode::LOP_SETTABLE, 2, 0, 1);
+            }
+            writer.emitABC(Bytecode::LOP_RETURN, 0, 2, 0);
+            writer.endProto(count);
+            return writer.finish().size();
+        };
+
+        std::string suffix = " (" + std::to_string(keys) + " keys, " + std::to_string(distinct) + " values)";
+        size_t iterations = 400000 / keys;
+        bench(("DUPTABLE" + suffix).c_str(), iterations, [&](size_t) { return Bytecode::CreatePushDictionary(dict).size(); });
+        bench(("NEWTABLE+SETTABLE" + suffix).c_str(), iterations, setTable);
+        std::cout << "    " << Bytecode::CreatePushDictionary(dict).size() << " vs " << setTable(0) << " bytes\n";
+    }
+
+    // Benchmark 8: JSON marshalling
+    std::cout << "\n8. MarshalJson throughput:\n";
+    {
+        std::string json = "{\"items\":[";
+        for (size_t i = 0; i < 100000; i++) {
+            if (i) json += ",";
+            json += "{\"id\":" + std::to_string(i) + ",\"name\":\"item" + std::to_string(i % 500) +
+                    "\",\"price\":" + std::to_string(i * 0.25) + ",\"tags\":[\"a\",\"b\"],\"active\":true}";
+        }
+        json += "]}";
+
+        const int rounds = 5;
+        size_t output = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; r++) output += Bytecode::MarshalJson(json).size();
+        auto end = std::chrono::steady_clock::now();
+
+        double seconds = std::chrono::duration<double>(end - start).count();
+        double mbps = (double(json.size()) * rounds / (1024.0 * 1024.0)) / seconds;
+        std::cout << "  " << json.size() / 1024 << " KiB JSON -> " << output / rounds / 1024 << " KiB bytecode, "
+                  << std::fixed << std::setprecision(1) << mbps << " MB/s\n";
+        g_sink += output;
+    }
+
+    // Benchmark 9: Concurrent cache scaling
+    std::cout << "\n9. Cache scaling (90% hot keys, 10% cold, Mops/s):\n";
+    {
+        const size_t opsPerThread = 200000;
+        const size_t hotKeys = 4096;
+
+        // Thread t's i-th key: mostly from a shared hot set, otherwise unique
+        auto keyFor = [&](size_t t, size_t i) {
+            uint64_t x = (t + 1) * 0x9E3779B97F4A7C15ull + i * 0xBF58476D1CE4E5B9ull;
+            x ^= x >> 31;
+            x *= 0x94D049BB133111EBull;
+            x ^= x >> 29;
+            if (x % 10 != 0) return double((x >> 8) % hotKeys);
+            return double(t) * 1e9 + double(i) + 0.5;
+        };
+
+        auto run = [&](size_t threads, auto&& body) {
+            std::vector<std::thread> workers;
+            std::vector<size_t> sinks(threads);
+            auto start = std::chrono::steady_clock::now();
+            for (size_t t = 0; t < threads; t++) {
+                workers.emplace_back([&, t] { sinks[t] = body(t); });
+            }
+            for (auto& worker : workers) worker.join();
+            auto end = std::chrono::steady_clock::now();
+            for (size_t sink : sinks) g_sink += sink;
+            return double(threads * opsPerThread) / std::chrono::duration<double, std::micro>(end - start).count();
+        };
+
+        std::cout << "  threads      shared  per-thread  hit rate\n";
+        for (size_t threads = 1; threads <= 32; threads *= 2) {
+            Bytecode::ConcurrentBytecodeCache shared;
+            double sharedRate = run(threads, [&](size_t t) {
+                size_t sink = 0;
+                for (size_t i = 0; i < opsPerThread; i++) sink += shared.getNumber(keyFor(t, i))->size();
+                return sink;
+            });
+            Bytecode::CacheStats stats = shared.stats();
+
+            double privateRate = run(threads, [&](size_t t) {
+                Bytecode::BytecodeCache local(Bytecode::ConcurrentBytecodeCache::DEFAULT_BUDGET / threads);
+                size_t sink = 0;
+                for (size_t i = 0; i < opsPerThread; i++) sink += local.getNumber(keyFor(t, i))->size();
+                return sink;
+            });
+
+            double hitRate = 100.0 * stats.hits / double(stats.hits + stats.misses);
+            std::cout << "  " << std::setw(7) << threads << std::fixed << std::setprecision(1)
+                      << std::setw(12) << sharedRate << std::setw(12) << privateRate
+                      << std::setw(9) << hitRate << "%\n";
+        }
+    }
+
+    // Benchmark 10: Warm start from a snapshot
+    std::cout << "\n10. Warm start, 20k entries:\n";
+    {
+        const size_t count = 20000;
+        const char* path = "bench_snapshot.tbcs";
+        auto timeMs = [](auto&& body) {
+            auto start = std::chrono::steady_clock::now();
+            body();
+            auto end = std::chrono::steady_clock::now();
+            return std::chrono::duration<double, std::milli>(end - start).count();
+        };
+
+        Bytecode::BytecodeCache cold(64 * 1024 * 1024);
+        double rebuild = timeMs([&] {
+            for (size_t i = 0; i < count; i++) {
+                g_sink += cold.getNumber(i * 0.75)->size();
+                g_sink += cold.getString("key_" + std::to_string(i))->size();
+            }
+        });
+        double save = timeMs([&] { cold.saveSnapshot(path); });
+
+        Bytecode::CacheSnapshot snapshot;
+        double open = timeMs([&] { snapshot.open(path); });
+        double warm = timeMs([&] {
+            for (size_t i = 0; i < count; i++) {
+                g_sink += snapshot.getNumber(i * 0.75).size();
+                g_sink += snapshot.getString("key_" + std::to_string(i)).size();
+            }
+        });
+        snapshot.close();
+        std::remove(path);
+
+        std::cout << std::fixed << std::setprecision(2)
+                  << "  rebuild cache          " << std::setw(8) << rebuild << " ms\n"
+                  << "  save snapshot          " << std::setw(8) << save << " ms\n"
+                  << "  open snapshot          " << std::setw(8) << open << " ms\n"
+                  << "  first lookups (warm)   " << std::setw(8) << warm << " ms\n";
+    }
+
+    // Benchmark 11: Bundles
+    std::cout << "\n11. Bundle, 50k names over 25k distinct chunks:\n";
+    {
+        const size_t count = 50000;
+        const char* path = "bench_bundle.tbb";
+        auto timeMs = [](auto&& body) {
+            auto start = std::chrono::steady_clock::now();
+            body();
+            auto end = std::chrono::steady_clock::now();
+            return std::chrono::duration<double, std::milli>(end - start).count();
+        };
+
+        Bytecode::BundleWriter writer;
+        for (size_t i = 0; i < count; i++) {
+            writer.add("module/" + std::to_string(i), Bytecode::CreatePushString("value_" + std::to_string(i / 2)));
+        }
+        double write = timeMs([&] { writer.write(path); });
+
+        Bytecode::BundleReader reader;
+        double open = timeMs([&] { reader.open(path); });
+        double find = timeMs([&] {
+            for (size_t i = 0; i < count; i++) g_sink += reader.find("module/" + std::to_string(i)).size();
+        });
+        size_t invalid = 0;
+        double validate = timeMs([&] {
+            for (size_t i = 0; i < reader.size(); i++) invalid += !Bytecode::ValidateBytecode(reader.entry(i).chunk);
+        });
+        reader.close();
+        std::remove(path);
+
+        std::cout << std::fixed << std::setprecision(2)
+                  << "  write (" << writer.blobCount() << " blobs)    " << std::setw(8) << write << " ms\n"
+                  << "  open                   " << std::setw(8) << open << " ms\n"
+                  << "  find every name        " << std::setw(8) << find << " ms\n"
+                  << "  validate every chunk   " << std::setw(8) << validate << " ms (" << invalid << " invalid)\n";
+    }
+
+    // Benchmark 12: Linking
+    std::cout << "\n12. LinkChunks:\n";
+    {
+        std::vector<std::string> batch;
+        size_t inputBytes = 0;
+        for (size_t i = 0; i < 200; i++) {
+            switch (i % 4) {
+                case 0: batch.push_back(Bytecode::CreatePushNumber(i * 0.5 + 0.25)); break;
+                case 1: batch.push_back(Bytecode::CreatePushString(values[i % values.size()])); break;
+                case 2: batch.push_back(Bytecode::CreatePushArray(items)); break;
+                default: batch.push_back(Bytecode::CreatePushNil()); break;
+            }
+            inputBytes += batch.back().size();
+        }
+        std::string linked = Bytecode::LinkChunks(batch);
+        std::cout << "  200 chunks: " << inputBytes << " bytes -> " << linked.size() << " bytes linked\n";
+        bench("LinkChunks (200)", 2000, [&](size_t) { return Bytecode::LinkChunks(batch).size(); });
+    }
+
+    // Benchmark 13: VM values
+    std::cout << "\n13. VMValue, NaN-boxed vs the previous layout:\n";
+    {
+        // What VMValue used to be: type, union, std::string, shared_ptr, TValue
+        struct LegacyValue {
+            int type = 0;
+            union {
+                bool boolean;
+                double number;
+                void* pointer;
+            } value;
+            std::string string;
+            std::shared_ptr<void> object;
+            alignas(8) unsigned char tvalue[16] = {};
+        };
+
+        std::cout << "  sizeof(VMValue)     " << std::setw(4) << sizeof(tsunami::VMValue) << " bytes\n"
+                  << "  sizeof(LegacyValue) " << std::setw(4) << sizeof(LegacyValue) << " bytes\n";
+
+        tsunami::VMHeap heap;
+        std::vector<tsunami::VMValue> mixed;
+        std::vector<LegacyValue> legacyMixed;
+        for (size_t i = 0; i < 1000; i++) {
+            if (i % 4 == 3) {
+                std::string text = values[i % values.size()];
+                mixed.push_back(tsunami::VMValue::String(heap.newString(text)));
+                legacyMixed.emplace_back();
+                legacyMixed.back().type = 3;
+                legacyMixed.back().string = text;
+            } else {
+                mixed.push_back(tsunami::VMValue::Number(i * 0.5));
+                legacyMixed.emplace_back();
+                legacyMixed.back().type = 2;
+                legacyMixed.back().value.number = i * 0.5;
+            }
+        }
+
+        std::vector<tsunami::VMValue> stack;
+        bench("push/pop 1000 VMValue", 20000, [&](size_t) {
+            for (const tsunami::VMValue& v : mixed) stack.push_back(v);
+            size_t sum = 0;
+            while (!stack.empty()) {
+                sum += static_cast<size_t>(stack.back().raw());
+                stack.pop_back();
+            }
+            return sum;
+        });
+
+        std::vector<LegacyValue> legacyStack;
+        bench("push/pop 1000 LegacyValue", 2000, [&](size_t) {
+            for (const LegacyValue& v : legacyMixed) legacyStack.push_back(v);
+            size_t sum = 0;
+            while (!legacyStack.empty()) {
+                sum += legacyStack.back().string.size();
+                legacyStack.pop_back();
+            }
+            return sum;
+        });
+
+        bench("VMHeap::newString (interned)", 200000, [&](size_t i) {
+            return heap.newString(values[i % values.size()])->length;
+        });
+    }
+
+    // Benchmark 14: String interning
+    std::cout << "\n14. Interned names, 1000 globals:\n";
+    {
+        tsunami::VMHeap heap;
+        std::vector<std::string> names;
+        std::unordered_map<std::string, double> byText;
+        std::unordered_map<const tsunami::VMString*, double, tsunami::VMStringHash> byHandle;
+        std::vector<const tsunami::VMString*> handles;
+        for (size_t i = 0; i < 1000; i++) {
+            names.push_back("global_name_" + std::to_string(i));
+            byText[names.back()] = static_cast<double>(i);
+            handles.push_back(heap.newString(names.back()));
+            byHandle[handles.back()] = static_cast<double>(i);
+        }
+        for (size_t i = 0; i < 100000; i++) heap.newString(names[i % names.size()]);
+
+        tsunami::VMInternStats stats = heap.stringStats();
+        std::cout << "  " << stats.strings << " strings in " << stats.buckets << " buckets ("
+                  << std::fixed << std::setprecision(2) << stats.occupancy() << " occupancy), "
+                  << stats.bytes << " bytes held, " << stats.hits << "/" << stats.lookups
+                  << " lookups shared, " << stats.bytesSaved << " bytes saved\n";
+
+        bench("lookup by std::string", 1000000, [&](size_t i) {
+            return static_cast<size_t>(byText.find(names[i % names.size()])->second);
+        });
+        bench("lookup by interned handle", 1000000, [&](size_t i) {
+            return static_cast<size_t>(byHandle.find(handles[i % handles.size()])->second);
+        });
+        bench("intern existing name", 1000000, [&](size_t i) {
+            return heap.newString(names[i % names.size()])->length;
+        });
+    }
+
+    // Benchmark 15: Running chunks in-process
+    std::cout << "\n15. Interpreter:\n";
+    {
+        tsunami::VMState vm;
+
+        // One run of an already compiled chunk, in milliseconds
+        auto runMs = [&](const std::string& chunk) {
+            vm.clearStack();
+            auto start = std::chrono::steady_clock::now();
+            bool ok = vm.executeBytecode(chunk);
+            auto end = std::chrono::steady_clock::now();
+            if (!ok) std::cout << "  error: " << vm.getLastError() << "\n";
+            g_sink += static_cast<size_t>(vm.stackSize());
+            return std::chrono::duration<double, std::milli>(end - start).count();
+        };
+        auto report = [&](const char* name, const std::string& source) {
+            std::string chunk = Bytecode::Compile(source);
+            runMs(chunk);
+            std::cout << "  " << std::left << std::setw(32) << name << std::right << std::fixed
+                      << std::setprecision(2) << std::setw(10) << runMs(chunk) << " ms\n";
+        };
+
+        report("for loop, 5M adds", "local s = 0 for i = 1, 5000000 do s = s + i end return s");
+        report("while loop, 5M compares", "local i = 0 while i < 5000000 do i = i + 1 end return i");
+        report("fib(27)", "local function fib(n) if n < 2 then return n end return fib(n - 1) + fib(n - 2) end "
+                          "return fib(27)");
+        report("1M table fill and sum", "local t = {} for i = 1, 1000000 do t[i] = i end "
+                                        "local s = 0 for i = 1, #t do s = s + t[i] end return s");
+        report("200k keys set and cleared", "local t = {} for i = 1, 200000 do local k = \"k\" .. i "
+                                            "t[k] = i t[k] = nil end return t");
+
+        // Pushed chunks: decode, verify and run one per call
+        std::string array = Bytecode::CreatePushArray(items);
+        std::string batch = Bytecode::CreatePushValues(typed);
+        bench("execute CreatePushArray (8)", 200000, [&](size_t) {
+            vm.clearStack();
+            return static_cast<size_t>(vm.executeBytecode(array));
+        });
+        bench("execute CreatePushValues (8)", 200000, [&](size_t) {
+            vm.clearStack();
+            return static_cast<size_t>(vm.executeBytecode(batch));
+        });
+    }
+
+    std::cout << "\n=== Benchmark completed (" << g_sink << ") ===\n";
+
+    return 0;
+}
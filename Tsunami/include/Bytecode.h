@@ -2,9 +2,13 @@
 #define BYTECODE_H
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <cstdint>
+#include <cstdio>
 #include <utility>
+#include <list>
+#include <memory>
 #include <unordered_map>
 
 namespace Bytecode {
@@ -95,6 +99,9 @@ enum LuauOpcode : uint8_t {
     LOP_CAPTURE = 70,
     LOP_JUMPX = 71,
     LOP_FASTCALLM = 72,
+    LOP_NEWCLOSURE = 73,
+    
+    LOP__COUNT
 };
 
 // ==================== BYTECODE HEADER STRUCT ====================
@@ -119,11 +126,36 @@ struct RobloxSignature {
 
 // ==================== PUBLIC API ====================
 
+// One value for CreatePushValues. Strings are views: the bytes only need to
+// outlive the call.
+enum PushValueType : uint8_t {
+    PUSH_NIL,
+    PUSH_BOOLEAN,
+    PUSH_NUMBER,
+    PUSH_STRING,
+};
+
+struct PushValue {
+    PushValueType type;
+    bool boolean;
+    double number;
+    std::string_view string;
+
+    static PushValue Nil() { return {PUSH_NIL, false, 0, {}}; }
+    static PushValue Boolean(bool value) { return {PUSH_BOOLEAN, value, 0, {}}; }
+    static PushValue Number(double value) { return {PUSH_NUMBER, false, value, {}}; }
+    static PushValue String(std::string_view value) { return {PUSH_STRING, false, 0, value}; }
+};
+
 // Basic compilation
-std::string Compile(const std::string& source);
+// Compiles a Luau subset (locals, globals, arithmetic, comparisons,
+// if/while/repeat/for, calls, tables, closures). Returns an empty string
+// on error; error receives "line N: message".
+std::string Compile(const std::string& source, std::string* error = nullptr);
 std::string Decompress(const std::string& signedBytecode);
 
-// Push operations
+// Push operations. Integral numbers within int16 (and not -0) load as LOADN
+// immediates here and in every generator below; others take a constant.
 std::string CreatePushNil();
 std::string CreatePushBoolean(bool value);
 std::string CreatePushNumber(double value);
@@ -133,10 +165,21 @@ std::string CreatePushInteger(int64_t value);
 // Table operations
 std::string CreatePushTable(int arraySize = 0, int hashSize = 0);
 std::string CreatePushArray(const std::vector<std::string>& values);
+std::string CreatePushArray(const std::vector<PushValue>& values);
 std::string CreatePushDictionary(const std::vector<std::pair<std::string, std::string>>& keyValues);
 std::string CreatePushMultiple(const std::vector<std::string>& values);
 
-// Roblox-specific types
+// Typed batch push: one chunk returning every value in order, loaded with
+// LOADNIL/LOADB/LOADN/LOADK as the type dictates. Up to 254 values return
+// straight from registers; longer batches are stored into a table and
+// returned through unpack(t, 1, n).
+std::string CreatePushValues(const PushValue* values, size_t count);
+inline std::string CreatePushValues(const std::vector<PushValue>& values) {
+    return CreatePushValues(values.data(), values.size());
+}
+
+// Roblox-specific types. Vectors are pushed as component arrays, {x, y}
+// and {x, y, z}, until the Vector2/Vector3 constructors can be imported.
 std::string CreatePushVector2(float x, float y);
 std::string CreatePushVector3(float x, float y, float z);
 std::string CreatePushCFrame(float px, float py, float pz, float rx = 0, float ry = 0, float rz = 0, float rw = 1);
@@ -154,58 +197,321 @@ std::string CreateFunctionCall(const std::string& functionName,
 
 // Utility
 std::string HexDump(const std::string& data, size_t maxBytes = 64);
-bool ValidateBytecode(const std::string& bytecode);
+bool ValidateBytecode(std::string_view bytecode);
 std::string GetBytecodeInfo(const std::string& bytecode);
 
-// Bytecode cache for repeated operations
-class BytecodeCache {
+// ==================== VERIFIER ====================
+enum VerifyResult : uint8_t {
+    VERIFY_OK = 0,
+    VERIFY_TRUNCATED,         // Ran out of bytes mid-structure
+    VERIFY_BAD_HEADER,        // Version or size field mismatch
+    VERIFY_BAD_HASH,          // FNV-1a hash mismatch
+    VERIFY_BAD_CONSTANT,      // Unknown constant type or bad reference
+    VERIFY_BAD_PROTO,         // Inconsistent proto fields or child list
+    VERIFY_BAD_OPCODE,        // Opcode outside LuauOpcode
+    VERIFY_BAD_REGISTER,      // Register operand >= maxstacksize
+    VERIFY_BAD_CONSTANT_INDEX,// Constant operand >= sizeK
+    VERIFY_BAD_JUMP,          // Jump target outside code or inside an AUX word
+    VERIFY_BAD_OPERAND,       // Other out-of-range operand
+    VERIFY_TRAILING_DATA,     // Bytes left after the last proto
+};
+
+// Single linear pass over header, constants, protos and instructions.
+// Does not allocate once the calling thread has verified a proto of the
+// same size. errorOffset receives the byte offset of the first failure.
+VerifyResult VerifyBytecode(const uint8_t* data, size_t size, size_t* errorOffset = nullptr);
+const char* VerifyResultName(VerifyResult result);
+
+// ==================== DISASSEMBLER ====================
+// Destination for streamed disassembly; receives output in large blocks
+class DisassemblySink {
+public:
+    virtual ~DisassemblySink() = default;
+    virtual void write(const char* data, size_t size) = 0;
+};
+
+class StringSink : public DisassemblySink {
+private:
+    std::string& out;
+    
+public:
+    explicit StringSink(std::string& target) : out(target) {}
+    void write(const char* data, size_t size) override { out.append(data, size); }
+};
+
+class FileSink : public DisassemblySink {
 private:
-    std::unordered_map<bool, std::string> boolCache;
-    std::unordered_map<double, std::string> numberCache;
-    std::unordered_map<std::string, std::string> stringCache;
-    std::unordered_map<int, std::string> integerCache;
+    FILE* file;
+    
+public:
+    explicit FileSink(FILE* target) : file(target) {}
+    void write(const char* data, size_t size) override { fwrite(data, 1, size, file); }
+};
+
+enum DisassemblyFormat : uint8_t {
+    DISASM_TEXT,
+    DISASM_JSON,
+};
+
+// Decodes constants, protos and instructions straight into the sink.
+// Returns false on malformed input (output up to that point is kept).
+bool Disassemble(const uint8_t* data, size_t size, DisassemblySink& sink,
+                 DisassemblyFormat format = DISASM_TEXT);
+
+// ==================== JSON MARSHALLING ====================
+
+// Supplies document text in pieces: read() fills up to capacity bytes and
+// returns how many it wrote, 0 at the end of input
+class JsonSource {
+public:
+    virtual ~JsonSource() = default;
+    virtual size_t read(char* buffer, size_t capacity) = 0;
+};
+
+class MemorySource : public JsonSource {
+private:
+    std::string_view remaining;
+    
+public:
+    explicit MemorySource(std::string_view text) : remaining(text) {}
+    size_t read(char* buffer, size_t capacity) override;
+};
+
+class FdSource : public JsonSource {
+private:
+    int fd;
+    
+public:
+    bool failed = false;    // read(2) reported an error
+    
+    explicit FdSource(int descriptor) : fd(descriptor) {}
+    size_t read(char* buffer, size_t capacity) override;
+};
+
+// Parses JSON incrementally into a chunk that rebuilds the document as
+// Luau tables. Objects and arrays become tables whose NEWTABLE size hints
+// are filled in once their counts are known; strings and numbers share one
+// constant pool across the document; null becomes nil. Working memory is a
+// fixed read buffer plus one stack frame per nesting level (at most 128);
+// only the output and the distinct constants grow with the document.
+// Returns an empty string on malformed input; error receives "line N: message".
+std::string MarshalJson(JsonSource& source, std::string* error = nullptr);
+std::string MarshalJson(std::string_view json, std::string* error = nullptr);
+std::string MarshalJsonFile(int fd, std::string* error = nullptr);
+
+// ==================== LINKER ====================
+
+// Links verified chunks into one, so N pushes load and run as a single chunk.
+// Constant pools merge with duplicates removed, and constant and proto
+// references in every proto are remapped in place. A new main proto calls
+// each input's main in order and returns the first result of each, in
+// order. Constants used by narrow operands (ADDK's C, import components,
+// LOADK's D) are ordered first so no instruction changes width.
+// Returns an empty string when an input fails verification or a limit is
+// exceeded (more than 32767 inputs, too many constants for an operand).
+std::string LinkChunks(const std::string_view* chunks, size_t count, std::string* error = nullptr);
+std::string LinkChunks(const std::vector<std::string>& chunks, std::string* error = nullptr);
+
+// Shared, immutable chunk. Handles stay valid after the cache evicts them.
+using ChunkHandle = std::shared_ptr<const std::string>;
+
+enum CacheKeyKind : uint8_t {
+    CACHE_KEY_NUMBER,
+    CACHE_KEY_INTEGER,
+    CACHE_KEY_STRING,
+};
+
+// Numbers are keyed by bit pattern (so 0.0 and -0.0, and distinct NaNs, stay
+// apart), integers by value, strings by content. text views caller memory
+// during lookup and the cache's own copy once inserted.
+struct CacheKey {
+    CacheKeyKind kind;
+    uint64_t bits;
+    std::string_view text;
     
+    static CacheKey number(double value);
+    static CacheKey integer(int64_t value) { return CacheKey{CACHE_KEY_INTEGER, static_cast<uint64_t>(value), {}}; }
+    static CacheKey string(std::string_view value) { return CacheKey{CACHE_KEY_STRING, 0, value}; }
+    
+    bool operator==(const CacheKey& other) const {
+        return kind == other.kind && bits == other.bits && text == other.text;
+    }
+};
+
+struct CacheKeyHash {
+    size_t operator()(const CacheKey& key) const {
+        if (key.kind == CACHE_KEY_STRING) return std::hash<std::string_view>()(key.text);
+        uint64_t h = key.bits * 0x9E3779B97F4A7C15ull;
+        return static_cast<size_t>(h ^ (h >> 32) ^ key.kind);
+    }
+};
+
+struct CacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    size_t entries = 0;
+    size_t residentBytes = 0;   // Chunks, owned key text and bookkeeping
+    size_t budgetBytes = 0;
+};
+
+// Byte-budgeted LRU cache of generated chunks. Lookups hand back a shared
+// handle instead of copying the chunk. Booleans come from the compile-time
+// literals and never occupy the budget.
+// Not thread-safe; each BytecodePusher owns its own cache. Threads sharing
+// one cache use ConcurrentBytecodeCache (BytecodeCache.h).
+class BytecodeCache {
 public:
-    std::string getBoolean(bool value);
-    std::string getNumber(double value);
-    std::string getString(const std::string& value);
-    std::string getInteger(int value);
+    static constexpr size_t DEFAULT_BUDGET = 4 * 1024 * 1024;
+    
+    explicit BytecodeCache(size_t budgetBytes = DEFAULT_BUDGET) : budget(budgetBytes) {}
+    
+    ChunkHandle getBoolean(bool value);
+    ChunkHandle getNumber(double value) { return lookup(CacheKey::number(value)); }
+    ChunkHandle getString(std::string_view value) { return lookup(CacheKey::string(value)); }
+    ChunkHandle getInteger(int64_t value) { return lookup(CacheKey::integer(value)); }
+    
+    // Shrinking the budget evicts immediately
+    void setBudget(size_t budgetBytes);
+    CacheStats stats() const;
+    void resetStats();
     void clear();
+    
+    // Writes every entry as a CacheSnapshot file (BytecodeCache.h)
+    bool saveSnapshot(const char* path, std::string* error = nullptr) const;
+
+private:
+    struct Entry {
+        CacheKeyKind kind;
+        uint64_t bits;
+        std::string text;
+        ChunkHandle chunk;
+        size_t bytes;
+    };
+    
+    using EntryList = std::list<Entry>;
+    
+    // Front is most recently used
+    EntryList entries;
+    std::unordered_map<CacheKey, EntryList::iterator, CacheKeyHash> index;
+    size_t budget;
+    size_t resident = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    
+    ChunkHandle lookup(const CacheKey& key);
+    void evictTo(size_t limit);
 };
 
 // Advanced compiler
+//
+// Instructions are recorded as fixed-width IR records with unencoded operands.
+// At optimization level 1 (the default) a linear-time peephole pass runs over
+// the IR before allocation.
+// Register operands are virtual: any number of them may be live, and
+// compile() maps them onto the 255 physical registers with a linear-scan
+// allocator, spilling single registers into a table when pressure exceeds
+// that (any number of them: slots past 256 are keyed through a register).
+// Jumps name a Label instead of an offset; compile() resolves labels,
+// widens out-of-range jumps (JUMP becomes JUMPX, conditional jumps invert
+// around a JUMPX) and serializes into a buffer sized exactly up front.
 class Compiler {
+public:
+    using Label = uint32_t;
+
+    static constexpr uint32_t NO_LABEL = UINT32_MAX;
+
+    // Values from push* live in this virtual range so they stay contiguous
+    // for the implicit RETURN, whatever temporaries were allocated between
+    static constexpr uint32_t RESULT_REGISTER_BASE = 1u << 24;
+
+    struct Instruction {
+        uint8_t op;
+        uint32_t a;
+        uint32_t b;
+        uint32_t c;
+        int32_t d;          // D or E operand
+        uint32_t aux;       // AUX word, for opcodes that take one
+        Label label;        // Jump target, NO_LABEL for everything else
+    };
+
+    // One entry of the chunk's constant pool, in serialized order
+    struct Constant {
+        uint8_t type;
+        bool boolean;
+        double number;
+        std::string string;
+        std::vector<uint32_t> keys;     // LBC_CONSTANT_TABLE shape
+    };
+
 private:
-    std::vector<uint8_t> bytecode;
-    std::vector<std::string> constants;
-    std::vector<double> numberConstants;
-    std::vector<bool> boolConstants;
-    
-    void writeVarInt(uint32_t value);
-    void writeString(const std::string& str);
-    void writeDouble(double value);
-    void writeByte(uint8_t value);
-    uint8_t encodeOpcode(uint8_t opcode);
-    int addConstant(const std::string& value);
+    std::vector<Instruction> code;
+    std::vector<uint32_t> labels;   // Label -> instruction index it is bound to
+    
+    // LOADB skips whose label binds once this many more words are emitted
+    struct PendingSkip {
+        Label label;
+        uint32_t words;
+    };
+    std::vector<PendingSkip> pendingSkips;
+    uint32_t nextRegister = 0;
+    uint32_t resultCount = 0;       // Values returned by the implicit RETURN
+    int optimizationLevel = 1;
+
+    // Interned pool: each distinct value is stored once, in first-use order.
+    // Strings are found by hash and compared against the pool, so lookups
+    // take a view and nothing points into the (reallocating) vector.
+    std::vector<Constant> constants;
+    std::unordered_multimap<size_t, uint32_t> stringIndex;
+    std::unordered_map<uint64_t, uint32_t> numberIndex;    // Keyed by bit pattern
+    int64_t booleanIndex[2] = {-1, -1};
+    
+    int addConstant(std::string_view value);
     int addNumberConstant(double value);
     int addBoolConstant(bool value);
+
+    void emit(const Instruction& insn);
+    void emitABC(uint8_t op, int a, int b, int c);
+    void emitAD(uint8_t op, int a, int d);
+    void emitAux(uint8_t op, int a, int b, int c, uint32_t aux);
+    void emitJump(uint8_t op, int reg, Label target);
+    int newResult() { return static_cast<int>(RESULT_REGISTER_BASE + resultCount++); }
     
 public:
     Compiler();
+
+    // Fresh virtual registers; newRegisters() returns the first of a block
+    // that stays contiguous after allocation (call frames, SETLIST sources)
+    int newRegister() { return newRegisters(1); }
+    int newRegisters(int count);
     
     // Building instructions
     void addLoadNil(int reg);
-    void addLoadBool(int reg, bool value, int jump = 0);
+    void addLoadBool(int reg, bool value, int jump = 0);         // Skips the next `jump` words
     void addLoadConst(int reg, int constIdx);
-    void addLoadK(int reg, int constIdx);
+    void addLoadK(int reg, int constIdx);                       // LOADKX past index 32767
     void addMove(int dest, int src);
+    void addArith(uint8_t op, int dest, int left, int right);   // LOP_ADD..LOP_POW
+    void addGetGlobal(int reg, const std::string& name);
     void addNewTable(int reg, int arraySize, int hashSize);
     void addSetTable(int tableReg, int keyReg, int valueReg);
-    void addSetList(int tableReg, int startReg, int count, int tableIndex = 0);
+    void addSetField(int tableReg, const std::string& key, int valueReg);
+    void addSetList(int tableReg, int startReg, int count, int tableIndex = 0);   // count <= 254
     void addReturn(int startReg, int count);
     void addCall(int funcReg, int argCount, int resultCount);
+
+    // Control flow. A label may be bound before or after the jumps to it;
+    // jumps to an earlier position are emitted as JUMPBACK.
+    Label newLabel();
+    void bindLabel(Label label);
+    void addJump(Label target);
+    void addJumpIf(int reg, Label target);
+    void addJumpIfNot(int reg, Label target);
     
-    // High-level operations
+    // High-level operations. Each pushed value gets its own register and
+    // all of them are returned, in order, by the implicit RETURN; past 254
+    // values it returns unpack() of a table holding them.
     void pushNil();
     void pushBoolean(bool value);
     void pushNumber(double value);
@@ -213,10 +519,17 @@ public:
     void pushTable(int arraySize = 0, int hashSize = 0);
     void pushArray(const std::vector<std::string>& values);
     
-    // Finalization
-    std::string compile();
+    // 0 emits the IR as recorded; 1 runs the peephole pass
+    void setOptimizationLevel(int level) { optimizationLevel = level; }
+
+    // Finalization. Appends an implicit RETURN unless the stream ends in one.
+    // Returns an empty string if a jump targets an unbound label or the
+    // registers cannot be allocated (a contiguous block wider than the frame).
+    std::string compile() const;
     std::string getBytecode() const;
     void clear();
+
+    const std::vector<Instruction>& instructions() const { return code; }
     
     // Debug
     void print() const;
@@ -0,0 +1,97 @@
+#ifndef BYTECODE_BUNDLE_H
+#define BYTECODE_BUNDLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace Bytecode {
+
+// ==================== BUNDLES ====================
+//
+// Many named chunks in one file. Chunks with identical bytes are stored
+// once; any number of names may point at the same blob. The name index is
+// sorted, so a lookup is a binary search over the mapping and opening a
+// bundle costs one mmap plus a bounds check of its tables, however many
+// chunks it holds.
+//
+// Layout, little-endian throughout:
+//   header   "TBBL", u32 version, u32 names, u32 blobs, u64 file size,
+//            u64 reserved
+//   blobs    u64 offset, u32 size, u32 FNV-1a of the chunk bytes
+//   names    u32 FNV-1a of the name, u32 blob, u64 name offset, u32 name
+//            size, u32 reserved; sorted by hash, then name
+//   data     name bytes, then chunk bytes
+
+struct BundleEntry {
+    std::string_view name;
+    std::string_view chunk;
+    uint32_t contentHash;
+};
+
+class BundleWriter {
+public:
+    // Copies both; false when name is already in the bundle
+    bool add(std::string_view name, std::string_view chunk);
+
+    size_t size() const { return names.size(); }
+    size_t blobCount() const { return blobs.size(); }
+
+    std::string build() const;
+    bool write(const char* path, std::string* error = nullptr) const;
+
+private:
+    struct Blob {
+        std::string bytes;
+        uint32_t hash;
+    };
+
+    std::vector<Blob> blobs;
+    std::unordered_multimap<uint32_t, uint32_t> blobsByHash;
+    std::unordered_map<std::string, uint32_t> names;
+};
+
+// Read-only view of a bundle file. Views returned by find() and entry()
+// point into the mapping and stay valid until close(); chunks are not
+// verified here, pass them to ValidateBytecode or VerifyBytecode.
+class BundleReader {
+public:
+    static constexpr uint32_t VERSION = 1;
+    static constexpr size_t HEADER_SIZE = 32;
+    static constexpr size_t BLOB_SIZE = 16;
+    static constexpr size_t NAME_SIZE = 24;
+
+    BundleReader() = default;
+    ~BundleReader() { close(); }
+
+    BundleReader(const BundleReader&) = delete;
+    BundleReader& operator=(const BundleReader&) = delete;
+
+    bool open(const char* path, std::string* error = nullptr);
+    void close();
+    bool isOpen() const { return base != nullptr; }
+
+    size_t size() const { return nameCount; }
+    size_t blobCount() const { return blobTotal; }
+
+    // Empty when no chunk has that name
+    std::string_view find(std::string_view name) const;
+
+    // Entries in index order, 0 <= i < size()
+    BundleEntry entry(size_t i) const;
+
+private:
+    const uint8_t* base = nullptr;
+    size_t mappedSize = 0;
+    uint32_t nameCount = 0;
+    uint32_t blobTotal = 0;
+    const uint8_t* blobTable = nullptr;
+    const uint8_t* nameTable = nullptr;
+};
+
+} // namespace Bytecode
+
+#endif // BYTECODE_BUNDLE_H
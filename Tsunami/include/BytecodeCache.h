@@ -0,0 +1,212 @@
+#ifndef BYTECODE_CACHE_H
+#define BYTECODE_CACHE_H
+
+#include "Bytecode.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Bytecode {
+
+// ==================== CONCURRENT CACHE ====================
+//
+// BytecodeCache shared by many producer threads. Keys hash to one of a
+// power-of-two number of shards, each with its own slice of the byte budget.
+//
+// A hit takes no lock and writes nothing another thread reads on its hit
+// path. Each shard publishes an open-addressed table of immutable entries
+// through an atomic pointer; readers probe it, copy the chunk handle and
+// leave. Recency is a CLOCK reference bit, stored only when it is clear, and
+// hits are counted in per-thread stripes.
+//
+// Writers serialize on the shard's mutex. They fill empty slots in place,
+// mark evicted slots with a tombstone and publish a rebuilt table when the
+// current one runs out of empty slots. Evicted entries and replaced tables
+// are freed once every thread that was reading when they were unlinked has
+// left (epoch-based reclamation).
+//
+// A miss registers the key as pending under the mutex and generates outside
+// it; threads that ask for the same key meanwhile wait on that key's future
+// instead of building the chunk again. If generation throws, the pending key
+// is dropped and its waiters see the same exception.
+class ConcurrentBytecodeCache {
+public:
+    static constexpr size_t DEFAULT_BUDGET = 16 * 1024 * 1024;
+    static constexpr size_t DEFAULT_SHARDS = 16;
+
+    // shardCount is rounded up to a power of two
+    explicit ConcurrentBytecodeCache(size_t budgetBytes = DEFAULT_BUDGET, size_t shardCount = DEFAULT_SHARDS);
+    ~ConcurrentBytecodeCache();
+
+    ConcurrentBytecodeCache(const ConcurrentBytecodeCache&) = delete;
+    ConcurrentBytecodeCache& operator=(const ConcurrentBytecodeCache&) = delete;
+
+    ChunkHandle getBoolean(bool value);
+    ChunkHandle getNumber(double value) { return lookup(CacheKey::number(value)); }
+    ChunkHandle getString(std::string_view value) { return lookup(CacheKey::string(value)); }
+    ChunkHandle getInteger(int64_t value) { return lookup(CacheKey::integer(value)); }
+
+    // Summed over shards; each shard is read consistently, the total is not
+    CacheStats stats() const;
+
+    // Drops every settled entry; chunks still being generated stay
+    void clear();
+
+    // Writes every settled entry as a CacheSnapshot file
+    bool saveSnapshot(const char* path, std::string* error = nullptr) const;
+
+private:
+    // Immutable once published, apart from the reference bit
+    struct Entry {
+        CacheKeyKind kind = CACHE_KEY_NUMBER;
+        uint64_t bits = 0;
+        std::string text;
+        ChunkHandle chunk;
+        size_t hash = 0;
+        size_t bytes = 0;
+        std::atomic<bool> referenced{true};
+
+        bool matches(const CacheKey& key) const { return kind == key.kind && bits == key.bits && text == key.text; }
+    };
+
+    // Marks a slot whose entry was evicted; probes continue past it
+    static Entry* const TOMBSTONE;
+
+    // Power-of-two slots, each null, a tombstone or an Entry. Probing
+    // starts from the top bits of the hash times 2^64/phi, since
+    // CacheKeyHash leaves the low bits of small integral numbers zero.
+    struct Table {
+        size_t mask = 0;
+        unsigned shift = 0;
+        std::unique_ptr<std::atomic<Entry*>[]> slots;
+
+        size_t home(size_t hash) const { return static_cast<size_t>((uint64_t(hash) * 0x9E3779B97F4A7C15ull) >> shift); }
+    };
+
+    struct Pending {
+        CacheKeyKind kind;
+        uint64_t bits;
+        std::string text;
+        std::shared_future<ChunkHandle> future;
+
+        bool matches(const CacheKey& key) const { return kind == key.kind && bits == key.bits && text == key.text; }
+    };
+
+    // An entry or table unlinked at epoch
+    struct Retired {
+        uint64_t epoch;
+        Entry* entry;
+        Table* table;
+    };
+
+    struct alignas(64) Shard {
+        std::atomic<Table*> table{nullptr};
+        std::mutex mutex;
+
+        // Guarded by mutex
+        std::vector<Entry*> ring;                   // Published entries, swept by CLOCK
+        std::vector<std::unique_ptr<Pending>> pending;
+        std::vector<Retired> retired;
+        size_t used = 0;                            // Slots holding an entry or a tombstone
+        size_t hand = 0;
+        size_t resident = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+    };
+
+    struct alignas(64) HitStripe {
+        std::atomic<uint64_t> hits{0};
+    };
+
+    static constexpr size_t HIT_STRIPES = 64;
+
+    std::unique_ptr<Shard[]> shards;
+    std::unique_ptr<HitStripe[]> hitStripes;
+    size_t shardMask;
+    size_t shardBudget;
+
+    ChunkHandle lookup(const CacheKey& key);
+    void insert(Shard& shard, const CacheKey& key, size_t hash, const ChunkHandle& chunk);
+    void dropPending(Shard& shard, const CacheKey& key);
+    void publish(Shard& shard, Entry* entry);
+    void rebuild(Shard& shard, size_t live);
+    void unlink(Shard& shard, Entry* entry);
+    void evictTo(Shard& shard, size_t limit, bool force);
+    void reclaim(Shard& shard);
+    void countHit();
+};
+
+// ==================== SNAPSHOTS ====================
+//
+// A cache saved to disk: one file holding a fixed header, an open-addressed
+// index and the key text and chunk bytes it points at. Opening maps the file
+// read-only and checks only the header; each chunk's own header hash is
+// checked the first time it is looked up. Lookups return views into the
+// mapping, valid until close(), so a warm start costs one mmap instead of
+// regenerating every chunk.
+//
+// Layout, little-endian throughout:
+//   header   "TBCS", u32 version, u32 entries, u32 slots, u64 file size,
+//            u64 reserved
+//   slots    u8 kind, 3 pad, u32 hash, u64 bits, u64 offset, u32 text size,
+//            u32 chunk size (0 marks an empty slot); slots is a power of two,
+//            probed linearly from hash
+//   data     per entry: key text, then the chunk
+class CacheSnapshot {
+public:
+    static constexpr uint32_t VERSION = 1;
+    static constexpr size_t HEADER_SIZE = 32;
+    static constexpr size_t SLOT_SIZE = 32;
+
+    CacheSnapshot() = default;
+    ~CacheSnapshot() { close(); }
+
+    CacheSnapshot(const CacheSnapshot&) = delete;
+    CacheSnapshot& operator=(const CacheSnapshot&) = delete;
+
+    bool open(const char* path, std::string* error = nullptr);
+    void close();
+    bool isOpen() const { return base != nullptr; }
+    size_t size() const { return entryCount; }
+
+    // Empty when the key is absent or its chunk fails the hash check
+    std::string_view find(const CacheKey& key) const;
+    std::string_view getNumber(double value) const { return find(CacheKey::number(value)); }
+    std::string_view getString(std::string_view value) const { return find(CacheKey::string(value)); }
+    std::string_view getInteger(int64_t value) const { return find(CacheKey::integer(value)); }
+
+    // Entries whose chunk failed the hash check so far
+    size_t corruptEntries() const { return corrupt.load(std::memory_order_relaxed); }
+
+private:
+    enum SlotState : uint8_t { SLOT_UNCHECKED, SLOT_VALID, SLOT_CORRUPT };
+
+    const uint8_t* base = nullptr;
+    size_t mappedSize = 0;
+    uint32_t entryCount = 0;
+    uint32_t slotMask = 0;
+    std::unique_ptr<std::atomic<uint8_t>[]> states;
+    mutable std::atomic<size_t> corrupt{0};
+
+    bool checkSlot(uint32_t slot, uint64_t offset, uint32_t textSize, uint32_t chunkSize) const;
+};
+
+// Key plus the chunk stored under it, as gathered for WriteSnapshot
+struct SnapshotEntry {
+    CacheKey key;
+    std::string_view chunk;
+};
+
+// Writes to path + ".tmp" and renames over path, so readers never see a
+// partial file
+bool WriteSnapshot(const char* path, const std::vector<SnapshotEntry>& entries, std::string* error = nullptr);
+
+} // namespace Bytecode
+
+#endif // BYTECODE_CACHE_H
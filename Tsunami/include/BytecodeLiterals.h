@@ -0,0 +1,282 @@
+#ifndef BYTECODE_LITERALS_H
+#define BYTECODE_LITERALS_H
+
+#include "BytecodeWriter.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace Bytecode {
+
+// ==================== COMPILE-TIME CHUNKS ====================
+//
+// Chunks whose every byte is known at compile time (nil, booleans, the empty
+// table, string and number literals) are built here as std::array constants,
+// header hash included. Pushing one costs no generation and no allocation:
+// the bytes live in the binary's read-only data.
+
+template<size_t N>
+using LiteralChunk = std::array<uint8_t, N>;
+
+template<size_t N>
+std::string_view chunkView(const LiteralChunk<N>& chunk) {
+    return std::string_view(reinterpret_cast<const char*>(chunk.data()), N);
+}
+
+template<size_t N>
+std::string chunkString(const LiteralChunk<N>& chunk) {
+    return std::string(reinterpret_cast<const char*>(chunk.data()), N);
+}
+
+#if defined(__has_builtin)
+#if __has_builtin(__builtin_bit_cast)
+#define BYTECODE_HAS_BIT_CAST 1
+#endif
+#endif
+
+// IEEE-754 bits of a double, usable in constant expressions
+constexpr uint64_t doubleBits(double value) {
+#ifdef BYTECODE_HAS_BIT_CAST
+    return __builtin_bit_cast(uint64_t, value);
+#else
+    // Without a bit cast, encode by hand; -0.0 cannot be told from 0.0 here
+    if (value != value) return 0x7FF8000000000000ull;
+    uint64_t sign = value < 0 ? 1ull << 63 : 0;
+    double magnitude = value < 0 ? -value : value;
+    if (magnitude == 0) return sign;
+    if (magnitude > 1.7976931348623157e308) return sign | 0x7FF0000000000000ull;
+
+    int exponent = 0;
+    while (magnitude >= 2) {
+        magnitude /= 2;
+        exponent++;
+    }
+    while (magnitude < 1 && exponent > -1022) {
+        magnitude *= 2;
+        exponent--;
+    }
+    if (magnitude < 1) {
+        // Subnormal: 2^-1022 scale, no implicit bit
+        return sign | static_cast<uint64_t>(magnitude * 4503599627370496.0);
+    }
+    uint64_t mantissa = static_cast<uint64_t>((magnitude - 1) * 4503599627370496.0);
+    return sign | (static_cast<uint64_t>(exponent + 1023) << 52) | mantissa;
+#endif
+}
+
+// Mirrors BytecodeWriter over a fixed array
+template<size_t N>
+class LiteralBuilder {
+private:
+    LiteralChunk<N> bytes{};
+    size_t pos = 0;
+
+public:
+    constexpr void writeByte(uint8_t value) { bytes[pos++] = value; }
+
+    constexpr void writeVarInt(uint32_t value) {
+        do {
+            uint8_t byte = value & 0x7F;
+            value >>= 7;
+            if (value != 0) byte |= 0x80;
+            writeByte(byte);
+        } while (value != 0);
+    }
+
+    constexpr void writeUInt32(uint32_t value) {
+        for (int i = 0; i < 4; i++) writeByte(static_cast<uint8_t>(value >> (8 * i)));
+    }
+
+    constexpr void writeConstantNumber(double value) {
+        uint64_t bits = doubleBits(value);
+        writeByte(LBC_CONSTANT_NUMBER);
+        for (int i = 0; i < 8; i++) writeByte(static_cast<uint8_t>(bits >> (8 * i)));
+    }
+
+    constexpr void writeConstantString(const char* data, size_t size) {
+        writeByte(LBC_CONSTANT_STRING);
+        writeVarInt(static_cast<uint32_t>(size));
+        for (size_t i = 0; i < size; i++) writeByte(static_cast<uint8_t>(data[i]));
+    }
+
+    constexpr void beginChunk() {
+        // LuauBytecodeHeader: version, flags, typesize, numbersize, hash, size
+        writeByte(0x02);
+        writeByte(0x00);
+        writeByte(0x08);
+        writeByte(0x08);
+        writeUInt32(0);
+        writeUInt32(0);
+    }
+
+    constexpr void beginProto(uint32_t maxStackSize, uint32_t sizeCode) {
+        writeVarInt(maxStackSize);
+        writeVarInt(0);     // params
+        writeVarInt(0);     // upvalues
+        writeVarInt(0);     // vararg
+        writeVarInt(sizeCode);
+    }
+
+    constexpr void endProto(uint32_t sizeK) {
+        writeVarInt(sizeK);
+        writeVarInt(0);     // children
+        for (int i = 0; i < 4; i++) writeByte(0x00);    // Debug info
+    }
+
+    constexpr void emitABC(uint8_t opcode, uint8_t a, uint8_t b, uint8_t c) {
+        writeByte(encodeOpcode(opcode));
+        writeByte(a);
+        writeByte(b);
+        writeByte(c);
+    }
+
+    constexpr void emitAD(uint8_t opcode, uint8_t a, int16_t d) {
+        uint16_t bits = static_cast<uint16_t>(d);
+        writeByte(encodeOpcode(opcode));
+        writeByte(a);
+        writeByte(static_cast<uint8_t>(bits));
+        writeByte(static_cast<uint8_t>(bits >> 8));
+    }
+
+    constexpr void emitAux(uint32_t aux) { writeUInt32(aux); }
+
+    // Patch size and FNV-1a hash into the header
+    constexpr LiteralChunk<N> finish() {
+        constexpr size_t header = BytecodeWriter::HEADER_SIZE;
+        uint32_t hash = FNV_OFFSET_BASIS;
+        for (size_t i = header; i < N; i++) {
+            hash ^= bytes[i];
+            hash *= FNV_PRIME;
+        }
+        for (int i = 0; i < 4; i++) {
+            bytes[4 + i] = static_cast<uint8_t>(hash >> (8 * i));
+            bytes[8 + i] = static_cast<uint8_t>(static_cast<uint32_t>(N - header) >> (8 * i));
+        }
+        return bytes;
+    }
+};
+
+// ==================== FIXED LITERALS ====================
+
+// LOADNIL / LOADB / NEWTABLE then RETURN, no constants
+constexpr size_t SIMPLE_LITERAL_SIZE = BytecodeWriter::chunkSize(0, 0, 1, 2);
+
+constexpr LiteralChunk<SIMPLE_LITERAL_SIZE> literalNil() {
+    LiteralBuilder<SIMPLE_LITERAL_SIZE> builder;
+    builder.beginChunk();
+    builder.writeVarInt(0);
+    builder.writeVarInt(1);
+    builder.beginProto(1, 2);
+    builder.emitABC(LOP_LOADNIL, 0, 0, 0);
+    builder.emitABC(LOP_RETURN, 0, 2, 0);
+    builder.endProto(0);
+    return builder.finish();
+}
+
+constexpr LiteralChunk<SIMPLE_LITERAL_SIZE> literalBoolean(bool value) {
+    LiteralBuilder<SIMPLE_LITERAL_SIZE> builder;
+    builder.beginChunk();
+    builder.writeVarInt(0);
+    builder.writeVarInt(1);
+    builder.beginProto(1, 2);
+    builder.emitABC(LOP_LOADB, 0, value ? 1 : 0, 0);
+    builder.emitABC(LOP_RETURN, 0, 2, 0);
+    builder.endProto(0);
+    return builder.finish();
+}
+
+constexpr size_t EMPTY_TABLE_LITERAL_SIZE = BytecodeWriter::chunkSize(0, 0, 1, 3);
+
+constexpr LiteralChunk<EMPTY_TABLE_LITERAL_SIZE> literalEmptyTable() {
+    LiteralBuilder<EMPTY_TABLE_LITERAL_SIZE> builder;
+    builder.beginChunk();
+    builder.writeVarInt(0);
+    builder.writeVarInt(1);
+    builder.beginProto(1, 3);
+    builder.emitABC(LOP_NEWTABLE, 0, 0, 0);
+    builder.emitAux(0);
+    builder.emitABC(LOP_RETURN, 0, 2, 0);
+    builder.endProto(0);
+    return builder.finish();
+}
+
+constexpr auto NIL_CHUNK = literalNil();
+constexpr auto TRUE_CHUNK = literalBoolean(true);
+constexpr auto FALSE_CHUNK = literalBoolean(false);
+constexpr auto EMPTY_TABLE_CHUNK = literalEmptyTable();
+
+// ==================== USER LITERALS ====================
+
+// A string literal: constexpr auto greeting = literalString("hello");
+template<size_t Length>
+constexpr auto literalString(const char (&text)[Length]) {
+    constexpr size_t size = Length - 1;
+    constexpr size_t total = BytecodeWriter::chunkSize(1, BytecodeWriter::stringConstantSize(size), 1, 2);
+
+    LiteralBuilder<total> builder;
+    builder.beginChunk();
+    builder.writeVarInt(1);
+    builder.writeConstantString(text, size);
+    builder.writeVarInt(1);
+    builder.beginProto(1, 2);
+    builder.emitAD(LOP_LOADK, 0, 0);
+    builder.emitABC(LOP_RETURN, 0, 2, 0);
+    builder.endProto(1);
+    return builder.finish();
+}
+
+// A tuple of numbers returned together, each from its own constant:
+// constexpr auto origin = literalNumbers(0.5, 1.5, 2.5);
+template<typename... Numbers>
+constexpr auto literalNumbers(Numbers... values) {
+    constexpr uint32_t count = sizeof...(Numbers);
+    static_assert(count >= 1 && count <= 254, "RETURN can name at most 254 registers");
+    constexpr size_t total = BytecodeWriter::chunkSize(count, count * BytecodeWriter::numberConstantSize(), count, count + 1);
+
+    const double numbers[] = {static_cast<double>(values)...};
+    LiteralBuilder<total> builder;
+    builder.beginChunk();
+    builder.writeVarInt(count);
+    for (uint32_t i = 0; i < count; i++) builder.writeConstantNumber(numbers[i]);
+    builder.writeVarInt(1);
+    builder.beginProto(count, count + 1);
+    for (uint32_t i = 0; i < count; i++) builder.emitAD(LOP_LOADK, static_cast<uint8_t>(i), static_cast<int16_t>(i));
+    builder.emitABC(LOP_RETURN, 0, static_cast<uint8_t>(count + 1), 0);
+    builder.endProto(count);
+    return builder.finish();
+}
+
+// A tuple of integers; values within int16 load as LOADN and take no
+// constant: constexpr auto ids = literalIntegers<1, 2, 100000>();
+template<int64_t... Values>
+constexpr auto literalIntegers() {
+    constexpr uint32_t count = sizeof...(Values);
+    static_assert(count >= 1 && count <= 254, "RETURN can name at most 254 registers");
+    constexpr uint32_t wide = ((Values < INT16_MIN || Values > INT16_MAX) + ... + 0);
+    constexpr size_t total = BytecodeWriter::chunkSize(wide, wide * BytecodeWriter::numberConstantSize(), count, count + 1);
+
+    constexpr int64_t integers[] = {Values...};
+    LiteralBuilder<total> builder;
+    builder.beginChunk();
+    builder.writeVarInt(wide);
+    for (int64_t value : integers) {
+        if (value < INT16_MIN || value > INT16_MAX) builder.writeConstantNumber(static_cast<double>(value));
+    }
+    builder.writeVarInt(1);
+    builder.beginProto(count, count + 1);
+    int16_t constant = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        int64_t value = integers[i];
+        if (value < INT16_MIN || value > INT16_MAX) builder.emitAD(LOP_LOADK, static_cast<uint8_t>(i), constant++);
+        else builder.emitAD(LOP_LOADN, static_cast<uint8_t>(i), static_cast<int16_t>(value));
+    }
+    builder.emitABC(LOP_RETURN, 0, static_cast<uint8_t>(count + 1), 0);
+    builder.endProto(wide);
+    return builder.finish();
+}
+
+} // namespace Bytecode
+
+#endif // BYTECODE_LITERALS_H
@@ -0,0 +1,172 @@
+#ifndef BYTECODE_OPCODES_H
+#define BYTECODE_OPCODES_H
+
+#include "Bytecode.h"
+#include <cstdint>
+
+namespace Bytecode {
+
+// ==================== OPERAND LAYOUT ====================
+//
+// Every instruction is one 32-bit word: encoded opcode, then either A B C
+// (three bytes), A D (byte + int16) or E (int24). Opcodes with length 2 are
+// followed by an AUX word.
+
+enum InstructionFormat : uint8_t {
+    FORMAT_ABC,
+    FORMAT_AD,
+    FORMAT_E,
+};
+
+// What an operand field refers to
+enum OperandKind : uint8_t {
+    OPERAND_NONE,
+    OPERAND_REG,       // Register
+    OPERAND_CONST,     // Constant table index
+    OPERAND_UPVAL,     // Upvalue index
+    OPERAND_IMM,       // Immediate / count / hint
+    OPERAND_JUMP,      // Signed offset from the next word
+    OPERAND_PROTO,     // Child proto index
+};
+
+struct OpcodeInfo {
+    const char* name;
+    uint8_t length;             // In 32-bit words, including AUX
+    InstructionFormat format;
+    OperandKind a;              // A (or E for FORMAT_E)
+    OperandKind b;              // B (or D for FORMAT_AD)
+    OperandKind c;
+    OperandKind aux;
+};
+
+#define OP_ABC(name, a, b, c) {name, 1, FORMAT_ABC, OPERAND_##a, OPERAND_##b, OPERAND_##c, OPERAND_NONE}
+#define OP_ABC_AUX(name, a, b, c, aux) {name, 2, FORMAT_ABC, OPERAND_##a, OPERAND_##b, OPERAND_##c, OPERAND_##aux}
+#define OP_AD(name, a, d) {name, 1, FORMAT_AD, OPERAND_##a, OPERAND_##d, OPERAND_NONE, OPERAND_NONE}
+#define OP_AD_AUX(name, a, d, aux) {name, 2, FORMAT_AD, OPERAND_##a, OPERAND_##d, OPERAND_NONE, OPERAND_##aux}
+#define OP_E(name, e) {name, 1, FORMAT_E, OPERAND_##e, OPERAND_NONE, OPERAND_NONE, OPERAND_NONE}
+
+constexpr OpcodeInfo OPCODE_INFO[LOP__COUNT] = {
+    OP_ABC("NOP", NONE, NONE, NONE),
+    OP_ABC("LOADNIL", REG, NONE, NONE),
+    OP_ABC("LOADB", REG, IMM, JUMP),
+    OP_AD("LOADN", REG, IMM),
+    OP_AD("LOADK", REG, CONST),
+    OP_ABC("MOVE", REG, REG, NONE),
+    OP_ABC_AUX("GETGLOBAL", REG, NONE, IMM, CONST),
+    OP_ABC_AUX("SETGLOBAL", REG, NONE, IMM, CONST),
+    OP_ABC("GETUPVAL", REG, UPVAL, NONE),
+    OP_ABC("SETUPVAL", REG, UPVAL, NONE),
+    OP_ABC("CLOSEUPVALS", REG, NONE, NONE),
+    OP_AD_AUX("GETIMPORT", REG, CONST, IMM),
+    OP_ABC("GETTABLE", REG, REG, REG),
+    OP_ABC("SETTABLE", REG, REG, REG),
+    OP_ABC_AUX("GETTABLKS", REG, REG, IMM, CONST),
+    OP_ABC_AUX("SETTABLKS", REG, REG, IMM, CONST),
+    OP_ABC_AUX("NAMECALL", REG, REG, IMM, CONST),
+    OP_ABC("CALL", REG, IMM, IMM),
+    OP_ABC("RETURN", REG, IMM, NONE),
+    OP_AD("JUMP", NONE, JUMP),
+    OP_AD("JUMPBACK", NONE, JUMP),
+    OP_AD("JUMPIF", REG, JUMP),
+    OP_AD("JUMPIFNOT", REG, JUMP),
+    OP_AD_AUX("JUMPIFEQ", REG, JUMP, REG),
+    OP_AD_AUX("JUMPIFLE", REG, JUMP, REG),
+    OP_AD_AUX("JUMPIFLT", REG, JUMP, REG),
+    OP_AD_AUX("JUMPIFNOTEQ", REG, JUMP, REG),
+    OP_AD_AUX("JUMPIFNOTLE", REG, JUMP, REG),
+    OP_AD_AUX("JUMPIFNOTLT", REG, JUMP, REG),
+    OP_ABC("ADD", REG, REG, REG),
+    OP_ABC("SUB", REG, REG, REG),
+    OP_ABC("MUL", REG, REG, REG),
+    OP_ABC("DIV", REG, REG, REG),
+    OP_ABC("MOD", REG, REG, REG),
+    OP_ABC("POW", REG, REG, REG),
+    OP_ABC("ADDK", REG, REG, CONST),
+    OP_ABC("SUBK", REG, REG, CONST),
+    OP_ABC("MULK", REG, REG, CONST),
+    OP_ABC("DIVK", REG, REG, CONST),
+    OP_ABC("MODK", REG, REG, CONST),
+    OP_ABC("POWK", REG, REG, CONST),
+    OP_ABC("CONCAT", REG, REG, REG),
+    OP_ABC("NOT", REG, REG, NONE),
+    OP_ABC("MINUS", REG, REG, NONE),
+    OP_ABC("LENGTH", REG, REG, NONE),
+    OP_ABC_AUX("NEWTABLE", REG, IMM, NONE, IMM),
+    OP_AD("DUPTABLE", REG, CONST),
+    OP_ABC_AUX("SETLIST", REG, REG, IMM, IMM),
+    OP_AD("FORNPREP", REG, JUMP),
+    OP_AD("FORNLOOP", REG, JUMP),
+    OP_AD_AUX("FORGLOOP", REG, JUMP, IMM),
+    OP_AD("FORGPREP_INEXT", REG, JUMP),
+    OP_AD("FORGPREP_NEXT", REG, JUMP),
+    OP_ABC("AND", REG, REG, REG),
+    OP_ABC("ANDK", REG, REG, CONST),
+    OP_ABC("OR", REG, REG, REG),
+    OP_ABC("ORK", REG, REG, CONST),
+    OP_E("COVERAGE", IMM),
+    OP_ABC("GETTABLEN", REG, REG, IMM),
+    OP_ABC("SETTABLEN", REG, REG, IMM),
+    OP_ABC("FASTCALL", IMM, NONE, IMM),
+    OP_ABC("FASTCALL1", IMM, REG, IMM),
+    OP_ABC_AUX("FASTCALL2", IMM, REG, IMM, REG),
+    OP_ABC_AUX("FASTCALL2K", IMM, REG, IMM, CONST),
+    OP_ABC("FASTCALL3", IMM, REG, IMM),
+    OP_AD("FORGPREP", REG, JUMP),
+    OP_AD_AUX("JUMPIFEQK", REG, JUMP, CONST),
+    OP_AD_AUX("JUMPIFNOTEQK", REG, JUMP, CONST),
+    OP_ABC_AUX("LOADKX", REG, NONE, NONE, CONST),
+    OP_ABC("FASTCALL2M", IMM, REG, IMM),
+    OP_ABC("CAPTURE", IMM, IMM, NONE),
+    OP_E("JUMPX", JUMP),
+    OP_ABC("FASTCALLM", IMM, IMM, IMM),
+    OP_AD("NEWCLOSURE", REG, PROTO),
+};
+
+#undef OP_ABC
+#undef OP_ABC_AUX
+#undef OP_AD
+#undef OP_AD_AUX
+#undef OP_E
+
+// ==================== CONSTEXPR TABLES ====================
+
+struct OpcodeTables {
+    uint8_t decode[256];    // Encoded byte -> opcode (opcode * 227 is a bijection mod 256)
+    uint8_t length[256];    // Opcode -> words, 0 for opcodes outside LuauOpcode
+};
+
+constexpr OpcodeTables makeOpcodeTables() {
+    OpcodeTables tables{};
+    for (int op = 0; op < 256; op++) {
+        tables.decode[static_cast<uint8_t>(op * 227)] = static_cast<uint8_t>(op);
+        tables.length[op] = op < LOP__COUNT ? OPCODE_INFO[op].length : 0;
+    }
+    return tables;
+}
+
+constexpr OpcodeTables OPCODE_TABLES = makeOpcodeTables();
+
+static_assert(OPCODE_TABLES.decode[227] == LOP_LOADNIL, "opcode decode table is not the inverse of * 227");
+static_assert(OPCODE_TABLES.length[LOP_NEWTABLE] == 2 && OPCODE_TABLES.length[LOP_LOADK] == 1,
+              "opcode length table out of sync with OPCODE_INFO");
+
+constexpr uint8_t encodeOpcode(uint8_t opcode) {
+    return static_cast<uint8_t>(opcode * 227);
+}
+
+constexpr uint8_t decodeOpcode(uint8_t encoded) {
+    return OPCODE_TABLES.decode[encoded];
+}
+
+// Opcodes followed by an AUX word
+constexpr bool isDoubleByteOpcode(uint8_t opcode) {
+    return OPCODE_TABLES.length[opcode] == 2;
+}
+
+constexpr uint8_t instructionLength(uint8_t opcode) {
+    return OPCODE_TABLES.length[opcode];
+}
+
+} // namespace Bytecode
+
+#endif // BYTECODE_OPCODES_H
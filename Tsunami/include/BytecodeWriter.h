@@ -0,0 +1,207 @@
+#ifndef BYTECODE_WRITER_H
+#define BYTECODE_WRITER_H
+
+#include "Bytecode.h"
+#include "BytecodeOpcodes.h"
+#include <string>
+#include <string_view>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+namespace Bytecode {
+
+// ==================== SHARED ENCODING HELPERS ====================
+
+constexpr uint32_t FNV_OFFSET_BASIS = 2166136261u;
+constexpr uint32_t FNV_PRIME = 16777619u;
+
+inline uint32_t fnv1a(uint32_t hash, const uint8_t* data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+inline uint32_t hashBytecode(const uint8_t* data, size_t size) {
+    return fnv1a(FNV_OFFSET_BASIS, data, size);
+}
+
+constexpr size_t varIntSize(uint32_t value) {
+    return value < (1u << 7) ? 1 : value < (1u << 14) ? 2 : value < (1u << 21) ? 3 : value < (1u << 28) ? 4 : 5;
+}
+
+// NEWTABLE B operand: 0 for no hash part, otherwise log2(hashSize) + 1
+uint8_t encodeHashSize(uint32_t hashSize);
+
+// Largest constant index LOADK's D can hold; LOADKX carries the rest in AUX
+constexpr uint32_t LOADK_MAX_INDEX = 32767;
+
+constexpr uint32_t loadConstantWords(uint32_t index) {
+    return index <= LOADK_MAX_INDEX ? 1 : 2;
+}
+
+// Numbers LOADN can carry in D: integral, within int16, and not -0
+inline bool fitsLoadN(double value) {
+    return value >= INT16_MIN && value <= INT16_MAX && static_cast<double>(static_cast<int32_t>(value)) == value &&
+           !(value == 0 && std::signbit(value));
+}
+
+// Values stored per SETLIST when building arrays. Bounds the register
+// window, so the frame stays the same size however long the array is.
+constexpr uint32_t SETLIST_BATCH = 64;
+
+// ==================== CONTAINER FILES ====================
+//
+// Shared by cache snapshots and bundles: little-endian fields at arbitrary
+// offsets, read-only mappings and write-then-rename saves.
+
+inline void storeU32(uint8_t* out, uint32_t value) {
+    for (int i = 0; i < 4; i++) out[i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+inline void storeU64(uint8_t* out, uint64_t value) {
+    for (int i = 0; i < 8; i++) out[i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+inline uint32_t loadU32(const uint8_t* in) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++) value |= static_cast<uint32_t>(in[i]) << (8 * i);
+    return value;
+}
+
+inline uint64_t loadU64(const uint8_t* in) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++) value |= static_cast<uint64_t>(in[i]) << (8 * i);
+    return value;
+}
+
+// Maps path read-only; release with UnmapFile
+bool MapFile(const char* path, const uint8_t** data, size_t* size, std::string* error);
+void UnmapFile(const uint8_t* data, size_t size);
+
+// Writes path + ".tmp" and renames over path, so readers never see a
+// partial file
+bool WriteFileAtomic(const char* path, std::string_view contents, std::string* error);
+
+// ==================== BYTECODE WRITER ====================
+//
+// Streams one chunk into a single growable buffer. Instructions are written as
+// 32-bit words (encoded opcode, A, B, C / D / E) followed by an AUX word for
+// opcodes that take one. beginChunk() reserves the header, finish() patches
+// size and hash in place and hands the buffer out by move, so a caller that
+// sizes the writer with chunkSize() pays exactly one allocation and no copy.
+class BytecodeWriter {
+private:
+    std::string buffer;
+    size_t pos = 0;
+
+    void grow(size_t needed);
+
+public:
+    static constexpr size_t HEADER_SIZE = sizeof(LuauBytecodeHeader);
+    static constexpr size_t INSTRUCTION_SIZE = 4;
+
+    explicit BytecodeWriter(size_t reserveBytes = 0);
+
+    // Reuse the writer for another chunk, keeping its buffer capacity
+    void reset(size_t reserveBytes = 0);
+
+    // Raw access to the next `count` bytes, growing the buffer if needed
+    uint8_t* claim(size_t count) {
+        if (pos + count > buffer.size()) grow(pos + count);
+        uint8_t* out = reinterpret_cast<uint8_t*>(&buffer[0]) + pos;
+        pos += count;
+        return out;
+    }
+
+    // Primitive writes
+    void writeByte(uint8_t value) { *claim(1) = value; }
+    void writeVarInt(uint32_t value);
+    void writeUInt32(uint32_t value);
+    void writeDouble(double value);
+    void writeBytes(const void* data, size_t size);
+
+    // Constant table entries
+    void writeConstantNil() { writeByte(LBC_CONSTANT_NIL); }
+    void writeConstantBoolean(bool value);
+    void writeConstantNumber(double value);
+    void writeConstantString(const char* data, size_t size);
+    void writeConstantString(const std::string& value) { writeConstantString(value.data(), value.size()); }
+    void writeConstantTable(const uint32_t* keys, size_t count);
+
+    // Chunk and proto framing
+    void beginChunk();
+    void beginProto(uint32_t maxStackSize, uint32_t numParams, uint32_t numUpvalues,
+                    bool isVararg, uint32_t sizeCode);
+    void endProto(uint32_t sizeK, const uint32_t* children = nullptr, uint32_t sizeP = 0);
+
+    // Instructions
+    void emitABC(uint8_t opcode, uint8_t a, uint8_t b, uint8_t c);
+    void emitAD(uint8_t opcode, uint8_t a, int16_t d);
+    void emitE(uint8_t opcode, int32_t e);
+    void emitAux(uint32_t aux) { writeUInt32(aux); }
+    void emitLoadConstant(uint8_t reg, uint32_t index);   // LOADK or LOADKX
+
+    // Patch size and hash into the header. The second form resumes from
+    // `state`, the FNV-1a state already known for the first `hashed` body bytes.
+    void finalize();
+    void finalize(size_t hashed, uint32_t state);
+
+    // finalize() and hand the buffer out without copying
+    std::string finish();
+    std::string finish(size_t hashed, uint32_t state);
+
+    size_t size() const { return pos; }
+    const uint8_t* data() const { return reinterpret_cast<const uint8_t*>(buffer.data()); }
+    uint8_t* data() { return reinterpret_cast<uint8_t*>(&buffer[0]); }
+
+    // Exact encoded sizes, for pre-sizing
+    static constexpr size_t numberConstantSize() { return 1 + sizeof(double); }
+    static constexpr size_t stringConstantSize(size_t length) {
+        return 1 + varIntSize(static_cast<uint32_t>(length)) + length;
+    }
+    static size_t tableConstantSize(const uint32_t* keys, size_t count) {
+        size_t size = 1 + varIntSize(static_cast<uint32_t>(count));
+        for (size_t i = 0; i < count; i++) size += varIntSize(keys[i]);
+        return size;
+    }
+    static constexpr size_t protoSize(uint32_t maxStackSize, uint32_t sizeCode,
+                                      uint32_t sizeK, uint32_t sizeP = 0) {
+        return varIntSize(maxStackSize) + 3 + varIntSize(sizeCode) + sizeCode * INSTRUCTION_SIZE +
+               varIntSize(sizeK) + varIntSize(sizeP) + 4;
+    }
+    // Size of a single-proto chunk whose constant table occupies constantBytes
+    static constexpr size_t chunkSize(uint32_t constantCount, size_t constantBytes,
+                                      uint32_t maxStackSize, uint32_t sizeCode) {
+        return HEADER_SIZE + varIntSize(constantCount) + constantBytes + varIntSize(1) +
+               protoSize(maxStackSize, sizeCode, constantCount);
+    }
+};
+
+// ==================== CHUNK TEMPLATE ====================
+//
+// A precompiled chunk with one variable region (the payload). The bytes in
+// front of the region never change, so their FNV-1a state is cached at
+// construction and instantiate() only hashes from the first patched byte on.
+// Producing a chunk is then one allocation, three memcpys and a short hash.
+class ChunkTemplate {
+private:
+    std::string bytes;      // chunk rendered with an empty payload region
+    size_t payloadOffset;   // where the payload is spliced in
+    uint32_t prefixState;   // FNV-1a state over body bytes before the payload
+
+public:
+    ChunkTemplate(std::string chunk, size_t offset);
+
+    // Splice lead + payload into the region (lead is e.g. a length varint)
+    std::string instantiate(const uint8_t* lead, size_t leadSize,
+                            const void* payload, size_t payloadSize) const;
+
+    size_t baseSize() const { return bytes.size(); }
+};
+
+} // namespace Bytecode
+
+#endif // BYTECODE_WRITER_H
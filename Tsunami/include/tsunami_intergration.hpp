@@ -149,7 +149,7 @@ private:
             oss << std::hex << reinterpret_cast<uint64_t>(thread);
             info += oss.str();
             
-            return VMValue::String(info);
+            return vm->getVM().newString(info);
         });
         
         vm->registerGlobalFunction("tsunami_clean_stack", [this](const std::vector<VMValue>& args) -> VMValue {
@@ -159,9 +159,9 @@ private:
                 using LuaSetTopFn = void(*)(lua_State*, int);
                 LuaSetTopFn settop = reinterpret_cast<LuaSetTopFn>(offsets.lua_settop);
                 settop(thread, 0);
-                return VMValue::String("Stack cleaned");
+                return vm->getVM().newString("Stack cleaned");
             }
-            return VMValue::String("Cleanup failed");
+            return vm->getVM().newString("Cleanup failed");
         });
     }
 };
@@ -2,10 +2,14 @@
 #define TSUNAMI_PUSH_HPP
 
 #include "Bytecode.h"
+#include "BytecodeCache.h"
+#include "BytecodeLiterals.h"
 #include <cstdint>
 #include <cstring>
+#include <iostream>
 #include <string>
 #include <unordered_map>
+#include <vector>
 #include <lua.hpp>
 
 namespace tsunami {
@@ -102,6 +106,7 @@ class BytecodePusher {
 private:
     lua_State* L;
     Bytecode::BytecodeCache cache;
+    Bytecode::CacheSnapshot snapshot;   // Consulted before cache when open
     
     // Function pointers to Roblox internals
     using LuauLoadFn = int(*)(lua_State*, const char*, size_t, const char*, int);
@@ -125,51 +130,93 @@ public:
         initializeFunctionPointers();
     }
     
+    // A Lua string made in the Roblox state; null if there is no strmaker
+    const char* makeString(const char* data, size_t size) {
+        return strmaker ? strmaker(L, data, size) : nullptr;
+    }
+    
     // ==================== BYTECODE EXECUTION ====================
-    bool executeBytecode(const std::string& bytecode, const char* chunkname = "=tsunami") {
+    bool executeBytecode(const char* data, size_t size, const char* chunkname = "=tsunami", int results = 1) {
         if (!luau_load || !pcall_impl) {
             return false;
         }
         
-        // Decompress if needed
-        std::string decompressed = Bytecode::Decompress(bytecode);
-        if (decompressed.empty()) {
-            decompressed = bytecode;
+        // Skip a Roblox signature in place rather than copying the rest
+        if (size >= sizeof(Bytecode::RobloxSignature) && std::memcmp(data, "RBX2", 4) == 0) {
+            data += sizeof(Bytecode::RobloxSignature);
+            size -= sizeof(Bytecode::RobloxSignature);
         }
         
         // Load bytecode
-        if (luau_load(L, decompressed.data(), decompressed.size(), chunkname, 0) != 0) {
+        if (luau_load(L, data, size, chunkname, 0) != 0) {
             return false;
         }
         
         // Execute
-        return (pcall_impl(L, 0, 1, 0) == 0);
+        return (pcall_impl(L, 0, results, 0) == 0);
+    }
+    
+    bool executeBytecode(const std::string& bytecode, const char* chunkname = "=tsunami") {
+        return executeBytecode(bytecode.data(), bytecode.size(), chunkname);
+    }
+    
+    // Links the chunks and runs them as one, leaving each one's first result
+    // on the stack in order
+    bool executeBatch(const std::vector<std::string>& chunks, const char* chunkname = "=tsunami") {
+        std::string linked = Bytecode::LinkChunks(chunks);
+        if (linked.empty()) return false;
+        return executeBytecode(linked.data(), linked.size(), chunkname, static_cast<int>(chunks.size()));
+    }
+    
+    // Compile-time chunks (BytecodeLiterals.h) run straight from read-only data
+    template<size_t N>
+    bool executeBytecode(const Bytecode::LiteralChunk<N>& chunk, const char* chunkname = "=tsunami") {
+        return executeBytecode(reinterpret_cast<const char*>(chunk.data()), N, chunkname);
+    }
+    
+    // ==================== WARM START ====================
+    // Maps a snapshot written by saveSnapshot; pushes served from it skip
+    // generation and copying entirely. saveSnapshot writes only what the
+    // cache holds, not entries served from a loaded snapshot.
+    bool loadSnapshot(const char* path, std::string* error = nullptr) {
+        return snapshot.open(path, error);
+    }
+    
+    bool saveSnapshot(const char* path, std::string* error = nullptr) const {
+        return cache.saveSnapshot(path, error);
     }
     
     // ==================== CACHED PUSH OPERATIONS ====================
     bool pushnil() {
-        static std::string nilBytecode = Bytecode::CreatePushNil();
-        return executeBytecode(nilBytecode);
+        return executeBytecode(Bytecode::NIL_CHUNK);
     }
     
     bool pushboolean(bool value) {
-        std::string bytecode = cache.getBoolean(value);
-        return executeBytecode(bytecode);
+        return value ? executeBytecode(Bytecode::TRUE_CHUNK) : executeBytecode(Bytecode::FALSE_CHUNK);
     }
     
     bool pushnumber(double value) {
-        std::string bytecode = cache.getNumber(value);
-        return executeBytecode(bytecode);
+        std::string_view warm = snapshot.getNumber(value);
+        if (!warm.empty()) return executeBytecode(warm.data(), warm.size());
+        
+        Bytecode::ChunkHandle bytecode = cache.getNumber(value);
+        return executeBytecode(*bytecode);
     }
     
     bool pushinteger(int value) {
-        std::string bytecode = cache.getInteger(value);
-        return executeBytecode(bytecode);
+        std::string_view warm = snapshot.getInteger(value);
+        if (!warm.empty()) return executeBytecode(warm.data(), warm.size());
+        
+        Bytecode::ChunkHandle bytecode = cache.getInteger(value);
+        return executeBytecode(*bytecode);
     }
     
     bool pushstring(const std::string& value) {
-        std::string bytecode = cache.getString(value);
-        return executeBytecode(bytecode);
+        std::string_view warm = snapshot.getString(value);
+        if (!warm.empty()) return executeBytecode(warm.data(), warm.size());
+        
+        Bytecode::ChunkHandle bytecode = cache.getString(value);
+        return executeBytecode(*bytecode);
     }
     
     bool pushstring(const char* value) {
@@ -178,6 +225,7 @@ public:
     
     // ==================== TABLE OPERATIONS ====================
     bool pushtable(int arraySize = 0, int hashSize = 0) {
+        if (arraySize == 0 && hashSize == 0) return executeBytecode(Bytecode::EMPTY_TABLE_CHUNK);
         std::string bytecode = Bytecode::CreatePushTable(arraySize, hashSize);
         return executeBytecode(bytecode);
     }
@@ -257,12 +305,14 @@ private:
     static constexpr uintptr_t STACK_TOP_OFFSET = 0x8;
     static constexpr uintptr_t STACK_LAST_OFFSET = 0x10;
     
+public:
     enum PushMode {
         MODE_TVALUE,    // Fast direct memory write
         MODE_BYTECODE,  // Portable bytecode execution
         MODE_AUTO       // Auto-select based on safety
     };
     
+private:
     PushMode mode;
     
     // Get TValue* to stack slot
@@ -317,9 +367,7 @@ private:
     }
     
     void pushstring_tvalue(const std::string& s) {
-        if (!strmaker) return;
-        
-        const char* luaStr = strmaker(L, s.c_str(), s.size());
+        const char* luaStr = bytecodePusher.makeString(s.c_str(), s.size());
         if (!luaStr) return;
         
         TValue* top = getTopPtr();
@@ -0,0 +1,1619 @@
+#ifndef TSUNAMI_STATE_HPP
+#define TSUNAMI_STATE_HPP
+
+#include "Bytecode.h"
+#include "BytecodeOpcodes.h"
+#include "tsunami_value.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <functional>
+#include <string>
+#include <memory>
+
+// Computed-goto dispatch in the interpreter; define as 0 to fall back to a switch
+#ifndef TSUNAMI_VM_COMPUTED_GOTO
+#if defined(__GNUC__) || defined(__clang__)
+#define TSUNAMI_VM_COMPUTED_GOTO 1
+#else
+#define TSUNAMI_VM_COMPUTED_GOTO 0
+#endif
+#endif
+
+namespace tsunami {
+
+// ==================== VM FUNCTION INTERFACE ====================
+// Convenience form: each call copies its arguments into a vector and
+// returns one value
+using VMFunction = std::function<VMValue(const std::vector<VMValue>&)>;
+
+class VMState;
+
+// What a VMNativeFunction sees. Arguments are read in place from the
+// caller's registers and results are written over them from index 0, so
+// read what you need first. A native returns how many results it wrote,
+// or error()'s -1.
+class VMNativeCall {
+public:
+    VMNativeCall(VMState& state, size_t slot, size_t nargs) : vm(state), slot(slot), nargs(nargs) {}
+    
+    size_t argCount() const { return nargs; }
+    VMValue arg(size_t i) const;    // Nil past the last argument
+    void setResult(size_t i, VMValue value);
+    
+    // Fails the call with getLastError() set to message
+    int error(std::string message);
+    
+    VMState& state() { return vm; }
+    
+private:
+    VMState& vm;
+    size_t slot;    // The function's register, where results start
+    size_t nargs;
+};
+
+// Entry of a native function table, e.g. a constexpr array registered in a loop
+struct VMNative {
+    const char* name;
+    VMNativeFunction function;
+    void* context;
+};
+
+// A global name resolved to its slot; valid for the life of its VMState
+struct GlobalHandle {
+    uint32_t slot = 0;
+};
+
+// Where names the VM itself does not define resolve next, e.g. a Roblox
+// state (RobloxFallback in tsunami_vm.hpp)
+class VMFallback {
+public:
+    virtual ~VMFallback() = default;
+    
+    virtual bool exists(const VMString* name) = 0;
+    virtual VMValue fetch(VMState& vm, const VMString* name) = 0;
+    
+    // Calls a function by name; false if there is no such function
+    virtual bool call(VMState& vm, const std::string& name, const std::vector<VMValue>& args, VMValue& result) = 0;
+};
+
+// ==================== CUSTOM VM STATE ====================
+class VMState {
+    friend class VMNativeCall;
+    
+private:
+    // Strings, tables and closures; roots are marked in collectGarbage()
+    VMHeap heap;
+    
+    // Custom environment: a slot per name ever resolved, never removed, so
+    // slot indices stay valid. A slot is undefined until first set, and
+    // lookups of its name fall through to functions and the fallback until then.
+    struct GlobalSlot {
+        const VMString* name;
+        VMValue value;
+        bool defined;
+    };
+    std::vector<GlobalSlot> globalSlots;
+    std::unordered_map<const VMString*, uint32_t, VMStringHash> globalIndex;
+    std::unordered_map<const VMString*, VMFunction, VMStringHash> functions;
+    
+    // Bumped whenever globalSlots grows, which may move every slot; inline
+    // caches hold a slot pointer and are valid only at the version they saw.
+    // Starts above the caches' 0, and cannot wrap as it counts slots.
+    uint32_t globalsVersion = 1;
+    
+    // Stack for execution
+    std::vector<VMValue> stack;
+    
+    // Resolves what the VM does not define; not owned, may be null
+    VMFallback* fallback;
+    
+    // Fallback globals that we've checked
+    std::unordered_map<const VMString*, bool, VMStringHash> fallbackCache;
+    
+    // Configuration
+    bool enableFallbackGlobals;
+    bool cacheFallbackGlobals;
+    
+    std::unordered_map<const VMString*, VMClosure*, VMStringHash> hostFunctions;
+    std::vector<const VMString*> libraryNames;     // Parallel to LIBRARY
+    VMValue nextFunction;
+    VMValue inextFunction;
+    VMValue typeNames[VMValue::LIGHTUSERDATA + 1];
+    
+    // Interpreter registers, shared by every active frame; a callee's frame
+    // starts just past its function slot in the caller's
+    std::vector<VMValue> registers;
+    std::vector<VMUpvalue*> openUpvalues;
+    size_t registerTop = 0;
+    int callDepth = 0;
+    std::string lastError;
+    
+    static constexpr int MAX_CALL_DEPTH = 200;
+    static constexpr uint32_t MAX_SIZE_HINT_LOG2 = 16;   // Caps NEWTABLE/DUPTABLE preallocation
+    
+public:
+    explicit VMState(VMFallback* fallbackGlobals = nullptr,
+                     bool enableFallback = true,
+                     bool cacheGlobals = true)
+        : fallback(fallbackGlobals),
+          enableFallbackGlobals(enableFallback),
+          cacheFallbackGlobals(cacheGlobals) {
+        
+        // Register built-in functions
+        registerBuiltins();
+    }
+    
+    // ==================== STACK OPERATIONS ====================
+    void push(const VMValue& value) {
+        stack.push_back(value);
+    }
+    
+    VMValue pop() {
+        if (stack.empty()) return VMValue::Nil();
+        VMValue value = stack.back();
+        stack.pop_back();
+        return value;
+    }
+    
+    VMValue& top() {
+        static VMValue nil = VMValue::Nil();
+        if (stack.empty()) return nil;
+        return stack.back();
+    }
+    
+    int stackSize() const {
+        return static_cast<int>(stack.size());
+    }
+    
+    void clearStack() {
+        stack.clear();
+    }
+    
+    // ==================== ENVIRONMENT MANAGEMENT ====================
+    // Names are interned once; lookups by handle hash nothing and compare
+    // pointers
+    const VMString* intern(std::string_view name) {
+        return heap.newString(name);
+    }
+    
+    void setGlobal(const std::string& name, const VMValue& value) {
+        setGlobal(intern(name), value);
+    }
+    
+    void setGlobal(const VMString* name, const VMValue& value) {
+        setGlobal(resolveGlobal(name), value);
+    }
+    
+    // Resolves a name to its slot once, defined or not; reads and writes
+    // through the handle then index the slot array directly
+    GlobalHandle resolveGlobal(const std::string& name) {
+        return resolveGlobal(intern(name));
+    }
+    
+    GlobalHandle resolveGlobal(const VMString* name) {
+        auto it = globalIndex.find(name);
+        if (it != globalIndex.end()) return GlobalHandle{it->second};
+        
+        uint32_t slot = static_cast<uint32_t>(globalSlots.size());
+        globalSlots.push_back(GlobalSlot{name, VMValue::Nil(), false});
+        globalIndex.emplace(name, slot);
+        globalsVersion++;
+        return GlobalHandle{slot};
+    }
+    
+    void setGlobal(GlobalHandle global, const VMValue& value) {
+        GlobalSlot& slot = globalSlots[global.slot];
+        if (!slot.defined) {
+            slot.defined = true;
+            fallbackCache.erase(slot.name); // Invalidate cache
+        }
+        slot.value = value;
+    }
+    
+    VMValue getGlobal(GlobalHandle global) {
+        const GlobalSlot& slot = globalSlots[global.slot];
+        if (slot.defined) return slot.value;
+        return lookupGlobal(slot.name);
+    }
+    
+    VMValue getGlobal(const std::string& name) {
+        const VMString* handle = heap.findString(name);
+        if (handle) return getGlobal(handle);
+        
+        // Never interned, so neither a global nor a function
+        if (enableFallbackGlobals && fallback) return getGlobal(intern(name));
+        return VMValue::Nil();
+    }
+    
+    VMValue getGlobal(const VMString* name) {
+        // 1. Check custom VM globals
+        if (const GlobalSlot* slot = findGlobal(name)) {
+            return slot->value;
+        }
+        return lookupGlobal(name);
+    }
+    
+    // A later registration of a name replaces an earlier one of either form
+    void registerFunction(const std::string& name, VMFunction func) {
+        const VMString* handle = intern(name);
+        functions[handle] = func;
+        auto it = hostFunctions.find(handle);
+        if (it != hostFunctions.end()) it->second->native = nullptr;
+    }
+    
+    void registerNative(const VMNative& native) {
+        const VMString* handle = intern(native.name);
+        functions.erase(handle);
+        VMClosure* function = functionValue(handle).closure();
+        function->native = native.function;
+        function->context = native.context;
+    }
+    
+    void registerNative(const char* name, VMNativeFunction function, void* context = nullptr) {
+        registerNative(VMNative{name, function, context});
+    }
+    
+    bool existsInVM(const std::string& name) const {
+        const VMString* handle = heap.findString(name);
+        return handle && (findGlobal(handle) || isHostFunction(handle));
+    }
+    
+private:
+    bool isHostFunction(const VMString* name) const {
+        if (functions.find(name) != functions.end()) return true;
+        auto it = hostFunctions.find(name);
+        return it != hostFunctions.end() && it->second->native;
+    }
+    
+    const GlobalSlot* findGlobal(const VMString* name) const {
+        auto it = globalIndex.find(name);
+        if (it == globalIndex.end() || !globalSlots[it->second].defined) return nullptr;
+        return &globalSlots[it->second];
+    }
+    
+    // Where a name with no defined global resolves
+    VMValue lookupGlobal(const VMString* name) {
+        // 2. Check cached fallback globals
+        if (cacheFallbackGlobals && fallback) {
+            auto cacheIt = fallbackCache.find(name);
+            if (cacheIt != fallbackCache.end() && cacheIt->second) {
+                // We know the fallback has it, fetch it
+                return fallback->fetch(*this, name);
+            }
+        }
+        
+        // 3. Check if function exists in custom VM
+        if (isHostFunction(name)) {
+            // Return a function value
+            return functionValue(name);
+        }
+        
+        // 4. Try the fallback
+        if (enableFallbackGlobals && fallback) {
+            if (fallback->exists(name)) {
+                if (cacheFallbackGlobals) {
+                    fallbackCache[name] = true;
+                }
+                return fallback->fetch(*this, name);
+            } else {
+                if (cacheFallbackGlobals) {
+                    fallbackCache[name] = false;
+                }
+            }
+        }
+        
+        // 5. Not found anywhere
+        return VMValue::Nil();
+    }
+    
+public:
+    // ==================== FUNCTION EXECUTION ====================
+    VMValue call(const std::string& funcName, const std::vector<VMValue>& args = {}) {
+        const VMString* name = heap.findString(funcName);
+        
+        // 1. Check custom VM functions
+        auto funcIt = name ? functions.find(name) : functions.end();
+        if (funcIt != functions.end()) {
+            return funcIt->second(args);
+        }
+        auto nativeIt = name ? hostFunctions.find(name) : hostFunctions.end();
+        if (nativeIt != hostFunctions.end() && nativeIt->second->native) {
+            return callValue(VMValue::Function(nativeIt->second), args);
+        }
+        
+        // 2. Functions defined by bytecode
+        const GlobalSlot* global = name ? findGlobal(name) : nullptr;
+        if (global && global->value.is(VMValue::FUNCTION)) {
+            return callValue(global->value, args);
+        }
+        
+        // 3. Check functions the fallback has
+        VMValue result;
+        if (enableFallbackGlobals && fallback && fallback->call(*this, funcName, args, result)) {
+            return result;
+        }
+        
+        // 4. Function not found
+        std::cerr << "Function '" << funcName << "' not found\n";
+        return VMValue::Nil();
+    }
+    
+    // Pops a function and numArgs arguments pushed after it, calls it and
+    // returns its first result. Errors return Nil; see getLastError().
+    VMValue call(int numArgs = 0) {
+        if (numArgs < 0 || stack.size() < static_cast<size_t>(numArgs + 1)) {
+            return VMValue::Nil();
+        }
+        
+        size_t first = stack.size() - numArgs - 1;
+        VMValue funcVal = stack[first];
+        std::vector<VMValue> args(stack.begin() + first + 1, stack.end());
+        stack.resize(first);
+        
+        return callValue(funcVal, args);
+    }
+    
+    VMValue callValue(const VMValue& function, const std::vector<VMValue>& args) {
+        size_t func = registerTop;
+        ensureRegisters(func + 1 + args.size());
+        registers[func] = function;
+        std::copy(args.begin(), args.end(), registers.begin() + func + 1);
+        
+        size_t results = 0;
+        VMValue result;
+        if (callAt(func, args.size(), results) && results > 0) {
+            result = registers[func];
+        }
+        releaseRegisters();
+        return result;
+    }
+    
+    // ==================== VALUES ====================
+    // Heap values are owned by this state. Those the host holds outside the
+    // stack and globals stay valid only until the VM next runs bytecode or
+    // collectGarbage() is called.
+    VMValue newString(std::string_view text) {
+        return VMValue::String(heap.newString(text));
+    }
+    
+    VMValue newTable(size_t arraySize = 0, size_t hashSize = 0) {
+        return VMValue::Table(heap.newTable(arraySize, hashSize));
+    }
+    
+    // Frees everything the stack, globals and running frames cannot reach
+    void collectGarbage() {
+        heap.collect([this](VMHeap& h) {
+            for (VMValue value : registers) h.mark(value);
+            for (VMValue value : stack) h.mark(value);
+            for (const GlobalSlot& global : globalSlots) {
+                h.mark(global.name);
+                h.mark(global.value);
+            }
+            for (const auto& function : functions) h.mark(function.first);
+            for (const auto& cached : fallbackCache) h.mark(cached.first);
+            for (const auto& function : hostFunctions) h.mark(function.second);
+            for (VMValue name : typeNames) h.mark(name);
+            for (VMUpvalue* upvalue : openUpvalues) h.mark(upvalue);
+        });
+    }
+    
+    size_t heapBytes() const {
+        return heap.bytes();
+    }
+    
+    // Occupancy of the string intern table and what sharing has saved
+    VMInternStats internStats() const {
+        return heap.stringStats();
+    }
+    
+    // ==================== BUILT-IN FUNCTIONS ====================
+private:
+    // Natives: nothing here allocates but a new vmtostring result
+    static int builtinPrint(VMNativeCall& call, void*) {
+        for (size_t i = 0; i < call.argCount(); i++) {
+            VMValue arg = call.arg(i);
+            switch (arg.type()) {
+                case VMValue::NIL:
+                    std::cout << "nil";
+                    break;
+                case VMValue::BOOLEAN:
+                    std::cout << (arg.asBoolean() ? "true" : "false");
+                    break;
+                case VMValue::NUMBER:
+                    std::cout << arg.asNumber();
+                    break;
+                case VMValue::STRING:
+                    std::cout << arg.asString()->view();
+                    break;
+                default:
+                    std::cout << "[unknown]";
+                    break;
+            }
+            std::cout << " ";
+        }
+        std::cout << "\n";
+        return 0;
+    }
+    
+    static int builtinType(VMNativeCall& call, void*) {
+        call.setResult(0, call.state().typeNames[call.arg(0).type()]);
+        return 1;
+    }
+    
+    static int builtinToString(VMNativeCall& call, void*) {
+        VMValue arg = call.arg(0);
+        if (arg.isString()) {
+            call.setResult(0, arg);
+            return 1;
+        }
+        
+        // Formats as ostream's defaults would
+        char buffer[32];
+        int length;
+        switch (arg.type()) {
+            case VMValue::NIL:
+                call.setResult(0, call.state().typeNames[VMValue::NIL]);
+                return 1;
+            case VMValue::BOOLEAN:
+                length = std::snprintf(buffer, sizeof(buffer), "%s", arg.asBoolean() ? "true" : "false");
+                break;
+            case VMValue::NUMBER:
+                length = std::snprintf(buffer, sizeof(buffer), "%g", arg.asNumber());
+                break;
+            default:
+                length = std::snprintf(buffer, sizeof(buffer), "%d", static_cast<int>(arg.type()));
+                break;
+        }
+        call.setResult(0, call.state().newString(std::string_view(buffer, static_cast<size_t>(length))));
+        return 1;
+    }
+    
+    static int builtinToNumber(VMNativeCall& call, void*) {
+        VMValue arg = call.arg(0);
+        VMValue result;
+        if (arg.isNumber()) {
+            result = arg;
+        } else if (arg.isString()) {
+            // A leading number, as std::stod reads one
+            const char* begin = arg.asString()->data();
+            char* end = nullptr;
+            errno = 0;
+            double num = std::strtod(begin, &end);
+            if (end != begin && errno != ERANGE) result = VMValue::Number(num);
+        } else if (arg.is(VMValue::BOOLEAN)) {
+            result = VMValue::Number(arg.asBoolean() ? 1.0 : 0.0);
+        }
+        
+        call.setResult(0, result);
+        return 1;
+    }
+    
+    static constexpr VMNative BUILTINS[] = {
+        {"vmprint", &VMState::builtinPrint, nullptr},
+        {"vmtype", &VMState::builtinType, nullptr},
+        {"vmtostring", &VMState::builtinToString, nullptr},
+        {"vmtonumber", &VMState::builtinToNumber, nullptr},
+    };
+    
+    void registerBuiltins() {
+        // Type names are interned once here for vmtype
+        static const char* const names[] = {"nil", "boolean", "number", "string", "function", "table", "userdata", "userdata"};
+        for (int type = VMValue::NIL; type <= VMValue::LIGHTUSERDATA; type++) typeNames[type] = newString(names[type]);
+        for (const VMNative& builtin : BUILTINS) registerNative(builtin);
+        
+        // Library functions that return several values live in the interpreter
+        for (const LibraryFunction& library : LIBRARY) {
+            const VMString* name = intern(library.name);
+            libraryNames.push_back(name);
+            if (library.global) setGlobal(name, functionValue(name));
+        }
+        nextFunction = functionValue(intern("next"));
+        inextFunction = functionValue(intern("inext"));
+    }
+    
+    // One function object per host name, so equal names compare equal
+    VMValue functionValue(const VMString* name) {
+        VMClosure*& function = hostFunctions[name];
+        if (!function) function = heap.newHostFunction(name);
+        return VMValue::Function(function);
+    }
+    
+public:
+    // ==================== BYTECODE EXECUTION ====================
+    // Runs a chunk in-process and pushes everything it returns onto the
+    // stack. On failure nothing is pushed and getLastError() says why.
+    bool executeBytecode(std::string_view bytecode) {
+        VMValue function = loadBytecode(bytecode);
+        if (function.isNil()) return false;
+        
+        size_t func = registerTop;
+        ensureRegisters(func + 1);
+        registers[func] = function;
+        
+        size_t results = 0;
+        bool ok = callAt(func, 0, results);
+        if (ok) {
+            stack.insert(stack.end(), registers.begin() + func, registers.begin() + func + results);
+        }
+        releaseRegisters();
+        return ok;
+    }
+    
+    // Verifies a chunk and decodes it into a function value; Nil on failure.
+    // Like newString(), the result is only held until the VM next runs.
+    VMValue loadBytecode(std::string_view bytecode) {
+        VMProgram* program = decodeChunk(bytecode);
+        if (!program) return VMValue::Nil();
+        
+        VMClosure* closure = heap.newClosure(program, &program->protos.back());
+        for (VMUpvalue*& upvalue : closure->upvalues) upvalue = heap.newUpvalue();
+        return VMValue::Function(closure);
+    }
+    
+    const std::string& getLastError() const {
+        return lastError;
+    }
+    
+    // ==================== SETTINGS ====================
+    void enableFallback(bool enable) {
+        enableFallbackGlobals = enable;
+    }
+    
+    void enableCaching(bool enable) {
+        cacheFallbackGlobals = enable;
+    }
+    
+    void clearCache() {
+        fallbackCache.clear();
+    }
+    
+    // ==================== UTILITIES ====================
+    void dumpStack() const {
+        std::cout << "VM Stack (" << stack.size() << " items):\n";
+        for (size_t i = 0; i < stack.size(); i++) {
+            std::cout << "  [" << i << "]: ";
+            switch (stack[i].type()) {
+                case VMValue::NIL: std::cout << "nil"; break;
+                case VMValue::BOOLEAN: std::cout << (stack[i].asBoolean() ? "true" : "false"); break;
+                case VMValue::NUMBER: std::cout << stack[i].asNumber(); break;
+                case VMValue::STRING: std::cout << "\"" << stack[i].asString()->view() << "\""; break;
+                case VMValue::FUNCTION: std::cout << "function"; break;
+                default: std::cout << "unknown"; break;
+            }
+            std::cout << "\n";
+        }
+    }
+    
+    void dumpGlobals() const {
+        std::cout << "VM Globals:\n";
+        for (const GlobalSlot& global : globalSlots) {
+            if (!global.defined) continue;
+            const VMValue& value = global.value;
+            std::cout << "  " << global.name->view() << " = ";
+            switch (value.type()) {
+                case VMValue::NIL: std::cout << "nil"; break;
+                case VMValue::BOOLEAN: std::cout << (value.asBoolean() ? "true" : "false"); break;
+                case VMValue::NUMBER: std::cout << value.asNumber(); break;
+                case VMValue::STRING: std::cout << "\"" << value.asString()->view() << "\""; break;
+                default: std::cout << "[" << value.type() << "]"; break;
+            }
+            std::cout << "\n";
+        }
+    }
+    
+    // ==================== INTERPRETER ====================
+private:
+    bool fail(std::string message) {
+        lastError = std::move(message);
+        return false;
+    }
+    
+    void ensureRegisters(size_t size) {
+        if (registers.size() < size) registers.resize(size);
+    }
+    
+    // Collection point inside the interpreter, taken only once the new
+    // object is in a register
+    void checkGarbage() {
+        if (heap.shouldCollect()) collectGarbage();
+    }
+    
+    // Drops every register once the outermost call has returned
+    void releaseRegisters() {
+        if (callDepth == 0) {
+            registers.clear();
+            openUpvalues.clear();
+        }
+    }
+    
+    static uint32_t insnA(uint32_t insn) { return (insn >> 8) & 0xFF; }
+    static uint32_t insnB(uint32_t insn) { return (insn >> 16) & 0xFF; }
+    static uint32_t insnC(uint32_t insn) { return insn >> 24; }
+    static int32_t insnD(uint32_t insn) { return static_cast<int32_t>(insn) >> 16; }
+    static int32_t insnE(uint32_t insn) { return static_cast<int32_t>(insn) >> 8; }
+    
+    static const char* typeName(const VMValue& v) {
+        switch (v.type()) {
+            case VMValue::NIL: return "nil";
+            case VMValue::BOOLEAN: return "boolean";
+            case VMValue::NUMBER: return "number";
+            case VMValue::STRING: return "string";
+            case VMValue::FUNCTION: return "function";
+            case VMValue::TABLE: return "table";
+            default: return "userdata";
+        }
+    }
+    
+    // Numbers, and strings that read as one, as Lua coerces for arithmetic
+    static bool toNumber(const VMValue& v, double& out) {
+        if (v.isNumber()) {
+            out = v.asNumber();
+            return true;
+        }
+        if (!v.isString() || v.asString()->length == 0) return false;
+        
+        const VMString* s = v.asString();
+        const char* begin = s->data();
+        
+        // strtod also reads "inf", "infinity" and "nan"; like Lua, reject
+        // any numeral with an 'n' in it
+        for (size_t i = 0; i < s->length; i++) {
+            if (begin[i] == 'n' || begin[i] == 'N') return false;
+        }
+        
+        char* end = nullptr;
+        out = std::strtod(begin, &end);
+        if (end == begin) return false;
+        while (*end == ' ' || *end == '\t' || *end == '\n' || *end == '\r') end++;
+        return end == begin + s->length;
+    }
+    
+    // Registers past the top of a multret CALL's results
+    static size_t multret(size_t top, size_t from) {
+        return top > from ? top - from : 0;
+    }
+    
+    static void appendNumber(std::string& out, double n) {
+        char buffer[32];
+        int length = std::snprintf(buffer, sizeof(buffer), "%.14g", n);
+        out.append(buffer, static_cast<size_t>(length));
+    }
+    
+    // ==================== CHUNK LOADING ====================
+    VMProgram* decodeChunk(std::string_view bytecode) {
+        // Skip a Roblox signature in place, as the pusher does
+        if (bytecode.size() >= sizeof(Bytecode::RobloxSignature) && bytecode.substr(0, 4) == "RBX2") {
+            bytecode.remove_prefix(sizeof(Bytecode::RobloxSignature));
+        }
+        
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(bytecode.data());
+        size_t errorOffset = 0;
+        Bytecode::VerifyResult verified = Bytecode::VerifyBytecode(data, bytecode.size(), &errorOffset);
+        if (verified != Bytecode::VERIFY_OK) {
+            fail(std::string("bad bytecode: ") + Bytecode::VerifyResultName(verified) +
+                 " at offset " + std::to_string(errorOffset));
+            return nullptr;
+        }
+        
+        // Verified, so the walk below needs no bounds checks
+        const uint8_t* pos = data + sizeof(Bytecode::LuauBytecodeHeader);
+        auto varInt = [&pos]() {
+            uint32_t result = 0;
+            for (int shift = 0;; shift += 7) {
+                uint8_t byte = *pos++;
+                result |= static_cast<uint32_t>(byte & 0x7F) << shift;
+                if (!(byte & 0x80)) return result;
+            }
+        };
+        
+        VMProgram* program = heap.newProgram();
+        program->constants.resize(varInt());
+        for (VMValue& constant : program->constants) {
+            switch (*pos++) {
+                case Bytecode::LBC_CONSTANT_BOOLEAN:
+                    constant = VMValue::Boolean(*pos++ != 0);
+                    break;
+                case Bytecode::LBC_CONSTANT_NUMBER: {
+                    double n;
+                    std::memcpy(&n, pos, sizeof(n));
+                    pos += sizeof(n);
+                    constant = VMValue::Number(n);
+                    break;
+                }
+                case Bytecode::LBC_CONSTANT_STRING: {
+                    uint32_t length = varInt();
+                    constant = newString(std::string_view(reinterpret_cast<const char*>(pos), length));
+                    pos += length;
+                    break;
+                }
+                case Bytecode::LBC_CONSTANT_IMPORT:
+                    // GETIMPORT carries the same id in its AUX word
+                    pos += 4;
+                    break;
+                case Bytecode::LBC_CONSTANT_TABLE: {
+                    uint32_t keys = varInt();
+                    for (uint32_t k = 0; k < keys; k++) varInt();
+                    constant = VMValue::Number(keys);
+                    break;
+                }
+                case Bytecode::LBC_CONSTANT_CLOSURE:
+                    varInt();
+                    break;
+                default:
+                    break;
+            }
+        }
+        
+        program->protos.resize(varInt());
+        for (VMProto& proto : program->protos) {
+            proto.maxStack = varInt();
+            proto.numParams = varInt();
+            proto.numUpvalues = varInt();
+            varInt();   // isVararg: there is no vararg access to support
+            uint32_t sizeCode = varInt();
+            
+            // Opcode bytes are decoded once here; a trailing RETURN 0 1 ends
+            // code that would otherwise run off the end
+            proto.code.resize(sizeCode + 1);
+            for (uint32_t i = 0; i < sizeCode; i++, pos += 4) {
+                proto.code[i] = pos[0] | (pos[1] << 8) | (pos[2] << 16) | (static_cast<uint32_t>(pos[3]) << 24);
+            }
+            for (uint32_t pc = 0; pc < sizeCode;) {
+                uint8_t op = Bytecode::decodeOpcode(proto.code[pc] & 0xFF);
+                proto.code[pc] = (proto.code[pc] & ~0xFFu) | op;
+                if (op == Bytecode::LOP_GETGLOBAL || op == Bytecode::LOP_SETGLOBAL) {
+                    // The verifier guarantees the AUX word names a string
+                    // constant (and GETIMPORT's id one to three of them).
+                    // It becomes a cache index; the cache keeps the name.
+                    proto.globalCaches.push_back(VMGlobalCache{proto.code[pc + 1]});
+                    proto.code[pc + 1] = static_cast<uint32_t>(proto.globalCaches.size() - 1);
+                }
+                pc += Bytecode::instructionLength(op);
+            }
+            proto.code[sizeCode] = Bytecode::LOP_RETURN | (1u << 16);
+            
+            varInt();   // sizeK: every proto sees the whole pool
+            proto.children.resize(varInt());
+            for (uint32_t& child : proto.children) child = varInt();
+            
+            varInt();   // linedefined
+            varInt();   // debugname
+            pos += 2;   // lineinfo, debuginfo
+        }
+        
+        return program;
+    }
+    
+    // ==================== GLOBAL CACHES ====================
+    // GETGLOBAL/SETGLOBAL slow paths. A cached slot is defined, or names a
+    // host function: that resolves the same until the name is defined, and
+    // defining it writes the slot the cache reads.
+    VMValue readGlobal(VMGlobalCache& cache, const VMValue* K) {
+        GlobalSlot& slot = globalSlots[resolveGlobal(K[cache.constant].asString()).slot];
+        if (!slot.defined) {
+            if (!isHostFunction(slot.name)) return lookupGlobal(slot.name);
+            slot.value = functionValue(slot.name);
+        }
+        
+        cache.value = &slot.value;
+        cache.version = globalsVersion;
+        return slot.value;
+    }
+    
+    void writeGlobal(VMGlobalCache& cache, const VMValue* K, const VMValue& value) {
+        GlobalHandle global = resolveGlobal(K[cache.constant].asString());
+        setGlobal(global, value);
+        cache.value = &globalSlots[global.slot].value;
+        cache.version = globalsVersion;
+    }
+    
+    // ==================== UPVALUES ====================
+    VMUpvalue* captureRegister(size_t index) {
+        for (VMUpvalue* upvalue : openUpvalues) {
+            if (upvalue->index == index) return upvalue;
+        }
+        VMUpvalue* upvalue = heap.newUpvalue();
+        upvalue->index = index;
+        upvalue->open = true;
+        openUpvalues.push_back(upvalue);
+        return upvalue;
+    }
+    
+    void closeUpvalues(size_t limit) {
+        size_t kept = 0;
+        for (size_t i = 0; i < openUpvalues.size(); i++) {
+            VMUpvalue& upvalue = *openUpvalues[i];
+            if (upvalue.index >= limit) {
+                upvalue.closed = registers[upvalue.index];
+                upvalue.open = false;
+            } else {
+                openUpvalues[kept++] = openUpvalues[i];
+            }
+        }
+        openUpvalues.resize(kept);
+    }
+    
+    // ==================== VALUE OPERATIONS ====================
+    static double arithmeticResult(uint32_t op, double x, double y) {
+        switch (op) {
+            case Bytecode::LOP_ADD: case Bytecode::LOP_ADDK: return x + y;
+            case Bytecode::LOP_SUB: case Bytecode::LOP_SUBK: return x - y;
+            case Bytecode::LOP_MUL: case Bytecode::LOP_MULK: return x * y;
+            case Bytecode::LOP_DIV: case Bytecode::LOP_DIVK: return x / y;
+            case Bytecode::LOP_MOD: case Bytecode::LOP_MODK: return x - std::floor(x / y) * y;
+            default: return std::pow(x, y);
+        }
+    }
+    
+    // Slow path once either operand is not a number
+    bool arithmetic(uint32_t op, VMValue& out, const VMValue& lhs, const VMValue& rhs) {
+        double x, y;
+        if (!toNumber(lhs, x)) return fail(std::string("attempt to perform arithmetic on a ") + typeName(lhs) + " value");
+        if (!toNumber(rhs, y)) return fail(std::string("attempt to perform arithmetic on a ") + typeName(rhs) + " value");
+        out = VMValue::Number(arithmeticResult(op, x, y));
+        return true;
+    }
+    
+    bool lessThan(const VMValue& a, const VMValue& b, bool& result) {
+        if (a.isNumber() && b.isNumber()) {
+            result = a.asNumber() < b.asNumber();
+        } else if (a.isString() && b.isString()) {
+            result = a.asString()->view() < b.asString()->view();
+        } else {
+            return fail(std::string("attempt to compare ") + typeName(a) + " with " + typeName(b));
+        }
+        return true;
+    }
+    
+    bool lessEqual(const VMValue& a, const VMValue& b, bool& result) {
+        if (a.isNumber() && b.isNumber()) {
+            result = a.asNumber() <= b.asNumber();
+        } else if (a.isString() && b.isString()) {
+            result = a.asString()->view() <= b.asString()->view();
+        } else {
+            return fail(std::string("attempt to compare ") + typeName(a) + " with " + typeName(b));
+        }
+        return true;
+    }
+    
+    // out may alias object or key
+    bool getTable(const VMValue& object, const VMValue& key, VMValue& out) {
+        VMTable* table = object.table();
+        if (!table) return fail(std::string("attempt to index a ") + typeName(object) + " value");
+        out = table->get(key);
+        return true;
+    }
+    
+    bool setTable(const VMValue& object, const VMValue& key, const VMValue& value) {
+        VMTable* table = object.table();
+        if (!table) return fail(std::string("attempt to index a ") + typeName(object) + " value");
+        if (key.isNil()) return fail("table index is nil");
+        if (key.isNumber() && std::isnan(key.asNumber())) return fail("table index is NaN");
+        table->set(key, value);
+        return true;
+    }
+    
+    bool concat(const VMValue* values, size_t count, VMValue& out) {
+        std::string result;
+        for (size_t i = 0; i < count; i++) {
+            if (values[i].isString()) {
+                result += values[i].asString()->view();
+            } else if (values[i].isNumber()) {
+                appendNumber(result, values[i].asNumber());
+            } else {
+                return fail(std::string("attempt to concatenate a ") + typeName(values[i]) + " value");
+            }
+        }
+        out = newString(result);
+        return true;
+    }
+    
+    // ==================== CALLS ====================
+    // Calls registers[func] with the nargs values after it. Results are
+    // written from registers[func] on and counted in results.
+    bool callAt(size_t func, size_t nargs, size_t& results) {
+        VMClosure* closure = registers[func].closure();
+        if (!closure) {
+            return fail(std::string("attempt to call a ") + typeName(registers[func]) + " value");
+        }
+        if (closure->proto) return execute(closure, func + 1, nargs, results);
+        return callHost(closure, func, nargs, results);
+    }
+    
+    bool callHost(VMClosure* function, size_t func, size_t nargs, size_t& results) {
+        // The host function may call back in; frames it opens go above the arguments
+        size_t savedTop = registerTop;
+        
+        if (function->native) {
+            VMNativeCall call(*this, func, nargs);
+            registerTop = std::max(registerTop, func + 1 + nargs);
+            int count = function->native(call, function->context);
+            registerTop = savedTop;
+            if (count < 0) return false;
+            
+            results = static_cast<size_t>(count);
+            ensureRegisters(func + results);
+            return true;
+        }
+        
+        const VMString* name = function->name;
+        auto funcIt = functions.find(name);
+        if (funcIt != functions.end()) {
+            std::vector<VMValue> args(registers.begin() + func + 1, registers.begin() + func + 1 + nargs);
+            registerTop = std::max(registerTop, func + 1 + nargs);
+            VMValue result = funcIt->second(args);
+            registerTop = savedTop;
+            
+            registers[func] = result;
+            results = 1;
+            return true;
+        }
+        
+        for (size_t i = 0; i < libraryNames.size(); i++) {
+            if (name == libraryNames[i]) return (this->*LIBRARY[i].call)(func, nargs, results);
+        }
+        return fail("attempt to call unknown function '" + std::string(name->view()) + "'");
+    }
+    
+    bool execute(VMClosure* closure, size_t base, size_t nargs, size_t& results) {
+        if (callDepth >= MAX_CALL_DEPTH) return fail("stack overflow");
+        
+        const VMProto& proto = *closure->proto;
+        ensureRegisters(base + proto.maxStack);
+        for (size_t i = std::min<size_t>(nargs, proto.numParams); i < proto.maxStack; i++) {
+            registers[base + i] = VMValue::Nil();
+        }
+        
+        size_t savedTop = registerTop;
+        registerTop = base + proto.maxStack;
+        callDepth++;
+        bool ok = run(closure, base, results);
+        callDepth--;
+        registerTop = savedTop;
+        
+        // RETURN closes its own upvalues before moving results; this is for errors
+        if (!ok) closeUpvalues(base);
+        return ok;
+    }
+    
+    // ==================== LIBRARY ====================
+    struct LibraryFunction {
+        const char* name;
+        bool global;    // Installed in globals; the ipairs iterator is not
+        bool (VMState::*call)(size_t func, size_t nargs, size_t& results);
+    };
+    
+    const VMValue& argument(size_t func, size_t nargs, size_t i) const {
+        return i < nargs ? registers[func + 1 + i] : VMTable::nil();
+    }
+    
+    bool libraryUnpack(size_t func, size_t nargs, size_t& results) {
+        const VMValue& list = argument(func, nargs, 0);
+        if (!list.table()) return fail(std::string("bad argument #1 to 'unpack' (table expected, got ") + typeName(list) + ")");
+        
+        double first = 1;
+        double last = static_cast<double>(list.table()->length());
+        const VMValue& from = argument(func, nargs, 1);
+        const VMValue& to = argument(func, nargs, 2);
+        if (!from.isNil() && !toNumber(from, first)) return fail("bad argument #2 to 'unpack' (number expected)");
+        if (!to.isNil() && !toNumber(to, last)) return fail("bad argument #3 to 'unpack' (number expected)");
+        
+        first = std::floor(first);
+        last = std::floor(last);
+        if (last - first >= 1e6) return fail("too many results to unpack");
+        results = last >= first ? static_cast<size_t>(last - first + 1) : 0;
+        
+        // Results overwrite the arguments, so hold the table first
+        const VMTable& table = *list.table();
+        ensureRegisters(func + results);
+        for (size_t i = 0; i < results; i++) {
+            double index = first + static_cast<double>(i);
+            if (index >= 1) registers[func + i] = table.getInt(static_cast<size_t>(index));
+            else registers[func + i] = table.get(VMValue::Number(index));
+        }
+        return true;
+    }
+    
+    bool librarySelect(size_t func, size_t nargs, size_t& results) {
+        const VMValue& selector = argument(func, nargs, 0);
+        size_t count = nargs ? nargs - 1 : 0;
+        if (selector.isString() && selector.asString()->view() == "#") {
+            registers[func] = VMValue::Number(static_cast<double>(count));
+            results = 1;
+            return true;
+        }
+        
+        double n;
+        if (!toNumber(selector, n) || n == 0) return fail("bad argument #1 to 'select' (index out of range)");
+        if (n < 0) n += static_cast<double>(count) + 1;
+        if (n < 1) return fail("bad argument #1 to 'select' (index out of range)");
+        
+        size_t start = n > static_cast<double>(count) ? count : static_cast<size_t>(n) - 1;
+        results = count - start;
+        for (size_t i = 0; i < results; i++) registers[func + i] = registers[func + 2 + start + i];
+        return true;
+    }
+    
+    bool libraryNext(size_t func, size_t nargs, size_t& results) {
+        const VMValue& object = argument(func, nargs, 0);
+        VMTable* table = object.table();
+        if (!table) return fail(std::string("bad argument #1 to 'next' (table expected, got ") + typeName(object) + ")");
+        
+        VMValue key, value;
+        if (!table->next(argument(func, nargs, 1), key, value)) return fail("invalid key to 'next'");
+        
+        ensureRegisters(func + 2);
+        bool done = key.isNil();
+        registers[func] = key;
+        registers[func + 1] = value;
+        results = done ? 1 : 2;
+        return true;
+    }
+    
+    bool libraryPairs(size_t func, size_t nargs, size_t& results) {
+        const VMValue& object = argument(func, nargs, 0);
+        if (!object.table()) return fail(std::string("bad argument #1 to 'pairs' (table expected, got ") + typeName(object) + ")");
+        
+        ensureRegisters(func + 3);
+        registers[func] = nextFunction;
+        registers[func + 2] = VMValue::Nil();
+        results = 3;
+        return true;
+    }
+    
+    bool libraryIpairs(size_t func, size_t nargs, size_t& results) {
+        const VMValue& object = argument(func, nargs, 0);
+        if (!object.table()) return fail(std::string("bad argument #1 to 'ipairs' (table expected, got ") + typeName(object) + ")");
+        
+        ensureRegisters(func + 3);
+        registers[func] = inextFunction;
+        registers[func + 2] = VMValue::Number(0);
+        results = 3;
+        return true;
+    }
+    
+    bool libraryInext(size_t func, size_t nargs, size_t& results) {
+        const VMValue& object = argument(func, nargs, 0);
+        const VMValue& control = argument(func, nargs, 1);
+        VMTable* table = object.table();
+        if (!table || !control.isNumber()) return fail("bad arguments to ipairs iterator");
+        
+        // Only an index ipairs could have produced converts safely; this
+        // also turns away NaN
+        double n = control.asNumber();
+        if (!(n >= 0 && n < 9007199254740992.0 && std::floor(n) == n)) return fail("bad arguments to ipairs iterator");
+        
+        size_t index = static_cast<size_t>(n) + 1;
+        VMValue value = table->getInt(index);
+        if (value.isNil()) {
+            registers[func] = VMValue::Nil();
+            results = 1;
+            return true;
+        }
+        
+        registers[func] = VMValue::Number(static_cast<double>(index));
+        registers[func + 1] = value;
+        results = 2;
+        return true;
+    }
+    
+    static constexpr LibraryFunction LIBRARY[] = {
+        {"unpack", true, &VMState::libraryUnpack},
+        {"select", true, &VMState::librarySelect},
+        {"next", true, &VMState::libraryNext},
+        {"pairs", true, &VMState::libraryPairs},
+        {"ipairs", true, &VMState::libraryIpairs},
+        {"inext", false, &VMState::libraryInext},
+    };
+    
+    // ==================== DISPATCH LOOP ====================
+    // Runs one frame; RETURN moves its results down to base - 1
+    bool run(VMClosure* function, size_t base, size_t& results) {
+        using namespace Bytecode;
+        
+        const VMClosure& closure = *function;
+        const VMProto& proto = *closure.proto;
+        const VMValue* K = closure.program->constants.data();
+        const uint32_t* pc = proto.code.data();
+        VMValue* R = registers.data() + base;
+        size_t top = base;      // End of the last multret CALL's results
+        uint32_t insn;
+
+#if TSUNAMI_VM_COMPUTED_GOTO
+        static const void* const dispatch[] = {
+            &&op_NOP, &&op_LOADNIL, &&op_LOADB, &&op_LOADN, &&op_LOADK, &&op_MOVE,
+            &&op_GETGLOBAL, &&op_SETGLOBAL, &&op_GETUPVAL, &&op_SETUPVAL, &&op_CLOSEUPVALS,
+            &&op_GETIMPORT, &&op_GETTABLE, &&op_SETTABLE, &&op_GETTABLKS, &&op_SETTABLKS,
+            &&op_NAMECALL, &&op_CALL, &&op_RETURN, &&op_JUMP, &&op_JUMPBACK, &&op_JUMPIF,
+            &&op_JUMPIFNOT, &&op_JUMPIFEQ, &&op_JUMPIFLE, &&op_JUMPIFLT, &&op_JUMPIFNOTEQ,
+            &&op_JUMPIFNOTLE, &&op_JUMPIFNOTLT, &&op_ADD, &&op_SUB, &&op_MUL, &&op_DIV,
+            &&op_MOD, &&op_POW, &&op_ADDK, &&op_SUBK, &&op_MULK, &&op_DIVK, &&op_MODK,
+            &&op_POWK, &&op_CONCAT, &&op_NOT, &&op_MINUS, &&op_LENGTH, &&op_NEWTABLE,
+            &&op_DUPTABLE, &&op_SETLIST, &&op_FORNPREP, &&op_FORNLOOP, &&op_FORGLOOP,
+            &&op_FORGPREP_INEXT, &&op_FORGPREP_NEXT, &&op_AND, &&op_ANDK, &&op_OR, &&op_ORK,
+            &&op_COVERAGE, &&op_GETTABLEN, &&op_SETTABLEN, &&op_FASTCALL, &&op_FASTCALL1,
+            &&op_FASTCALL2, &&op_FASTCALL2K, &&op_FASTCALL3, &&op_FORGPREP, &&op_JUMPIFEQK,
+            &&op_JUMPIFNOTEQK, &&op_LOADKX, &&op_FASTCALL2M, &&op_CAPTURE, &&op_JUMPX,
+            &&op_FASTCALLM, &&op_NEWCLOSURE,
+        };
+        static_assert(sizeof(dispatch) / sizeof(dispatch[0]) == LOP__COUNT, "dispatch table out of sync with LuauOpcode");
+
+#define VM_CASE(name) op_##name
+#define VM_NEXT() do { insn = *pc++; goto *dispatch[insn & 0xFF]; } while (0)
+        VM_NEXT();
+#else
+#define VM_CASE(name) case LOP_##name
+#define VM_NEXT() goto dispatch
+    dispatch:
+        insn = *pc++;
+        switch (insn & 0xFF) {
+#endif
+
+// Number fast path inline, coercion and errors out of line
+#define VM_ARITH(name, rhs, operation) \
+        VM_CASE(name): { \
+            const VMValue& lhsValue = R[insnB(insn)]; \
+            const VMValue& rhsValue = rhs; \
+            if (lhsValue.isNumber() && rhsValue.isNumber()) { \
+                double x = lhsValue.asNumber(); \
+                double y = rhsValue.asNumber(); \
+                R[insnA(insn)] = VMValue::Number(operation); \
+            } else if (!arithmetic(LOP_##name, R[insnA(insn)], lhsValue, rhsValue)) { \
+                return false; \
+            } \
+            VM_NEXT(); \
+        }
+        
+        VM_CASE(NOP):
+        VM_CASE(COVERAGE):
+            VM_NEXT();
+        
+        VM_CASE(LOADNIL):
+            R[insnA(insn)] = VMValue::Nil();
+            VM_NEXT();
+        
+        VM_CASE(LOADB):
+            R[insnA(insn)] = VMValue::Boolean(insnB(insn) != 0);
+            pc += insnC(insn);
+            VM_NEXT();
+        
+        VM_CASE(LOADN):
+            R[insnA(insn)] = VMValue::Number(insnD(insn));
+            VM_NEXT();
+        
+        VM_CASE(LOADK):
+            R[insnA(insn)] = K[insnD(insn)];
+            VM_NEXT();
+        
+        VM_CASE(LOADKX):
+            R[insnA(insn)] = K[*pc++];
+            VM_NEXT();
+        
+        VM_CASE(MOVE):
+            R[insnA(insn)] = R[insnB(insn)];
+            VM_NEXT();
+        
+        VM_CASE(GETGLOBAL): {
+            VMGlobalCache& cache = proto.globalCaches[*pc++];
+            VMValue value = cache.version == globalsVersion ? *cache.value : readGlobal(cache, K);
+            R[insnA(insn)] = value;
+            VM_NEXT();
+        }
+        
+        VM_CASE(SETGLOBAL): {
+            VMGlobalCache& cache = proto.globalCaches[*pc++];
+            if (cache.version == globalsVersion) *cache.value = R[insnA(insn)];
+            else writeGlobal(cache, K, R[insnA(insn)]);
+            VM_NEXT();
+        }
+        
+        VM_CASE(GETUPVAL): {
+            const VMUpvalue& upvalue = *closure.upvalues[insnB(insn)];
+            R[insnA(insn)] = upvalue.open ? registers[upvalue.index] : upvalue.closed;
+            VM_NEXT();
+        }
+        
+        VM_CASE(SETUPVAL): {
+            VMUpvalue& upvalue = *closure.upvalues[insnB(insn)];
+            if (upvalue.open) registers[upvalue.index] = R[insnA(insn)];
+            else upvalue.closed = R[insnA(insn)];
+            VM_NEXT();
+        }
+        
+        VM_CASE(CLOSEUPVALS):
+            closeUpvalues(base + insnA(insn));
+            VM_NEXT();
+        
+        VM_CASE(GETIMPORT): {
+            // Up to three 10-bit constant indices, count in the top two bits
+            uint32_t id = *pc++;
+            uint32_t count = id >> 30;
+            VMValue value = getGlobal(K[(id >> 20) & 1023].asString());
+            for (uint32_t k = 1; k < count; k++) {
+                if (!getTable(value, K[(id >> (20 - k * 10)) & 1023], value)) return false;
+            }
+            R[insnA(insn)] = value;
+            VM_NEXT();
+        }
+        
+        VM_CASE(GETTABLE):
+            if (!getTable(R[insnB(insn)], R[insnC(insn)], R[insnA(insn)])) return false;
+            VM_NEXT();
+        
+        VM_CASE(SETTABLE):
+            if (!setTable(R[insnB(insn)], R[insnC(insn)], R[insnA(insn)])) return false;
+            VM_NEXT();
+        
+        VM_CASE(GETTABLKS):
+            if (!getTable(R[insnB(insn)], K[*pc++], R[insnA(insn)])) return false;
+            VM_NEXT();
+        
+        VM_CASE(SETTABLKS):
+            if (!setTable(R[insnB(insn)], K[*pc++], R[insnA(insn)])) return false;
+            VM_NEXT();
+        
+        VM_CASE(GETTABLEN): {
+            const VMValue& object = R[insnB(insn)];
+            VMTable* table = object.table();
+            if (!table) return fail(std::string("attempt to index a ") + typeName(object) + " value");
+            VMValue value = table->getInt(insnC(insn) + 1);
+            R[insnA(insn)] = value;
+            VM_NEXT();
+        }
+        
+        VM_CASE(SETTABLEN): {
+            const VMValue& object = R[insnB(insn)];
+            VMTable* table = object.table();
+            if (!table) return fail(std::string("attempt to index a ") + typeName(object) + " value");
+            table->setInt(insnC(insn) + 1, R[insnA(insn)]);
+            VM_NEXT();
+        }
+        
+        VM_CASE(NAMECALL): {
+            // R(A) = R(B)[K], R(A+1) = R(B)
+            uint32_t a = insnA(insn);
+            VMValue object = R[insnB(insn)];
+            if (!getTable(object, K[*pc++], R[a])) return false;
+            R[a + 1] = object;
+            VM_NEXT();
+        }
+        
+        VM_CASE(CALL): {
+            // B = args + 1, C = results + 1, 0 means up to / set top
+            size_t func = base + insnA(insn);
+            uint32_t b = insnB(insn);
+            uint32_t c = insnC(insn);
+            size_t nargs = b ? b - 1 : multret(top, func + 1);
+            
+            size_t count;
+            if (!callAt(func, nargs, count)) return false;
+            R = registers.data() + base;
+            
+            if (c) {
+                for (size_t i = count; i < c - 1; i++) registers[func + i] = VMValue::Nil();
+            } else {
+                top = func + count;
+            }
+            VM_NEXT();
+        }
+        
+        VM_CASE(RETURN): {
+            size_t first = base + insnA(insn);
+            uint32_t b = insnB(insn);
+            size_t count = b ? b - 1 : multret(top, first);
+            
+            closeUpvalues(base);
+            for (size_t i = 0; i < count; i++) registers[base - 1 + i] = registers[first + i];
+            results = count;
+            return true;
+        }
+        
+        VM_CASE(JUMP):
+        VM_CASE(JUMPBACK):
+        VM_CASE(FORGPREP):
+        VM_CASE(FORGPREP_INEXT):
+        VM_CASE(FORGPREP_NEXT):
+            pc += insnD(insn);
+            VM_NEXT();
+        
+        VM_CASE(JUMPX):
+            pc += insnE(insn);
+            VM_NEXT();
+        
+        VM_CASE(JUMPIF):
+            if (R[insnA(insn)].truthy()) pc += insnD(insn);
+            VM_NEXT();
+        
+        VM_CASE(JUMPIFNOT):
+            if (!R[insnA(insn)].truthy()) pc += insnD(insn);
+            VM_NEXT();
+        
+        // Compare-and-jump: offsets count from the AUX word
+        VM_CASE(JUMPIFEQ):
+            pc += rawEquals(R[insnA(insn)], R[*pc]) ? insnD(insn) : 1;
+            VM_NEXT();
+        
+        VM_CASE(JUMPIFNOTEQ):
+            pc += rawEquals(R[insnA(insn)], R[*pc]) ? 1 : insnD(insn);
+            VM_NEXT();
+        
+        VM_CASE(JUMPIFEQK):
+            pc += rawEquals(R[insnA(insn)], K[*pc & 0xFFFFFF]) ? insnD(insn) : 1;
+            VM_NEXT();
+        
+        VM_CASE(JUMPIFNOTEQK):
+            pc += rawEquals(R[insnA(insn)], K[*pc & 0xFFFFFF]) ? 1 : insnD(insn);
+            VM_NEXT();
+        
+        VM_CASE(JUMPIFLE): {
+            bool result;
+            if (!lessEqual(R[insnA(insn)], R[*pc], result)) return false;
+            pc += result ? insnD(insn) : 1;
+            VM_NEXT();
+        }
+        
+        VM_CASE(JUMPIFNOTLE): {
+            bool result;
+            if (!lessEqual(R[insnA(insn)], R[*pc], result)) return false;
+            pc += result ? 1 : insnD(insn);
+            VM_NEXT();
+        }
+        
+        VM_CASE(JUMPIFLT): {
+            bool result;
+            if (!lessThan(R[insnA(insn)], R[*pc], result)) return false;
+            pc += result ? insnD(insn) : 1;
+            VM_NEXT();
+        }
+        
+        VM_CASE(JUMPIFNOTLT): {
+            bool result;
+            if (!lessThan(R[insnA(insn)], R[*pc], result)) return false;
+            pc += result ? 1 : insnD(insn);
+            VM_NEXT();
+        }
+        
+        VM_ARITH(ADD, R[insnC(insn)], x + y)
+        VM_ARITH(SUB, R[insnC(insn)], x - y)
+        VM_ARITH(MUL, R[insnC(insn)], x * y)
+        VM_ARITH(DIV, R[insnC(insn)], x / y)
+        VM_ARITH(MOD, R[insnC(insn)], x - std::floor(x / y) * y)
+        VM_ARITH(POW, R[insnC(insn)], std::pow(x, y))
+        VM_ARITH(ADDK, K[insnC(insn)], x + y)
+        VM_ARITH(SUBK, K[insnC(insn)], x - y)
+        VM_ARITH(MULK, K[insnC(insn)], x * y)
+        VM_ARITH(DIVK, K[insnC(insn)], x / y)
+        VM_ARITH(MODK, K[insnC(insn)], x - std::floor(x / y) * y)
+        VM_ARITH(POWK, K[insnC(insn)], std::pow(x, y))
+        
+        VM_CASE(AND): {
+            const VMValue& lhs = R[insnB(insn)];
+            R[insnA(insn)] = lhs.truthy() ? R[insnC(insn)] : lhs;
+            VM_NEXT();
+        }
+        
+        VM_CASE(ANDK): {
+            const VMValue& lhs = R[insnB(insn)];
+            R[insnA(insn)] = lhs.truthy() ? K[insnC(insn)] : lhs;
+            VM_NEXT();
+        }
+        
+        VM_CASE(OR): {
+            const VMValue& lhs = R[insnB(insn)];
+            R[insnA(insn)] = lhs.truthy() ? lhs : R[insnC(insn)];
+            VM_NEXT();
+        }
+        
+        VM_CASE(ORK): {
+            const VMValue& lhs = R[insnB(insn)];
+            R[insnA(insn)] = lhs.truthy() ? lhs : K[insnC(insn)];
+            VM_NEXT();
+        }
+        
+        VM_CASE(CONCAT):
+            if (!concat(R + insnB(insn), insnC(insn) - insnB(insn) + 1, R[insnA(insn)])) return false;
+            checkGarbage();
+            VM_NEXT();
+        
+        VM_CASE(NOT):
+            R[insnA(insn)] = VMValue::Boolean(!R[insnB(insn)].truthy());
+            VM_NEXT();
+        
+        VM_CASE(MINUS): {
+            const VMValue& operand = R[insnB(insn)];
+            double n;
+            if (!toNumber(operand, n)) return fail(std::string("attempt to perform arithmetic on a ") + typeName(operand) + " value");
+            R[insnA(insn)] = VMValue::Number(-n);
+            VM_NEXT();
+        }
+        
+        VM_CASE(LENGTH): {
+            const VMValue& operand = R[insnB(insn)];
+            if (operand.isString()) R[insnA(insn)] = VMValue::Number(operand.asString()->length);
+            else if (VMTable* table = operand.table()) R[insnA(insn)] = VMValue::Number(static_cast<double>(table->length()));
+            else return fail(std::string("attempt to get length of a ") + typeName(operand) + " value");
+            VM_NEXT();
+        }
+        
+        VM_CASE(NEWTABLE): {
+            // B = encoded hash size, AUX = array size; both only size hints
+            uint32_t b = std::min<uint32_t>(insnB(insn), MAX_SIZE_HINT_LOG2 + 1);
+            uint32_t arraySize = std::min<uint32_t>(*pc++, 1u << MAX_SIZE_HINT_LOG2);
+            R[insnA(insn)] = newTable(arraySize, b ? size_t(1) << (b - 1) : 0);
+            checkGarbage();
+            VM_NEXT();
+        }
+        
+        VM_CASE(DUPTABLE): {
+            const VMValue& shape = K[insnD(insn)];
+            double keys = shape.isNumber() ? shape.asNumber() : 0;
+            R[insnA(insn)] = newTable(0, keys < (1u << MAX_SIZE_HINT_LOG2) ? static_cast<size_t>(keys) : 0);
+            checkGarbage();
+            VM_NEXT();
+        }
+        
+        VM_CASE(SETLIST): {
+            // Values R(B)..R(B+C-2), C = 0 means up to top; AUX = first index
+            VMTable* table = R[insnA(insn)].table();
+            if (!table) return fail("SETLIST target is not a table");
+            uint32_t b = insnB(insn);
+            uint32_t c = insnC(insn);
+            size_t count = c ? c - 1 : multret(top, base + b);
+            size_t index = *pc++;
+            if (index == table->array.size() + 1) table->reserveArray(index - 1 + count);
+            for (size_t i = 0; i < count; i++) table->setInt(index + i, R[b + i]);
+            VM_NEXT();
+        }
+        
+        VM_CASE(FORNPREP): {
+            // Limit, step and index in A..A+2; skip the loop if it runs zero times
+            const VMValue* loop = R + insnA(insn);
+            if (!loop[0].isNumber()) return fail("'for' limit must be a number");
+            if (!loop[1].isNumber()) return fail("'for' step must be a number");
+            if (!loop[2].isNumber()) return fail("'for' initial value must be a number");
+            double limit = loop[0].asNumber();
+            double step = loop[1].asNumber();
+            double index = loop[2].asNumber();
+            if (!(step > 0 ? index <= limit : limit <= index)) pc += insnD(insn);
+            VM_NEXT();
+        }
+        
+        VM_CASE(FORNLOOP): {
+            VMValue* loop = R + insnA(insn);
+            double limit = loop[0].asNumber();
+            double step = loop[1].asNumber();
+            double index = loop[2].asNumber() + step;
+            if (step > 0 ? index <= limit : limit <= index) {
+                loop[2] = VMValue::Number(index);
+                pc += insnD(insn);
+            }
+            VM_NEXT();
+        }
+        
+        VM_CASE(FORGLOOP): {
+            // Generator, state and control in A..A+2, variables from A+3;
+            // AUX low byte = variable count
+            uint32_t a = insnA(insn);
+            uint32_t vars = *pc & 0xFF;
+            
+            if (VMTable* table = R[a].table()) {
+                // Iterating a table directly walks it like next
+                VMValue key, value;
+                if (!table->next(R[a + 2], key, value)) return fail("invalid key to 'next'");
+                if (key.isNil()) {
+                    pc++;
+                    VM_NEXT();
+                }
+                R[a + 2] = key;
+                R[a + 3] = key;
+                if (vars > 1) R[a + 4] = value;
+                for (uint32_t i = 2; i < vars; i++) R[a + 3 + i] = VMValue::Nil();
+                pc += insnD(insn);
+                VM_NEXT();
+            }
+            
+            size_t func = base + a + 3;
+            ensureRegisters(func + 3);
+            R = registers.data() + base;
+            R[a + 3] = R[a];
+            R[a + 4] = R[a + 1];
+            R[a + 5] = R[a + 2];
+            
+            size_t count;
+            if (!callAt(func, 2, count)) return false;
+            R = registers.data() + base;
+            for (size_t i = count; i < vars; i++) R[a + 3 + i] = VMValue::Nil();
+            
+            if (R[a + 3].isNil()) {
+                pc++;
+            } else {
+                R[a + 2] = R[a + 3];
+                pc += insnD(insn);
+            }
+            VM_NEXT();
+        }
+        
+        // The fallback CALL that follows always handles the call
+        VM_CASE(FASTCALL):
+        VM_CASE(FASTCALL1):
+        VM_CASE(FASTCALL2):
+        VM_CASE(FASTCALL2K):
+        VM_CASE(FASTCALL3):
+        VM_CASE(FASTCALLM):
+        VM_CASE(FASTCALL2M):
+            pc += instructionLength(insn & 0xFF) - 1;
+            VM_NEXT();
+        
+        VM_CASE(NEWCLOSURE): {
+            const VMProto* child = &closure.program->protos[proto.children[insnD(insn)]];
+            VMClosure* created = heap.newClosure(closure.program, child);
+            
+            // Stored first, so a local function capturing itself by value sees the closure
+            R[insnA(insn)] = VMValue::Function(created);
+            
+            // One CAPTURE per upvalue: A = 0 value, 1 reference, 2 upvalue
+            for (VMUpvalue*& upvalue : created->upvalues) {
+                uint32_t capture = *pc;
+                if ((capture & 0xFF) != LOP_CAPTURE) return fail("NEWCLOSURE is missing a CAPTURE");
+                pc++;
+                
+                uint32_t source = insnB(capture);
+                switch (insnA(capture)) {
+                    case 0:
+                        upvalue = heap.newUpvalue();
+                        upvalue->closed = R[source];
+                        break;
+                    case 1:
+                        upvalue = captureRegister(base + source);
+                        break;
+                    default:
+                        upvalue = closure.upvalues[source];
+                        break;
+                }
+            }
+            
+            checkGarbage();
+            VM_NEXT();
+        }
+        
+        VM_CASE(CAPTURE):
+            return fail("CAPTURE outside NEWCLOSURE");
+
+#if !TSUNAMI_VM_COMPUTED_GOTO
+        default:
+            return fail("unknown opcode");
+        }
+#endif
+
+#undef VM_ARITH
+#undef VM_NEXT
+#undef VM_CASE
+    }
+};
+
+inline VMValue VMNativeCall::arg(size_t i) const {
+    return i < nargs ? vm.registers[slot + 1 + i] : VMValue::Nil();
+}
+
+inline void VMNativeCall::setResult(size_t i, VMValue value) {
+    vm.ensureRegisters(slot + i + 1);
+    vm.registers[slot + i] = value;
+}
+
+inline int VMNativeCall::error(std::string message) {
+    vm.fail(std::move(message));
+    return -1;
+}
+
+} // namespace tsunami
+
+#endif // TSUNAMI_STATE_HPP
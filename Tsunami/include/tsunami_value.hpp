@@ -0,0 +1,738 @@
+#ifndef TSUNAMI_VALUE_HPP
+#define TSUNAMI_VALUE_HPP
+
+#include "BytecodeWriter.h"
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace tsunami {
+
+struct VMString;
+struct VMTable;
+struct VMClosure;
+class VMNativeCall;
+
+// Host function called without allocating; see VMNativeCall in tsunami_state.hpp
+using VMNativeFunction = int (*)(VMNativeCall& call, void* context);
+
+// ==================== HEAP OBJECTS ====================
+// Header shared by everything a VMHeap allocates; see VMHeap below
+struct VMObject {
+    enum Kind : uint8_t {
+        STRING,
+        TABLE,
+        CLOSURE,
+        PROGRAM,
+        UPVALUE
+    };
+    
+    VMObject* nextObject = nullptr;  // Every object of one heap, newest first
+    Kind kind;
+    bool marked = false;
+    
+    explicit VMObject(Kind k) : kind(k) {}
+};
+
+// ==================== VM VALUE TYPE ====================
+// One NaN-boxed word. Numbers are stored as their own bits, every NaN
+// folded into one canonical quiet NaN. All other types sit in the space of
+// negative quiet NaNs above it: a 3-bit tag at bits 48-50 and a 48-bit
+// payload, which is a pointer or 0/1 for booleans. User-space pointers on
+// x86-64 and arm64 fit in 48 bits.
+//
+// Values are trivially copyable and own nothing. Strings, tables and
+// closures belong to the VMHeap that created them and live as long as that
+// heap can reach them.
+class VMValue {
+public:
+    enum Type {
+        NIL,
+        BOOLEAN,
+        NUMBER,
+        STRING,
+        FUNCTION,
+        TABLE,
+        USERDATA,
+        LIGHTUSERDATA
+    };
+    
+    VMValue() : bits(boxed(NIL, 0)) {}
+    
+    static VMValue Nil() {
+        return VMValue();
+    }
+    
+    static VMValue Boolean(bool b) {
+        return fromBits(boxed(BOOLEAN, b ? 1 : 0));
+    }
+    
+    static VMValue Number(double n) {
+        uint64_t raw = CANONICAL_NAN;
+        if (n == n) std::memcpy(&raw, &n, sizeof(raw));
+        return fromBits(raw);
+    }
+    
+    static VMValue LightUserData(void* p) {
+        return fromBits(boxed(LIGHTUSERDATA, reinterpret_cast<uintptr_t>(p)));
+    }
+    
+    static VMValue String(const VMString* s);
+    static VMValue Function(const VMClosure* closure);
+    static VMValue Table(const VMTable* table);
+    
+    Type type() const {
+        if (isNumber()) return NUMBER;
+        uint32_t tag = static_cast<uint32_t>(bits >> 48) & 7;
+        return static_cast<Type>(tag <= 2 ? tag - 1 : tag);
+    }
+    
+    bool is(Type t) const {
+        return t == NUMBER ? isNumber() : (bits >> 48) == (BOX >> 48 | tagOf(t));
+    }
+    
+    bool isNil() const { return bits == boxed(NIL, 0); }
+    bool isNumber() const { return bits < boxed(NIL, 0); }
+    bool isString() const { return is(STRING); }
+    
+    bool asBoolean() const { return (bits & PAYLOAD) != 0; }
+    
+    double asNumber() const {
+        double n;
+        std::memcpy(&n, &bits, sizeof(n));
+        return n;
+    }
+    
+    void* asPointer() const { return reinterpret_cast<void*>(static_cast<uintptr_t>(bits & PAYLOAD)); }
+    
+    VMString* asString() const;
+    
+    // Null unless the value holds one
+    VMTable* table() const;
+    VMClosure* closure() const;
+    VMObject* object() const {
+        Type t = type();
+        return t == STRING || t == FUNCTION || t == TABLE ? static_cast<VMObject*>(asPointer()) : nullptr;
+    }
+    
+    bool truthy() const {
+        return bits != boxed(NIL, 0) && bits != boxed(BOOLEAN, 0);
+    }
+    
+    uint64_t raw() const { return bits; }
+    
+private:
+    static constexpr uint64_t BOX = 0xFFF8000000000000ull;
+    static constexpr uint64_t PAYLOAD = 0x0000FFFFFFFFFFFFull;
+    static constexpr uint64_t CANONICAL_NAN = 0x7FF8000000000000ull;
+    
+    // NIL and BOOLEAN take tags 1 and 2; NUMBER needs none, so the rest keep
+    // their enum value
+    static constexpr uint64_t tagOf(Type t) { return t < NUMBER ? t + 1 : t; }
+    static constexpr uint64_t boxed(Type t, uint64_t payload) { return BOX | tagOf(t) << 48 | (payload & PAYLOAD); }
+    
+    static VMValue fromBits(uint64_t raw) {
+        VMValue v;
+        v.bits = raw;
+        return v;
+    }
+    
+    static VMValue fromObject(Type t, const VMObject* object) {
+        return fromBits(boxed(t, reinterpret_cast<uintptr_t>(object)));
+    }
+    
+    uint64_t bits;
+};
+
+static_assert(sizeof(VMValue) == 8, "VMValue must stay one word");
+static_assert(std::is_trivially_copyable<VMValue>::value, "VMValue must stay trivially copyable");
+static_assert(sizeof(void*) <= sizeof(uint64_t), "pointers must fit the NaN-box payload");
+
+// Primitive equality, also used for table keys. Strings are interned per
+// heap, so every type but numbers compares by bits.
+inline bool rawEquals(VMValue a, VMValue b) {
+    if (a.isNumber() && b.isNumber()) return a.asNumber() == b.asNumber();
+    return a.raw() == b.raw();
+}
+
+struct VMValueHash {
+    size_t operator()(VMValue v) const {
+        // +0 and -0 are the same key
+        uint64_t bits = v.isNumber() && v.asNumber() == 0 ? 0 : v.raw();
+        bits = (bits ^ (bits >> 31)) * 0x9E3779B97F4A7C15ull;
+        return static_cast<size_t>(bits ^ (bits >> 29));
+    }
+};
+
+struct VMValueEqual {
+    bool operator()(VMValue a, VMValue b) const { return rawEquals(a, b); }
+};
+
+// ==================== VM STRING ====================
+// Immutable and interned; the bytes follow the header and are
+// NUL-terminated. The hash is computed once, when the text is interned.
+struct VMString : VMObject {
+    uint32_t length;
+    uint32_t hash;
+    VMString* nextInBucket = nullptr;
+    
+    VMString(uint32_t n, uint32_t h) : VMObject(STRING), length(n), hash(h) {}
+    
+    const char* data() const { return reinterpret_cast<const char*>(this + 1); }
+    std::string_view view() const { return std::string_view(data(), length); }
+};
+
+// Keys maps by string handle: the stored hash, then a pointer compare
+struct VMStringHash {
+    size_t operator()(const VMString* s) const { return s->hash; }
+};
+
+struct VMInternStats {
+    size_t strings = 0;         // Distinct strings held
+    size_t buckets = 0;
+    size_t bytes = 0;           // Held by those strings, headers included
+    uint64_t lookups = 0;       // Texts interned
+    uint64_t hits = 0;          // Lookups answered by an existing string
+    uint64_t bytesSaved = 0;    // What the hits would have allocated as copies
+    
+    double occupancy() const { return buckets ? static_cast<double>(strings) / buckets : 0; }
+};
+
+// ==================== VM TABLE ====================
+// Keys 1..n live in the array part, everything else in the hash part.
+// Clearing a hash key leaves a nil entry behind so next() can still step
+// past it during a traversal. Those entries are dropped before the hash
+// part would grow (adding keys mid-traversal is undefined anyway), and by
+// a collection once nothing else can reach their key.
+struct VMTable : VMObject {
+    std::vector<VMValue> array;
+    std::unordered_map<VMValue, VMValue, VMValueHash, VMValueEqual> hash;
+    size_t deadKeys = 0;            // Nil entries in hash
+    size_t* charge = nullptr;       // Owning heap's byte count, which growth adds to
+    
+    // What one hash entry costs beyond its bucket
+    static constexpr size_t HASH_NODE_SIZE = 2 * sizeof(VMValue) + 2 * sizeof(void*);
+    
+    VMTable() : VMObject(TABLE) {}
+    
+    static const VMValue& nil() {
+        static const VMValue value;
+        return value;
+    }
+    
+    static bool arrayIndex(VMValue key, size_t& index) {
+        if (!key.isNumber()) return false;
+        double n = key.asNumber();
+        if (!(n >= 1 && n <= 4294967295.0) || n != std::floor(n)) return false;
+        index = static_cast<size_t>(n);
+        return true;
+    }
+    
+    const VMValue& getInt(size_t index) const {
+        if (index - 1 < array.size()) return array[index - 1];
+        if (hash.empty()) return nil();
+        return get(VMValue::Number(static_cast<double>(index)));
+    }
+    
+    const VMValue& get(VMValue key) const {
+        size_t index;
+        if (arrayIndex(key, index) && index <= array.size()) return array[index - 1];
+        auto it = hash.find(key);
+        return it == hash.end() ? nil() : it->second;
+    }
+    
+    // Key must be neither nil nor NaN
+    void set(VMValue key, VMValue value) {
+        size_t index;
+        if (arrayIndex(key, index)) {
+            setInt(index, value);
+            return;
+        }
+        setHash(key, value);
+    }
+    
+    void setInt(size_t index, VMValue value) {
+        if (index - 1 < array.size()) {
+            array[index - 1] = value;
+            return;
+        }
+        if (index == array.size() + 1 && !value.isNil()) {
+            append(value);
+            migrate();
+            return;
+        }
+        setHash(VMValue::Number(static_cast<double>(index)), value);
+    }
+    
+    void reserveArray(size_t size) {
+        size_t capacity = array.capacity();
+        array.reserve(size);
+        grew((array.capacity() - capacity) * sizeof(VMValue));
+    }
+    
+    // Erases the nil entries keep(key) rejects; all of them by default
+    template<typename Keep>
+    void purgeDeadKeys(Keep&& keep) {
+        for (auto it = hash.begin(); deadKeys && it != hash.end();) {
+            if (it->second.isNil() && !keep(it->first)) {
+                it = hash.erase(it);
+                deadKeys--;
+            } else {
+                ++it;
+            }
+        }
+    }
+    
+    // Border of the array part
+    size_t length() const {
+        size_t n = array.size();
+        while (n > 0 && array[n - 1].isNil()) n--;
+        return n;
+    }
+    
+    // One traversal step: array part in order, then the hash part. False
+    // when key is not in the table; nextKey is nil once the traversal ends.
+    bool next(VMValue key, VMValue& nextKey, VMValue& nextValue) const {
+        size_t index = 0;
+        auto it = hash.begin();
+        if (!key.isNil()) {
+            size_t at;
+            if (arrayIndex(key, at) && at <= array.size()) {
+                index = at;
+            } else {
+                it = hash.find(key);
+                if (it == hash.end()) return false;
+                ++it;
+                index = array.size();
+            }
+        }
+        for (; index < array.size(); index++) {
+            if (!array[index].isNil()) {
+                nextKey = VMValue::Number(static_cast<double>(index + 1));
+                nextValue = array[index];
+                return true;
+            }
+        }
+        for (; it != hash.end(); ++it) {
+            if (!it->second.isNil()) {
+                nextKey = it->first;
+                nextValue = it->second;
+                return true;
+            }
+        }
+        nextKey = VMValue::Nil();
+        return true;
+    }
+    
+private:
+    void setHash(VMValue key, VMValue value) {
+        if (value.isNil()) {
+            auto it = hash.find(key);
+            if (it != hash.end() && !it->second.isNil()) {
+                it->second = value;
+                deadKeys++;
+            }
+            return;
+        }
+        
+        // Reuse the room nil entries hold before growing past them
+        if (deadKeys && hash.size() + 1 > hash.bucket_count() * hash.max_load_factor()) {
+            purgeDeadKeys([](VMValue) { return false; });
+        }
+        
+        size_t buckets = hash.bucket_count();
+        auto result = hash.try_emplace(key, value);
+        if (result.second) {
+            grew(HASH_NODE_SIZE + (hash.bucket_count() - buckets) * sizeof(void*));
+        } else {
+            if (result.first->second.isNil()) deadKeys--;
+            result.first->second = value;
+        }
+    }
+    
+    void append(VMValue value) {
+        size_t capacity = array.capacity();
+        array.push_back(value);
+        if (array.capacity() != capacity) grew((array.capacity() - capacity) * sizeof(VMValue));
+    }
+    
+    void grew(size_t bytes) {
+        if (charge) *charge += bytes;
+    }
+    
+    // Moves keys that now continue the array out of the hash part
+    void migrate() {
+        while (!hash.empty()) {
+            auto it = hash.find(VMValue::Number(static_cast<double>(array.size() + 1)));
+            if (it == hash.end() || it->second.isNil()) return;
+            append(it->second);
+            hash.erase(it);
+        }
+    }
+};
+
+// ==================== LOADED BYTECODE ====================
+// Inline cache of one GETGLOBAL/SETGLOBAL, whose AUX word indexes it
+struct VMGlobalCache {
+    uint32_t constant = 0;      // The name's constant index
+    uint32_t version = 0;       // Valid while equal to the owning state's globals version
+    VMValue* value = nullptr;   // That global's slot
+};
+
+struct VMProto {
+    uint32_t maxStack = 0;
+    uint32_t numParams = 0;
+    uint32_t numUpvalues = 0;
+    std::vector<uint32_t> code;         // Opcode bytes decoded, AUX words as-is but for globals
+    std::vector<uint32_t> children;
+    mutable std::vector<VMGlobalCache> globalCaches;
+};
+
+struct VMProgram : VMObject {
+    std::vector<VMValue> constants;     // TABLE constants hold their key count
+    std::vector<VMProto> protos;        // Main proto last
+    
+    VMProgram() : VMObject(PROGRAM) {}
+};
+
+// Refers to a live register until its frame returns or CLOSEUPVALS
+struct VMUpvalue : VMObject {
+    size_t index = 0;
+    bool open = false;
+    VMValue closed;
+    
+    VMUpvalue() : VMObject(UPVALUE) {}
+};
+
+// A bytecode function, or a host function when proto is null
+struct VMClosure : VMObject {
+    VMProgram* program = nullptr;
+    const VMProto* proto = nullptr;
+    std::vector<VMUpvalue*> upvalues;
+    const VMString* name = nullptr;     // Host functions are called by name,
+    VMNativeFunction native = nullptr;  // or directly once registered native
+    void* context = nullptr;            // Passed to native
+    
+    VMClosure() : VMObject(CLOSURE) {}
+};
+
+inline VMValue VMValue::String(const VMString* s) {
+    return fromObject(STRING, s);
+}
+
+inline VMValue VMValue::Function(const VMClosure* closure) {
+    return fromObject(FUNCTION, closure);
+}
+
+inline VMValue VMValue::Table(const VMTable* table) {
+    return fromObject(TABLE, table);
+}
+
+inline VMString* VMValue::asString() const {
+    return static_cast<VMString*>(static_cast<VMObject*>(asPointer()));
+}
+
+inline VMTable* VMValue::table() const {
+    return is(TABLE) ? static_cast<VMTable*>(static_cast<VMObject*>(asPointer())) : nullptr;
+}
+
+inline VMClosure* VMValue::closure() const {
+    return is(FUNCTION) ? static_cast<VMClosure*>(static_cast<VMObject*>(asPointer())) : nullptr;
+}
+
+// ==================== VM HEAP ====================
+// Owns every object behind a VMValue. Strings are interned in a chained
+// table keyed by their stored hash, so equal text is one object. Collection is mark and sweep: the owner marks its roots
+// from collect(), everything reachable from them survives and the rest is
+// freed, cycles included. Nothing is collected unless collect() is called.
+class VMHeap {
+public:
+    static constexpr size_t MIN_THRESHOLD = 1 << 20;
+    static constexpr size_t MIN_BUCKETS = 64;
+    
+    VMHeap() = default;
+    
+    ~VMHeap() {
+        while (objects) {
+            VMObject* object = objects;
+            objects = object->nextObject;
+            destroy(object);
+        }
+    }
+    
+    VMHeap(const VMHeap&) = delete;
+    VMHeap& operator=(const VMHeap&) = delete;
+    
+    // Interned: the same text always returns the same string while it lives
+    VMString* newString(std::string_view text) {
+        uint32_t hash = hashString(text);
+        internStats.lookups++;
+        if (VMString* s = findString(text, hash)) {
+            internStats.hits++;
+            internStats.bytesSaved += stringSize(text.size());
+            return s;
+        }
+        
+        void* memory = ::operator new(stringSize(text.size()));
+        VMString* s = new (memory) VMString(static_cast<uint32_t>(text.size()), hash);
+        char* chars = reinterpret_cast<char*>(s + 1);
+        if (!text.empty()) std::memcpy(chars, text.data(), text.size());
+        chars[text.size()] = '\0';
+        
+        if (internStats.strings >= buckets.size()) rehash(buckets.empty() ? MIN_BUCKETS : buckets.size() * 2);
+        VMString*& bucket = buckets[hash & (buckets.size() - 1)];
+        s->nextInBucket = bucket;
+        bucket = s;
+        internStats.strings++;
+        internStats.bytes += stringSize(s->length);
+        return track(s);
+    }
+    
+    // Lookup only; null when the text is not interned
+    VMString* findString(std::string_view text) const {
+        return findString(text, hashString(text));
+    }
+    
+    VMTable* newTable(size_t arraySize = 0, size_t hashSize = 0) {
+        VMTable* table = new VMTable();
+        if (arraySize) table->array.reserve(arraySize);
+        if (hashSize) table->hash.reserve(hashSize);
+        table->charge = &allocated;
+        return track(table);
+    }
+    
+    VMClosure* newClosure(VMProgram* program, const VMProto* proto) {
+        VMClosure* closure = new VMClosure();
+        closure->program = program;
+        closure->proto = proto;
+        closure->upvalues.resize(proto->numUpvalues);
+        return track(closure);
+    }
+    
+    VMClosure* newHostFunction(const VMString* name) {
+        VMClosure* closure = new VMClosure();
+        closure->name = name;
+        return track(closure);
+    }
+    
+    VMProgram* newProgram() {
+        return track(new VMProgram());
+    }
+    
+    VMUpvalue* newUpvalue() {
+        return track(new VMUpvalue());
+    }
+    
+    // True once enough has been allocated since the last collection
+    bool shouldCollect() const {
+        return allocated >= threshold;
+    }
+    
+    // Objects belong to the heap, so marking a const handle is fine
+    void mark(const VMObject* handle) {
+        VMObject* object = const_cast<VMObject*>(handle);
+        if (!object || object->marked) return;
+        object->marked = true;
+        if (object->kind != VMObject::STRING) gray.push_back(object);
+    }
+    
+    void mark(VMValue value) {
+        mark(value.object());
+    }
+    
+    // markRoots(VMHeap&) marks every root; whatever they do not reach is freed
+    template<typename MarkRoots>
+    void collect(MarkRoots&& markRoots) {
+        markRoots(*this);
+        while (!gray.empty()) {
+            VMObject* object = gray.back();
+            gray.pop_back();
+            traverse(object);
+        }
+        
+        // Nil entries are kept for next() only while their key is reachable
+        for (VMTable* table : deadKeyTables) {
+            table->purgeDeadKeys([](VMValue key) {
+                const VMObject* object = key.object();
+                return !object || object->marked;
+            });
+        }
+        deadKeyTables.clear();
+        
+        size_t live = 0;
+        VMObject** link = &objects;
+        while (VMObject* object = *link) {
+            if (object->marked) {
+                object->marked = false;
+                live += objectSize(object);
+                link = &object->nextObject;
+            } else {
+                *link = object->nextObject;
+                objectCount--;
+                destroy(object);
+            }
+        }
+        
+        // Give back buckets once most strings are gone
+        size_t wanted = buckets.size();
+        while (wanted > MIN_BUCKETS && internStats.strings * 4 <= wanted) wanted /= 2;
+        if (wanted != buckets.size()) rehash(wanted);
+        
+        allocated = live;
+        threshold = live * 2 > MIN_THRESHOLD ? live * 2 : MIN_THRESHOLD;
+    }
+    
+    // Approximate bytes in use, exact as of the last collection plus
+    // allocations since
+    size_t bytes() const { return allocated; }
+    size_t count() const { return objectCount; }
+    
+    VMInternStats stringStats() const {
+        VMInternStats stats = internStats;
+        stats.buckets = buckets.size();
+        return stats;
+    }
+    
+private:
+    static uint32_t hashString(std::string_view text) {
+        return Bytecode::fnv1a(Bytecode::FNV_OFFSET_BASIS, reinterpret_cast<const uint8_t*>(text.data()), text.size());
+    }
+    
+    static size_t stringSize(size_t length) {
+        return sizeof(VMString) + length + 1;
+    }
+    
+    VMString* findString(std::string_view text, uint32_t hash) const {
+        if (buckets.empty()) return nullptr;
+        for (VMString* s = buckets[hash & (buckets.size() - 1)]; s; s = s->nextInBucket) {
+            if (s->hash == hash && s->length == text.size() &&
+                (text.empty() || std::memcmp(s->data(), text.data(), text.size()) == 0)) {
+                return s;
+            }
+        }
+        return nullptr;
+    }
+    
+    void rehash(size_t count) {
+        std::vector<VMString*> grown(count, nullptr);
+        for (VMString* s : buckets) {
+            while (s) {
+                VMString* next = s->nextInBucket;
+                VMString*& bucket = grown[s->hash & (count - 1)];
+                s->nextInBucket = bucket;
+                bucket = s;
+                s = next;
+            }
+        }
+        buckets.swap(grown);
+    }
+    
+    void unlinkString(VMString* s) {
+        VMString** link = &buckets[s->hash & (buckets.size() - 1)];
+        while (*link != s) link = &(*link)->nextInBucket;
+        *link = s->nextInBucket;
+        internStats.strings--;
+        internStats.bytes -= stringSize(s->length);
+    }
+    
+    template<typename T>
+    T* track(T* object) {
+        object->nextObject = objects;
+        objects = object;
+        objectCount++;
+        allocated += objectSize(object);
+        return object;
+    }
+    
+    static size_t objectSize(const VMObject* object) {
+        switch (object->kind) {
+            case VMObject::STRING:
+                return stringSize(static_cast<const VMString*>(object)->length);
+            case VMObject::TABLE: {
+                const VMTable* table = static_cast<const VMTable*>(object);
+                return sizeof(VMTable) + table->array.capacity() * sizeof(VMValue) +
+                       table->hash.size() * VMTable::HASH_NODE_SIZE +
+                       table->hash.bucket_count() * sizeof(void*);
+            }
+            case VMObject::CLOSURE:
+                return sizeof(VMClosure) + static_cast<const VMClosure*>(object)->upvalues.capacity() * sizeof(void*);
+            case VMObject::PROGRAM: {
+                const VMProgram* program = static_cast<const VMProgram*>(object);
+                size_t size = sizeof(VMProgram) + program->constants.size() * sizeof(VMValue);
+                for (const VMProto& proto : program->protos) {
+                    size += sizeof(VMProto) + (proto.code.size() + proto.children.size()) * sizeof(uint32_t);
+                }
+                return size;
+            }
+            default:
+                return sizeof(VMUpvalue);
+        }
+    }
+    
+    void traverse(VMObject* object) {
+        switch (object->kind) {
+            case VMObject::TABLE: {
+                VMTable* table = static_cast<VMTable*>(object);
+                for (VMValue value : table->array) mark(value);
+                for (const auto& entry : table->hash) {
+                    if (entry.second.isNil()) continue;
+                    mark(entry.first);
+                    mark(entry.second);
+                }
+                if (table->deadKeys) deadKeyTables.push_back(table);
+                break;
+            }
+            case VMObject::CLOSURE: {
+                VMClosure* closure = static_cast<VMClosure*>(object);
+                mark(closure->program);
+                mark(closure->name);
+                for (VMUpvalue* upvalue : closure->upvalues) mark(upvalue);
+                break;
+            }
+            case VMObject::PROGRAM:
+                for (VMValue constant : static_cast<VMProgram*>(object)->constants) mark(constant);
+                break;
+            case VMObject::UPVALUE:
+                mark(static_cast<VMUpvalue*>(object)->closed);
+                break;
+            default:
+                break;
+        }
+    }
+    
+    void destroy(VMObject* object) {
+        switch (object->kind) {
+            case VMObject::STRING: {
+                VMString* s = static_cast<VMString*>(object);
+                unlinkString(s);
+                s->~VMString();
+                ::operator delete(s);
+                break;
+            }
+            case VMObject::TABLE: delete static_cast<VMTable*>(object); break;
+            case VMObject::CLOSURE: delete static_cast<VMClosure*>(object); break;
+            case VMObject::PROGRAM: delete static_cast<VMProgram*>(object); break;
+            default: delete static_cast<VMUpvalue*>(object); break;
+        }
+    }
+    
+    VMObject* objects = nullptr;
+    size_t objectCount = 0;
+    size_t allocated = 0;
+    size_t threshold = MIN_THRESHOLD;
+    std::vector<VMObject*> gray;
+    std::vector<VMTable*> deadKeyTables;   // Marked tables holding nil entries
+    std::vector<VMString*> buckets;    // Power of two, chained through nextInBucket
+    VMInternStats internStats;
+};
+
+} // namespace tsunami
+
+#endif // TSUNAMI_VALUE_HPP
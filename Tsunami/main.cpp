@@ -1,9 +1,64 @@
 // main.cpp
 #include "Bytecode.h"
+#include "BytecodeBundle.h"
+#include "tsunami_state.hpp"
+#include <cstdio>
 #include <iostream>
-#include <fstream>
+
+// Instruction lines of a compiled chunk's text disassembly
+static std::string listing(const std::string& source) {
+    std::string bytecode = Bytecode::Compile(source);
+    std::string text;
+    Bytecode::StringSink sink(text);
+    Bytecode::Disassemble(reinterpret_cast<const uint8_t*>(bytecode.data()), bytecode.size(), sink);
+    
+    std::string code;
+    size_t line = 0;
+    while (line < text.size()) {
+        size_t end = text.find('\n', line);
+        if (end == std::string::npos) end = text.size();
+        if (text.compare(line, 5, "     ") == 0) code.append(text, line, end - line + 1);
+        line = end + 1;
+    }
+    return code;
+}
+
+// Everything a chunk returns when run in-process, space separated, or
+// "error: ..." if it fails
+static std::string runBytecode(tsunami::VMState& vm, const std::string& bytecode) {
+    vm.clearStack();
+    if (!vm.executeBytecode(bytecode)) return "error: " + vm.getLastError();
+    
+    std::string values;
+    while (vm.stackSize() > 0) {
+        tsunami::VMValue value = vm.pop();
+        std::string text;
+        switch (value.type()) {
+            case tsunami::VMValue::NIL: text = "nil"; break;
+            case tsunami::VMValue::BOOLEAN: text = value.asBoolean() ? "true" : "false"; break;
+            case tsunami::VMValue::NUMBER: {
+                char buffer[32];
+                std::snprintf(buffer, sizeof(buffer), "%.14g", value.asNumber());
+                text = buffer;
+                break;
+            }
+            case tsunami::VMValue::STRING: text = std::string(value.asString()->view()); break;
+            case tsunami::VMValue::TABLE: text = "table"; break;
+            case tsunami::VMValue::FUNCTION: text = "function"; break;
+            default: text = "userdata"; break;
+        }
+        values = values.empty() ? text : text + " " + values;
+    }
+    return values;
+}
+
+static std::string run(tsunami::VMState& vm, const std::string& source) {
+    return runBytecode(vm, Bytecode::Compile(source));
+}
 
 int main() {
+    bool failed = false;
+    
     std::cout << "=== Bytecode Generator Test ===\n\n";
     
     // Test 1: Basic push operations
@@ -49,21 +104,32 @@ int main() {
     Bytecode::BytecodeCache cache;
     auto cached_num = cache.getNumber(42.0);
     auto cached_str = cache.getString("cached");
-    std::cout << "Cached number size: " << cached_num.size() << " bytes\n";
-    std::cout << "Cached string size: " << cached_str.size() << " bytes\n";
+    std::cout << "Cached number size: " << cached_num->size() << " bytes\n";
+    std::cout << "Cached string size: " << cached_str->size() << " bytes\n";
     
-    // Test 7: Save to file
-    std::cout << "\n7. Saving bytecode to files...\n";
-    std::ofstream nil_file("nil.bc", std::ios::binary);
-    nil_file.write(nil_bc.data(), nil_bc.size());
-    nil_file.close();
+    // Test 7: Save to a bundle
+    std::cout << "\n7. Saving bytecode to a bundle...\n";
+    Bytecode::BundleWriter bundle;
+    bundle.add("nil", nil_bc);
+    bundle.add("string", str_bc);
+    bundle.add("nil_again", Bytecode::CreatePushNil());
+    bool saved = bundle.write("chunks.tbb");
+    if (saved) {
+        std::cout << "Saved chunks.tbb (" << bundle.size() << " names, " << bundle.blobCount() << " blobs)\n";
+    }
     
-    std::ofstream str_file("string.bc", std::ios::binary);
-    str_file.write(str_bc.data(), str_bc.size());
-    str_file.close();
+    // The two nil chunks share one blob
+    bool deduplicated = bundle.blobCount() == 2;
+    std::cout << "Identical chunks stored once: " << (deduplicated ? "OK" : "MISMATCH") << "\n";
+    failed |= !saved || !deduplicated;
     
-    std::cout << "Saved nil.bc (" << nil_bc.size() << " bytes)\n";
-    std::cout << "Saved string.bc (" << str_bc.size() << " bytes)\n";
+    Bytecode::BundleReader reader;
+    bool opened = reader.open("chunks.tbb");
+    bool found = opened && reader.find("string") == str_bc;
+    bool missing = opened && reader.find("missing").empty();
+    std::cout << "Loaded string: " << (found ? "OK" : "MISMATCH") << "\n";
+    std::cout << "Missing name: " << (missing ? "OK" : "MISMATCH") << "\n";
+    failed |= !found || !missing;
     
     // Test 8: Compiler class
     std::cout << "\n8. Using Compiler class:\n";
@@ -74,7 +140,138 @@ int main() {
     auto compiled = compiler.compile();
     std::cout << "Compiler output: " << compiled.size() << " bytes\n";
     
+    // 1000 flags live at once spill past the 256 short slots; 300 results
+    // return through unpack. Both at level 0, where nothing folds them away.
+    {
+        tsunami::VMState vm;
+        Bytecode::Compiler spilling;
+        spilling.setOptimizationLevel(0);
+        spilling.pushNumber(0);
+        spilling.pushNumber(1);
+        int sum = Bytecode::Compiler::RESULT_REGISTER_BASE;
+        std::vector<int> flags;
+        for (int i = 0; i < 1000; i++) {
+            flags.push_back(spilling.newRegister());
+            spilling.addLoadBool(flags.back(), i % 3 == 0);
+        }
+        for (int flag : flags) {
+            Bytecode::Compiler::Label skip = spilling.newLabel();
+            spilling.addJumpIfNot(flag, skip);
+            spilling.addArith(Bytecode::LOP_ADD, sum, sum, sum + 1);
+            spilling.bindLabel(skip);
+        }
+        std::string spilled = runBytecode(vm, spilling.compile());
+        std::cout << "1000 live registers: " << (spilled == "334 1" ? "OK" : "MISMATCH " + spilled) << "\n";
+        failed |= spilled != "334 1";
+        
+        Bytecode::Compiler many;
+        many.setOptimizationLevel(0);
+        std::string expected;
+        for (int i = 0; i < 300; i++) {
+            many.pushNumber(i);
+            expected += (i ? " " : "") + std::to_string(i);
+        }
+        bool returned = runBytecode(vm, many.compile()) == expected;
+        std::cout << "300 results: " << (returned ? "OK" : "MISMATCH") << "\n";
+        failed |= !returned;
+    }
+    
+    // Test 9: Multiple assignment indexes through the old value of a local
+    std::cout << "\n9. Multiple assignment order:\n";
+    struct Listing {
+        const char* source;
+        const char* code;
+    };
+    const Listing assignments[] = {
+        {"local i = 1 local a = {} i, a[i] = i + 1, 20",
+         "     0  LOADN           R0 1\n"
+         "     1  NEWTABLE        R1 0 0\n"
+         "     3  MOVE            R2 R0\n"
+         "     4  ADDK            R3 R0 K0  ; 1\n"
+         "     5  LOADN           R4 20\n"
+         "     6  MOVE            R0 R3\n"
+         "     7  SETTABLE        R4 R1 R2\n"
+         "     8  RETURN          R0 1\n"},
+        {"local t = {} t, t.x = {}, 1",
+         "     0  NEWTABLE        R0 0 0\n"
+         "     2  MOVE            R1 R0\n"
+         "     3  NEWTABLE        R2 0 0\n"
+         "     5  LOADN           R3 1\n"
+         "     6  MOVE            R0 R2\n"
+         "     7  SETTABLKS       R3 R1 0 K0  ; \"x\"\n"
+         "     9  RETURN          R0 1\n"},
+    };
+    for (const Listing& assignment : assignments) {
+        std::string code = listing(assignment.source);
+        bool ok = code == assignment.code;
+        std::cout << assignment.source << ": " << (ok ? "OK" : "MISMATCH") << "\n";
+        if (!ok) std::cout << code;
+        failed |= !ok;
+    }
+    
+    // Test 10: JSON disassembly of a cut-off chunk still parses
+    std::cout << "\n10. JSON disassembly of truncated chunks:\n";
+    std::string chunk = Bytecode::Compile(
+        "local t = {x = 1, y = \"two\"} "
+        "local function f(n) return math.floor(n) + t.x end "
+        "return f(2.5), true");
+    size_t malformed = 0;
+    for (size_t length = 0; length <= chunk.size(); length++) {
+        std::string json;
+        Bytecode::StringSink sink(json);
+        Bytecode::Disassemble(reinterpret_cast<const uint8_t*>(chunk.data()), length, sink, Bytecode::DISASM_JSON);
+        if (Bytecode::MarshalJson(json).empty()) {
+            if (!malformed) std::cout << json;
+            malformed++;
+        }
+    }
+    std::cout << chunk.size() + 1 << " prefixes, " << malformed << " malformed\n";
+    failed |= malformed != 0;
+    
+    // Test 11: Compiled chunks run in-process
+    std::cout << "\n11. Running chunks in the interpreter:\n";
+    struct Run {
+        const char* source;
+        const char* result;
+    };
+    const Run runs[] = {
+        {"return 1 + 2 * 3, 7 / 2, 2 ^ 10, 7 % 3", "7 3.5 1024 1"},
+        {"local s = \"\" for i = 1, 3 do s = s .. i end return s, #s", "123 3"},
+        {"local t = {10, 20, 30, x = 5} t.y = t.x * 2 return #t, t[2], t.y", "3 20 10"},
+        {"local function fib(n) if n < 2 then return n end return fib(n - 1) + fib(n - 2) end return fib(20)", "6765"},
+        {"local function counter() local n = 0 return function() n = n + 1 return n end end "
+         "local c = counter() c() c() return c()", "3"},
+        {"total = 0 for i = 1, 10 do total = total + i end return total", "55"},
+        {"local n, i = 0, 0 while i < 5 do i = i + 1 if i % 2 == 0 then n = n + i end end return n", "6"},
+        {"local a, b = 1, 2 a, b = b, a return a, b, a == b, a ~= b, not nil", "2 1 false true true"},
+        {"return undefinedGlobal", "nil"},
+        {"local t = nil return t.x", "error: attempt to index a nil value"},
+        {"return \"inf\" + 1", "error: attempt to perform arithmetic on a string value"},
+        {"return \"nan\" + 0", "error: attempt to perform arithmetic on a string value"},
+        {"return \" 0x10 \" + \"1e1\"", "26"},
+    };
+    {
+        tsunami::VMState vm;
+        for (const Run& r : runs) {
+            std::string result = run(vm, r.source);
+            bool ok = result == r.result;
+            std::cout << r.source << ": " << (ok ? "OK" : "MISMATCH " + result) << "\n";
+            failed |= !ok;
+        }
+        
+        // Filling a table moves the heap toward a collection; keys set and
+        // cleared again do not pile up
+        run(vm, "filled = {} for i = 1, 100000 do filled[i] = i end");
+        bool grew = vm.heapBytes() >= 100000 * sizeof(tsunami::VMValue);
+        run(vm, "filled = nil churned = {} for i = 1, 100000 do churned[\"k\" .. i] = i churned[\"k\" .. i] = nil end");
+        vm.collectGarbage();
+        bool bounded = vm.heapBytes() < 64 * 1024;
+        std::cout << "Table growth counted: " << (grew ? "OK" : "MISMATCH") << "\n";
+        std::cout << "Cleared keys released: " << (bounded ? "OK" : "MISMATCH") << "\n";
+        failed |= !grew || !bounded;
+    }
+    
     std::cout << "\n=== All tests completed ===\n";
     
-    return 0;
+    return failed ? 1 : 0;
 }
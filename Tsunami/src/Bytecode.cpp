@@ -1,4 +1,6 @@
 #include "Bytecode.h"
+#include "BytecodeLiterals.h"
+#include "BytecodeWriter.h"
 #include <cstring>
 #include <cmath>
 #include <sstream>
@@ -7,584 +9,668 @@
 
 namespace Bytecode {
 
-// ==================== UTILITY FUNCTIONS ====================
+// ==================== BASIC PUSH OPERATIONS ====================
 
-static uint32_t hashBytecode(const uint8_t* data, size_t size) {
-    uint32_t hash = 2166136261u;
-    for (size_t i = 0; i < size; i++) {
-        hash ^= data[i];
-        hash *= 16777619u;
-    }
-    return hash;
+// Fixed chunks are built at compile time (BytecodeLiterals.h)
+std::string CreatePushNil() {
+    return chunkString(NIL_CHUNK);
 }
 
-static void writeVarInt(uint32_t value, std::vector<uint8_t>& out) {
-    do {
-        uint8_t byte = value & 0x7F;
-        value >>= 7;
-        if (value != 0) byte |= 0x80;
-        out.push_back(byte);
-    } while (value != 0);
-}
-
-static uint8_t encodeOpcode(uint8_t opcode) {
-    return (opcode * 227) & 0xFF;  // Same as your Rust code
-}
-
-static bool isDoubleByteOpcode(uint8_t opcode) {
-    switch (opcode) {
-        case LOP_GETGLOBAL:
-        case LOP_SETGLOBAL:
-        case LOP_GETIMPORT:
-        case LOP_GETTABLKS:
-        case LOP_SETTABLKS:
-        case LOP_NAMECALL:
-        case LOP_JUMPIFEQ:
-        case LOP_JUMPIFLE:
-        case LOP_JUMPIFLT:
-        case LOP_JUMPIFNOTEQ:
-        case LOP_JUMPIFNOTLE:
-        case LOP_JUMPIFNOTLT:
-        case LOP_NEWTABLE:
-        case LOP_SETLIST:
-        case LOP_FORGLOOP:
-        case LOP_LOADKX:
-        case LOP_JUMPIFEQK:
-        case LOP_JUMPIFNOTEQK:
-        case LOP_FASTCALL2:
-        case LOP_FASTCALL2K:
-            return true;
-        default:
-            return false;
-    }
+std::string CreatePushBoolean(bool value) {
+    return value ? chunkString(TRUE_CHUNK) : chunkString(FALSE_CHUNK);
 }
 
-// ==================== BASIC PUSH OPERATIONS ====================
-
-std::string CreatePushNil() {
-    std::vector<uint8_t> bytecode;
+// Number and string chunks differ only in their constant payload, so they
+// are stamped out from a precompiled template instead of being re-emitted
+static ChunkTemplate buildConstantTemplate(uint8_t constantType) {
+    BytecodeWriter writer;
+    writer.beginChunk();
     
-    // Header
-    LuauBytecodeHeader header = {0x02, 0x00, 0x08, 0x08, 0, 0};
-    bytecode.insert(bytecode.end(), 
-                   reinterpret_cast<uint8_t*>(&header),
-                   reinterpret_cast<uint8_t*>(&header) + sizeof(header));
-    
-    // Constants: 0
-    writeVarInt(0, bytecode);
+    // Constants: 1, payload spliced in after the type byte
+    writer.writeVarInt(1);
+    writer.writeByte(constantType);
+    size_t payloadOffset = writer.size();
     
     // Functions: 1
-    writeVarInt(1, bytecode);
-    
-    // Function proto
-    writeVarInt(0, bytecode);  // maxstacksize
-    writeVarInt(0, bytecode);  // numparams
-    writeVarInt(1, bytecode);  // numupvalues
-    writeVarInt(0, bytecode);  // is_vararg
-    
-    // Instructions: 1
-    writeVarInt(1, bytecode);
-    
-    // LOADNIL opcode
-    bytecode.push_back(encodeOpcode(LOP_LOADNIL));
-    bytecode.push_back(0x00);  // Register A
-    
-    // SizeK: 0
-    writeVarInt(0, bytecode);
-    
-    // SizeP: 0
-    writeVarInt(0, bytecode);
+    writer.writeVarInt(1);
+    writer.beginProto(1, 0, 0, false, 2);
     
-    // Debug info
-    writeVarInt(0, bytecode);  // linedefined
-    writeVarInt(0, bytecode);  // debugname
-    bytecode.push_back(0x00);  // lineinfo
-    bytecode.push_back(0x00);  // debuginfo
+    writer.emitAD(LOP_LOADK, 0, 0);
+    writer.emitABC(LOP_RETURN, 0, 2, 0);
     
-    // Update header
-    header.size = bytecode.size() - sizeof(header);
-    header.hash = hashBytecode(bytecode.data() + sizeof(header), header.size);
-    std::memcpy(bytecode.data(), &header, sizeof(header));
-    
-    return std::string(reinterpret_cast<char*>(bytecode.data()), bytecode.size());
+    writer.endProto(1);
+    return ChunkTemplate(writer.finish(), payloadOffset);
 }
 
-std::string CreatePushBoolean(bool value) {
-    std::vector<uint8_t> bytecode;
-    
-    // Header
-    LuauBytecodeHeader header = {0x02, 0x00, 0x08, 0x08, 0, 0};
-    bytecode.insert(bytecode.end(), 
-                   reinterpret_cast<uint8_t*>(&header),
-                   reinterpret_cast<uint8_t*>(&header) + sizeof(header));
+static const ChunkTemplate& numberTemplate() {
+    static const ChunkTemplate tmpl = buildConstantTemplate(LBC_CONSTANT_NUMBER);
+    return tmpl;
+}
+
+static const ChunkTemplate& stringTemplate() {
+    static const ChunkTemplate tmpl = buildConstantTemplate(LBC_CONSTANT_STRING);
+    return tmpl;
+}
+
+// Numbers LOADN can carry need no constant at all
+static std::string pushImmediate(int16_t value) {
+    BytecodeWriter writer(BytecodeWriter::chunkSize(0, 0, 1, 2));
+    writer.beginChunk();
     
-    // Constants: 0 (boolean is inline in LOADB)
-    writeVarInt(0, bytecode);
+    // Constants: 0 (value is inline in LOADN)
+    writer.writeVarInt(0);
     
     // Functions: 1
-    writeVarInt(1, bytecode);
-    
-    // Function proto
-    writeVarInt(1, bytecode);  // maxstacksize
-    writeVarInt(0, bytecode);  // numparams
-    writeVarInt(0, bytecode);  // numupvalues
-    writeVarInt(0, bytecode);  // is_vararg
-    
-    // Instructions: 1
-    writeVarInt(1, bytecode);
+    writer.writeVarInt(1);
+    writer.beginProto(1, 0, 0, false, 2);
     
-    // LOADB opcode
-    bytecode.push_back(encodeOpcode(LOP_LOADB));
-    bytecode.push_back(0x00);  // Register A
-    bytecode.push_back(value ? 0x01 : 0x00);  // Boolean value
-    bytecode.push_back(0x00);  // Jump (unused)
+    writer.emitAD(LOP_LOADN, 0, value);
+    writer.emitABC(LOP_RETURN, 0, 2, 0);
     
-    // SizeK: 0
-    writeVarInt(0, bytecode);
-    
-    // SizeP: 0
-    writeVarInt(0, bytecode);
-    
-    // Debug info
-    writeVarInt(0, bytecode);
-    writeVarInt(0, bytecode);
-    bytecode.push_back(0x00);
-    bytecode.push_back(0x00);
-    
-    // Update header
-    header.size = bytecode.size() - sizeof(header);
-    header.hash = hashBytecode(bytecode.data() + sizeof(header), header.size);
-    std::memcpy(bytecode.data(), &header, sizeof(header));
-    
-    return std::string(reinterpret_cast<char*>(bytecode.data()), bytecode.size());
+    writer.endProto(0);
+    return writer.finish();
 }
 
 std::string CreatePushNumber(double value) {
-    std::vector<uint8_t> bytecode;
-    
-    // Header
-    LuauBytecodeHeader header = {0x02, 0x00, 0x08, 0x08, 0, 0};
-    bytecode.insert(bytecode.end(), 
-                   reinterpret_cast<uint8_t*>(&header),
-                   reinterpret_cast<uint8_t*>(&header) + sizeof(header));
-    
-    // Constants: 1 (the number)
-    writeVarInt(1, bytecode);
-    bytecode.push_back(LBC_CONSTANT_NUMBER);
+    if (fitsLoadN(value)) {
+        return pushImmediate(static_cast<int16_t>(value));
+    }
     
-    // Write double
     uint64_t bits;
     std::memcpy(&bits, &value, sizeof(double));
+    
+    uint8_t payload[8];
     for (int i = 0; i < 8; i++) {
-        bytecode.push_back(static_cast<uint8_t>(bits & 0xFF));
+        payload[i] = static_cast<uint8_t>(bits & 0xFF);
         bits >>= 8;
     }
     
-    // Functions: 1
-    writeVarInt(1, bytecode);
-    
-    // Function proto
-    writeVarInt(1, bytecode);  // maxstacksize
-    writeVarInt(0, bytecode);  // numparams
-    writeVarInt(0, bytecode);  // numupvalues
-    writeVarInt(0, bytecode);  // is_vararg
-    
-    // Instructions: 1
-    writeVarInt(1, bytecode);
-    
-    // LOADN opcode
-    bytecode.push_back(encodeOpcode(LOP_LOADN));
-    bytecode.push_back(0x00);  // Register A
-    bytecode.push_back(0x00);  // Constant index 0
-    
-    // SizeK: 1
-    writeVarInt(1, bytecode);
-    
-    // SizeP: 0
-    writeVarInt(0, bytecode);
-    
-    // Debug info
-    writeVarInt(0, bytecode);
-    writeVarInt(0, bytecode);
-    bytecode.push_back(0x00);
-    bytecode.push_back(0x00);
-    
-    // Update header
-    header.size = bytecode.size() - sizeof(header);
-    header.hash = hashBytecode(bytecode.data() + sizeof(header), header.size);
-    std::memcpy(bytecode.data(), &header, sizeof(header));
-    
-    return std::string(reinterpret_cast<char*>(bytecode.data()), bytecode.size());
+    return numberTemplate().instantiate(nullptr, 0, payload, sizeof(payload));
+}
+
+std::string CreatePushInteger(int64_t value) {
+    if (value >= INT16_MIN && value <= INT16_MAX) {
+        return pushImmediate(static_cast<int16_t>(value));
+    }
+    return CreatePushNumber(static_cast<double>(value));
 }
 
 std::string CreatePushString(const std::string& value) {
-    std::vector<uint8_t> bytecode;
-    
-    // Header
-    LuauBytecodeHeader header = {0x02, 0x00, 0x08, 0x08, 0, 0};
-    bytecode.insert(bytecode.end(), 
-                   reinterpret_cast<uint8_t*>(&header),
-                   reinterpret_cast<uint8_t*>(&header) + sizeof(header));
-    
-    // Constants: 1 (the string)
-    writeVarInt(1, bytecode);
-    bytecode.push_back(LBC_CONSTANT_STRING);
-    writeVarInt(value.size(), bytecode);
-    bytecode.insert(bytecode.end(), value.begin(), value.end());
-    
-    // Functions: 1
-    writeVarInt(1, bytecode);
-    
-    // Function proto
-    writeVarInt(1, bytecode);  // maxstacksize
-    writeVarInt(0, bytecode);  // numparams
-    writeVarInt(0, bytecode);  // numupvalues
-    writeVarInt(0, bytecode);  // is_vararg
-    
-    // Instructions: 1
-    writeVarInt(1, bytecode);
-    
-    // LOADK opcode
-    bytecode.push_back(encodeOpcode(LOP_LOADK));
-    bytecode.push_back(0x00);  // Register A
-    bytecode.push_back(0x00);  // Constant index 0
-    
-    // SizeK: 1
-    writeVarInt(1, bytecode);
-    
-    // SizeP: 0
-    writeVarInt(0, bytecode);
-    
-    // Debug info
-    writeVarInt(0, bytecode);
-    writeVarInt(0, bytecode);
-    bytecode.push_back(0x00);
-    bytecode.push_back(0x00);
-    
-    // Update header
-    header.size = bytecode.size() - sizeof(header);
-    header.hash = hashBytecode(bytecode.data() + sizeof(header), header.size);
-    std::memcpy(bytecode.data(), &header, sizeof(header));
+    // Length varint leads the string bytes
+    uint8_t lead[5];
+    size_t leadSize = 0;
+    uint32_t length = static_cast<uint32_t>(value.size());
+    do {
+        uint8_t byte = length & 0x7F;
+        length >>= 7;
+        if (length != 0) byte |= 0x80;
+        lead[leadSize++] = byte;
+    } while (length != 0);
     
-    return std::string(reinterpret_cast<char*>(bytecode.data()), bytecode.size());
+    return stringTemplate().instantiate(lead, leadSize, value.data(), value.size());
+}
+
+// ==================== VALUE LOADING ====================
+//
+// Array and multi-value chunks are generic over their element type: strings
+// always take a constant, typed values pick LOADNIL/LOADB/LOADN/LOADK.
+// Constants are numbered in value order, so `constant` tracks the next index.
+
+static bool needsConstant(const std::string&) {
+    return true;
+}
+
+static bool needsConstant(const PushValue& value) {
+    return value.type == PUSH_STRING || (value.type == PUSH_NUMBER && !fitsLoadN(value.number));
+}
+
+static size_t valueConstantSize(const std::string& value) {
+    return BytecodeWriter::stringConstantSize(value.size());
+}
+
+static size_t valueConstantSize(const PushValue& value) {
+    return value.type == PUSH_STRING ? BytecodeWriter::stringConstantSize(value.string.size())
+                                     : BytecodeWriter::numberConstantSize();
+}
+
+static void writeValueConstant(BytecodeWriter& writer, const std::string& value) {
+    writer.writeConstantString(value);
+}
+
+static void writeValueConstant(BytecodeWriter& writer, const PushValue& value) {
+    if (value.type == PUSH_STRING) writer.writeConstantString(value.string.data(), value.string.size());
+    else writer.writeConstantNumber(value.number);
+}
+
+static void emitLoadValue(BytecodeWriter& writer, uint8_t reg, const std::string&, uint32_t& constant) {
+    writer.emitLoadConstant(reg, constant++);
+}
+
+static void emitLoadValue(BytecodeWriter& writer, uint8_t reg, const PushValue& value, uint32_t& constant) {
+    switch (value.type) {
+        case PUSH_BOOLEAN:
+            writer.emitABC(LOP_LOADB, reg, value.boolean ? 1 : 0, 0);
+            break;
+        case PUSH_NUMBER:
+            if (fitsLoadN(value.number)) writer.emitAD(LOP_LOADN, reg, static_cast<int16_t>(value.number));
+            else writer.emitLoadConstant(reg, constant++);
+            break;
+        case PUSH_STRING:
+            writer.emitLoadConstant(reg, constant++);
+            break;
+        default:
+            writer.emitABC(LOP_LOADNIL, reg, 0, 0);
+            break;
+    }
+}
+
+// Constant count, constant bytes and load words for a run of values
+struct ValueCosts {
+    uint32_t constantCount = 0;
+    size_t constantBytes = 0;
+    uint32_t loadWords = 0;
+};
+
+template<typename Value>
+static ValueCosts measureValues(const Value* values, size_t count) {
+    ValueCosts costs;
+    for (size_t i = 0; i < count; i++) {
+        if (needsConstant(values[i])) {
+            costs.constantBytes += valueConstantSize(values[i]);
+            costs.loadWords += loadConstantWords(costs.constantCount++);
+        } else {
+            costs.loadWords += 1;
+        }
+    }
+    return costs;
+}
+
+template<typename Value>
+static void writeValueConstants(BytecodeWriter& writer, const Value* values, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (needsConstant(values[i])) writeValueConstant(writer, values[i]);
+    }
+}
+
+constexpr uint32_t arrayBatches(uint32_t count) {
+    return (count + SETLIST_BATCH - 1) / SETLIST_BATCH;
+}
+
+// Stores values into t[1..count], t in R(table): each batch loads into the
+// registers just above the table and goes in with one SETLIST + AUX
+template<typename Value>
+static void emitArrayBatches(BytecodeWriter& writer, uint8_t table, const Value* values, uint32_t count,
+                             uint32_t& constant) {
+    for (uint32_t first = 0; first < count; first += SETLIST_BATCH) {
+        uint32_t batch = std::min(count - first, SETLIST_BATCH);
+        for (uint32_t i = 0; i < batch; i++) {
+            emitLoadValue(writer, static_cast<uint8_t>(table + 1 + i), values[first + i], constant);
+        }
+        writer.emitABC(LOP_SETLIST, table, static_cast<uint8_t>(table + 1), static_cast<uint8_t>(batch + 1));
+        writer.emitAux(first + 1);
+    }
 }
 
 // ==================== TABLE OPERATIONS ====================
 
 std::string CreatePushTable(int arraySize, int hashSize) {
-    std::vector<uint8_t> bytecode;
+    if (arraySize == 0 && hashSize == 0) {
+        return chunkString(EMPTY_TABLE_CHUNK);
+    }
     
-    // Header
-    LuauBytecodeHeader header = {0x02, 0x00, 0x08, 0x08, 0, 0};
-    bytecode.insert(bytecode.end(), 
-                   reinterpret_cast<uint8_t*>(&header),
-                   reinterpret_cast<uint8_t*>(&header) + sizeof(header));
+    BytecodeWriter writer(BytecodeWriter::chunkSize(0, 0, 1, 3));
+    writer.beginChunk();
     
     // Constants: 0
-    writeVarInt(0, bytecode);
+    writer.writeVarInt(0);
     
     // Functions: 1
-    writeVarInt(1, bytecode);
-    
-    // Function proto
-    writeVarInt(1, bytecode);  // maxstacksize
-    writeVarInt(0, bytecode);  // numparams
-    writeVarInt(0, bytecode);  // numupvalues
-    writeVarInt(0, bytecode);  // is_vararg
-    
-    // Instructions: 1
-    writeVarInt(1, bytecode);
-    
-    // NEWTABLE opcode (2-byte)
-    bytecode.push_back(encodeOpcode(LOP_NEWTABLE));
-    bytecode.push_back(0x00);  // Register A
-    bytecode.push_back(static_cast<uint8_t>(arraySize & 0xFF));  // Array size
-    bytecode.push_back(static_cast<uint8_t>(hashSize & 0xFF));   // Hash size
-    
-    // SizeK: 0
-    writeVarInt(0, bytecode);
+    writer.writeVarInt(1);
+    writer.beginProto(1, 0, 0, false, 3);
     
-    // SizeP: 0
-    writeVarInt(0, bytecode);
+    // NEWTABLE: B = encoded hash size, AUX = array size
+    writer.emitABC(LOP_NEWTABLE, 0, encodeHashSize(static_cast<uint32_t>(hashSize)), 0);
+    writer.emitAux(static_cast<uint32_t>(arraySize));
+    writer.emitABC(LOP_RETURN, 0, 2, 0);
     
-    // Debug info
-    writeVarInt(0, bytecode);
-    writeVarInt(0, bytecode);
-    bytecode.push_back(0x00);
-    bytecode.push_back(0x00);
-    
-    // Update header
-    header.size = bytecode.size() - sizeof(header);
-    header.hash = hashBytecode(bytecode.data() + sizeof(header), header.size);
-    std::memcpy(bytecode.data(), &header, sizeof(header));
-    
-    return std::string(reinterpret_cast<char*>(bytecode.data()), bytecode.size());
+    writer.endProto(0);
+    return writer.finish();
 }
 
-std::string CreatePushArray(const std::vector<std::string>& values) {
-    if (values.empty()) {
+template<typename Value>
+static std::string pushArray(const Value* values, uint32_t count) {
+    if (count == 0) {
         return CreatePushTable(0, 0);
     }
     
-    std::vector<uint8_t> bytecode;
+    ValueCosts costs = measureValues(values, count);
+    uint32_t maxStack = 1 + std::min(count, SETLIST_BATCH);     // table + window
     
-    // Header
-    LuauBytecodeHeader header = {0x02, 0x00, 0x08, 0x08, 0, 0};
-    bytecode.insert(bytecode.end(), 
-                   reinterpret_cast<uint8_t*>(&header),
-                   reinterpret_cast<uint8_t*>(&header) + sizeof(header));
+    // NEWTABLE + AUX, the loads, SETLIST + AUX per batch, RETURN
+    uint32_t sizeCode = 2 + costs.loadWords + arrayBatches(count) * 2 + 1;
     
-    // Constants: all string values
-    writeVarInt(values.size(), bytecode);
-    for (const auto& value : values) {
-        bytecode.push_back(LBC_CONSTANT_STRING);
-        writeVarInt(value.size(), bytecode);
-        bytecode.insert(bytecode.end(), value.begin(), value.end());
-    }
+    BytecodeWriter writer(BytecodeWriter::chunkSize(costs.constantCount, costs.constantBytes, maxStack, sizeCode));
+    writer.beginChunk();
+    
+    writer.writeVarInt(costs.constantCount);
+    writeValueConstants(writer, values, count);
     
     // Functions: 1
-    writeVarInt(1, bytecode);
-    
-    // Function proto
-    writeVarInt(1 + values.size(), bytecode);  // maxstacksize (table + values)
-    writeVarInt(0, bytecode);  // numparams
-    writeVarInt(0, bytecode);  // numupvalues
-    writeVarInt(0, bytecode);  // is_vararg
-    
-    // Instructions: values.size() + 2 (NEWTABLE + LOADKs + SETLIST)
-    writeVarInt(values.size() + 2, bytecode);
-    
-    // 1. NEWTABLE
-    bytecode.push_back(encodeOpcode(LOP_NEWTABLE));
-    bytecode.push_back(0x00);  // Register 0 = table
-    bytecode.push_back(static_cast<uint8_t>(values.size()));  // Array size
-    bytecode.push_back(0x00);  // Hash size 0
-    
-    // 2. Load each constant into consecutive registers
-    for (size_t i = 0; i < values.size(); i++) {
-        bytecode.push_back(encodeOpcode(LOP_LOADK));
-        bytecode.push_back(static_cast<uint8_t>(i + 1));  // Registers 1, 2, 3...
-        bytecode.push_back(static_cast<uint8_t>(i));      // Constant index
-    }
+    writer.writeVarInt(1);
+    writer.beginProto(maxStack, 0, 0, false, sizeCode);
     
-    // 3. SETLIST to populate array
-    bytecode.push_back(encodeOpcode(LOP_SETLIST));
-    bytecode.push_back(0x00);  // Table register
-    bytecode.push_back(static_cast<uint8_t>(values.size()));  // Value count
-    bytecode.push_back(0x00);  // Table index (start at 1)
+    // NEWTABLE, presized for the whole array
+    writer.emitABC(LOP_NEWTABLE, 0, 0, 0);
+    writer.emitAux(count);
     
-    // SizeK: values.size()
-    writeVarInt(values.size(), bytecode);
+    uint32_t constant = 0;
+    emitArrayBatches(writer, 0, values, count, constant);
     
-    // SizeP: 0
-    writeVarInt(0, bytecode);
+    writer.emitABC(LOP_RETURN, 0, 2, 0);
     
-    // Debug info
-    writeVarInt(0, bytecode);
-    writeVarInt(0, bytecode);
-    bytecode.push_back(0x00);
-    bytecode.push_back(0x00);
+    writer.endProto(costs.constantCount);
+    return writer.finish();
+}
+
+std::string CreatePushArray(const std::vector<std::string>& values) {
+    return pushArray(values.data(), static_cast<uint32_t>(values.size()));
+}
+
+std::string CreatePushArray(const std::vector<PushValue>& values) {
+    return pushArray(values.data(), static_cast<uint32_t>(values.size()));
+}
+
+// ==================== DICTIONARIES ====================
+
+using KeyValues = std::vector<std::pair<std::string, std::string>>;
+
+constexpr uint32_t NO_CONSTANT = UINT32_MAX;
+
+// Open-addressed string hash -> constant index, for interning
+using InternTable = std::vector<std::pair<size_t, uint32_t>>;
+
+// A dictionary's key set, encoded once: the key string constants, then the
+// template table DUPTABLE clones (already holding every key, so the hash
+// part arrives sized and no key is inserted one by one).
+struct DictionaryShape {
+    std::string signature;          // Length-prefixed key sequence
+    std::string constants;          // Encoded K0..Kn-1 keys, then the template
+    size_t keyBytes = 0;            // Bytes of `constants` before the template
+    size_t pairKeyBytes = 0;        // Key constants with one per pair, as NEWTABLE+SETTABLE encodes them
+    uint32_t keyCount = 0;          // Distinct keys
+    bool templated = false;         // False past DUPTABLE's int16 constant index
+    std::vector<uint32_t> slots;    // Pair -> key constant
+    std::vector<uint32_t> firstPair;    // Key constant -> first pair naming it
+    InternTable keyIndex;           // Key hash -> key constant, for values equal to a key
+    size_t hash = 0;
+    size_t bytes = 0;               // Charged against the cache budget
+    
+    // FNV-1a state over the body up to the end of the key constants (and
+    // template if used), which only varies with the constant count in front
+    uint32_t prefixCount = UINT32_MAX;
+    bool prefixTemplated = false;
+    uint32_t prefixState = 0;
+};
+
+static void appendSignature(std::string& out, std::string_view key) {
+    uint32_t length = static_cast<uint32_t>(key.size());
+    out.append(reinterpret_cast<const char*>(&length), sizeof(length));
+    out.append(key);
+}
+
+static bool sameKeys(const DictionaryShape& shape, const KeyValues& keyValues) {
+    if (shape.slots.size() != keyValues.size()) return false;
+    size_t offset = 0;
+    for (const auto& kv : keyValues) {
+        uint32_t length;
+        if (shape.signature.size() - offset < sizeof(length) + kv.first.size()) return false;
+        std::memcpy(&length, shape.signature.data() + offset, sizeof(length));
+        offset += sizeof(length);
+        if (length != kv.first.size() || shape.signature.compare(offset, length, kv.first) != 0) return false;
+        offset += length;
+    }
+    return offset == shape.signature.size();
+}
+
+static DictionaryShape buildShape(const KeyValues& keyValues, size_t hash) {
+    DictionaryShape shape;
+    std::unordered_map<std::string_view, uint32_t> index;
+    std::vector<uint32_t> keys;
+    BytecodeWriter writer;
+    
+    shape.hash = hash;
+    shape.slots.reserve(keyValues.size());
+    for (uint32_t i = 0; i < keyValues.size(); i++) {
+        const std::string& key = keyValues[i].first;
+        appendSignature(shape.signature, key);
+        shape.pairKeyBytes += BytecodeWriter::stringConstantSize(key.size());
+        auto found = index.emplace(key, static_cast<uint32_t>(keys.size()));
+        if (found.second) {
+            keys.push_back(found.first->second);
+            shape.firstPair.push_back(i);
+            writer.writeConstantString(key);
+        }
+        shape.slots.push_back(found.first->second);
+    }
     
-    // Update header
-    header.size = bytecode.size() - sizeof(header);
-    header.hash = hashBytecode(bytecode.data() + sizeof(header), header.size);
-    std::memcpy(bytecode.data(), &header, sizeof(header));
+    shape.keyCount = static_cast<uint32_t>(keys.size());
+    shape.templated = shape.keyCount <= LOADK_MAX_INDEX;
+    shape.keyBytes = writer.size();
+    if (shape.templated) writer.writeConstantTable(keys.data(), keys.size());
+    shape.constants.assign(reinterpret_cast<const char*>(writer.data()), writer.size());
+    
+    size_t mask = 15;
+    while (mask + 1 < 2 * size_t(shape.keyCount)) mask = mask * 2 + 1;
+    shape.keyIndex.assign(mask + 1, {0, NO_CONSTANT});
+    for (uint32_t k = 0; k < shape.keyCount; k++) {
+        size_t keyHash = std::hash<std::string_view>()(keyValues[shape.firstPair[k]].first);
+        size_t i = keyHash & mask;
+        while (shape.keyIndex[i].second != NO_CONSTANT) i = (i + 1) & mask;
+        shape.keyIndex[i] = {keyHash, k};
+    }
     
-    return std::string(reinterpret_cast<char*>(bytecode.data()), bytecode.size());
+    // Strings, vectors, list and index nodes, roughly
+    shape.bytes = sizeof(DictionaryShape) + shape.signature.size() + shape.constants.size() +
+                  (shape.slots.size() + shape.firstPair.size()) * sizeof(uint32_t) +
+                  shape.keyIndex.size() * sizeof(InternTable::value_type) + 8 * sizeof(void*);
+    return shape;
 }
 
-// ==================== MULTIPLE VALUES ====================
-
-std::string CreatePushMultiple(const std::vector<std::string>& values) {
-    if (values.empty()) {
-        return CreatePushNil();
-    }
+// Per-thread LRU of shapes bounded by bytes, like BytecodeCache: a workload
+// cycling through more key sets than fit keeps its most recent ones
+class ShapeCache {
+public:
+    static constexpr size_t BUDGET = 1024 * 1024;
     
-    std::vector<uint8_t> bytecode;
-    
-    // Header
-    LuauBytecodeHeader header = {0x02, 0x00, 0x08, 0x08, 0, 0};
-    bytecode.insert(bytecode.end(), 
-                   reinterpret_cast<uint8_t*>(&header),
-                   reinterpret_cast<uint8_t*>(&header) + sizeof(header));
-    
-    // Process values to determine types
-    std::vector<bool> isNumber(values.size(), false);
-    std::vector<bool> isBool(values.size(), false);
-    std::vector<double> numbers;
-    std::vector<bool> booleans;
-    std::vector<std::string> strings;
-    
-    for (size_t i = 0; i < values.size(); i++) {
-        const auto& val = values[i];
-        if (val == "true") {
-            isBool[i] = true;
-            booleans.push_back(true);
-        } else if (val == "false") {
-            isBool[i] = true;
-            booleans.push_back(false);
-        } else {
-            // Try to parse as number
-            char* end;
-            double num = strtod(val.c_str(), &end);
-            if (end != val.c_str() && *end == '\0') {
-                isNumber[i] = true;
-                numbers.push_back(num);
-            } else {
-                strings.push_back(val);
+    // Valid until the next call. Repeating the last key set skips hashing it.
+    DictionaryShape& get(const KeyValues& keyValues) {
+        if (!shapes.empty() && sameKeys(shapes.front(), keyValues)) return shapes.front();
+        
+        std::hash<std::string_view> hasher;
+        size_t hash = keyValues.size();
+        for (const auto& kv : keyValues) hash = (hash ^ hasher(kv.first)) * 0x100000001B3ull;
+        
+        auto range = index.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (!sameKeys(*it->second, keyValues)) continue;
+            shapes.splice(shapes.begin(), shapes, it->second);
+            return shapes.front();
+        }
+        
+        DictionaryShape shape = buildShape(keyValues, hash);
+        if (shape.bytes > BUDGET) {
+            oversized = std::move(shape);
+            return oversized;
+        }
+        
+        while (resident + shape.bytes > BUDGET) {
+            const DictionaryShape& victim = shapes.back();
+            auto victims = index.equal_range(victim.hash);
+            for (auto it = victims.first; it != victims.second; ++it) {
+                if (&*it->second == &victim) {
+                    index.erase(it);
+                    break;
+                }
             }
+            resident -= victim.bytes;
+            shapes.pop_back();
         }
+        
+        resident += shape.bytes;
+        shapes.push_front(std::move(shape));
+        index.emplace(hash, shapes.begin());
+        return shapes.front();
+    }
+
+private:
+    std::list<DictionaryShape> shapes;      // Front is most recently used
+    std::unordered_multimap<size_t, std::list<DictionaryShape>::iterator> index;
+    size_t resident = 0;
+    DictionaryShape oversized;              // Last shape too large to cache
+};
+
+std::string CreatePushDictionary(const KeyValues& keyValues) {
+    if (keyValues.empty()) {
+        return CreatePushTable(0, 0);
     }
     
-    // Write constants
-    uint32_t totalConstants = numbers.size() + booleans.size() + strings.size();
-    writeVarInt(totalConstants, bytecode);
-    
-    // Numbers
-    for (double num : numbers) {
-        bytecode.push_back(LBC_CONSTANT_NUMBER);
-        uint64_t bits;
-        std::memcpy(&bits, &num, sizeof(double));
-        for (int i = 0; i < 8; i++) {
-            bytecode.push_back(static_cast<uint8_t>(bits & 0xFF));
-            bits >>= 8;
+    thread_local ShapeCache shapes;
+    thread_local InternTable strings;                                 // New value strings
+    thread_local std::vector<uint32_t> valueConstants;
+    thread_local std::vector<uint32_t> valuePairs;                   // New value constant -> pair
+    
+    const uint32_t pairs = static_cast<uint32_t>(keyValues.size());
+    std::hash<std::string_view> hasher;
+    DictionaryShape& shape = shapes.get(keyValues);
+    
+    // Values share string constants with the keys (through the shape's
+    // index) and with each other; only the first occurrence of each new
+    // string is added. Until the layout is chosen a new value is numbered
+    // keyCount + n.
+    size_t mask = 15;
+    while (mask + 1 < 2 * size_t(pairs)) mask = mask * 2 + 1;
+    strings.assign(mask + 1, {0, NO_CONSTANT});
+    valueConstants.resize(pairs);
+    valuePairs.clear();
+    
+    auto findKey = [&](size_t hash, const std::string& value) {
+        const size_t keyMask = shape.keyIndex.size() - 1;
+        for (size_t i = hash & keyMask; shape.keyIndex[i].second != NO_CONSTANT; i = (i + 1) & keyMask) {
+            uint32_t k = shape.keyIndex[i].second;
+            if (shape.keyIndex[i].first == hash && keyValues[shape.firstPair[k]].first == value) return k;
+        }
+        return NO_CONSTANT;
+    };
+    auto intern = [&](size_t hash, const std::string& value, uint32_t fresh) {
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            if (strings[i].second == NO_CONSTANT) {
+                strings[i] = {hash, fresh};
+                return fresh;
+            }
+            uint32_t pair = valuePairs[strings[i].second - shape.keyCount];
+            if (strings[i].first == hash && keyValues[pair].second == value) return strings[i].second;
+        }
+    };
+    
+    size_t valueBytes = 0;          // New value constants
+    size_t pairValueBytes = 0;      // One value constant per pair
+    uint32_t loadWords[2] = {0, 0}; // Without and with the template shifting values up
+    for (uint32_t i = 0; i < pairs; i++) {
+        const std::string& value = keyValues[i].second;
+        size_t hash = hasher(value);
+        uint32_t fresh = shape.keyCount + static_cast<uint32_t>(valuePairs.size());
+        uint32_t constant = findKey(hash, value);
+        if (constant == NO_CONSTANT) constant = intern(hash, value, fresh);
+        size_t bytes = BytecodeWriter::stringConstantSize(value.size());
+        if (constant == fresh) {
+            valuePairs.push_back(i);
+            valueBytes += bytes;
+        }
+        pairValueBytes += bytes;
+        valueConstants[i] = constant;
+        
+        // R1 still holds the previous pair's value when they match
+        if (i == 0 || valueConstants[i - 1] != constant) {
+            loadWords[0] += loadConstantWords(constant);
+            loadWords[1] += loadConstantWords(constant < shape.keyCount ? constant : constant + 1);
         }
     }
     
-    // Booleans (won't actually be in constants, but we count them)
-    for (bool b : booleans) {
-        bytecode.push_back(LBC_CONSTANT_BOOLEAN);
-        bytecode.push_back(b ? 0x01 : 0x00);
+    // The template costs a constant and a key index per key. Take it only
+    // once interning has paid for that, so the chunk is never larger than
+    // NEWTABLE + LOADK key + LOADK value + SETTABLE per pair; otherwise a
+    // sized NEWTABLE and SETTABLKS.
+    // DUPTABLE (NEWTABLE + AUX without a template), loads, SETTABLKS + AUX
+    // per pair, RETURN
+    bool templated = false;
+    if (shape.templated) {
+        size_t baseline = BytecodeWriter::chunkSize(2 * pairs, shape.pairKeyBytes + pairValueBytes, 3,
+                                                    2 + pairs * 3 + 1);
+        templated = BytecodeWriter::chunkSize(shape.keyCount + 1 + static_cast<uint32_t>(valuePairs.size()),
+                                              shape.constants.size() + valueBytes, 2,
+                                              1 + loadWords[1] + pairs * 2 + 1) <= baseline;
     }
-    
-    // Strings
-    for (const auto& str : strings) {
-        bytecode.push_back(LBC_CONSTANT_STRING);
-        writeVarInt(str.size(), bytecode);
-        bytecode.insert(bytecode.end(), str.begin(), str.end());
+    const uint32_t shift = templated ? 1 : 0;
+    uint32_t sizeCode = (templated ? 1 : 2) + loadWords[shift] + pairs * 2 + 1;
+    const size_t prefixBytes = templated ? shape.constants.size() : shape.keyBytes;
+    uint32_t constantCount = shape.keyCount + shift + static_cast<uint32_t>(valuePairs.size());
+    
+    BytecodeWriter writer(BytecodeWriter::chunkSize(constantCount, prefixBytes + valueBytes, 2, sizeCode));
+    writer.beginChunk();
+    
+    writer.writeVarInt(constantCount);
+    writer.writeBytes(shape.constants.data(), prefixBytes);
+    size_t hashed = writer.size() - BytecodeWriter::HEADER_SIZE;
+    if (shape.prefixCount != constantCount || shape.prefixTemplated != templated) {
+        shape.prefixCount = constantCount;
+        shape.prefixTemplated = templated;
+        shape.prefixState = hashBytecode(writer.data() + BytecodeWriter::HEADER_SIZE, hashed);
+    }
+    for (uint32_t pair : valuePairs) {
+        writer.writeConstantString(keyValues[pair].second);
     }
     
     // Functions: 1
-    writeVarInt(1, bytecode);
-    
-    // Function proto
-    writeVarInt(values.size(), bytecode);  // maxstacksize
-    writeVarInt(0, bytecode);  // numparams
-    writeVarInt(0, bytecode);  // numupvalues
-    writeVarInt(0, bytecode);  // is_vararg
-    
-    // Instructions: values.size()
-    writeVarInt(values.size(), bytecode);
-    
-    // Generate load instructions
-    size_t numIdx = 0, boolIdx = 0, strIdx = 0;
-    
-    for (size_t i = 0; i < values.size(); i++) {
-        if (isBool[i]) {
-            // LOADB
-            bytecode.push_back(encodeOpcode(LOP_LOADB));
-            bytecode.push_back(static_cast<uint8_t>(i));  // Register
-            bytecode.push_back(booleans[boolIdx++] ? 0x01 : 0x00);
-            bytecode.push_back(0x00);
-        } else if (isNumber[i]) {
-            // LOADN
-            bytecode.push_back(encodeOpcode(LOP_LOADN));
-            bytecode.push_back(static_cast<uint8_t>(i));  // Register
-            bytecode.push_back(static_cast<uint8_t>(numIdx++));  // Constant index
-        } else {
-            // LOADK for string
-            bytecode.push_back(encodeOpcode(LOP_LOADK));
-            bytecode.push_back(static_cast<uint8_t>(i));  // Register
-            bytecode.push_back(static_cast<uint8_t>(numbers.size() + booleans.size() + strIdx++));  // Constant index
-        }
+    writer.writeVarInt(1);
+    writer.beginProto(2, 0, 0, false, sizeCode);
+    
+    if (templated) {
+        writer.emitAD(LOP_DUPTABLE, 0, static_cast<int16_t>(shape.keyCount));
+    } else {
+        writer.emitABC(LOP_NEWTABLE, 0, encodeHashSize(shape.keyCount), 0);
+        writer.emitAux(0);
     }
     
-    // SizeK: totalConstants
-    writeVarInt(totalConstants, bytecode);
-    
-    // SizeP: 0
-    writeVarInt(0, bytecode);
-    
-    // Debug info
-    writeVarInt(0, bytecode);
-    writeVarInt(0, bytecode);
-    bytecode.push_back(0x00);
-    bytecode.push_back(0x00);
+    for (uint32_t i = 0; i < pairs; i++) {
+        uint32_t constant = valueConstants[i];
+        if (i == 0 || valueConstants[i - 1] != constant) {
+            writer.emitLoadConstant(1, constant < shape.keyCount ? constant : constant + shift);
+        }
+        writer.emitABC(LOP_SETTABLKS, 1, 0, 0);
+        writer.emitAux(shape.slots[i]);
+    }
     
-    // Update header
-    header.size = bytecode.size() - sizeof(header);
-    header.hash = hashBytecode(bytecode.data() + sizeof(header), header.size);
-    std::memcpy(bytecode.data(), &header, sizeof(header));
+    writer.emitABC(LOP_RETURN, 0, 2, 0);
     
-    return std::string(reinterpret_cast<char*>(bytecode.data()), bytecode.size());
+    writer.endProto(constantCount);
+    return writer.finish(hashed, shape.prefixState);
 }
 
-// ==================== ROBOX-SPECIFIC TYPES ====================
+// ==================== MULTIPLE VALUES ====================
 
-std::string CreatePushVector2(float x, float y) {
-    std::vector<uint8_t> bytecode;
+// RETURN's B is count + 1 in one byte
+constexpr size_t MAX_RETURN_VALUES = 254;
+
+std::string CreatePushValues(const PushValue* values, size_t count) {
+    // Size everything first so the writer allocates exactly once
+    ValueCosts costs = measureValues(values, count);
     
-    // Header
-    LuauBytecodeHeader header = {0x02, 0x00, 0x08, 0x08, 0, 0};
-    bytecode.insert(bytecode.end(), 
-                   reinterpret_cast<uint8_t*>(&header),
-                   reinterpret_cast<uint8_t*>(&header) + sizeof(header));
+    if (count <= MAX_RETURN_VALUES) {
+        // Values land in R0..Rn-1 and return from there
+        uint32_t sizeCode = costs.loadWords + 1;
+        uint32_t maxStack = std::max<uint32_t>(static_cast<uint32_t>(count), 1);
+        
+        BytecodeWriter writer(BytecodeWriter::chunkSize(costs.constantCount, costs.constantBytes, maxStack, sizeCode));
+        writer.beginChunk();
+        
+        writer.writeVarInt(costs.constantCount);
+        writeValueConstants(writer, values, count);
+        
+        writer.writeVarInt(1);
+        writer.beginProto(maxStack, 0, 0, false, sizeCode);
+        
+        uint32_t constant = 0;
+        for (size_t i = 0; i < count; i++) {
+            emitLoadValue(writer, static_cast<uint8_t>(i), values[i], constant);
+        }
+        writer.emitABC(LOP_RETURN, 0, static_cast<uint8_t>(count + 1), 0);
+        
+        writer.endProto(costs.constantCount);
+        return writer.finish();
+    }
     
-    // Constants: 2 numbers (x, y)
-    writeVarInt(2, bytecode);
+    // Too many for registers: R0 = unpack, R1 = table filled in SETLIST
+    // batches from R2.., then unpack(t, 1, n) returns them all
+    uint32_t n = static_cast<uint32_t>(count);
+    uint32_t constantCount = costs.constantCount;
+    size_t constantBytes = costs.constantBytes;
     
-    // X constant
-    bytecode.push_back(LBC_CONSTANT_NUMBER);
-    double dx = x;
-    uint64_t bits;
-    std::memcpy(&bits, &dx, sizeof(double));
-    for (int i = 0; i < 8; i++) {
-        bytecode.push_back(static_cast<uint8_t>(bits & 0xFF));
-        bits >>= 8;
-    }
+    uint32_t unpackConstant = constantCount++;
+    constantBytes += BytecodeWriter::stringConstantSize(6);
+    bool countInline = n <= LOADK_MAX_INDEX;
+    uint32_t countConstant = countInline ? 0 : constantCount++;
+    if (!countInline) constantBytes += BytecodeWriter::numberConstantSize();
     
-    // Y constant  
-    bytecode.push_back(LBC_CONSTANT_NUMBER);
-    double dy = y;
-    std::memcpy(&bits, &dy, sizeof(double));
-    for (int i = 0; i < 8; i++) {
-        bytecode.push_back(static_cast<uint8_t>(bits & 0xFF));
-        bits >>= 8;
-    }
+    // GETGLOBAL + AUX, NEWTABLE + AUX, loads, SETLIST + AUX per batch,
+    // LOADN 1, the count, CALL, RETURN
+    uint32_t sizeCode = 2 + 2 + costs.loadWords + arrayBatches(n) * 2 + 1 +
+                        (countInline ? 1 : loadConstantWords(countConstant)) + 2;
+    uint32_t maxStack = 2 + std::min(n, SETLIST_BATCH);
     
-    // Functions: 1
-    writeVarInt(1, bytecode);
+    BytecodeWriter writer(BytecodeWriter::chunkSize(constantCount, constantBytes, maxStack, sizeCode));
+    writer.beginChunk();
     
-    // Function proto
-    writeVarInt(3, bytecode);  // maxstacksize (vector + x + y)
-    writeVarInt(0, bytecode);  // numparams
-    writeVarInt(0, bytecode);  // numupvalues
-    writeVarInt(0, bytecode);  // is_vararg
+    writer.writeVarInt(constantCount);
+    writeValueConstants(writer, values, count);
+    writer.writeConstantString("unpack", 6);
+    if (!countInline) writer.writeConstantNumber(n);
     
-    // Instructions: 5 (load x, load y, get Vector2, call new)
-    writeVarInt(5, bytecode);
+    writer.writeVarInt(1);
+    writer.beginProto(maxStack, 0, 0, false, sizeCode);
     
-    // 1. Load X into reg 1
-    bytecode.push_back(encodeOpcode(LOP_LOADN));
-    bytecode.push_back(0x01);
-    bytecode.push_back(0x00);
+    writer.emitABC(LOP_GETGLOBAL, 0, 0, 0);
+    writer.emitAux(unpackConstant);
+    writer.emitABC(LOP_NEWTABLE, 1, 0, 0);
+    writer.emitAux(n);
     
-    // 2. Load Y into reg 2
-    bytecode.push_back(encodeOpcode(LOP_LOADN));
-    bytecode.push_back(0x02);
-    bytecode.push_back(0x01);
+    uint32_t constant = 0;
+    emitArrayBatches(writer, 1, values, n, constant);
     
-    // 3. Get Vector2 global
-    // Need to add "Vector2" string constant
-    // This is simplified - actual implementation would need proper constant handling
+    writer.emitAD(LOP_LOADN, 2, 1);
+    if (countInline) writer.emitAD(LOP_LOADN, 3, static_cast<int16_t>(n));
+    else writer.emitLoadConstant(3, countConstant);
+    writer.emitABC(LOP_CALL, 0, 4, 0);
+    writer.emitABC(LOP_RETURN, 0, 0, 0);
     
-    // For now, return a simple table
-    return CreatePushTable(2, 0);
+    writer.endProto(constantCount);
+    return writer.finish();
+}
+
+std::string CreatePushMultiple(const std::vector<std::string>& values) {
+    if (values.empty()) {
+        return CreatePushNil();
+    }
+    
+    // Text form: "true"/"false" are booleans, whole-string numbers are
+    // numbers, everything else is a string
+    std::vector<PushValue> typed;
+    typed.reserve(values.size());
+    for (const auto& val : values) {
+        if (val == "true" || val == "false") {
+            typed.push_back(PushValue::Boolean(val == "true"));
+            continue;
+        }
+        char* end;
+        double num = strtod(val.c_str(), &end);
+        if (end != val.c_str() && *end == '\0') typed.push_back(PushValue::Number(num));
+        else typed.push_back(PushValue::String(val));
+    }
+    
+    return CreatePushValues(typed);
+}
+
+// ==================== ROBOX-SPECIFIC TYPES ====================
+
+std::string CreatePushVector2(float x, float y) {
+    // Needs a Vector2.new import; push the components as {x, y} until that lands
+    const PushValue components[] = {PushValue::Number(x), PushValue::Number(y)};
+    return pushArray(components, 2);
 }
 
 std::string CreatePushVector3(float x, float y, float z) {
-    // Similar to Vector2 but with 3 values
-    return CreatePushTable(3, 0);
+    // Same stand-in as Vector2: {x, y, z}
+    const PushValue components[] = {PushValue::Number(x), PushValue::Number(y), PushValue::Number(z)};
+    return pushArray(components, 3);
 }
 
 // ==================== UTILITY FUNCTIONS ====================
@@ -603,29 +689,9 @@ std::string HexDump(const std::string& data, size_t maxBytes) {
     return oss.str();
 }
 
-bool ValidateBytecode(const std::string& bytecode) {
-    if (bytecode.size() < sizeof(LuauBytecodeHeader)) {
-        return false;
-    }
-    
-    const LuauBytecodeHeader* header = 
-        reinterpret_cast<const LuauBytecodeHeader*>(bytecode.data());
-    
-    if (header->version != 0x02) {
-        return false;
-    }
-    
-    if (header->size != bytecode.size() - sizeof(LuauBytecodeHeader)) {
-        return false;
-    }
-    
-    // Check hash
-    uint32_t calculated = hashBytecode(
-        reinterpret_cast<const uint8_t*>(bytecode.data() + sizeof(LuauBytecodeHeader)),
-        header->size
-    );
-    
-    return header->hash == calculated;
+bool ValidateBytecode(std::string_view bytecode) {
+    // Header, hash and full structural check
+    return VerifyBytecode(reinterpret_cast<const uint8_t*>(bytecode.data()), bytecode.size()) == VERIFY_OK;
 }
 
 std::string Decompress(const std::string& signedBytecode) {
@@ -646,320 +712,4 @@ std::string Decompress(const std::string& signedBytecode) {
     return signedBytecode;
 }
 
-// ==================== BYTECODE CACHE ====================
-
-std::string BytecodeCache::getBoolean(bool value) {
-    auto it = boolCache.find(value);
-    if (it != boolCache.end()) return it->second;
-    
-    std::string bytecode = CreatePushBoolean(value);
-    boolCache[value] = bytecode;
-    return bytecode;
-}
-
-std::string BytecodeCache::getNumber(double value) {
-    auto it = numberCache.find(value);
-    if (it != numberCache.end()) return it->second;
-    
-    std::string bytecode = CreatePushNumber(value);
-    numberCache[value] = bytecode;
-    return bytecode;
-}
-
-std::string BytecodeCache::getString(const std::string& value) {
-    auto it = stringCache.find(value);
-    if (it != stringCache.end()) return it->second;
-    
-    std::string bytecode = CreatePushString(value);
-    stringCache[value] = bytecode;
-    return bytecode;
-}
-
-std::string BytecodeCache::getInteger(int value) {
-    auto it = integerCache.find(value);
-    if (it != integerCache.end()) return it->second;
-    
-    std::string bytecode = CreatePushNumber(static_cast<double>(value));
-    integerCache[value] = bytecode;
-    return bytecode;
-}
-
-void BytecodeCache::clear() {
-    boolCache.clear();
-    numberCache.clear();
-    stringCache.clear();
-    integerCache.clear();
-}
-
-// ==================== COMPILER CLASS ====================
-
-Compiler::Compiler() {
-    // Initialize with header
-    LuauBytecodeHeader header = {0x02, 0x00, 0x08, 0x08, 0, 0};
-    bytecode.insert(bytecode.end(), 
-                   reinterpret_cast<uint8_t*>(&header),
-                   reinterpret_cast<uint8_t*>(&header) + sizeof(header));
-}
-
-void Compiler::writeVarInt(uint32_t value) {
-    do {
-        uint8_t byte = value & 0x7F;
-        value >>= 7;
-        if (value != 0) byte |= 0x80;
-        bytecode.push_back(byte);
-    } while (value != 0);
-}
-
-void Compiler::writeString(const std::string& str) {
-    writeVarInt(str.size());
-    bytecode.insert(bytecode.end(), str.begin(), str.end());
-}
-
-void Compiler::writeDouble(double value) {
-    uint64_t bits;
-    std::memcpy(&bits, &value, sizeof(double));
-    for (int i = 0; i < 8; i++) {
-        bytecode.push_back(static_cast<uint8_t>(bits & 0xFF));
-        bits >>= 8;
-    }
-}
-
-void Compiler::writeByte(uint8_t value) {
-    bytecode.push_back(value);
-}
-
-uint8_t Compiler::encodeOpcode(uint8_t opcode) {
-    return (opcode * 227) & 0xFF;
-}
-
-int Compiler::addConstant(const std::string& value) {
-    constants.push_back(value);
-    return constants.size() - 1;
-}
-
-int Compiler::addNumberConstant(double value) {
-    numberConstants.push_back(value);
-    return numberConstants.size() - 1;
-}
-
-int Compiler::addBoolConstant(bool value) {
-    boolConstants.push_back(value);
-    return boolConstants.size() - 1;
-}
-
-void Compiler::addLoadNil(int reg) {
-    bytecode.push_back(encodeOpcode(LOP_LOADNIL));
-    bytecode.push_back(static_cast<uint8_t>(reg));
-}
-
-void Compiler::addLoadBool(int reg, bool value, int jump) {
-    bytecode.push_back(encodeOpcode(LOP_LOADB));
-    bytecode.push_back(static_cast<uint8_t>(reg));
-    bytecode.push_back(value ? 0x01 : 0x00);
-    bytecode.push_back(static_cast<uint8_t>(jump));
-}
-
-void Compiler::pushNil() {
-    // Add LOADNIL instruction
-    bytecode.push_back(encodeOpcode(LOP_LOADNIL));
-    bytecode.push_back(0x00);  // Register 0
-}
-
-void Compiler::pushBoolean(bool value) {
-    // Add LOADB instruction
-    bytecode.push_back(encodeOpcode(LOP_LOADB));
-    bytecode.push_back(0x00);  // Register 0
-    bytecode.push_back(value ? 0x01 : 0x00);
-    bytecode.push_back(0x00);  // No jump
-}
-
-void Compiler::pushNumber(double value) {
-    // Add number constant and LOADN instruction
-    int constIdx = addNumberConstant(value);
-    
-    bytecode.push_back(encodeOpcode(LOP_LOADN));
-    bytecode.push_back(0x00);  // Register 0
-    bytecode.push_back(static_cast<uint8_t>(constIdx));
-}
-
-void Compiler::pushString(const std::string& value) {
-    // Add string constant and LOADK instruction
-    int constIdx = addConstant(value);
-    
-    bytecode.push_back(encodeOpcode(LOP_LOADK));
-    bytecode.push_back(0x00);  // Register 0
-    bytecode.push_back(static_cast<uint8_t>(constIdx));
-}
-
-void Compiler::pushTable(int arraySize, int hashSize) {
-    // Add NEWTABLE instruction
-    bytecode.push_back(encodeOpcode(LOP_NEWTABLE));
-    bytecode.push_back(0x00);  // Register 0
-    bytecode.push_back(static_cast<uint8_t>(arraySize));
-    bytecode.push_back(static_cast<uint8_t>(hashSize));
-}
-
-void Compiler::pushArray(const std::vector<std::string>& values) {
-    if (values.empty()) {
-        pushTable(0, 0);
-        return;
-    }
-    
-    // Create table with array size
-    pushTable(values.size(), 0);
-    
-    // Add each value as constant
-    for (size_t i = 0; i < values.size(); i++) {
-        int constIdx = addConstant(values[i]);
-        
-        // Load constant into register i+1
-        bytecode.push_back(encodeOpcode(LOP_LOADK));
-        bytecode.push_back(static_cast<uint8_t>(i + 1));
-        bytecode.push_back(static_cast<uint8_t>(constIdx));
-    }
-    
-    // Add SETLIST to populate array
-    bytecode.push_back(encodeOpcode(LOP_SETLIST));
-    bytecode.push_back(0x00);  // Table register
-    bytecode.push_back(static_cast<uint8_t>(values.size()));
-    bytecode.push_back(0x00);  // Start index
-}
-
-void Compiler::addNewTable(int reg, int arraySize, int hashSize) {
-    bytecode.push_back(encodeOpcode(LOP_NEWTABLE));
-    bytecode.push_back(static_cast<uint8_t>(reg));
-    bytecode.push_back(static_cast<uint8_t>(arraySize));
-    bytecode.push_back(static_cast<uint8_t>(hashSize));
-}
-
-void Compiler::addSetTable(int tableReg, int keyReg, int valueReg) {
-    bytecode.push_back(encodeOpcode(LOP_SETTABLE));
-    bytecode.push_back(static_cast<uint8_t>(tableReg));
-    bytecode.push_back(static_cast<uint8_t>(keyReg));
-    bytecode.push_back(static_cast<uint8_t>(valueReg));
-}
-
-void Compiler::addSetList(int tableReg, int startReg, int count, int tableIndex) {
-    bytecode.push_back(encodeOpcode(LOP_SETLIST));
-    bytecode.push_back(static_cast<uint8_t>(tableReg));
-    bytecode.push_back(static_cast<uint8_t>(count));
-    bytecode.push_back(static_cast<uint8_t>(tableIndex));
-}
-
-void Compiler::addReturn(int startReg, int count) {
-    bytecode.push_back(encodeOpcode(LOP_RETURN));
-    bytecode.push_back(static_cast<uint8_t>(startReg));
-    bytecode.push_back(static_cast<uint8_t>(count));
-}
-
-void Compiler::addCall(int funcReg, int argCount, int resultCount) {
-    bytecode.push_back(encodeOpcode(LOP_CALL));
-    bytecode.push_back(static_cast<uint8_t>(funcReg));
-    bytecode.push_back(static_cast<uint8_t>(argCount + 1));  // +1 for function itself
-    bytecode.push_back(static_cast<uint8_t>(resultCount + 1));  // +1 for function
-}
-
-void Compiler::addLoadConst(int reg, int constIdx) {
-    bytecode.push_back(encodeOpcode(LOP_LOADK));
-    bytecode.push_back(static_cast<uint8_t>(reg));
-    bytecode.push_back(static_cast<uint8_t>(constIdx));
-}
-
-void Compiler::addMove(int dest, int src) {
-    bytecode.push_back(encodeOpcode(LOP_MOVE));
-    bytecode.push_back(static_cast<uint8_t>(dest));
-    bytecode.push_back(static_cast<uint8_t>(src));
-}
-
-std::string Compiler::compile() {
-    // Start over with fresh bytecode
-    std::vector<uint8_t> result;
-    
-    // Write header placeholder
-    LuauBytecodeHeader header = {0x02, 0x00, 0x08, 0x08, 0, 0};
-    result.insert(result.end(), 
-                 reinterpret_cast<uint8_t*>(&header),
-                 reinterpret_cast<uint8_t*>(&header) + sizeof(header));
-    
-    // Write constants
-    writeVarInt(constants.size() + numberConstants.size() + boolConstants.size());
-    
-    // Write number constants
-    for (double num : numberConstants) {
-        result.push_back(LBC_CONSTANT_NUMBER);
-        writeDouble(num);
-    }
-    
-    // Write boolean constants
-    for (bool b : boolConstants) {
-        result.push_back(LBC_CONSTANT_BOOLEAN);
-        result.push_back(b ? 0x01 : 0x00);
-    }
-    
-    // Write string constants
-    for (const auto& str : constants) {
-        result.push_back(LBC_CONSTANT_STRING);
-        writeVarInt(str.size());
-        result.insert(result.end(), str.begin(), str.end());
-    }
-    
-    // Write function proto
-    // This is simplified - actual implementation would need proper proto structure
-    
-    // Update header
-    header.size = result.size() - sizeof(header);
-    header.hash = hashBytecode(result.data() + sizeof(header), header.size);
-    std::memcpy(result.data(), &header, sizeof(header));
-    
-    return std::string(reinterpret_cast<char*>(result.data()), result.size());
-}
-
-std::string Compiler::getBytecode() const {
-    return std::string(reinterpret_cast<const char*>(bytecode.data()), bytecode.size());
-}
-
-void Compiler::clear() {
-    bytecode.clear();
-    constants.clear();
-    numberConstants.clear();
-    boolConstants.clear();
-    
-    // Re-add header
-    LuauBytecodeHeader header = {0x02, 0x00, 0x08, 0x08, 0, 0};
-    bytecode.insert(bytecode.end(), 
-                   reinterpret_cast<uint8_t*>(&header),
-                   reinterpret_cast<uint8_t*>(&header) + sizeof(header));
-}
-
-// ==================== PUBLIC API WRAPPERS ====================
-
-std::string Compile(const std::string& source) {
-    // Very basic compilation - just handles simple return statements
-    if (source.find("return ") == 0) {
-        std::string value = source.substr(7);
-        
-        // Check for nil
-        if (value == "nil") return CreatePushNil();
-        
-        // Check for boolean
-        if (value == "true") return CreatePushBoolean(true);
-        if (value == "false") return CreatePushBoolean(false);
-        
-        // Check for number
-        char* end;
-        double num = strtod(value.c_str(), &end);
-        if (end != value.c_str() && *end == '\0') {
-            return CreatePushNumber(num);
-        }
-        
-        // Check for string (quoted)
-        if (value.size() >= 2 && value[0] == '"' && value.back() == '"') {
-            return CreatePushString(value.substr(1, value.size() - 2));
-        }
-    }
-    
-    // Default to nil
-    return CreatePushNil();
-}
-
 } // namespace Bytecode
@@ -0,0 +1,192 @@
+#include "BytecodeBundle.h"
+#include "BytecodeWriter.h"
+#include <algorithm>
+#include <cstring>
+
+namespace Bytecode {
+
+static const char BUNDLE_MAGIC[4] = {'T', 'B', 'B', 'L'};
+
+static uint32_t hashBytes(std::string_view bytes) {
+    return fnv1a(FNV_OFFSET_BASIS, reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size());
+}
+
+static bool fail(std::string* error, const char* message) {
+    if (error) *error = message;
+    return false;
+}
+
+// ==================== WRITER ====================
+
+bool BundleWriter::add(std::string_view name, std::string_view chunk) {
+    if (name.size() > UINT32_MAX || chunk.size() > UINT32_MAX) return false;
+    if (names.find(std::string(name)) != names.end()) return false;
+
+    uint32_t hash = hashBytes(chunk);
+    uint32_t blob = static_cast<uint32_t>(blobs.size());
+    auto range = blobsByHash.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (blobs[it->second].bytes == chunk) {
+            blob = it->second;
+            break;
+        }
+    }
+
+    if (blob == blobs.size()) {
+        blobs.push_back(Blob{std::string(chunk), hash});
+        blobsByHash.emplace(hash, blob);
+    }
+    names.emplace(std::string(name), blob);
+    return true;
+}
+
+std::string BundleWriter::build() const {
+    struct Name {
+        std::string_view name;
+        uint32_t hash;
+        uint32_t blob;
+    };
+
+    std::vector<Name> sorted;
+    sorted.reserve(names.size());
+    for (const auto& entry : names) sorted.push_back(Name{entry.first, hashBytes(entry.first), entry.second});
+    std::sort(sorted.begin(), sorted.end(), [](const Name& a, const Name& b) {
+        return a.hash != b.hash ? a.hash < b.hash : a.name < b.name;
+    });
+
+    size_t nameOffset = BundleReader::HEADER_SIZE + blobs.size() * BundleReader::BLOB_SIZE +
+                        sorted.size() * BundleReader::NAME_SIZE;
+    size_t blobOffset = nameOffset;
+    for (const Name& name : sorted) blobOffset += name.name.size();
+    size_t total = blobOffset;
+    for (const Blob& blob : blobs) total += blob.bytes.size();
+
+    std::string file(total, '\0');
+    uint8_t* out = reinterpret_cast<uint8_t*>(&file[0]);
+    std::memcpy(out, BUNDLE_MAGIC, 4);
+    storeU32(out + 4, BundleReader::VERSION);
+    storeU32(out + 8, static_cast<uint32_t>(sorted.size()));
+    storeU32(out + 12, static_cast<uint32_t>(blobs.size()));
+    storeU64(out + 16, total);
+
+    uint8_t* record = out + BundleReader::HEADER_SIZE;
+    for (const Blob& blob : blobs) {
+        storeU64(record, blobOffset);
+        storeU32(record + 8, static_cast<uint32_t>(blob.bytes.size()));
+        storeU32(record + 12, blob.hash);
+        std::memcpy(out + blobOffset, blob.bytes.data(), blob.bytes.size());
+        blobOffset += blob.bytes.size();
+        record += BundleReader::BLOB_SIZE;
+    }
+
+    for (const Name& name : sorted) {
+        storeU32(record, name.hash);
+        storeU32(record + 4, name.blob);
+        storeU64(record + 8, nameOffset);
+        storeU32(record + 16, static_cast<uint32_t>(name.name.size()));
+        std::memcpy(out + nameOffset, name.name.data(), name.name.size());
+        nameOffset += name.name.size();
+        record += BundleReader::NAME_SIZE;
+    }
+
+    return file;
+}
+
+bool BundleWriter::write(const char* path, std::string* error) const {
+    if (names.size() > UINT32_MAX) return fail(error, "too many names");
+    return WriteFileAtomic(path, build(), error);
+}
+
+// ==================== READER ====================
+
+bool BundleReader::open(const char* path, std::string* error) {
+    close();
+
+    const uint8_t* bytes;
+    size_t size;
+    if (!MapFile(path, &bytes, &size, error)) return false;
+
+    uint32_t names = size >= HEADER_SIZE ? loadU32(bytes + 8) : 0;
+    uint32_t blobs = size >= HEADER_SIZE ? loadU32(bytes + 12) : 0;
+    const char* problem = nullptr;
+    if (size < HEADER_SIZE) problem = "truncated header";
+    else if (std::memcmp(bytes, BUNDLE_MAGIC, 4) != 0) problem = "bad magic";
+    else if (loadU32(bytes + 4) != VERSION) problem = "unsupported version";
+    else if (loadU64(bytes + 16) != size) problem = "size mismatch";
+    else if ((size - HEADER_SIZE) / BLOB_SIZE < blobs ||
+             (size - HEADER_SIZE - size_t(blobs) * BLOB_SIZE) / NAME_SIZE < names) problem = "truncated index";
+
+    // One pass over both tables so every view handed out later is in bounds
+    const uint8_t* blobRecords = bytes + HEADER_SIZE;
+    const uint8_t* nameRecords = blobRecords + size_t(blobs) * BLOB_SIZE;
+    for (uint32_t i = 0; !problem && i < blobs; i++) {
+        const uint8_t* record = blobRecords + size_t(i) * BLOB_SIZE;
+        uint64_t offset = loadU64(record);
+        if (offset > size || size - offset < loadU32(record + 8)) problem = "blob out of bounds";
+    }
+    for (uint32_t i = 0; !problem && i < names; i++) {
+        const uint8_t* record = nameRecords + size_t(i) * NAME_SIZE;
+        uint64_t offset = loadU64(record + 8);
+        if (loadU32(record + 4) >= blobs) problem = "bad blob index";
+        else if (offset > size || size - offset < loadU32(record + 16)) problem = "name out of bounds";
+    }
+
+    if (problem) {
+        UnmapFile(bytes, size);
+        return fail(error, problem);
+    }
+
+    base = bytes;
+    mappedSize = size;
+    nameCount = names;
+    blobTotal = blobs;
+    blobTable = blobRecords;
+    nameTable = nameRecords;
+    return true;
+}
+
+void BundleReader::close() {
+    if (base) UnmapFile(base, mappedSize);
+    base = nullptr;
+    mappedSize = 0;
+    nameCount = 0;
+    blobTotal = 0;
+    blobTable = nullptr;
+    nameTable = nullptr;
+}
+
+std::string_view BundleReader::find(std::string_view name) const {
+    uint32_t hash = hashBytes(name);
+
+    // Lower bound on (hash, name) over the sorted name table
+    size_t low = 0;
+    size_t high = nameCount;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        const uint8_t* record = nameTable + mid * NAME_SIZE;
+        uint32_t midHash = loadU32(record);
+        bool less = midHash != hash ? midHash < hash
+                                    : std::string_view(reinterpret_cast<const char*>(base + loadU64(record + 8)),
+                                                       loadU32(record + 16)) < name;
+        if (less) low = mid + 1;
+        else high = mid;
+    }
+
+    if (low == nameCount) return std::string_view();
+    BundleEntry found = entry(low);
+    if (found.name != name) return std::string_view();
+    return found.chunk;
+}
+
+BundleEntry BundleReader::entry(size_t i) const {
+    const uint8_t* record = nameTable + i * NAME_SIZE;
+    const uint8_t* blob = blobTable + size_t(loadU32(record + 4)) * BLOB_SIZE;
+
+    BundleEntry result;
+    result.name = std::string_view(reinterpret_cast<const char*>(base + loadU64(record + 8)), loadU32(record + 16));
+    result.chunk = std::string_view(reinterpret_cast<const char*>(base + loadU64(blob)), loadU32(blob + 8));
+    result.contentHash = loadU32(blob + 12);
+    return result;
+}
+
+} // namespace Bytecode
@@ -0,0 +1,631 @@
+#include "BytecodeCache.h"
+#include "BytecodeLiterals.h"
+#include "BytecodeWriter.h"
+#include <cstring>
+#include <mutex>
+
+namespace Bytecode {
+
+// ==================== SHARED HELPERS ====================
+
+CacheKey CacheKey::number(double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return CacheKey{CACHE_KEY_NUMBER, bits, {}};
+}
+
+static ChunkHandle generateChunk(const CacheKey& key) {
+    switch (key.kind) {
+        case CACHE_KEY_NUMBER: {
+            double value;
+            std::memcpy(&value, &key.bits, sizeof(value));
+            return std::make_shared<const std::string>(CreatePushNumber(value));
+        }
+        case CACHE_KEY_INTEGER:
+            return std::make_shared<const std::string>(CreatePushInteger(static_cast<int64_t>(key.bits)));
+        case CACHE_KEY_STRING:
+        default:
+            return std::make_shared<const std::string>(CreatePushString(std::string(key.text)));
+    }
+}
+
+static ChunkHandle booleanChunk(bool value) {
+    static const ChunkHandle trueChunk = std::make_shared<const std::string>(chunkString(TRUE_CHUNK));
+    static const ChunkHandle falseChunk = std::make_shared<const std::string>(chunkString(FALSE_CHUNK));
+    return value ? trueChunk : falseChunk;
+}
+
+// ==================== BYTECODE CACHE ====================
+
+ChunkHandle BytecodeCache::getBoolean(bool value) {
+    return booleanChunk(value);
+}
+
+ChunkHandle BytecodeCache::lookup(const CacheKey& key) {
+    auto it = index.find(key);
+    if (it != index.end()) {
+        hits++;
+        entries.splice(entries.begin(), entries, it->second);
+        return it->second->chunk;
+    }
+
+    misses++;
+    ChunkHandle chunk = generateChunk(key);
+
+    // List node, index node and the shared_ptr control block, roughly
+    constexpr size_t overhead = sizeof(Entry) + sizeof(CacheKey) + sizeof(EntryList::iterator) + 6 * sizeof(void*);
+    size_t bytes = chunk->size() + key.text.size() + overhead;
+    if (bytes > budget) return chunk;
+
+    evictTo(budget - bytes);
+    entries.push_front(Entry{key.kind, key.bits, std::string(key.text), chunk, bytes});
+    Entry& entry = entries.front();
+    index.emplace(CacheKey{entry.kind, entry.bits, entry.text}, entries.begin());
+    resident += bytes;
+    return chunk;
+}
+
+void BytecodeCache::evictTo(size_t limit) {
+    while (resident > limit && !entries.empty()) {
+        Entry& victim = entries.back();
+        index.erase(CacheKey{victim.kind, victim.bits, victim.text});
+        resident -= victim.bytes;
+        entries.pop_back();
+        evictions++;
+    }
+}
+
+void BytecodeCache::setBudget(size_t budgetBytes) {
+    budget = budgetBytes;
+    evictTo(budget);
+}
+
+CacheStats BytecodeCache::stats() const {
+    CacheStats result;
+    result.hits = hits;
+    result.misses = misses;
+    result.evictions = evictions;
+    result.entries = entries.size();
+    result.residentBytes = resident;
+    result.budgetBytes = budget;
+    return result;
+}
+
+void BytecodeCache::resetStats() {
+    hits = 0;
+    misses = 0;
+    evictions = 0;
+}
+
+void BytecodeCache::clear() {
+    index.clear();
+    entries.clear();
+    resident = 0;
+}
+
+bool BytecodeCache::saveSnapshot(const char* path, std::string* error) const {
+    std::vector<SnapshotEntry> gathered;
+    gathered.reserve(entries.size());
+    for (const Entry& entry : entries) {
+        gathered.push_back(SnapshotEntry{CacheKey{entry.kind, entry.bits, entry.text}, *entry.chunk});
+    }
+    return WriteSnapshot(path, gathered, error);
+}
+
+// ==================== CONCURRENT CACHE ====================
+
+// Epoch-based reclamation shared by every ConcurrentBytecodeCache. A reader
+// stores the global epoch in its thread's record while it probes, and zero
+// once it is done. Whatever a writer unlinks is tagged with the epoch it
+// advances past, and freed once every record still reading holds a later
+// epoch: such readers started after the unlink and cannot reach it.
+namespace {
+
+struct alignas(64) ReaderRecord {
+    std::atomic<uint64_t> epoch{0};     // Zero while not reading
+    std::atomic<bool> claimed{false};
+    ReaderRecord* next = nullptr;
+    size_t id = 0;
+};
+
+std::atomic<uint64_t> globalEpoch{1};
+std::atomic<ReaderRecord*> readerRecords{nullptr};
+std::atomic<size_t> readerRecordCount{0};
+
+// Records outlive their threads and are reused by later ones
+struct ReaderRecordOwner {
+    ReaderRecord* record = nullptr;
+
+    ReaderRecordOwner() {
+        for (ReaderRecord* r = readerRecords.load(std::memory_order_acquire); r; r = r->next) {
+            bool expected = false;
+            if (r->claimed.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                record = r;
+                return;
+            }
+        }
+        record = new ReaderRecord();
+        record->claimed.store(true, std::memory_order_relaxed);
+        record->id = readerRecordCount.fetch_add(1, std::memory_order_relaxed);
+        ReaderRecord* head = readerRecords.load(std::memory_order_relaxed);
+        do {
+            record->next = head;
+        } while (!readerRecords.compare_exchange_weak(head, record, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    ~ReaderRecordOwner() { record->claimed.store(false, std::memory_order_release); }
+};
+
+ReaderRecord& localRecord() {
+    thread_local ReaderRecordOwner owner;
+    return *owner.record;
+}
+
+class ReadGuard {
+public:
+    explicit ReadGuard(ReaderRecord& record) : record(record) {
+        // Sequentially consistent with the unlinking stores and the scan in
+        // oldestReader(): either a writer sees this epoch, or this reader
+        // sees everything that writer unlinked
+        record.epoch.store(globalEpoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+    }
+    ~ReadGuard() { record.epoch.store(0, std::memory_order_release); }
+
+private:
+    ReaderRecord& record;
+};
+
+// Tag for something just unlinked
+uint64_t retireEpoch() {
+    return globalEpoch.fetch_add(1, std::memory_order_seq_cst);
+}
+
+// Smallest epoch a reader currently holds, or UINT64_MAX
+uint64_t oldestReader() {
+    uint64_t oldest = UINT64_MAX;
+    for (ReaderRecord* r = readerRecords.load(std::memory_order_acquire); r; r = r->next) {
+        uint64_t epoch = r->epoch.load(std::memory_order_seq_cst);
+        if (epoch && epoch < oldest) oldest = epoch;
+    }
+    return oldest;
+}
+
+} // namespace
+
+ConcurrentBytecodeCache::Entry* const ConcurrentBytecodeCache::TOMBSTONE = reinterpret_cast<Entry*>(uintptr_t(1));
+
+static constexpr size_t MIN_TABLE_SLOTS = 16;    // 2^4
+
+ConcurrentBytecodeCache::ConcurrentBytecodeCache(size_t budgetBytes, size_t shardCount) {
+    size_t count = 1;
+    while (count < shardCount) count <<= 1;
+
+    shards.reset(new Shard[count]);
+    hitStripes.reset(new HitStripe[HIT_STRIPES]);
+    shardMask = count - 1;
+    shardBudget = budgetBytes / count;
+
+    for (size_t i = 0; i < count; i++) {
+        std::lock_guard<std::mutex> lock(shards[i].mutex);
+        rebuild(shards[i], 0);
+    }
+}
+
+ConcurrentBytecodeCache::~ConcurrentBytecodeCache() {
+    // No reader can still be inside this cache
+    for (size_t i = 0; i <= shardMask; i++) {
+        Shard& shard = shards[i];
+        for (Entry* entry : shard.ring) delete entry;
+        for (const Retired& retired : shard.retired) {
+            delete retired.entry;
+            delete retired.table;
+        }
+        delete shard.table.load(std::memory_order_relaxed);
+    }
+}
+
+ChunkHandle ConcurrentBytecodeCache::getBoolean(bool value) {
+    return booleanChunk(value);
+}
+
+void ConcurrentBytecodeCache::countHit() {
+    HitStripe& stripe = hitStripes[localRecord().id & (HIT_STRIPES - 1)];
+    stripe.hits.fetch_add(1, std::memory_order_relaxed);
+}
+
+ChunkHandle ConcurrentBytecodeCache::lookup(const CacheKey& key) {
+    // Tables index on the low bits, so pick the shard from higher ones
+    size_t hash = CacheKeyHash()(key);
+    Shard& shard = shards[(hash >> 24) & shardMask];
+
+    {
+        ReadGuard guard(localRecord());
+        const Table* table = shard.table.load(std::memory_order_seq_cst);
+        for (size_t i = table->home(hash);; i = (i + 1) & table->mask) {
+            Entry* entry = table->slots[i].load(std::memory_order_seq_cst);
+            if (!entry) break;
+            if (entry == TOMBSTONE || entry->hash != hash || !entry->matches(key)) continue;
+
+            if (!entry->referenced.load(std::memory_order_relaxed)) {
+                entry->referenced.store(true, std::memory_order_relaxed);
+            }
+            ChunkHandle chunk = entry->chunk;
+            countHit();
+            return chunk;
+        }
+    }
+
+    // Missed the published table: under the mutex the key is either settled
+    // by now, pending on another thread, or ours to generate
+    std::promise<ChunkHandle> promise;
+    std::shared_future<ChunkHandle> waitFor;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        const Table* table = shard.table.load(std::memory_order_relaxed);
+        for (size_t i = table->home(hash);; i = (i + 1) & table->mask) {
+            Entry* entry = table->slots[i].load(std::memory_order_relaxed);
+            if (!entry) break;
+            if (entry != TOMBSTONE && entry->hash == hash && entry->matches(key)) {
+                entry->referenced.store(true, std::memory_order_relaxed);
+                countHit();
+                return entry->chunk;
+            }
+        }
+        for (const auto& pending : shard.pending) {
+            if (pending->matches(key)) {
+                waitFor = pending->future;
+                break;
+            }
+        }
+        if (!waitFor.valid()) {
+            shard.pending.push_back(std::make_unique<Pending>(
+                Pending{key.kind, key.bits, std::string(key.text), promise.get_future().share()}));
+            shard.misses++;
+        }
+    }
+    if (waitFor.valid()) {
+        countHit();
+        return waitFor.get();
+    }
+
+    ChunkHandle chunk;
+    try {
+        chunk = generateChunk(key);
+    } catch (...) {
+        // Later lookups of this key build it afresh; current waiters rethrow
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            dropPending(shard, key);
+        }
+        promise.set_exception(std::current_exception());
+        throw;
+    }
+
+    insert(shard, key, hash, chunk);
+    promise.set_value(chunk);
+    return chunk;
+}
+
+void ConcurrentBytecodeCache::dropPending(Shard& shard, const CacheKey& key) {
+    for (auto it = shard.pending.begin(); it != shard.pending.end(); ++it) {
+        if ((*it)->matches(key)) {
+            shard.pending.erase(it);
+            return;
+        }
+    }
+}
+
+void ConcurrentBytecodeCache::insert(Shard& shard, const CacheKey& key, size_t hash, const ChunkHandle& chunk) {
+    auto entry = std::make_unique<Entry>();
+    entry->kind = key.kind;
+    entry->bits = key.bits;
+    entry->text.assign(key.text.data(), key.text.size());
+    entry->chunk = chunk;
+    entry->hash = hash;
+
+    // Entry, its slot and the shared_ptr control block, roughly
+    constexpr size_t overhead = sizeof(Entry) + sizeof(void*) + 4 * sizeof(void*);
+    entry->bytes = entry->text.size() + chunk->size() + overhead;
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    dropPending(shard, key);
+    if (entry->bytes > shardBudget) {
+        shard.evictions++;
+        return;
+    }
+
+    evictTo(shard, shardBudget - entry->bytes, false);
+    publish(shard, entry.release());
+    reclaim(shard);
+}
+
+void ConcurrentBytecodeCache::publish(Shard& shard, Entry* entry) {
+    // Keep at least a quarter of the slots empty so probes stay short and
+    // always end; tombstones count against that until a rebuild drops them
+    Table* table = shard.table.load(std::memory_order_relaxed);
+    if ((shard.used + 1) * 4 > (table->mask + 1) * 3) {
+        rebuild(shard, shard.ring.size() + 1);
+        table = shard.table.load(std::memory_order_relaxed);
+    }
+
+    size_t i = table->home(entry->hash);
+    while (table->slots[i].load(std::memory_order_relaxed)) i = (i + 1) & table->mask;
+    table->slots[i].store(entry, std::memory_order_seq_cst);
+    shard.used++;
+    shard.ring.push_back(entry);
+    shard.resident += entry->bytes;
+}
+
+void ConcurrentBytecodeCache::rebuild(Shard& shard, size_t live) {
+    size_t slots = MIN_TABLE_SLOTS;
+    unsigned shift = 64 - 4;
+    while (slots < live * 2) {
+        slots <<= 1;
+        shift--;
+    }
+
+    Table* table = new Table();
+    table->mask = slots - 1;
+    table->shift = shift;
+    table->slots.reset(new std::atomic<Entry*>[slots]);
+    for (size_t i = 0; i < slots; i++) table->slots[i].store(nullptr, std::memory_order_relaxed);
+    for (Entry* entry : shard.ring) {
+        size_t i = table->home(entry->hash);
+        while (table->slots[i].load(std::memory_order_relaxed)) i = (i + 1) & table->mask;
+        table->slots[i].store(entry, std::memory_order_relaxed);
+    }
+    shard.used = shard.ring.size();
+
+    Table* old = shard.table.exchange(table, std::memory_order_seq_cst);
+    if (old) shard.retired.push_back(Retired{retireEpoch(), nullptr, old});
+}
+
+void ConcurrentBytecodeCache::unlink(Shard& shard, Entry* entry) {
+    Table* table = shard.table.load(std::memory_order_relaxed);
+    size_t i = table->home(entry->hash);
+    while (table->slots[i].load(std::memory_order_relaxed) != entry) i = (i + 1) & table->mask;
+    table->slots[i].store(TOMBSTONE, std::memory_order_seq_cst);
+
+    shard.resident -= entry->bytes;
+    shard.evictions++;
+    shard.retired.push_back(Retired{retireEpoch(), entry, nullptr});
+}
+
+void ConcurrentBytecodeCache::evictTo(Shard& shard, size_t limit, bool force) {
+    // CLOCK: a referenced entry loses its bit and survives one more pass.
+    // Two full turns clear every bit, so the sweep is bounded.
+    size_t remaining = shard.ring.size() * 2;
+    while (shard.resident > limit && !shard.ring.empty() && remaining-- > 0) {
+        if (shard.hand >= shard.ring.size()) shard.hand = 0;
+        Entry* entry = shard.ring[shard.hand];
+        if (!force && entry->referenced.exchange(false, std::memory_order_relaxed)) {
+            shard.hand++;
+            continue;
+        }
+
+        // The last entry takes the victim's place in the ring, and the hand
+        // stays put to look at it next
+        shard.ring[shard.hand] = shard.ring.back();
+        shard.ring.pop_back();
+        unlink(shard, entry);
+    }
+}
+
+void ConcurrentBytecodeCache::reclaim(Shard& shard) {
+    if (shard.retired.empty()) return;
+
+    uint64_t oldest = oldestReader();
+    size_t kept = 0;
+    for (const Retired& retired : shard.retired) {
+        if (retired.epoch < oldest) {
+            delete retired.entry;
+            delete retired.table;
+        } else {
+            shard.retired[kept++] = retired;
+        }
+    }
+    shard.retired.resize(kept);
+}
+
+CacheStats ConcurrentBytecodeCache::stats() const {
+    CacheStats result;
+    for (size_t i = 0; i < HIT_STRIPES; i++) result.hits += hitStripes[i].hits.load(std::memory_order_relaxed);
+    for (size_t i = 0; i <= shardMask; i++) {
+        Shard& shard = shards[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        result.misses += shard.misses;
+        result.evictions += shard.evictions;
+        result.entries += shard.ring.size();
+        result.residentBytes += shard.resident;
+        result.budgetBytes += shardBudget;
+    }
+    return result;
+}
+
+void ConcurrentBytecodeCache::clear() {
+    for (size_t i = 0; i <= shardMask; i++) {
+        Shard& shard = shards[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        evictTo(shard, 0, true);
+        rebuild(shard, 0);
+        reclaim(shard);
+    }
+}
+
+bool ConcurrentBytecodeCache::saveSnapshot(const char* path, std::string* error) const {
+    // Entries are only freed under their shard's mutex, so holding every
+    // mutex keeps the gathered views alive
+    std::vector<std::unique_lock<std::mutex>> locks;
+    std::vector<SnapshotEntry> gathered;
+    for (size_t i = 0; i <= shardMask; i++) {
+        Shard& shard = shards[i];
+        locks.emplace_back(shard.mutex);
+        for (const Entry* entry : shard.ring) {
+            gathered.push_back(SnapshotEntry{CacheKey{entry->kind, entry->bits, entry->text}, *entry->chunk});
+        }
+    }
+    return WriteSnapshot(path, gathered, error);
+}
+
+// ==================== SNAPSHOTS ====================
+
+static const char SNAPSHOT_MAGIC[4] = {'T', 'B', 'C', 'S'};
+
+// std::hash differs between builds, so snapshots hash keys themselves
+static uint32_t snapshotHash(CacheKeyKind kind, uint64_t bits, std::string_view text) {
+    uint8_t head[9];
+    head[0] = kind;
+    for (int i = 0; i < 8; i++) head[1 + i] = static_cast<uint8_t>(bits >> (8 * i));
+    uint32_t hash = fnv1a(FNV_OFFSET_BASIS, head, sizeof(head));
+    return fnv1a(hash, reinterpret_cast<const uint8_t*>(text.data()), text.size());
+}
+
+static bool fail(std::string* error, const char* message) {
+    if (error) *error = message;
+    return false;
+}
+
+bool WriteSnapshot(const char* path, const std::vector<SnapshotEntry>& entries, std::string* error) {
+    if (entries.size() > UINT32_MAX / 4) return fail(error, "too many entries");
+
+    uint32_t slots = 8;
+    while (slots < entries.size() * 2) slots <<= 1;
+
+    size_t dataOffset = CacheSnapshot::HEADER_SIZE + size_t(slots) * CacheSnapshot::SLOT_SIZE;
+    size_t total = dataOffset;
+    for (const SnapshotEntry& entry : entries) {
+        if (entry.key.text.size() > UINT32_MAX || entry.chunk.size() > UINT32_MAX) return fail(error, "entry too large");
+        total += entry.key.text.size() + entry.chunk.size();
+    }
+
+    std::string file(total, '\0');
+    uint8_t* out = reinterpret_cast<uint8_t*>(&file[0]);
+    std::memcpy(out, SNAPSHOT_MAGIC, 4);
+    storeU32(out + 4, CacheSnapshot::VERSION);
+    storeU32(out + 8, static_cast<uint32_t>(entries.size()));
+    storeU32(out + 12, slots);
+    storeU64(out + 16, total);
+
+    size_t offset = dataOffset;
+    for (const SnapshotEntry& entry : entries) {
+        const CacheKey& key = entry.key;
+        uint32_t hash = snapshotHash(key.kind, key.bits, key.text);
+
+        uint32_t slot = hash & (slots - 1);
+        while (loadU32(out + CacheSnapshot::HEADER_SIZE + size_t(slot) * CacheSnapshot::SLOT_SIZE + 28) != 0) {
+            slot = (slot + 1) & (slots - 1);
+        }
+
+        uint8_t* record = out + CacheSnapshot::HEADER_SIZE + size_t(slot) * CacheSnapshot::SLOT_SIZE;
+        record[0] = key.kind;
+        storeU32(record + 4, hash);
+        storeU64(record + 8, key.bits);
+        storeU64(record + 16, offset);
+        storeU32(record + 24, static_cast<uint32_t>(key.text.size()));
+        storeU32(record + 28, static_cast<uint32_t>(entry.chunk.size()));
+
+        std::memcpy(out + offset, key.text.data(), key.text.size());
+        offset += key.text.size();
+        std::memcpy(out + offset, entry.chunk.data(), entry.chunk.size());
+        offset += entry.chunk.size();
+    }
+
+    return WriteFileAtomic(path, file, error);
+}
+
+bool CacheSnapshot::open(const char* path, std::string* error) {
+    close();
+
+    const uint8_t* bytes;
+    size_t size;
+    if (!MapFile(path, &bytes, &size, error)) return false;
+
+    uint32_t entries = size >= HEADER_SIZE ? loadU32(bytes + 8) : 0;
+    uint32_t slots = size >= HEADER_SIZE ? loadU32(bytes + 12) : 0;
+    const char* problem = nullptr;
+    if (size < HEADER_SIZE) problem = "truncated header";
+    else if (std::memcmp(bytes, SNAPSHOT_MAGIC, 4) != 0) problem = "bad magic";
+    else if (loadU32(bytes + 4) != VERSION) problem = "unsupported version";
+    else if (loadU64(bytes + 16) != size) problem = "size mismatch";
+    else if (slots == 0 || (slots & (slots - 1)) != 0 || entries >= slots) problem = "bad slot count";
+    else if ((size - HEADER_SIZE) / SLOT_SIZE < slots) problem = "truncated index";
+    else {
+        // The entry count is only a claim; the index itself must leave a
+        // slot empty or a miss would never stop probing
+        uint32_t slot = 0;
+        while (slot < slots && loadU32(bytes + HEADER_SIZE + size_t(slot) * SLOT_SIZE + 28) != 0) slot++;
+        if (slot == slots) problem = "full index";
+    }
+    if (problem) {
+        UnmapFile(bytes, size);
+        return fail(error, problem);
+    }
+
+    base = bytes;
+    mappedSize = size;
+    entryCount = entries;
+    slotMask = slots - 1;
+    states.reset(new std::atomic<uint8_t>[slots]);
+    for (uint32_t i = 0; i < slots; i++) states[i].store(SLOT_UNCHECKED, std::memory_order_relaxed);
+    corrupt.store(0, std::memory_order_relaxed);
+    return true;
+}
+
+void CacheSnapshot::close() {
+    if (base) UnmapFile(base, mappedSize);
+    base = nullptr;
+    mappedSize = 0;
+    entryCount = 0;
+    slotMask = 0;
+    states.reset();
+}
+
+std::string_view CacheSnapshot::find(const CacheKey& key) const {
+    if (!base) return std::string_view();
+
+    uint32_t hash = snapshotHash(key.kind, key.bits, key.text);
+    const uint8_t* slots = base + HEADER_SIZE;
+
+    // open() saw an empty slot; the bound still keeps a miss finite if the
+    // file is rewritten in place under the mapping
+    uint32_t slot = hash & slotMask;
+    for (uint32_t probes = 0; probes <= slotMask; probes++, slot = (slot + 1) & slotMask) {
+        const uint8_t* record = slots + size_t(slot) * SLOT_SIZE;
+        uint32_t chunkSize = loadU32(record + 28);
+        if (chunkSize == 0) return std::string_view();
+        if (loadU32(record + 4) != hash || record[0] != key.kind || loadU64(record + 8) != key.bits) continue;
+
+        uint64_t offset = loadU64(record + 16);
+        uint32_t textSize = loadU32(record + 24);
+        if (!checkSlot(slot, offset, textSize, chunkSize)) return std::string_view();
+
+        const char* text = reinterpret_cast<const char*>(base + offset);
+        if (std::string_view(text, textSize) != key.text) continue;
+        return std::string_view(text + textSize, chunkSize);
+    }
+    return std::string_view();
+}
+
+bool CacheSnapshot::checkSlot(uint32_t slot, uint64_t offset, uint32_t textSize, uint32_t chunkSize) const {
+    uint8_t state = states[slot].load(std::memory_order_acquire);
+    if (state != SLOT_UNCHECKED) return state == SLOT_VALID;
+
+    bool valid = offset >= HEADER_SIZE + size_t(slotMask + 1) * SLOT_SIZE &&
+                 offset <= mappedSize && mappedSize - offset >= uint64_t(textSize) + chunkSize &&
+                 chunkSize >= BytecodeWriter::HEADER_SIZE;
+    if (valid) {
+        const uint8_t* chunk = base + offset + textSize;
+        const uint8_t* body = chunk + BytecodeWriter::HEADER_SIZE;
+        size_t bodySize = chunkSize - BytecodeWriter::HEADER_SIZE;
+        valid = loadU32(chunk + 8) == bodySize && loadU32(chunk + 4) == hashBytecode(body, bodySize);
+    }
+
+    // Racing threads reach the same verdict; only the first one records it
+    uint8_t expected = SLOT_UNCHECKED;
+    if (states[slot].compare_exchange_strong(expected, valid ? SLOT_VALID : SLOT_CORRUPT, std::memory_order_acq_rel) && !valid) {
+        corrupt.fetch_add(1, std::memory_order_relaxed);
+    }
+    return valid;
+}
+
+} // namespace Bytecode
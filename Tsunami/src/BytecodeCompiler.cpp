@@ -0,0 +1,1215 @@
+#include "Bytecode.h"
+#include "BytecodeWriter.h"
+#include <algorithm>
+#include <cstring>
+
+namespace Bytecode {
+
+// ==================== REGISTER OPERANDS ====================
+
+namespace {
+
+using Instruction = Compiler::Instruction;
+using Constant = Compiler::Constant;
+
+enum OperandField : uint8_t {
+    FIELD_A,
+    FIELD_B,
+    FIELD_C,
+    FIELD_AUX,
+};
+
+// A register operand and the number of consecutive registers it names
+struct RegisterOperand {
+    OperandField field;
+    uint32_t count;
+};
+
+uint32_t& operandField(Instruction& insn, OperandField field) {
+    switch (field) {
+        case FIELD_A: return insn.a;
+        case FIELD_B: return insn.b;
+        case FIELD_C: return insn.c;
+        default: return insn.aux;
+    }
+}
+
+uint32_t operandValue(const Instruction& insn, OperandField field) {
+    return operandField(const_cast<Instruction&>(insn), field);
+}
+
+// Register operands of one instruction, read off the operand kinds in
+// OPCODE_INFO plus the opcodes that name a register range by count
+int registerOperands(const Instruction& insn, RegisterOperand* out) {
+    const OpcodeInfo& info = OPCODE_INFO[insn.op];
+    uint32_t rangeA = 1;
+
+    switch (insn.op) {
+        case LOP_CALL:
+            // Function, arguments and results share the frame at A
+            rangeA = 1 + std::max(insn.b ? insn.b - 1 : 0u, insn.c ? insn.c - 1 : 0u);
+            break;
+        case LOP_RETURN:
+            if (insn.b == 1) return 0;
+            rangeA = insn.b ? insn.b - 1 : 1;
+            break;
+        case LOP_NAMECALL:
+            rangeA = 2;
+            break;
+        case LOP_FORNPREP:
+        case LOP_FORNLOOP:
+        case LOP_FORGPREP:
+        case LOP_FORGPREP_INEXT:
+        case LOP_FORGPREP_NEXT:
+            rangeA = 3;
+            break;
+        case LOP_FORGLOOP:
+            rangeA = 3 + (insn.aux & 0xFF);
+            break;
+        default:
+            break;
+    }
+
+    int n = 0;
+    if (info.format != FORMAT_E && info.a == OPERAND_REG) out[n++] = {FIELD_A, rangeA};
+
+    if (info.format == FORMAT_ABC && info.b == OPERAND_REG) {
+        if (insn.op == LOP_CONCAT) {
+            // B..C is one range; C is rewritten along with B
+            out[n++] = {FIELD_B, insn.c - insn.b + 1};
+            return n;
+        }
+        if (insn.op == LOP_SETLIST) {
+            if (insn.c != 1) out[n++] = {FIELD_B, insn.c ? insn.c - 1 : 1};
+        } else {
+            out[n++] = {FIELD_B, 1};
+        }
+    }
+
+    if (info.format == FORMAT_ABC && info.c == OPERAND_REG) out[n++] = {FIELD_C, 1};
+    if (info.aux == OPERAND_REG) out[n++] = {FIELD_AUX, 1};
+    return n;
+}
+
+// Opcodes that only read A; everything else may write it
+bool readsOnlyA(uint8_t op) {
+    switch (op) {
+        case LOP_SETGLOBAL:
+        case LOP_SETUPVAL:
+        case LOP_SETTABLE:
+        case LOP_SETTABLKS:
+        case LOP_SETTABLEN:
+        case LOP_SETLIST:
+        case LOP_RETURN:
+        case LOP_JUMPIF:
+        case LOP_JUMPIFNOT:
+        case LOP_JUMPIFEQ:
+        case LOP_JUMPIFLE:
+        case LOP_JUMPIFLT:
+        case LOP_JUMPIFNOTEQ:
+        case LOP_JUMPIFNOTLE:
+        case LOP_JUMPIFNOTLT:
+        case LOP_JUMPIFEQK:
+        case LOP_JUMPIFNOTEQK:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// ==================== REGISTER ALLOCATION ====================
+
+constexpr uint32_t MAX_REGISTERS = 255;
+constexpr uint32_t SHORT_SPILL_SLOTS = 256;    // GETTABLEN/SETTABLEN index range
+constexpr uint32_t SPILL_SCRATCH = 3;          // Spilled operands per instruction
+constexpr uint32_t NONE = UINT32_MAX;
+
+// Virtual registers that must stay adjacent (every range operand touching
+// them, merged) and the instructions over which they are live
+struct LiveGroup {
+    uint32_t lo;
+    uint32_t hi;
+    uint32_t start = NONE;
+    uint32_t end = 0;
+    uint32_t phys = NONE;
+    uint32_t slot = NONE;   // Spill slot when spilled
+    bool spillable = true;
+
+    uint32_t size() const { return hi - lo + 1; }
+};
+
+class RegisterAllocator {
+private:
+    const std::vector<Instruction>& code;
+    const std::vector<uint32_t>& labels;
+    std::vector<LiveGroup> groups;      // Sorted by lo
+    uint32_t spillRegister = NONE;
+    bool dropSelfMoves;
+
+    // Pool for slot keys too wide for LOADN; each one is added once
+    const std::vector<Constant>& constants;
+    std::vector<Constant>& extra;
+    std::vector<uint32_t> keyConstants;
+
+public:
+    RegisterAllocator(const std::vector<Instruction>& stream, const std::vector<uint32_t>& labelTargets,
+                      bool optimize, const std::vector<Constant>& pool, std::vector<Constant>& added)
+        : code(stream), labels(labelTargets), dropSelfMoves(optimize), constants(pool), extra(added) {}
+
+    // Rewrites the stream onto physical registers; labels are remapped in place
+    bool run(std::vector<Instruction>& out, std::vector<uint32_t>& outLabels);
+
+private:
+    void buildGroups();
+    void extendOverLoops();
+    bool scan(uint32_t limit, bool allowSpill);
+    void rewrite(std::vector<Instruction>& out, std::vector<uint32_t>& outLabels);
+
+    LiveGroup& groupOf(uint32_t reg) {
+        auto it = std::upper_bound(groups.begin(), groups.end(), reg,
+                                   [](uint32_t r, const LiveGroup& g) { return r < g.lo; });
+        return *(it - 1);
+    }
+
+    const LiveGroup& groupOf(uint32_t reg) const {
+        return const_cast<RegisterAllocator*>(this)->groupOf(reg);
+    }
+
+    // Slots past the short range are keyed through the register after the
+    // scratch registers
+    void reload(std::vector<Instruction>& out, uint32_t reg, uint32_t slot);
+    void store(std::vector<Instruction>& out, uint32_t reg, uint32_t slot);
+    uint32_t loadKey(std::vector<Instruction>& out, uint32_t slot);
+};
+
+uint32_t RegisterAllocator::loadKey(std::vector<Instruction>& out, uint32_t slot) {
+    uint32_t key = spillRegister + 1 + SPILL_SCRATCH;
+    uint32_t value = slot + 1;
+    if (value <= static_cast<uint32_t>(INT16_MAX)) {
+        out.push_back({LOP_LOADN, key, 0, 0, static_cast<int32_t>(value), 0, Compiler::NO_LABEL});
+        return key;
+    }
+
+    uint32_t wide = value - INT16_MAX - 1;
+    if (wide >= keyConstants.size()) keyConstants.resize(wide + 1, NONE);
+    if (keyConstants[wide] == NONE) {
+        keyConstants[wide] = static_cast<uint32_t>(constants.size() + extra.size());
+        extra.push_back({LBC_CONSTANT_NUMBER, false, static_cast<double>(value), std::string(), {}});
+    }
+    uint32_t index = keyConstants[wide];
+    if (index > LOADK_MAX_INDEX) out.push_back({LOP_LOADKX, key, 0, 0, 0, index, Compiler::NO_LABEL});
+    else out.push_back({LOP_LOADK, key, 0, 0, static_cast<int32_t>(index), 0, Compiler::NO_LABEL});
+    return key;
+}
+
+void RegisterAllocator::reload(std::vector<Instruction>& out, uint32_t reg, uint32_t slot) {
+    if (slot < SHORT_SPILL_SLOTS) {
+        out.push_back({LOP_GETTABLEN, reg, spillRegister, slot, 0, 0, Compiler::NO_LABEL});
+        return;
+    }
+    uint32_t key = loadKey(out, slot);
+    out.push_back({LOP_GETTABLE, reg, spillRegister, key, 0, 0, Compiler::NO_LABEL});
+}
+
+void RegisterAllocator::store(std::vector<Instruction>& out, uint32_t reg, uint32_t slot) {
+    if (slot < SHORT_SPILL_SLOTS) {
+        out.push_back({LOP_SETTABLEN, reg, spillRegister, slot, 0, 0, Compiler::NO_LABEL});
+        return;
+    }
+    uint32_t key = loadKey(out, slot);
+    out.push_back({LOP_SETTABLE, reg, spillRegister, key, 0, 0, Compiler::NO_LABEL});
+}
+
+void RegisterAllocator::buildGroups() {
+    // Merge overlapping register ranges into groups
+    std::vector<std::pair<uint32_t, uint32_t>> ranges;
+    RegisterOperand operands[4];
+    for (const Instruction& insn : code) {
+        int n = registerOperands(insn, operands);
+        for (int k = 0; k < n; k++) {
+            uint32_t base = operandValue(insn, operands[k].field);
+            ranges.push_back({base, base + operands[k].count - 1});
+        }
+    }
+    std::sort(ranges.begin(), ranges.end());
+
+    for (const auto& range : ranges) {
+        if (!groups.empty() && range.first <= groups.back().hi) {
+            groups.back().hi = std::max(groups.back().hi, range.second);
+        } else {
+            LiveGroup group;
+            group.lo = range.first;
+            group.hi = range.second;
+            groups.push_back(group);
+        }
+    }
+
+    for (uint32_t i = 0; i < code.size(); i++) {
+        const Instruction& insn = code[i];
+        int n = registerOperands(insn, operands);
+        for (int k = 0; k < n; k++) {
+            LiveGroup& group = groupOf(operandValue(insn, operands[k].field));
+            group.start = std::min(group.start, i);
+            group.end = std::max(group.end, i);
+
+            // The skip jumps over whatever store follows LOADB, so its
+            // target has to stay in a register
+            if (insn.op == LOP_LOADB && insn.label != Compiler::NO_LABEL) group.spillable = false;
+        }
+    }
+
+    for (LiveGroup& group : groups) {
+        if (group.size() > 1) group.spillable = false;
+    }
+}
+
+void RegisterAllocator::extendOverLoops() {
+    // Without def/use information, anything live inside a loop is assumed to
+    // be carried around its back edge
+    std::vector<std::pair<uint32_t, uint32_t>> loops;
+    for (uint32_t i = 0; i < code.size(); i++) {
+        if (code[i].label != Compiler::NO_LABEL && labels[code[i].label] <= i) {
+            loops.push_back({labels[code[i].label], i});
+        }
+    }
+    if (loops.empty()) return;
+
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (LiveGroup& group : groups) {
+            for (const auto& loop : loops) {
+                if (group.start > loop.second || group.end < loop.first) continue;
+                if (group.start > loop.first || group.end < loop.second) {
+                    group.start = std::min(group.start, loop.first);
+                    group.end = std::max(group.end, loop.second);
+                    changed = true;
+                }
+            }
+        }
+    }
+}
+
+bool RegisterAllocator::scan(uint32_t limit, bool allowSpill) {
+    std::vector<uint32_t> order(groups.size());
+    for (uint32_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+        groups[i].phys = NONE;
+        groups[i].slot = NONE;
+    }
+    std::sort(order.begin(), order.end(), [&](uint32_t x, uint32_t y) {
+        return groups[x].start != groups[y].start ? groups[x].start < groups[y].start : x < y;
+    });
+
+    std::vector<uint8_t> used(limit, 0);
+    std::vector<uint32_t> freeSlots;
+    uint32_t nextSlot = 0;
+    std::vector<uint32_t> active;
+
+    auto release = [&](LiveGroup& group) {
+        if (group.phys != NONE) std::fill(used.begin() + group.phys, used.begin() + group.phys + group.size(), 0);
+        if (group.slot != NONE) freeSlots.push_back(group.slot);
+    };
+
+    auto findBlock = [&](uint32_t size) {
+        for (uint32_t p = 0, run = 0; p < limit; p++) {
+            run = used[p] ? 0 : run + 1;
+            if (run == size) return p + 1 - size;
+        }
+        return NONE;
+    };
+
+    auto spill = [&](LiveGroup& group) {
+        if (freeSlots.empty()) freeSlots.push_back(nextSlot++);
+        if (group.phys != NONE) std::fill(used.begin() + group.phys, used.begin() + group.phys + group.size(), 0);
+        group.phys = NONE;
+        group.slot = freeSlots.back();
+        freeSlots.pop_back();
+        return true;
+    };
+
+    for (uint32_t index : order) {
+        LiveGroup& group = groups[index];
+
+        // Expire groups whose last use precedes this definition
+        active.erase(std::remove_if(active.begin(), active.end(),
+                                    [&](uint32_t a) {
+                                        if (groups[a].end >= group.start) return false;
+                                        release(groups[a]);
+                                        return true;
+                                    }),
+                     active.end());
+
+        uint32_t phys = findBlock(group.size());
+        while (phys == NONE) {
+            if (!allowSpill) return false;
+
+            // Spill whichever spillable interval ends furthest away
+            LiveGroup* victim = group.spillable ? &group : nullptr;
+            for (uint32_t a : active) {
+                LiveGroup& candidate = groups[a];
+                if (candidate.spillable && candidate.phys != NONE && (!victim || candidate.end > victim->end)) {
+                    victim = &candidate;
+                }
+            }
+            if (!victim || !spill(*victim)) return false;
+            if (victim == &group) break;
+            phys = findBlock(group.size());
+        }
+
+        if (phys != NONE) {
+            group.phys = phys;
+            std::fill(used.begin() + phys, used.begin() + phys + group.size(), 1);
+        }
+        active.push_back(index);
+    }
+
+    return true;
+}
+
+void RegisterAllocator::rewrite(std::vector<Instruction>& out, std::vector<uint32_t>& outLabels) {
+    std::vector<uint32_t> newIndex(code.size() + 1);
+    out.clear();
+    out.reserve(code.size() + 1);
+
+    // Spill slots live in a table created on entry; labels skip past it
+    if (spillRegister != NONE) {
+        out.push_back({LOP_NEWTABLE, spillRegister, 0, 0, 0, 0, Compiler::NO_LABEL});
+    }
+
+    RegisterOperand operands[4];
+    for (uint32_t i = 0; i < code.size(); i++) {
+        // Labels, LOADB skips included, land on the reloads of their target
+        // and so stay correct however much spill code a window grows
+        newIndex[i] = static_cast<uint32_t>(out.size());
+
+        Instruction insn = code[i];
+        int n = registerOperands(insn, operands);
+
+        uint32_t spilled[4];
+        uint32_t scratch[4];
+        uint32_t spilledCount = 0;
+        uint32_t oldB = insn.b;
+
+        for (int k = 0; k < n; k++) {
+            uint32_t& field = operandField(insn, operands[k].field);
+            const LiveGroup& group = groupOf(field);
+
+            if (group.phys != NONE) {
+                field = group.phys + (field - group.lo);
+                continue;
+            }
+
+            // Reload into a scratch register shared by repeats of the same operand
+            uint32_t s = 0;
+            while (s < spilledCount && spilled[s] != group.lo) s++;
+            if (s == spilledCount) {
+                spilled[s] = group.lo;
+                scratch[s] = spillRegister + 1 + s;
+                spilledCount++;
+                reload(out, scratch[s], group.slot);
+            }
+            field = scratch[s];
+        }
+
+        if (insn.op == LOP_CONCAT) insn.c = insn.b + (insn.c - oldB);
+
+        // Copies between values that landed in the same register vanish
+        if (dropSelfMoves && insn.op == LOP_MOVE && insn.a == insn.b) continue;
+
+        out.push_back(insn);
+
+        // A may have been written; put the value back
+        if (n > 0 && operands[0].field == FIELD_A && spilledCount > 0 && !readsOnlyA(insn.op)) {
+            const LiveGroup& group = groupOf(code[i].a);
+            if (group.phys == NONE) {
+                store(out, insn.a, group.slot);
+            }
+        }
+    }
+    newIndex[code.size()] = static_cast<uint32_t>(out.size());
+
+    outLabels.resize(labels.size());
+    for (size_t l = 0; l < labels.size(); l++) outLabels[l] = newIndex[labels[l]];
+}
+
+bool RegisterAllocator::run(std::vector<Instruction>& out, std::vector<uint32_t>& outLabels) {
+    buildGroups();
+    extendOverLoops();
+
+    // Spilling costs a table register, scratch registers and a key register,
+    // so only pay for them when the whole frame does not fit
+    if (!scan(MAX_REGISTERS, false)) {
+        uint32_t limit = MAX_REGISTERS - 1 - SPILL_SCRATCH - 1;
+        if (!scan(limit, true)) return false;
+        spillRegister = limit;
+    }
+
+    rewrite(out, outLabels);
+    return true;
+}
+
+// ==================== FINALIZATION HELPERS ====================
+
+bool isJump(const Instruction& insn) {
+    return insn.label != Compiler::NO_LABEL;
+}
+
+// Highest physical register touched + 1
+uint32_t frameSize(const Instruction& insn) {
+    RegisterOperand operands[4];
+    int n = registerOperands(insn, operands);
+    uint32_t top = 0;
+    for (int k = 0; k < n; k++) {
+        top = std::max(top, operandValue(insn, operands[k].field) + operands[k].count);
+    }
+    return top;
+}
+
+size_t constantSize(const Constant& k) {
+    switch (k.type) {
+        case LBC_CONSTANT_BOOLEAN: return 2;
+        case LBC_CONSTANT_NUMBER: return BytecodeWriter::numberConstantSize();
+        case LBC_CONSTANT_STRING: return BytecodeWriter::stringConstantSize(k.string.size());
+        case LBC_CONSTANT_TABLE: return BytecodeWriter::tableConstantSize(k.keys.data(), k.keys.size());
+        default: return 1;
+    }
+}
+
+void writeConstant(BytecodeWriter& writer, const Constant& k) {
+    switch (k.type) {
+        case LBC_CONSTANT_BOOLEAN: writer.writeConstantBoolean(k.boolean); break;
+        case LBC_CONSTANT_NUMBER: writer.writeConstantNumber(k.number); break;
+        case LBC_CONSTANT_STRING: writer.writeConstantString(k.string); break;
+        case LBC_CONSTANT_TABLE: writer.writeConstantTable(k.keys.data(), k.keys.size()); break;
+        default: writer.writeConstantNil(); break;
+    }
+}
+
+// RETURN's B is the value count + 1
+constexpr uint32_t MAX_RETURN_VALUES = UINT8_MAX - 1;
+
+// Index of a constant in the pool followed by extra, appended to extra
+// unless one of them already holds it
+uint32_t stringConstant(const std::vector<Constant>& constants, std::vector<Constant>& extra, std::string_view value) {
+    for (uint32_t i = 0; i < constants.size(); i++) {
+        if (constants[i].type == LBC_CONSTANT_STRING && constants[i].string == value) return i;
+    }
+    for (uint32_t i = 0; i < extra.size(); i++) {
+        if (extra[i].type == LBC_CONSTANT_STRING && extra[i].string == value) {
+            return static_cast<uint32_t>(constants.size()) + i;
+        }
+    }
+    extra.push_back({LBC_CONSTANT_STRING, false, 0, std::string(value), {}});
+    return static_cast<uint32_t>(constants.size() + extra.size() - 1);
+}
+
+// Loads a non-negative integer, from a fresh pool constant once it is too
+// wide for LOADN
+void loadCount(std::vector<Instruction>& stream, const std::vector<Constant>& constants,
+               std::vector<Constant>& extra, uint32_t reg, uint32_t value) {
+    if (value <= static_cast<uint32_t>(INT16_MAX)) {
+        stream.push_back({LOP_LOADN, reg, 0, 0, static_cast<int32_t>(value), 0, Compiler::NO_LABEL});
+        return;
+    }
+    uint32_t index = static_cast<uint32_t>(constants.size() + extra.size());
+    extra.push_back({LBC_CONSTANT_NUMBER, false, static_cast<double>(value), std::string(), {}});
+    if (index > LOADK_MAX_INDEX) stream.push_back({LOP_LOADKX, reg, 0, 0, 0, index, Compiler::NO_LABEL});
+    else stream.push_back({LOP_LOADK, reg, 0, 0, static_cast<int32_t>(index), 0, Compiler::NO_LABEL});
+}
+
+// Too many results for RETURN: store them into a table and return
+// unpack(t, 1, n), as CreatePushValues does. Takes a four-register call
+// frame and a key register from `registers`.
+void returnThroughTable(std::vector<Instruction>& stream, const std::vector<Constant>& constants,
+                        std::vector<Constant>& extra, uint32_t& registers, uint32_t resultCount) {
+    uint32_t frame = registers;
+    uint32_t table = frame + 1;
+    uint32_t key = frame + 4;
+    registers += 5;
+
+    stream.push_back({LOP_NEWTABLE, table, 0, 0, 0, resultCount, Compiler::NO_LABEL});
+    for (uint32_t i = 0; i < resultCount; i++) {
+        uint32_t value = Compiler::RESULT_REGISTER_BASE + i;
+        if (i <= UINT8_MAX) {
+            stream.push_back({LOP_SETTABLEN, value, table, i, 0, 0, Compiler::NO_LABEL});
+        } else {
+            loadCount(stream, constants, extra, key, i + 1);
+            stream.push_back({LOP_SETTABLE, value, table, key, 0, 0, Compiler::NO_LABEL});
+        }
+    }
+
+    uint32_t unpack = stringConstant(constants, extra, "unpack");
+    stream.push_back({LOP_GETGLOBAL, frame, 0, 0, 0, unpack, Compiler::NO_LABEL});
+    loadCount(stream, constants, extra, frame + 2, 1);
+    loadCount(stream, constants, extra, frame + 3, resultCount);
+    stream.push_back({LOP_CALL, frame, 4, 0, 0, 0, Compiler::NO_LABEL});
+    stream.push_back({LOP_RETURN, frame, 0, 0, 0, 0, Compiler::NO_LABEL});
+}
+
+// ==================== PEEPHOLE ====================
+
+// Constant index a LOADK or LOADKX loads, NONE for anything else
+uint32_t loadedConstant(const Instruction& insn) {
+    if (insn.op == LOP_LOADK) return static_cast<uint32_t>(insn.d);
+    if (insn.op == LOP_LOADKX) return insn.aux;
+    return NONE;
+}
+
+constexpr uint32_t MAX_DUPTABLE_SCAN = 1024;   // Bounds the shape scan per NEWTABLE
+constexpr uint32_t MAX_JUMP_THREADING = 16;    // Hops followed per jump
+
+// Linear-time rewrites over the virtual IR. Register facts are per virtual
+// register; a constant is only propagated when its single definition sits in
+// the same basic block as the use, so no path can observe the register unset.
+class Peephole {
+private:
+    struct RegisterInfo {
+        uint32_t defs = 0;
+        uint32_t uses = 0;
+        uint32_t def = NONE;
+    };
+
+    std::vector<Instruction>& code;
+    std::vector<uint32_t>& labels;
+    const std::vector<Constant>& constants;
+    std::vector<Constant>& extra;       // Constants added by the pass, appended to the pool
+    uint32_t denseRegisters;
+    uint32_t openFrom = NONE;           // Lowest register a multret CALL may write
+
+    std::vector<RegisterInfo> registers;
+    std::vector<uint32_t> block;
+    std::vector<uint8_t> removed;
+
+public:
+    Peephole(std::vector<Instruction>& stream, std::vector<uint32_t>& labelTargets,
+             const std::vector<Constant>& pool, std::vector<Constant>& added, uint32_t dense)
+        : code(stream), labels(labelTargets), constants(pool), extra(added), denseRegisters(dense) {}
+
+    void run();
+
+private:
+    uint32_t index(uint32_t reg) const {
+        return reg < Compiler::RESULT_REGISTER_BASE ? reg : denseRegisters + (reg - Compiler::RESULT_REGISTER_BASE);
+    }
+
+    RegisterInfo& info(uint32_t reg) { return registers[index(reg)]; }
+
+    const Constant* constantAt(uint32_t index) const {
+        if (index < constants.size()) return &constants[index];
+        if (index - constants.size() < extra.size()) return &extra[index - constants.size()];
+        return nullptr;
+    }
+
+    void analyze();
+    uint32_t constantOf(uint32_t reg, uint32_t use);
+    void foldOperands();
+    void fuseTableShapes();
+    void threadJumps();
+    void foldLoads();
+    void removeDeadLoads();
+    bool compact();                   // Returns true if another round is needed
+};
+
+void Peephole::analyze() {
+    // Basic blocks start at label targets and after jumps and returns
+    std::vector<uint8_t> leader(code.size() + 1, 0);
+    for (uint32_t target : labels) {
+        if (target <= code.size()) leader[target] = 1;
+    }
+    for (uint32_t i = 0; i < code.size(); i++) {
+        if (isJump(code[i]) || code[i].op == LOP_RETURN) leader[i + 1] = 1;
+    }
+
+    block.assign(code.size(), 0);
+    for (uint32_t i = 0, id = 0; i < code.size(); i++) {
+        id += leader[i];
+        block[i] = id;
+    }
+
+    uint32_t maxResult = 0;
+    for (const Instruction& insn : code) {
+        RegisterOperand operands[4];
+        int n = registerOperands(insn, operands);
+        for (int k = 0; k < n; k++) {
+            uint32_t reg = operandValue(insn, operands[k].field) + operands[k].count - 1;
+            if (reg >= Compiler::RESULT_REGISTER_BASE) maxResult = std::max(maxResult, reg - Compiler::RESULT_REGISTER_BASE + 1);
+        }
+    }
+    registers.assign(denseRegisters + maxResult, RegisterInfo());
+
+    for (uint32_t i = 0; i < code.size(); i++) {
+        const Instruction& insn = code[i];
+        if (insn.op == LOP_CALL && insn.c == 0) openFrom = std::min(openFrom, index(insn.a));
+
+        RegisterOperand operands[4];
+        int n = registerOperands(insn, operands);
+        for (int k = 0; k < n; k++) {
+            uint32_t base = operandValue(insn, operands[k].field);
+            // A is written unless the opcode only reads it; ranges at A (call
+            // frames, loop state) are read as well
+            bool writes = operands[k].field == FIELD_A && !readsOnlyA(insn.op);
+            bool reads = !writes || operands[k].count > 1 || insn.op == LOP_CLOSEUPVALS;
+
+            for (uint32_t r = 0; r < operands[k].count; r++) {
+                RegisterInfo& reg = info(base + r);
+                if (writes) {
+                    reg.defs++;
+                    reg.def = i;
+                }
+                if (reads) reg.uses++;
+            }
+        }
+    }
+}
+
+uint32_t Peephole::constantOf(uint32_t reg, uint32_t use) {
+    // Constant index held by reg at instruction `use`, or NONE
+    RegisterInfo& r = info(reg);
+    if (index(reg) >= openFrom || r.defs != 1 || r.def >= use || block[r.def] != block[use] || removed[r.def]) return NONE;
+
+    return loadedConstant(code[r.def]);
+}
+
+void Peephole::foldOperands() {
+    for (uint32_t i = 0; i < code.size(); i++) {
+        Instruction& insn = code[i];
+
+        switch (insn.op) {
+            case LOP_MOVE:
+                if (insn.a == insn.b) {
+                    removed[i] = 1;
+                    info(insn.b).uses--;
+                }
+                break;
+
+            case LOP_ADD:
+            case LOP_SUB:
+            case LOP_MUL:
+            case LOP_DIV:
+            case LOP_MOD:
+            case LOP_POW: {
+                // Only the right operand: swapping would reorder metamethod arguments
+                uint32_t k = constantOf(insn.c, i);
+                const Constant* constant = k != NONE ? constantAt(k) : nullptr;
+                if (!constant || constant->type != LBC_CONSTANT_NUMBER || k > 255) break;
+
+                info(insn.c).uses--;
+                insn.op = static_cast<uint8_t>(insn.op - LOP_ADD + LOP_ADDK);
+                insn.c = k;
+                break;
+            }
+
+            case LOP_SETTABLE: {
+                uint32_t k = constantOf(insn.c, i);
+                const Constant* constant = k != NONE ? constantAt(k) : nullptr;
+                if (!constant || constant->type != LBC_CONSTANT_STRING) break;
+
+                info(insn.c).uses--;
+                insn.op = LOP_SETTABLKS;
+                insn.c = 0;
+                insn.aux = k;
+                break;
+            }
+
+            default:
+                break;
+        }
+    }
+}
+
+void Peephole::fuseTableShapes() {
+    // NEWTABLE followed by constant-key stores into it becomes DUPTABLE of
+    // the key shape; the stores stay, but the table is created presized.
+    // Array values cannot be carried by a shape, so SETLIST runs are kept.
+    std::vector<uint32_t> keys;
+
+    for (uint32_t i = 0; i < code.size(); i++) {
+        const Instruction& insn = code[i];
+        if (insn.op != LOP_NEWTABLE || removed[i] || insn.aux != 0) continue;
+
+        keys.clear();
+        uint32_t end = std::min<uint32_t>(static_cast<uint32_t>(code.size()), i + 1 + MAX_DUPTABLE_SCAN);
+        for (uint32_t j = i + 1; j < end && block[j] == block[i]; j++) {
+            const Instruction& next = code[j];
+            if (removed[j]) continue;
+
+            if (next.op == LOP_SETTABLKS && next.b == insn.a && next.a != insn.a) {
+                if (std::find(keys.begin(), keys.end(), next.aux) == keys.end()) keys.push_back(next.aux);
+                continue;
+            }
+
+            // Stop at anything else that touches the table
+            RegisterOperand operands[4];
+            int n = registerOperands(next, operands);
+            bool touches = false;
+            for (int k = 0; k < n; k++) {
+                uint32_t base = operandValue(next, operands[k].field);
+                touches |= insn.a >= base && insn.a < base + operands[k].count;
+            }
+            if (touches) break;
+        }
+
+        uint32_t index = static_cast<uint32_t>(constants.size() + extra.size());
+        if (keys.empty() || index > static_cast<uint32_t>(INT16_MAX)) continue;
+
+        extra.push_back({LBC_CONSTANT_TABLE, false, 0, std::string(), keys});
+        code[i] = {LOP_DUPTABLE, insn.a, 0, 0, static_cast<int32_t>(index), 0, Compiler::NO_LABEL};
+    }
+}
+
+void Peephole::threadJumps() {
+    // Jumps landing on an unconditional jump go straight to its target.
+    // LOADB skips stay put: C cannot follow a jump backwards.
+    for (Instruction& insn : code) {
+        if (!isJump(insn) || insn.op == LOP_LOADB) continue;
+
+        for (uint32_t hops = 0; hops < MAX_JUMP_THREADING; hops++) {
+            uint32_t target = labels[insn.label];
+            if (target >= code.size() || code[target].op != LOP_JUMP || code[target].label == insn.label) break;
+            insn.label = code[target].label;
+        }
+    }
+}
+
+void Peephole::foldLoads() {
+    // Small integral numbers load as immediates
+    for (Instruction& insn : code) {
+        uint32_t k = loadedConstant(insn);
+        const Constant* constant = k != NONE ? constantAt(k) : nullptr;
+        if (!constant || constant->type != LBC_CONSTANT_NUMBER) continue;
+
+        if (fitsLoadN(constant->number)) {
+            insn.op = LOP_LOADN;
+            insn.d = static_cast<int32_t>(constant->number);
+        }
+    }
+}
+
+void Peephole::removeDeadLoads() {
+    // Walk backwards so dead copies release their sources in one pass
+    for (uint32_t i = static_cast<uint32_t>(code.size()); i-- > 0;) {
+        const Instruction& insn = code[i];
+        if (removed[i]) continue;
+
+        bool pure = insn.op == LOP_LOADNIL || insn.op == LOP_LOADN || insn.op == LOP_LOADK ||
+                    insn.op == LOP_LOADKX || insn.op == LOP_MOVE || (insn.op == LOP_LOADB && !isJump(insn));
+        if (!pure || info(insn.a).uses != 0) continue;
+
+        removed[i] = 1;
+        if (insn.op == LOP_MOVE) info(insn.b).uses--;
+    }
+}
+
+bool Peephole::compact() {
+    std::vector<uint32_t> newIndex(code.size() + 1);
+    uint32_t out = 0;
+    for (uint32_t i = 0; i < code.size(); i++) {
+        newIndex[i] = out;
+        if (!removed[i]) code[out++] = code[i];
+    }
+    newIndex[code.size()] = out;
+    code.resize(out);
+
+    for (uint32_t& target : labels) {
+        if (target != NONE) target = newIndex[target];
+    }
+
+    // Jumps to the very next instruction fall through anyway; truthiness
+    // tests have no side effects, so conditional ones go as well. A LOADB
+    // whose skip window emptied becomes a plain load.
+    removed.assign(code.size(), 0);
+    bool again = false;
+    for (uint32_t i = 0; i < code.size(); i++) {
+        bool plain = code[i].op == LOP_JUMP || code[i].op == LOP_JUMPIF || code[i].op == LOP_JUMPIFNOT;
+        if (!isJump(code[i]) || labels[code[i].label] != i + 1) continue;
+        if (plain) {
+            removed[i] = 1;
+            again = true;
+        } else if (code[i].op == LOP_LOADB) {
+            code[i].label = Compiler::NO_LABEL;
+        }
+    }
+    return again;
+}
+
+void Peephole::run() {
+    removed.assign(code.size(), 0);
+    analyze();
+
+    foldOperands();
+    fuseTableShapes();
+    threadJumps();
+    foldLoads();
+    removeDeadLoads();
+
+    // Dropping a fallthrough jump can expose another; each round is linear
+    while (compact()) {}
+}
+
+} // namespace
+
+// ==================== COMPILER CLASS ====================
+
+Compiler::Compiler() = default;
+
+int Compiler::addConstant(std::string_view value) {
+    size_t hash = std::hash<std::string_view>()(value);
+    auto range = stringIndex.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (constants[it->second].string == value) return static_cast<int>(it->second);
+    }
+
+    uint32_t index = static_cast<uint32_t>(constants.size());
+    constants.push_back({LBC_CONSTANT_STRING, false, 0, std::string(value), {}});
+    stringIndex.emplace(hash, index);
+    return static_cast<int>(index);
+}
+
+int Compiler::addNumberConstant(double value) {
+    // Bitwise key: -0.0 stays apart from 0.0 and a NaN matches itself
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    auto it = numberIndex.find(bits);
+    if (it != numberIndex.end()) return static_cast<int>(it->second);
+
+    uint32_t index = static_cast<uint32_t>(constants.size());
+    constants.push_back({LBC_CONSTANT_NUMBER, false, value, std::string(), {}});
+    numberIndex.emplace(bits, index);
+    return static_cast<int>(index);
+}
+
+int Compiler::addBoolConstant(bool value) {
+    int64_t& index = booleanIndex[value ? 1 : 0];
+    if (index < 0) {
+        index = static_cast<int64_t>(constants.size());
+        constants.push_back({LBC_CONSTANT_BOOLEAN, value, 0, std::string(), {}});
+    }
+    return static_cast<int>(index);
+}
+
+int Compiler::newRegisters(int count) {
+    uint32_t first = nextRegister;
+    nextRegister += static_cast<uint32_t>(count);
+    return static_cast<int>(first);
+}
+
+// ==================== IR EMISSION ====================
+
+void Compiler::emit(const Instruction& insn) {
+    code.push_back(insn);
+
+    // A skip ending inside an AUX word lands after it
+    if (!pendingSkips.empty()) {
+        uint32_t words = instructionLength(insn.op);
+        size_t kept = 0;
+        for (PendingSkip& skip : pendingSkips) {
+            if (skip.words <= words) {
+                labels[skip.label] = static_cast<uint32_t>(code.size());
+            } else {
+                skip.words -= words;
+                pendingSkips[kept++] = skip;
+            }
+        }
+        pendingSkips.resize(kept);
+    }
+
+    // Keep newRegister() clear of registers named directly by the caller
+    RegisterOperand operands[4];
+    int n = registerOperands(insn, operands);
+    for (int k = 0; k < n; k++) {
+        uint32_t reg = operandValue(insn, operands[k].field);
+        if (reg < RESULT_REGISTER_BASE) nextRegister = std::max(nextRegister, reg + operands[k].count);
+    }
+}
+
+void Compiler::emitABC(uint8_t op, int a, int b, int c) {
+    emit({op, static_cast<uint32_t>(a), static_cast<uint32_t>(b), static_cast<uint32_t>(c), 0, 0, NO_LABEL});
+}
+
+void Compiler::emitAD(uint8_t op, int a, int d) {
+    emit({op, static_cast<uint32_t>(a), 0, 0, d, 0, NO_LABEL});
+}
+
+void Compiler::emitAux(uint8_t op, int a, int b, int c, uint32_t aux) {
+    emit({op, static_cast<uint32_t>(a), static_cast<uint32_t>(b), static_cast<uint32_t>(c), 0, aux, NO_LABEL});
+}
+
+void Compiler::emitJump(uint8_t op, int reg, Label target) {
+    emit({op, static_cast<uint32_t>(reg), 0, 0, 0, 0, target});
+}
+
+Compiler::Label Compiler::newLabel() {
+    labels.push_back(UINT32_MAX);
+    return static_cast<Label>(labels.size() - 1);
+}
+
+void Compiler::bindLabel(Label label) {
+    labels[label] = static_cast<uint32_t>(code.size());
+}
+
+void Compiler::addJump(Label target) {
+    emitJump(LOP_JUMP, 0, target);
+}
+
+void Compiler::addJumpIf(int reg, Label target) {
+    emitJump(LOP_JUMPIF, reg, target);
+}
+
+void Compiler::addJumpIfNot(int reg, Label target) {
+    emitJump(LOP_JUMPIFNOT, reg, target);
+}
+
+// ==================== BUILDING INSTRUCTIONS ====================
+
+void Compiler::addLoadNil(int reg) {
+    emitABC(LOP_LOADNIL, reg, 0, 0);
+}
+
+void Compiler::addLoadBool(int reg, bool value, int jump) {
+    if (jump <= 0) {
+        emitABC(LOP_LOADB, reg, value ? 1 : 0, 0);
+        return;
+    }
+
+    // The skip targets a label, so instructions the passes add or drop
+    // inside it move the target with them; compile() turns it back into C
+    Label target = newLabel();
+    emit({LOP_LOADB, static_cast<uint32_t>(reg), value ? 1u : 0u, 0, 0, 0, target});
+    pendingSkips.push_back({target, static_cast<uint32_t>(jump)});
+}
+
+void Compiler::addLoadConst(int reg, int constIdx) {
+    addLoadK(reg, constIdx);
+}
+
+void Compiler::addLoadK(int reg, int constIdx) {
+    if (static_cast<uint32_t>(constIdx) > LOADK_MAX_INDEX) emitAux(LOP_LOADKX, reg, 0, 0, constIdx);
+    else emitAD(LOP_LOADK, reg, constIdx);
+}
+
+void Compiler::addMove(int dest, int src) {
+    emitABC(LOP_MOVE, dest, src, 0);
+}
+
+void Compiler::addArith(uint8_t op, int dest, int left, int right) {
+    emitABC(op, dest, left, right);
+}
+
+void Compiler::addGetGlobal(int reg, const std::string& name) {
+    emitAux(LOP_GETGLOBAL, reg, 0, 0, addConstant(name));
+}
+
+void Compiler::addNewTable(int reg, int arraySize, int hashSize) {
+    emitAux(LOP_NEWTABLE, reg, encodeHashSize(hashSize), 0, arraySize);
+}
+
+void Compiler::addSetTable(int tableReg, int keyReg, int valueReg) {
+    emitABC(LOP_SETTABLE, valueReg, tableReg, keyReg);
+}
+
+void Compiler::addSetField(int tableReg, const std::string& key, int valueReg) {
+    emitAux(LOP_SETTABLKS, valueReg, tableReg, 0, addConstant(key));
+}
+
+void Compiler::addSetList(int tableReg, int startReg, int count, int tableIndex) {
+    // tableIndex is the 0-based array slot of the first value
+    emitAux(LOP_SETLIST, tableReg, startReg, count + 1, tableIndex + 1);
+}
+
+void Compiler::addReturn(int startReg, int count) {
+    emitABC(LOP_RETURN, startReg, count + 1, 0);
+}
+
+void Compiler::addCall(int funcReg, int argCount, int resultCount) {
+    emitABC(LOP_CALL, funcReg, argCount + 1, resultCount + 1);
+}
+
+// ==================== HIGH-LEVEL OPERATIONS ====================
+
+void Compiler::pushNil() {
+    addLoadNil(newResult());
+}
+
+void Compiler::pushBoolean(bool value) {
+    addLoadBool(newResult(), value);
+}
+
+void Compiler::pushNumber(double value) {
+    // Immediate even at optimization level 0
+    if (fitsLoadN(value)) emitAD(LOP_LOADN, newResult(), static_cast<int32_t>(value));
+    else addLoadK(newResult(), addNumberConstant(value));
+}
+
+void Compiler::pushString(const std::string& value) {
+    addLoadK(newResult(), addConstant(value));
+}
+
+void Compiler::pushTable(int arraySize, int hashSize) {
+    addNewTable(newResult(), arraySize, hashSize);
+}
+
+void Compiler::pushArray(const std::vector<std::string>& values) {
+    int table = newResult();
+    int count = static_cast<int>(values.size());
+    addNewTable(table, count, 0);
+
+    // Each batch gets its own block; the allocator reuses the registers
+    for (int first = 0; first < count; first += static_cast<int>(SETLIST_BATCH)) {
+        int batch = std::min(count - first, static_cast<int>(SETLIST_BATCH));
+        int base = newRegisters(batch);
+        for (int i = 0; i < batch; i++) {
+            addLoadK(base + i, addConstant(values[first + i]));
+        }
+        addSetList(table, base, batch, first);
+    }
+}
+
+// ==================== FINALIZATION ====================
+
+std::string Compiler::compile() const {
+    for (const Instruction& insn : code) {
+        if (isJump(insn) && (insn.label >= labels.size() || labels[insn.label] > code.size())) return std::string();
+    }
+
+    // A trailing RETURN is only enough if nothing jumps past it
+    bool needsReturn = code.empty() || code.back().op != LOP_RETURN;
+    for (uint32_t target : labels) needsReturn |= target == code.size();
+
+    std::vector<Instruction> stream;
+    stream.reserve(code.size() + 1);
+    stream = code;
+    std::vector<Constant> extra;
+    uint32_t registers = nextRegister;
+    if (needsReturn) {
+        if (resultCount > MAX_RETURN_VALUES) returnThroughTable(stream, constants, extra, registers, resultCount);
+        else if (resultCount) stream.push_back({LOP_RETURN, RESULT_REGISTER_BASE, resultCount + 1, 0, 0, 0, NO_LABEL});
+        else stream.push_back({LOP_RETURN, 0, 1, 0, 0, 0, NO_LABEL});
+    }
+
+    std::vector<uint32_t> targets = labels;
+    if (optimizationLevel > 0) Peephole(stream, targets, constants, extra, registers).run();
+
+    std::vector<Instruction> physical;
+    std::vector<uint32_t> target;
+    if (!RegisterAllocator(stream, targets, optimizationLevel > 0, constants, extra).run(physical, target)) return std::string();
+
+    const size_t total = physical.size();
+
+    // Word offset of every instruction. Jumps start short and are widened
+    // until every short jump fits in D; widening only grows the stream, so
+    // this converges, normally after a single pass.
+    std::vector<uint32_t> offset(total + 1);
+    std::vector<uint8_t> wide(total, 0);
+
+    for (bool changed = true; changed;) {
+        changed = false;
+
+        uint32_t words = 0;
+        for (size_t i = 0; i < total; i++) {
+            offset[i] = words;
+            const Instruction& insn = physical[i];
+            bool conditional = insn.op == LOP_JUMPIF || insn.op == LOP_JUMPIFNOT;
+            words += wide[i] && conditional ? 2 : instructionLength(insn.op);
+        }
+        offset[total] = words;
+
+        for (size_t i = 0; i < total; i++) {
+            if (!isJump(physical[i]) || wide[i] || physical[i].op == LOP_LOADB) continue;
+            int32_t distance = static_cast<int32_t>(offset[target[physical[i].label]]) - static_cast<int32_t>(offset[i] + 1);
+            if (distance < INT16_MIN || distance > INT16_MAX) {
+                wide[i] = 1;
+                changed = true;
+            }
+        }
+    }
+
+    const uint32_t sizeCode = offset[total];
+    if (sizeCode >= (1u << 23)) return std::string();
+
+    uint32_t maxStack = 1;
+    for (const Instruction& insn : physical) maxStack = std::max(maxStack, frameSize(insn));
+
+    // The pass's table shapes follow the recorded pool, so existing indices hold
+    size_t constantBytes = 0;
+    for (const Constant& k : constants) constantBytes += constantSize(k);
+    for (const Constant& k : extra) constantBytes += constantSize(k);
+    const uint32_t constantCount = static_cast<uint32_t>(constants.size() + extra.size());
+
+    BytecodeWriter writer(BytecodeWriter::chunkSize(constantCount, constantBytes, maxStack, sizeCode));
+    writer.beginChunk();
+
+    writer.writeVarInt(constantCount);
+    for (const Constant& k : constants) writeConstant(writer, k);
+    for (const Constant& k : extra) writeConstant(writer, k);
+
+    writer.writeVarInt(1);
+    writer.beginProto(maxStack, 0, 0, false, sizeCode);
+
+    for (size_t i = 0; i < total; i++) {
+        const Instruction& insn = physical[i];
+        uint8_t a = static_cast<uint8_t>(insn.a);
+
+        if (isJump(insn)) {
+            int32_t to = static_cast<int32_t>(offset[target[insn.label]]);
+            int32_t from = static_cast<int32_t>(offset[i]);
+
+            if (insn.op == LOP_LOADB) {
+                // C only reaches forward, at most 255 words
+                int32_t skip = to - (from + 1);
+                if (skip < 0 || skip > UINT8_MAX) return std::string();
+                writer.emitABC(LOP_LOADB, a, static_cast<uint8_t>(insn.b), static_cast<uint8_t>(skip));
+            } else if (insn.op == LOP_JUMP) {
+                if (wide[i]) writer.emitE(LOP_JUMPX, to - (from + 1));
+                else writer.emitAD(to <= from ? LOP_JUMPBACK : LOP_JUMP, 0, static_cast<int16_t>(to - (from + 1)));
+            } else if (wide[i]) {
+                // Inverted test skips the long jump
+                writer.emitAD(insn.op == LOP_JUMPIF ? LOP_JUMPIFNOT : LOP_JUMPIF, a, 1);
+                writer.emitE(LOP_JUMPX, to - (from + 2));
+            } else {
+                writer.emitAD(insn.op, a, static_cast<int16_t>(to - (from + 1)));
+            }
+            continue;
+        }
+
+        const OpcodeInfo& info = OPCODE_INFO[insn.op];
+        switch (info.format) {
+            case FORMAT_ABC:
+                writer.emitABC(insn.op, a, static_cast<uint8_t>(insn.b), static_cast<uint8_t>(insn.c));
+                break;
+            case FORMAT_AD:
+                writer.emitAD(insn.op, a, static_cast<int16_t>(insn.d));
+                break;
+            case FORMAT_E:
+                writer.emitE(insn.op, insn.d);
+                break;
+        }
+        if (info.length == 2) writer.emitAux(insn.aux);
+    }
+
+    writer.endProto(constantCount);
+    return writer.finish();
+}
+
+std::string Compiler::getBytecode() const {
+    return compile();
+}
+
+void Compiler::clear() {
+    code.clear();
+    labels.clear();
+    pendingSkips.clear();
+    nextRegister = 0;
+    resultCount = 0;
+    constants.clear();
+    stringIndex.clear();
+    numberIndex.clear();
+    booleanIndex[0] = booleanIndex[1] = -1;
+}
+
+void Compiler::print() const {
+    std::string chunk = compile();
+    FileSink sink(stdout);
+    Disassemble(reinterpret_cast<const uint8_t*>(chunk.data()), chunk.size(), sink);
+}
+
+} // namespace Bytecode
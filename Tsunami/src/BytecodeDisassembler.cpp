@@ -0,0 +1,658 @@
+#include "Bytecode.h"
+#include "BytecodeWriter.h"
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace Bytecode {
+
+namespace {
+
+// ==================== BUFFERED OUTPUT ====================
+
+// Formats directly into a fixed block and hands full blocks to the sink,
+// so no per-token strings are built
+class Output {
+private:
+    DisassemblySink& sink;
+    char buffer[16384];
+    size_t used = 0;
+
+public:
+    explicit Output(DisassemblySink& target) : sink(target) {}
+    ~Output() { flush(); }
+
+    void flush() {
+        if (used) sink.write(buffer, used);
+        used = 0;
+    }
+
+    char* reserve(size_t count) {
+        if (used + count > sizeof(buffer)) flush();
+        return buffer + used;
+    }
+
+    void put(const char* data, size_t size) {
+        if (size > sizeof(buffer) / 2) {
+            flush();
+            sink.write(data, size);
+            return;
+        }
+        std::memcpy(reserve(size), data, size);
+        used += size;
+    }
+
+    void put(const char* text) { put(text, std::strlen(text)); }
+
+    void putChar(char c) {
+        *reserve(1) = c;
+        used++;
+    }
+
+    void putUInt(uint64_t value) {
+        char* out = reserve(20);
+        used += std::to_chars(out, out + 20, value).ptr - out;
+    }
+
+    void putInt(int64_t value) {
+        char* out = reserve(21);
+        used += std::to_chars(out, out + 21, value).ptr - out;
+    }
+
+    void putHex(uint32_t value) {
+        static const char digits[] = "0123456789abcdef";
+        char* out = reserve(10);
+        out[0] = '0';
+        out[1] = 'x';
+        for (int i = 0; i < 8; i++) out[2 + i] = digits[(value >> (28 - i * 4)) & 0xF];
+        used += 10;
+    }
+
+    void putDouble(double value, bool json) {
+        if (!std::isfinite(value)) {
+            const char* text = std::isnan(value) ? "nan" : value > 0 ? "inf" : "-inf";
+            if (json) putChar('"');
+            put(text);
+            if (json) putChar('"');
+            return;
+        }
+        char* out = reserve(32);
+        used += std::to_chars(out, out + 32, value).ptr - out;
+    }
+
+    // Quoted and escaped; text mode escapes as \xNN, JSON as \u00NN
+    void putString(const uint8_t* data, size_t size, bool json, size_t limit = SIZE_MAX) {
+        static const char digits[] = "0123456789abcdef";
+        size_t shown = size < limit ? size : limit;
+
+        putChar('"');
+        for (size_t i = 0; i < shown; i++) {
+            uint8_t c = data[i];
+            char* out = reserve(6);
+            if (c == '"' || c == '\\') {
+                out[0] = '\\';
+                out[1] = static_cast<char>(c);
+                used += 2;
+            } else if (c == '\n') {
+                out[0] = '\\';
+                out[1] = 'n';
+                used += 2;
+            } else if (c >= 0x20 && c < 0x7F) {
+                out[0] = static_cast<char>(c);
+                used += 1;
+            } else if (json) {
+                std::memcpy(out, "\\u00", 4);
+                out[4] = digits[c >> 4];
+                out[5] = digits[c & 0xF];
+                used += 6;
+            } else {
+                out[0] = '\\';
+                out[1] = 'x';
+                out[2] = digits[c >> 4];
+                out[3] = digits[c & 0xF];
+                used += 4;
+            }
+        }
+        putChar('"');
+        if (shown < size) put("...");
+    }
+
+    void padTo(size_t width, size_t written) {
+        while (written++ < width) putChar(' ');
+    }
+};
+
+// ==================== DISASSEMBLER ====================
+
+class Disassembler {
+private:
+    const uint8_t* begin;
+    const uint8_t* pos;
+    const uint8_t* end;
+    Output out;
+    bool json;
+
+    uint32_t constantCount = 0;
+
+    // Closers of the JSON containers still open, innermost last
+    std::string nesting;
+
+    // Byte offset of each constant, for operand annotations; reused across calls
+    static thread_local std::vector<uint32_t> constantOffsets;
+
+public:
+    Disassembler(const uint8_t* data, size_t size, DisassemblySink& sink, bool asJson)
+        : begin(data), pos(data), end(data + size), out(sink), json(asJson) {}
+
+    bool run();
+
+private:
+    bool readByte(uint8_t& value) {
+        if (pos >= end) return false;
+        value = *pos++;
+        return true;
+    }
+
+    bool readVarInt(uint32_t& value) {
+        uint32_t result = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            if (pos >= end) return false;
+            uint8_t byte = *pos++;
+            result |= static_cast<uint32_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                value = result;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static uint32_t readUInt32(const uint8_t* p) {
+        return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+    }
+
+    bool constants();
+    bool constant(uint32_t index);
+    void constantValue(uint32_t index, size_t limit);
+    bool proto(uint32_t index);
+    void instruction(const uint8_t* insn, uint32_t pc);
+    void operand(OperandKind kind, int64_t value, uint32_t pc, bool first);
+    bool error(const char* message);
+
+    void nest(char closer) {
+        if (json) nesting.push_back(closer);
+    }
+
+    void unnest(size_t count = 1) {
+        if (json) nesting.resize(nesting.size() - count);
+    }
+};
+
+thread_local std::vector<uint32_t> Disassembler::constantOffsets;
+
+bool Disassembler::error(const char* message) {
+    if (json) {
+        // Close whatever the failure interrupted. With nothing inside it
+        // open, the top-level object already ends in a comma.
+        if (nesting.size() > 1) {
+            while (nesting.size() > 1) {
+                out.putChar(nesting.back());
+                nesting.pop_back();
+            }
+            out.putChar(',');
+        }
+        out.put("\"error\":");
+        out.putString(reinterpret_cast<const uint8_t*>(message), std::strlen(message), true);
+        out.put(",\"offset\":");
+        out.putUInt(static_cast<uint64_t>(pos - begin));
+        out.put("}\n");
+    } else {
+        out.put("; error: ");
+        out.put(message);
+        out.put(" at offset ");
+        out.putUInt(static_cast<uint64_t>(pos - begin));
+        out.putChar('\n');
+    }
+    return false;
+}
+
+// ==================== CONSTANTS ====================
+
+bool Disassembler::constants() {
+    if (!readVarInt(constantCount)) return error("truncated constant count");
+    constantOffsets.clear();
+
+    if (json) {
+        out.put("\"constants\":[");
+        nest(']');
+    } else {
+        out.put("; ");
+        out.putUInt(constantCount);
+        out.put(" constants\n");
+    }
+
+    for (uint32_t i = 0; i < constantCount; i++) {
+        constantOffsets.push_back(static_cast<uint32_t>(pos - begin));
+        if (!constant(i)) return false;
+    }
+
+    if (json) out.put("],");
+    unnest();
+    return true;
+}
+
+bool Disassembler::constant(uint32_t index) {
+    uint8_t type;
+    if (!readByte(type)) return error("truncated constant");
+
+    // Written once the value has been read, so an error never lands
+    // inside the type string
+    auto label = [&]() {
+        if (json) {
+            if (index) out.putChar(',');
+            out.put("{\"type\":\"");
+        } else {
+            out.putChar('K');
+            out.putUInt(index);
+            out.padTo(6, 1 + (index < 10 ? 1 : index < 100 ? 2 : index < 1000 ? 3 : 4));
+        }
+    };
+
+    switch (type) {
+        case LBC_CONSTANT_NIL:
+            label();
+            out.put(json ? "nil\"}" : "nil\n");
+            return true;
+
+        case LBC_CONSTANT_BOOLEAN: {
+            uint8_t value;
+            if (!readByte(value)) return error("truncated boolean constant");
+            label();
+            out.put(json ? "boolean\",\"value\":" : "boolean ");
+            out.put(value ? "true" : "false");
+            out.put(json ? "}" : "\n");
+            return true;
+        }
+
+        case LBC_CONSTANT_NUMBER: {
+            if (end - pos < 8) return error("truncated number constant");
+            uint64_t bits = 0;
+            for (int i = 7; i >= 0; i--) bits = (bits << 8) | pos[i];
+            pos += 8;
+            double value;
+            std::memcpy(&value, &bits, sizeof(double));
+            label();
+            out.put(json ? "number\",\"value\":" : "number  ");
+            out.putDouble(value, json);
+            out.put(json ? "}" : "\n");
+            return true;
+        }
+
+        case LBC_CONSTANT_STRING: {
+            uint32_t length;
+            if (!readVarInt(length) || static_cast<size_t>(end - pos) < length) {
+                return error("truncated string constant");
+            }
+            label();
+            out.put(json ? "string\",\"value\":" : "string  ");
+            out.putString(pos, length, json);
+            pos += length;
+            out.put(json ? "}" : "\n");
+            return true;
+        }
+
+        case LBC_CONSTANT_IMPORT: {
+            if (end - pos < 4) return error("truncated import constant");
+            uint32_t id = readUInt32(pos);
+            pos += 4;
+            uint32_t count = id >> 30;
+            label();
+            out.put(json ? "import\",\"indices\":[" : "import  ");
+            for (uint32_t k = 0; k < count; k++) {
+                if (k) out.putChar(json ? ',' : '.');
+                if (!json) out.putChar('K');
+                out.putUInt((id >> (20 - k * 10)) & 1023);
+            }
+            out.put(json ? "]}" : "\n");
+            return true;
+        }
+
+        case LBC_CONSTANT_TABLE: {
+            uint32_t keys;
+            if (!readVarInt(keys)) return error("truncated table constant");
+            label();
+            out.put(json ? "table\",\"keys\":[" : "table   {");
+            nest('}');
+            nest(']');
+            for (uint32_t k = 0; k < keys; k++) {
+                uint32_t key;
+                if (!readVarInt(key)) return error("truncated table constant");
+                if (k) out.put(json ? "," : ", ");
+                if (!json) out.putChar('K');
+                out.putUInt(key);
+            }
+            out.put(json ? "]}" : "}\n");
+            unnest(2);
+            return true;
+        }
+
+        case LBC_CONSTANT_CLOSURE: {
+            uint32_t proto;
+            if (!readVarInt(proto)) return error("truncated closure constant");
+            label();
+            out.put(json ? "closure\",\"proto\":" : "closure P");
+            out.putUInt(proto);
+            out.put(json ? "}" : "\n");
+            return true;
+        }
+
+        default:
+            return error("unknown constant type");
+    }
+}
+
+// Short rendering of a constant for text-mode operand comments
+void Disassembler::constantValue(uint32_t index, size_t limit) {
+    if (index >= constantOffsets.size()) {
+        out.put("<invalid>");
+        return;
+    }
+
+    const uint8_t* p = begin + constantOffsets[index];
+    switch (*p++) {
+        case LBC_CONSTANT_NIL:
+            out.put("nil");
+            break;
+        case LBC_CONSTANT_BOOLEAN:
+            out.put(*p ? "true" : "false");
+            break;
+        case LBC_CONSTANT_NUMBER: {
+            uint64_t bits = 0;
+            for (int i = 7; i >= 0; i--) bits = (bits << 8) | p[i];
+            double value;
+            std::memcpy(&value, &bits, sizeof(double));
+            out.putDouble(value, false);
+            break;
+        }
+        case LBC_CONSTANT_STRING: {
+            uint32_t length = 0;
+            for (int shift = 0;; shift += 7) {
+                uint8_t byte = *p++;
+                length |= static_cast<uint32_t>(byte & 0x7F) << shift;
+                if (!(byte & 0x80)) break;
+            }
+            out.putString(p, length, false, limit);
+            break;
+        }
+        case LBC_CONSTANT_IMPORT:
+            out.put("import");
+            break;
+        case LBC_CONSTANT_TABLE:
+            out.put("table");
+            break;
+        case LBC_CONSTANT_CLOSURE:
+            out.put("closure");
+            break;
+    }
+}
+
+// ==================== PROTOS ====================
+
+bool Disassembler::proto(uint32_t index) {
+    uint32_t maxStack, numParams, numUpvalues, isVararg, sizeCode;
+    if (!readVarInt(maxStack) || !readVarInt(numParams) || !readVarInt(numUpvalues) ||
+        !readVarInt(isVararg) || !readVarInt(sizeCode)) {
+        return error("truncated proto header");
+    }
+
+    if (json) {
+        if (index) out.putChar(',');
+        out.put("{\"maxstack\":");
+        out.putUInt(maxStack);
+        out.put(",\"params\":");
+        out.putUInt(numParams);
+        out.put(",\"upvalues\":");
+        out.putUInt(numUpvalues);
+        out.put(",\"vararg\":");
+        out.put(isVararg ? "true" : "false");
+        out.put(",\"code\":[");
+        nest('}');
+        nest(']');
+    } else {
+        out.put("\n; proto ");
+        out.putUInt(index);
+        out.put(": maxstack ");
+        out.putUInt(maxStack);
+        out.put(", params ");
+        out.putUInt(numParams);
+        out.put(", upvalues ");
+        out.putUInt(numUpvalues);
+        out.put(", vararg ");
+        out.putUInt(isVararg);
+        out.put(", ");
+        out.putUInt(sizeCode);
+        out.put(" words\n");
+    }
+
+    if (static_cast<size_t>(end - pos) / BytecodeWriter::INSTRUCTION_SIZE < sizeCode) {
+        return error("truncated code");
+    }
+
+    const uint8_t* code = pos;
+    bool firstInstruction = true;
+    for (uint32_t pc = 0; pc < sizeCode;) {
+        uint8_t op = decodeOpcode(code[pc * 4]);
+        uint8_t length = instructionLength(op);
+        if (length == 0) {
+            pos = code + pc * 4;
+            return error("invalid opcode");
+        }
+        if (pc + length > sizeCode) {
+            pos = code + pc * 4;
+            return error("instruction runs past end of code");
+        }
+
+        if (json && !firstInstruction) out.putChar(',');
+        instruction(code + pc * 4, pc);
+        firstInstruction = false;
+        pc += length;
+    }
+    pos = code + static_cast<size_t>(sizeCode) * 4;
+
+    uint32_t sizeK, sizeP;
+    if (!readVarInt(sizeK) || !readVarInt(sizeP)) return error("truncated proto tail");
+
+    if (json) {
+        // The children array takes the place of the code array
+        out.put("],\"sizek\":");
+        out.putUInt(sizeK);
+        out.put(",\"children\":[");
+    } else {
+        out.put("; sizeK ");
+        out.putUInt(sizeK);
+        out.put(", children [");
+    }
+
+    for (uint32_t i = 0; i < sizeP; i++) {
+        uint32_t child;
+        if (!readVarInt(child)) return error("truncated child list");
+        if (i) out.put(json ? "," : ", ");
+        if (!json) out.putChar('P');
+        out.putUInt(child);
+    }
+
+    uint32_t lineDefined, debugName;
+    uint8_t lineInfo, debugInfo;
+    if (!readVarInt(lineDefined) || !readVarInt(debugName) ||
+        !readByte(lineInfo) || !readByte(debugInfo)) {
+        return error("truncated debug info");
+    }
+
+    out.put(json ? "]}" : "]\n");
+    unnest(2);
+    return true;
+}
+
+void Disassembler::operand(OperandKind kind, int64_t value, uint32_t pc, bool first) {
+    if (json) return;
+
+    if (!first) out.putChar(' ');
+    switch (kind) {
+        case OPERAND_REG:   out.putChar('R'); out.putInt(value); break;
+        case OPERAND_CONST: out.putChar('K'); out.putInt(value); break;
+        case OPERAND_UPVAL: out.putChar('U'); out.putInt(value); break;
+        case OPERAND_PROTO: out.putChar('P'); out.putInt(value); break;
+        case OPERAND_JUMP:  out.putChar('L'); out.putInt(pc + 1 + value); break;
+        default:            out.putInt(value); break;
+    }
+}
+
+void Disassembler::instruction(const uint8_t* insn, uint32_t pc) {
+    uint8_t op = decodeOpcode(insn[0]);
+    const OpcodeInfo& info = OPCODE_INFO[op];
+
+    int64_t a = insn[1];
+    int64_t b = insn[2];
+    int64_t c = insn[3];
+    int64_t d = static_cast<int16_t>(insn[2] | (insn[3] << 8));
+    int64_t e = static_cast<int32_t>((insn[1] | (insn[2] << 8) | (insn[3] << 16)) << 8) >> 8;
+    uint32_t aux = info.length == 2 ? readUInt32(insn + 4) : 0;
+
+    if (json) {
+        out.put("{\"pc\":");
+        out.putUInt(pc);
+        out.put(",\"op\":\"");
+        out.put(info.name);
+        out.putChar('"');
+        switch (info.format) {
+            case FORMAT_ABC:
+                out.put(",\"a\":"); out.putInt(a);
+                out.put(",\"b\":"); out.putInt(b);
+                out.put(",\"c\":"); out.putInt(c);
+                break;
+            case FORMAT_AD:
+                out.put(",\"a\":"); out.putInt(a);
+                out.put(",\"d\":"); out.putInt(d);
+                break;
+            case FORMAT_E:
+                out.put(",\"e\":"); out.putInt(e);
+                break;
+        }
+        if (info.length == 2) {
+            out.put(",\"aux\":");
+            out.putUInt(aux);
+        }
+        out.putChar('}');
+        return;
+    }
+
+    // Text: "   pc  NAME          operands  ; annotation"
+    out.padTo(6, (pc < 10 ? 1 : pc < 100 ? 2 : pc < 1000 ? 3 : pc < 10000 ? 4 : pc < 100000 ? 5 : 6));
+    out.putUInt(pc);
+    out.put("  ");
+    size_t nameLength = std::strlen(info.name);
+    out.put(info.name, nameLength);
+    out.padTo(16, nameLength);
+
+    bool first = true;
+    int64_t annotate = -1;
+    auto field = [&](OperandKind kind, int64_t value) {
+        if (kind == OPERAND_NONE) return;
+        operand(kind, value, pc, first);
+        if (kind == OPERAND_CONST) annotate = value;
+        first = false;
+    };
+
+    switch (info.format) {
+        case FORMAT_ABC:
+            field(info.a, a);
+            field(info.b, b);
+            field(info.c, c);
+            break;
+        case FORMAT_AD:
+            field(info.a, a);
+            field(info.b, d);
+            break;
+        case FORMAT_E:
+            field(info.a, e);
+            break;
+    }
+
+    if (info.length == 2 && info.aux != OPERAND_NONE) {
+        // JUMPIFEQK keeps a flag in the top bit of AUX
+        field(info.aux, info.aux == OPERAND_CONST ? (aux & 0xFFFFFF) : aux);
+    }
+
+    if (annotate >= 0) {
+        out.put("  ; ");
+        constantValue(static_cast<uint32_t>(annotate), 48);
+    }
+    out.putChar('\n');
+}
+
+// ==================== DRIVER ====================
+
+bool Disassembler::run() {
+    if (static_cast<size_t>(end - begin) < sizeof(LuauBytecodeHeader)) {
+        if (json) out.put("{\"error\":\"truncated header\"}\n");
+        else out.put("; error: truncated header\n");
+        return false;
+    }
+
+    LuauBytecodeHeader header;
+    std::memcpy(&header, begin, sizeof(header));
+    pos = begin + sizeof(header);
+
+    if (json) {
+        out.put("{\"version\":");
+        out.putUInt(header.version);
+        out.put(",\"size\":");
+        out.putUInt(header.size);
+        out.put(",\"hash\":");
+        out.putUInt(header.hash);
+        out.putChar(',');
+        nest('}');
+    } else {
+        out.put("; version ");
+        out.putUInt(header.version);
+        out.put(", ");
+        out.putUInt(header.size);
+        out.put(" bytes, hash ");
+        out.putHex(header.hash);
+        out.putChar('\n');
+    }
+
+    if (!constants()) return false;
+
+    uint32_t protoCount;
+    if (!readVarInt(protoCount)) return error("truncated proto count");
+
+    if (json) out.put("\"protos\":[");
+    nest(']');
+    for (uint32_t i = 0; i < protoCount; i++) {
+        if (!proto(i)) return false;
+    }
+
+    if (json) out.put("]}\n");
+    unnest(2);
+    return true;
+}
+
+} // namespace
+
+// ==================== PUBLIC API ====================
+
+bool Disassemble(const uint8_t* data, size_t size, DisassemblySink& sink, DisassemblyFormat format) {
+    Disassembler disassembler(data, size, sink, format == DISASM_JSON);
+    return disassembler.run();
+}
+
+std::string GetBytecodeInfo(const std::string& bytecode) {
+    std::string info;
+    StringSink sink(info);
+    Disassemble(reinterpret_cast<const uint8_t*>(bytecode.data()), bytecode.size(), sink, DISASM_TEXT);
+    return info;
+}
+
+} // namespace Bytecode
@@ -0,0 +1,464 @@
+#include "Bytecode.h"
+#include "BytecodeWriter.h"
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+namespace Bytecode {
+
+namespace {
+
+// ==================== PARSED INPUT ====================
+
+// Operand widths a constant index may have to fit, narrowest first. A
+// constant takes the narrowest class of any use, and anything it refers to
+// (table keys, import components) is pulled into at least the same class so
+// it is placed earlier.
+enum WidthClass : uint8_t {
+    WIDTH_BYTE,         // ADDK..ORK C
+    WIDTH_IMPORT,       // Import components, 10 bits
+    WIDTH_SHORT,        // LOADK, DUPTABLE, GETIMPORT D
+    WIDTH_AUX24,        // JUMPIFEQK / JUMPIFNOTEQK AUX low 24 bits
+    WIDTH_AUX,          // Full AUX word, or unused
+};
+
+constexpr uint32_t WIDTH_LIMIT[] = {255, 1023, 32767, 0xFFFFFF, UINT32_MAX};
+
+struct ParsedConstant {
+    uint8_t type;
+    const uint8_t* payload;     // Bytes after the type byte
+    size_t payloadSize;
+    uint32_t reference;         // Import id or closure proto
+    std::vector<uint32_t> keys; // Table keys
+    uint8_t width = WIDTH_AUX;
+    uint32_t merged = 0;
+};
+
+struct ParsedProto {
+    uint32_t maxStack, numParams, numUpvalues, isVararg;
+    const uint8_t* code;
+    uint32_t sizeCode;
+    std::vector<uint32_t> children;
+};
+
+struct ParsedChunk {
+    std::vector<ParsedConstant> constants;
+    std::vector<ParsedProto> protos;
+    uint32_t protoBase = 0;
+};
+
+// Input has passed VerifyBytecode, so reads need no bounds checks
+class Reader {
+public:
+    const uint8_t* pos;
+
+    explicit Reader(const uint8_t* at) : pos(at) {}
+
+    uint8_t byte() { return *pos++; }
+
+    uint32_t varInt() {
+        uint32_t result = 0;
+        for (int shift = 0;; shift += 7) {
+            uint8_t value = *pos++;
+            result |= static_cast<uint32_t>(value & 0x7F) << shift;
+            if (!(value & 0x80)) return result;
+        }
+    }
+
+    uint32_t u32() {
+        uint32_t value = loadU32(pos);
+        pos += 4;
+        return value;
+    }
+};
+
+void parseChunk(std::string_view bytes, ParsedChunk& chunk) {
+    Reader in(reinterpret_cast<const uint8_t*>(bytes.data()) + BytecodeWriter::HEADER_SIZE);
+
+    chunk.constants.resize(in.varInt());
+    for (ParsedConstant& constant : chunk.constants) {
+        constant.type = in.byte();
+        constant.payload = in.pos;
+        switch (constant.type) {
+            case LBC_CONSTANT_BOOLEAN:
+                in.pos++;
+                break;
+            case LBC_CONSTANT_NUMBER:
+                in.pos += sizeof(double);
+                break;
+            case LBC_CONSTANT_STRING:
+                in.pos += in.varInt();
+                break;
+            case LBC_CONSTANT_IMPORT:
+                constant.reference = in.u32();
+                break;
+            case LBC_CONSTANT_TABLE:
+                constant.keys.resize(in.varInt());
+                for (uint32_t& key : constant.keys) key = in.varInt();
+                break;
+            case LBC_CONSTANT_CLOSURE:
+                constant.reference = in.varInt();
+                break;
+            default:
+                break;
+        }
+        constant.payloadSize = static_cast<size_t>(in.pos - constant.payload);
+    }
+
+    chunk.protos.resize(in.varInt());
+    for (ParsedProto& proto : chunk.protos) {
+        proto.maxStack = in.varInt();
+        proto.numParams = in.varInt();
+        proto.numUpvalues = in.varInt();
+        proto.isVararg = in.varInt();
+        proto.sizeCode = in.varInt();
+        proto.code = in.pos;
+        in.pos += static_cast<size_t>(proto.sizeCode) * BytecodeWriter::INSTRUCTION_SIZE;
+
+        in.varInt();    // sizeK: the merged pool is shared, so it is rewritten
+        proto.children.resize(in.varInt());
+        for (uint32_t& child : proto.children) child = in.varInt();
+
+        // Debug info is dropped: linedefined, debugname, empty tables
+        in.varInt();
+        in.varInt();
+        in.pos += 2;
+    }
+}
+
+uint32_t importCount(uint32_t id) { return id >> 30; }
+
+uint32_t importComponent(uint32_t id, uint32_t k) { return (id >> (20 - k * 10)) & 1023; }
+
+uint32_t remapImport(uint32_t id, const std::vector<ParsedConstant>& constants) {
+    uint32_t result = id & (3u << 30);
+    for (uint32_t k = 0; k < importCount(id); k++) {
+        result |= constants[importComponent(id, k)].merged << (20 - k * 10);
+    }
+    return result;
+}
+
+// ==================== WIDTH CLASSES ====================
+
+void narrow(ParsedConstant& constant, uint8_t width) {
+    if (width < constant.width) constant.width = width;
+}
+
+// Marks every constant with the narrowest operand that names it
+void classifyUses(ParsedChunk& chunk) {
+    std::vector<ParsedConstant>& constants = chunk.constants;
+
+    for (const ParsedProto& proto : chunk.protos) {
+        for (uint32_t pc = 0; pc < proto.sizeCode;) {
+            const uint8_t* insn = proto.code + pc * 4;
+            uint8_t op = decodeOpcode(insn[0]);
+            uint32_t d = static_cast<uint16_t>(insn[2] | (insn[3] << 8));
+            uint32_t aux = isDoubleByteOpcode(op) ? loadU32(insn + 4) : 0;
+
+            switch (op) {
+                case LOP_ADDK: case LOP_SUBK: case LOP_MULK: case LOP_DIVK:
+                case LOP_MODK: case LOP_POWK: case LOP_ANDK: case LOP_ORK:
+                    narrow(constants[insn[3]], WIDTH_BYTE);
+                    break;
+                case LOP_LOADK:
+                case LOP_DUPTABLE:
+                    narrow(constants[d], WIDTH_SHORT);
+                    break;
+                case LOP_GETIMPORT:
+                    narrow(constants[d], WIDTH_SHORT);
+                    for (uint32_t k = 0; k < importCount(aux); k++) {
+                        narrow(constants[importComponent(aux, k)], WIDTH_IMPORT);
+                    }
+                    break;
+                case LOP_JUMPIFEQK:
+                case LOP_JUMPIFNOTEQK:
+                    narrow(constants[aux & 0xFFFFFF], WIDTH_AUX24);
+                    break;
+                default:
+                    break;
+            }
+            pc += isDoubleByteOpcode(op) ? 2 : 1;
+        }
+    }
+
+    // References point backwards, so one reverse pass carries classes down
+    // any chain of them
+    for (size_t i = constants.size(); i-- > 0;) {
+        ParsedConstant& constant = constants[i];
+        if (constant.type == LBC_CONSTANT_TABLE) {
+            for (uint32_t key : constant.keys) narrow(constants[key], constant.width);
+        } else if (constant.type == LBC_CONSTANT_IMPORT) {
+            for (uint32_t k = 0; k < importCount(constant.reference); k++) {
+                ParsedConstant& component = constants[importComponent(constant.reference, k)];
+                narrow(component, std::min<uint8_t>(constant.width, WIDTH_IMPORT));
+            }
+        }
+    }
+}
+
+// ==================== MERGED POOL ====================
+
+class ConstantPool {
+public:
+    std::string bytes;      // Encoded constants, back to back
+    uint32_t count = 0;
+
+    // Interns an encoded constant, returning its merged index
+    uint32_t intern(const std::string& encoded) {
+        auto inserted = index.emplace(encoded, count);
+        if (inserted.second) {
+            bytes += encoded;
+            count++;
+        }
+        return inserted.first->second;
+    }
+
+    uint32_t internString(std::string_view text) {
+        std::string encoded(1, static_cast<char>(LBC_CONSTANT_STRING));
+        appendVarInt(encoded, static_cast<uint32_t>(text.size()));
+        encoded.append(text.data(), text.size());
+        return intern(encoded);
+    }
+
+    static void appendVarInt(std::string& out, uint32_t value) {
+        do {
+            uint8_t byte = value & 0x7F;
+            value >>= 7;
+            if (value != 0) byte |= 0x80;
+            out += static_cast<char>(byte);
+        } while (value != 0);
+    }
+
+private:
+    std::unordered_map<std::string, uint32_t> index;
+};
+
+// Encodes constant with its references already remapped
+std::string encodeConstant(const ParsedConstant& constant, const ParsedChunk& chunk) {
+    std::string encoded(1, static_cast<char>(constant.type));
+    switch (constant.type) {
+        case LBC_CONSTANT_IMPORT: {
+            uint8_t id[4];
+            storeU32(id, remapImport(constant.reference, chunk.constants));
+            encoded.append(reinterpret_cast<const char*>(id), 4);
+            break;
+        }
+        case LBC_CONSTANT_TABLE:
+            ConstantPool::appendVarInt(encoded, static_cast<uint32_t>(constant.keys.size()));
+            for (uint32_t key : constant.keys) ConstantPool::appendVarInt(encoded, chunk.constants[key].merged);
+            break;
+        case LBC_CONSTANT_CLOSURE:
+            ConstantPool::appendVarInt(encoded, chunk.protoBase + constant.reference);
+            break;
+        default:
+            encoded.append(reinterpret_cast<const char*>(constant.payload), constant.payloadSize);
+            break;
+    }
+    return encoded;
+}
+
+// ==================== CODE ====================
+
+void patchShort(uint8_t* insn, uint32_t value) {
+    insn[2] = static_cast<uint8_t>(value);
+    insn[3] = static_cast<uint8_t>(value >> 8);
+}
+
+// Copies a proto's code with every constant operand remapped
+void relocateCode(const ParsedProto& proto, const ParsedChunk& chunk, uint8_t* out) {
+    const std::vector<ParsedConstant>& constants = chunk.constants;
+    std::memcpy(out, proto.code, static_cast<size_t>(proto.sizeCode) * BytecodeWriter::INSTRUCTION_SIZE);
+
+    for (uint32_t pc = 0; pc < proto.sizeCode;) {
+        uint8_t* insn = out + pc * 4;
+        uint8_t op = decodeOpcode(insn[0]);
+        bool hasAux = isDoubleByteOpcode(op);
+        uint32_t d = static_cast<uint16_t>(insn[2] | (insn[3] << 8));
+        uint32_t aux = hasAux ? loadU32(insn + 4) : 0;
+
+        switch (op) {
+            case LOP_ADDK: case LOP_SUBK: case LOP_MULK: case LOP_DIVK:
+            case LOP_MODK: case LOP_POWK: case LOP_ANDK: case LOP_ORK:
+                insn[3] = static_cast<uint8_t>(constants[insn[3]].merged);
+                break;
+            case LOP_LOADK:
+            case LOP_DUPTABLE:
+                patchShort(insn, constants[d].merged);
+                break;
+            case LOP_GETIMPORT:
+                patchShort(insn, constants[d].merged);
+                storeU32(insn + 4, remapImport(aux, constants));
+                break;
+            case LOP_JUMPIFEQK:
+            case LOP_JUMPIFNOTEQK:
+                storeU32(insn + 4, (aux & 0xFF000000) | constants[aux & 0xFFFFFF].merged);
+                break;
+            case LOP_LOADKX:
+            case LOP_GETGLOBAL:
+            case LOP_SETGLOBAL:
+            case LOP_GETTABLKS:
+            case LOP_SETTABLKS:
+            case LOP_NAMECALL:
+            case LOP_FASTCALL2K:
+                storeU32(insn + 4, constants[aux].merged);
+                break;
+            default:
+                break;
+        }
+        pc += hasAux ? 2 : 1;
+    }
+}
+
+std::string fail(std::string* error, const std::string& message) {
+    if (error) *error = message;
+    return std::string();
+}
+
+// RETURN's B is count + 1 in one byte
+constexpr size_t MAX_RETURN_VALUES = 254;
+
+} // namespace
+
+// ==================== PUBLIC API ====================
+
+std::string LinkChunks(const std::string_view* chunks, size_t count, std::string* error) {
+    if (count == 0) return fail(error, "no chunks to link");
+    if (count > INT16_MAX) return fail(error, "too many chunks (NEWCLOSURE indexes at most 32767)");
+
+    std::vector<ParsedChunk> parsed(count);
+    uint32_t protoTotal = 0;
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(chunks[i].data());
+        size_t offset = 0;
+        VerifyResult result = VerifyBytecode(data, chunks[i].size(), &offset);
+        if (result != VERIFY_OK) {
+            return fail(error, "chunk " + std::to_string(i) + ": " + VerifyResultName(result) + " at offset " +
+                               std::to_string(offset));
+        }
+
+        parseChunk(chunks[i], parsed[i]);
+        if (parsed[i].protos.back().numUpvalues != 0) {
+            return fail(error, "chunk " + std::to_string(i) + ": main proto has upvalues");
+        }
+        parsed[i].protoBase = protoTotal;
+        protoTotal += static_cast<uint32_t>(parsed[i].protos.size());
+        classifyUses(parsed[i]);
+    }
+
+    // Merge narrowest class first; within a class, input order keeps every
+    // reference pointing at an already merged constant
+    struct Placement {
+        uint8_t width;
+        uint32_t chunk;
+        uint32_t index;
+    };
+    std::vector<Placement> order;
+    for (uint32_t c = 0; c < count; c++) {
+        const std::vector<ParsedConstant>& constants = parsed[c].constants;
+        for (uint32_t i = 0; i < constants.size(); i++) order.push_back(Placement{constants[i].width, c, i});
+    }
+    std::stable_sort(order.begin(), order.end(), [](const Placement& a, const Placement& b) {
+        return a.width < b.width;
+    });
+
+    ConstantPool pool;
+    for (const Placement& placement : order) {
+        ParsedChunk& chunk = parsed[placement.chunk];
+        ParsedConstant& constant = chunk.constants[placement.index];
+        constant.merged = pool.intern(encodeConstant(constant, chunk));
+        if (constant.merged > WIDTH_LIMIT[constant.width]) {
+            return fail(error, "too many distinct constants: index " + std::to_string(constant.merged) +
+                               " does not fit its operand");
+        }
+    }
+
+    // Main proto: call each input's main and collect one result apiece,
+    // in registers when RETURN can name them all, otherwise in a table that
+    // unpack(t, 1, n) spreads back out. n <= INT16_MAX, so LOADN holds it.
+    uint32_t n = static_cast<uint32_t>(count);
+    bool direct = count <= MAX_RETURN_VALUES;
+    uint32_t unpackConstant = direct ? 0 : pool.internString("unpack");
+
+    std::vector<uint32_t> mainChildren(count);
+    for (size_t i = 0; i < count; i++) {
+        mainChildren[i] = parsed[i].protoBase + static_cast<uint32_t>(parsed[i].protos.size()) - 1;
+    }
+
+    uint32_t batches = (n + SETLIST_BATCH - 1) / SETLIST_BATCH;
+    // Direct: NEWCLOSURE + CALL each, RETURN. Table: GETGLOBAL + AUX,
+    // NEWTABLE + AUX, NEWCLOSURE + CALL each, SETLIST + AUX per batch,
+    // LOADN 1, LOADN n, CALL, RETURN
+    uint32_t mainCode = direct ? n * 2 + 1 : 2 + 2 + n * 2 + batches * 2 + 4;
+    uint32_t mainStack = direct ? n : 2 + std::min(n, SETLIST_BATCH);
+
+    // Exact output size
+    size_t size = BytecodeWriter::HEADER_SIZE + varIntSize(pool.count) + pool.bytes.size() + varIntSize(protoTotal + 1);
+    for (const ParsedChunk& chunk : parsed) {
+        for (const ParsedProto& proto : chunk.protos) {
+            size += varIntSize(proto.maxStack) + varIntSize(proto.numParams) + varIntSize(proto.numUpvalues) +
+                    varIntSize(proto.isVararg) + varIntSize(proto.sizeCode) +
+                    static_cast<size_t>(proto.sizeCode) * BytecodeWriter::INSTRUCTION_SIZE +
+                    varIntSize(pool.count) + varIntSize(static_cast<uint32_t>(proto.children.size())) + 4;
+            for (uint32_t child : proto.children) size += varIntSize(chunk.protoBase + child);
+        }
+    }
+    size += BytecodeWriter::protoSize(mainStack, mainCode, pool.count, n);
+    for (uint32_t child : mainChildren) size += varIntSize(child);
+
+    BytecodeWriter writer(size);
+    writer.beginChunk();
+    writer.writeVarInt(pool.count);
+    writer.writeBytes(pool.bytes.data(), pool.bytes.size());
+
+    writer.writeVarInt(protoTotal + 1);
+    std::vector<uint32_t> children;
+    for (const ParsedChunk& chunk : parsed) {
+        for (const ParsedProto& proto : chunk.protos) {
+            writer.beginProto(proto.maxStack, proto.numParams, proto.numUpvalues, proto.isVararg != 0, proto.sizeCode);
+            relocateCode(proto, chunk,
+                         writer.claim(static_cast<size_t>(proto.sizeCode) * BytecodeWriter::INSTRUCTION_SIZE));
+
+            children.clear();
+            for (uint32_t child : proto.children) children.push_back(chunk.protoBase + child);
+            writer.endProto(pool.count, children.data(), static_cast<uint32_t>(children.size()));
+        }
+    }
+
+    writer.beginProto(mainStack, 0, 0, false, mainCode);
+    if (direct) {
+        for (uint32_t i = 0; i < n; i++) {
+            writer.emitAD(LOP_NEWCLOSURE, static_cast<uint8_t>(i), static_cast<int16_t>(i));
+            writer.emitABC(LOP_CALL, static_cast<uint8_t>(i), 1, 2);
+        }
+        writer.emitABC(LOP_RETURN, 0, static_cast<uint8_t>(n + 1), 0);
+    } else {
+        writer.emitABC(LOP_GETGLOBAL, 0, 0, 0);
+        writer.emitAux(unpackConstant);
+        writer.emitABC(LOP_NEWTABLE, 1, 0, 0);
+        writer.emitAux(n);
+        for (uint32_t first = 0; first < n; first += SETLIST_BATCH) {
+            uint32_t batch = std::min(n - first, SETLIST_BATCH);
+            for (uint32_t i = 0; i < batch; i++) {
+                writer.emitAD(LOP_NEWCLOSURE, static_cast<uint8_t>(2 + i), static_cast<int16_t>(first + i));
+                writer.emitABC(LOP_CALL, static_cast<uint8_t>(2 + i), 1, 2);
+            }
+            writer.emitABC(LOP_SETLIST, 1, 2, static_cast<uint8_t>(batch + 1));
+            writer.emitAux(first + 1);
+        }
+        writer.emitAD(LOP_LOADN, 2, 1);
+        writer.emitAD(LOP_LOADN, 3, static_cast<int16_t>(n));
+        writer.emitABC(LOP_CALL, 0, 4, 0);
+        writer.emitABC(LOP_RETURN, 0, 0, 0);
+    }
+    writer.endProto(pool.count, mainChildren.data(), n);
+
+    return writer.finish();
+}
+
+std::string LinkChunks(const std::vector<std::string>& chunks, std::string* error) {
+    std::vector<std::string_view> views(chunks.begin(), chunks.end());
+    return LinkChunks(views.data(), views.size(), error);
+}
+
+} // namespace Bytecode
@@ -0,0 +1,561 @@
+#include "Bytecode.h"
+#include "BytecodeWriter.h"
+#include <cstddef>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace Bytecode {
+
+namespace {
+
+// ==================== VERIFIER STATE ====================
+
+class Verifier {
+private:
+    const uint8_t* begin;
+    const uint8_t* pos;
+    const uint8_t* end;
+
+    VerifyResult failure = VERIFY_OK;
+    size_t failureOffset = 0;
+
+    uint32_t constantCount = 0;
+    uint32_t closureProtoLimit = 0;  // highest proto id referenced by a closure constant, plus one
+
+    // Instruction start bitmap for jump target checks, reused across calls
+    static thread_local std::vector<uint64_t> boundaries;
+
+    // Forward jumps as (target, jump pc), checked once the bitmap is complete
+    static thread_local std::vector<std::pair<uint32_t, uint32_t>> forwardJumps;
+
+    // Type tag of each constant read so far, for operands that must name strings
+    static thread_local std::vector<uint8_t> constantTypes;
+
+public:
+    Verifier(const uint8_t* data, size_t size) : begin(data), pos(data), end(data + size) {}
+
+    VerifyResult run(size_t* errorOffset);
+
+private:
+    bool fail(VerifyResult result, const uint8_t* at) {
+        if (failure == VERIFY_OK) {
+            failure = result;
+            failureOffset = static_cast<size_t>(at - begin);
+        }
+        return false;
+    }
+
+    bool readByte(uint8_t& out) {
+        if (pos >= end) return fail(VERIFY_TRUNCATED, pos);
+        out = *pos++;
+        return true;
+    }
+
+    bool readVarInt(uint32_t& out) {
+        const uint8_t* start = pos;
+        uint32_t result = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            if (pos >= end) return fail(VERIFY_TRUNCATED, pos);
+            uint8_t byte = *pos++;
+            if (shift == 28 && (byte & 0x70)) break;  // Overflows 32 bits
+            result |= static_cast<uint32_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                out = result;
+                return true;
+            }
+        }
+        return fail(VERIFY_BAD_OPERAND, start);
+    }
+
+    bool skip(size_t count) {
+        if (static_cast<size_t>(end - pos) < count) return fail(VERIFY_TRUNCATED, end);
+        pos += count;
+        return true;
+    }
+
+    bool verifyHeader();
+    bool verifyConstants();
+    bool verifyProto(uint32_t index);
+    bool verifyCode(const uint8_t* code, uint32_t sizeCode, uint32_t maxStack,
+                    uint32_t numUpvalues, uint32_t& constantLimit, uint32_t& childLimit);
+};
+
+thread_local std::vector<uint64_t> Verifier::boundaries;
+thread_local std::vector<std::pair<uint32_t, uint32_t>> Verifier::forwardJumps;
+thread_local std::vector<uint8_t> Verifier::constantTypes;
+
+// ==================== HEADER AND CONSTANTS ====================
+
+bool Verifier::verifyHeader() {
+    if (static_cast<size_t>(end - begin) < sizeof(LuauBytecodeHeader)) {
+        return fail(VERIFY_TRUNCATED, end);
+    }
+
+    LuauBytecodeHeader header;
+    std::memcpy(&header, begin, sizeof(header));
+
+    if (header.version != 0x02) {
+        return fail(VERIFY_BAD_HEADER, begin);
+    }
+
+    if (header.size != static_cast<size_t>(end - begin) - sizeof(LuauBytecodeHeader)) {
+        return fail(VERIFY_BAD_HEADER, begin + offsetof(LuauBytecodeHeader, size));
+    }
+
+    pos = begin + sizeof(LuauBytecodeHeader);
+    return true;
+}
+
+bool Verifier::verifyConstants() {
+    if (!readVarInt(constantCount)) return false;
+
+    // Grown as constants are read, so a huge count in a short chunk allocates nothing
+    constantTypes.clear();
+    for (uint32_t i = 0; i < constantCount; i++) {
+        const uint8_t* at = pos;
+        uint8_t type;
+        if (!readByte(type)) return false;
+        constantTypes.push_back(type);
+
+        switch (type) {
+            case LBC_CONSTANT_NIL:
+                break;
+
+            case LBC_CONSTANT_BOOLEAN: {
+                uint8_t value;
+                if (!readByte(value)) return false;
+                if (value > 1) return fail(VERIFY_BAD_CONSTANT, at);
+                break;
+            }
+
+            case LBC_CONSTANT_NUMBER:
+                if (!skip(sizeof(double))) return false;
+                break;
+
+            case LBC_CONSTANT_STRING: {
+                uint32_t length;
+                if (!readVarInt(length) || !skip(length)) return false;
+                break;
+            }
+
+            case LBC_CONSTANT_IMPORT: {
+                // Up to three 10-bit constant indices, count in the top two bits
+                if (static_cast<size_t>(end - pos) < 4) return fail(VERIFY_TRUNCATED, end);
+                uint32_t id = pos[0] | (pos[1] << 8) | (pos[2] << 16) | (static_cast<uint32_t>(pos[3]) << 24);
+                pos += 4;
+
+                uint32_t count = id >> 30;
+                if (count == 0) return fail(VERIFY_BAD_CONSTANT, at);
+                for (uint32_t k = 0; k < count; k++) {
+                    uint32_t index = (id >> (20 - k * 10)) & 1023;
+                    if (index >= i || constantTypes[index] != LBC_CONSTANT_STRING) {
+                        return fail(VERIFY_BAD_CONSTANT, at);
+                    }
+                }
+                break;
+            }
+
+            case LBC_CONSTANT_TABLE: {
+                uint32_t keys;
+                if (!readVarInt(keys)) return false;
+                for (uint32_t k = 0; k < keys; k++) {
+                    uint32_t key;
+                    if (!readVarInt(key)) return false;
+                    if (key >= i) return fail(VERIFY_BAD_CONSTANT, at);
+                }
+                break;
+            }
+
+            case LBC_CONSTANT_CLOSURE: {
+                uint32_t proto;
+                if (!readVarInt(proto)) return false;
+                if (proto + 1 > closureProtoLimit) closureProtoLimit = proto + 1;
+                break;
+            }
+
+            default:
+                return fail(VERIFY_BAD_CONSTANT, at);
+        }
+    }
+
+    return true;
+}
+
+// ==================== PROTOS ====================
+
+bool Verifier::verifyProto(uint32_t index) {
+    uint32_t maxStack, numParams, numUpvalues, isVararg, sizeCode;
+    const uint8_t* protoStart = pos;
+
+    if (!readVarInt(maxStack) || !readVarInt(numParams) ||
+        !readVarInt(numUpvalues) || !readVarInt(isVararg)) {
+        return false;
+    }
+
+    if (maxStack > 256 || numParams > maxStack || numUpvalues > 255 || isVararg > 1) {
+        return fail(VERIFY_BAD_PROTO, protoStart);
+    }
+
+    if (!readVarInt(sizeCode)) return false;
+
+    const uint8_t* code = pos;
+    if (!skip(static_cast<size_t>(sizeCode) * BytecodeWriter::INSTRUCTION_SIZE)) return false;
+
+    uint32_t constantLimit = 0;
+    uint32_t childLimit = 0;
+    if (!verifyCode(code, sizeCode, maxStack, numUpvalues, constantLimit, childLimit)) return false;
+
+    const uint8_t* sizeKAt = pos;
+    uint32_t sizeK;
+    if (!readVarInt(sizeK)) return false;
+    if (sizeK > constantCount) return fail(VERIFY_BAD_PROTO, sizeKAt);
+    if (constantLimit > sizeK) return fail(VERIFY_BAD_CONSTANT_INDEX, sizeKAt);
+
+    // Children are serialized before their parents
+    const uint8_t* sizePAt = pos;
+    uint32_t sizeP;
+    if (!readVarInt(sizeP)) return false;
+    if (childLimit > sizeP) return fail(VERIFY_BAD_PROTO, sizePAt);
+    for (uint32_t i = 0; i < sizeP; i++) {
+        const uint8_t* at = pos;
+        uint32_t child;
+        if (!readVarInt(child)) return false;
+        if (child >= index) return fail(VERIFY_BAD_PROTO, at);
+    }
+
+    // Debug info: linedefined, debugname, no line or debug tables
+    uint32_t lineDefined, debugName;
+    if (!readVarInt(lineDefined) || !readVarInt(debugName)) return false;
+
+    const uint8_t* flagsAt = pos;
+    uint8_t lineInfo, debugInfo;
+    if (!readByte(lineInfo) || !readByte(debugInfo)) return false;
+    if (lineInfo != 0 || debugInfo != 0) return fail(VERIFY_BAD_PROTO, flagsAt);
+
+    return true;
+}
+
+// ==================== INSTRUCTIONS ====================
+
+bool Verifier::verifyCode(const uint8_t* code, uint32_t sizeCode, uint32_t maxStack,
+                          uint32_t numUpvalues, uint32_t& constantLimit, uint32_t& childLimit) {
+    const size_t words = (static_cast<size_t>(sizeCode) + 63) / 64;
+    if (boundaries.size() < words) boundaries.resize(words);
+    std::memset(boundaries.data(), 0, words * sizeof(uint64_t));
+    forwardJumps.clear();
+
+    // One pass over the code: instruction boundaries are marked as they are
+    // reached, so backward jumps are checked on the spot and forward ones once
+    // the scan has marked every boundary
+    for (uint32_t pc = 0; pc < sizeCode;) {
+        const uint8_t* insn = code + pc * 4;
+        uint8_t op = decodeOpcode(insn[0]);
+        if (op >= LOP__COUNT) return fail(VERIFY_BAD_OPCODE, insn);
+        if (isDoubleByteOpcode(op) && pc + 2 > sizeCode) return fail(VERIFY_TRUNCATED, code + sizeCode * 4);
+        boundaries[pc >> 6] |= 1ull << (pc & 63);
+
+        uint32_t a = insn[1];
+        uint32_t b = insn[2];
+        uint32_t c = insn[3];
+        int32_t d = static_cast<int16_t>(insn[2] | (insn[3] << 8));
+        int32_t e = static_cast<int32_t>((insn[1] | (insn[2] << 8) | (insn[3] << 16)) << 8) >> 8;
+
+        bool hasAux = isDoubleByteOpcode(op);
+        uint32_t aux = 0;
+        if (hasAux) {
+            const uint8_t* word = insn + 4;
+            aux = word[0] | (word[1] << 8) | (word[2] << 16) | (static_cast<uint32_t>(word[3]) << 24);
+        }
+        uint32_t next = pc + (hasAux ? 2 : 1);
+
+        auto reg = [&](uint32_t r) {
+            return r < maxStack || fail(VERIFY_BAD_REGISTER, insn);
+        };
+        auto constant = [&](uint32_t k) {
+            if (k >= constantCount) return fail(VERIFY_BAD_CONSTANT_INDEX, insn);
+            if (k + 1 > constantLimit) constantLimit = k + 1;
+            return true;
+        };
+        auto stringConstant = [&](uint32_t k) {
+            return constant(k) && (constantTypes[k] == LBC_CONSTANT_STRING || fail(VERIFY_BAD_CONSTANT, insn));
+        };
+        auto import = [&](uint32_t id) {
+            // Up to three 10-bit string constant indices, count in the top two bits
+            uint32_t count = id >> 30;
+            if (count == 0) return fail(VERIFY_BAD_OPERAND, insn);
+            for (uint32_t k = 0; k < count; k++) {
+                if (!stringConstant((id >> (20 - k * 10)) & 1023)) return false;
+            }
+            return true;
+        };
+        auto jump = [&](int64_t target) {
+            if (target < 0 || target >= sizeCode) return fail(VERIFY_BAD_JUMP, insn);
+            if (target > pc) {
+                forwardJumps.emplace_back(static_cast<uint32_t>(target), pc);
+                return true;
+            }
+            return (boundaries[target >> 6] & (1ull << (target & 63))) != 0 || fail(VERIFY_BAD_JUMP, insn);
+        };
+        auto upvalue = [&](uint32_t u) {
+            return u < numUpvalues || fail(VERIFY_BAD_OPERAND, insn);
+        };
+
+        bool ok = true;
+        switch (op) {
+            case LOP_NOP:
+            case LOP_COVERAGE:
+                break;
+
+            case LOP_LOADNIL:
+            case LOP_CLOSEUPVALS:
+            case LOP_NEWTABLE:
+                ok = reg(a);
+                break;
+
+            case LOP_LOADB:
+                ok = reg(a) && (c == 0 || jump(pc + 1 + static_cast<int64_t>(c)));
+                break;
+
+            case LOP_LOADN:
+                ok = reg(a);
+                break;
+
+            case LOP_LOADK:
+            case LOP_DUPTABLE:
+                ok = reg(a) && (d >= 0 || fail(VERIFY_BAD_CONSTANT_INDEX, insn)) && constant(d);
+                break;
+
+            case LOP_LOADKX:
+                ok = reg(a) && constant(aux);
+                break;
+
+            case LOP_MOVE:
+            case LOP_NOT:
+            case LOP_MINUS:
+            case LOP_LENGTH:
+            case LOP_GETTABLEN:
+            case LOP_SETTABLEN:
+                ok = reg(a) && reg(b);
+                break;
+
+            case LOP_GETGLOBAL:
+            case LOP_SETGLOBAL:
+                ok = reg(a) && stringConstant(aux);
+                break;
+
+            case LOP_GETUPVAL:
+            case LOP_SETUPVAL:
+                ok = reg(a) && upvalue(b);
+                break;
+
+            case LOP_GETIMPORT:
+                ok = reg(a) && (d >= 0 || fail(VERIFY_BAD_CONSTANT_INDEX, insn)) && constant(d) && import(aux);
+                break;
+
+            case LOP_GETTABLE:
+            case LOP_SETTABLE:
+            case LOP_ADD:
+            case LOP_SUB:
+            case LOP_MUL:
+            case LOP_DIV:
+            case LOP_MOD:
+            case LOP_POW:
+            case LOP_AND:
+            case LOP_OR:
+                ok = reg(a) && reg(b) && reg(c);
+                break;
+
+            case LOP_GETTABLKS:
+            case LOP_SETTABLKS:
+                ok = reg(a) && reg(b) && stringConstant(aux);
+                break;
+
+            case LOP_NAMECALL:
+                ok = reg(a) && reg(a + 1) && reg(b) && stringConstant(aux);
+                break;
+
+            case LOP_CALL:
+                // B = args + 1, C = results + 1, 0 means multret
+                ok = reg(a) && (b == 0 || reg(a + b - 1)) && (c <= 1 || reg(a + c - 2));
+                break;
+
+            case LOP_RETURN:
+                ok = b == 0 ? (a <= maxStack || fail(VERIFY_BAD_REGISTER, insn))
+                            : (b == 1 || reg(a + b - 2));
+                break;
+
+            case LOP_JUMP:
+            case LOP_JUMPBACK:
+                ok = jump(pc + 1 + static_cast<int64_t>(d));
+                break;
+
+            case LOP_JUMPIF:
+            case LOP_JUMPIFNOT:
+            case LOP_FORGPREP:
+            case LOP_FORGPREP_INEXT:
+            case LOP_FORGPREP_NEXT:
+                ok = reg(a) && jump(pc + 1 + static_cast<int64_t>(d));
+                break;
+
+            case LOP_JUMPIFEQ:
+            case LOP_JUMPIFLE:
+            case LOP_JUMPIFLT:
+            case LOP_JUMPIFNOTEQ:
+            case LOP_JUMPIFNOTLE:
+            case LOP_JUMPIFNOTLT:
+                ok = reg(a) && reg(aux) && jump(pc + 1 + static_cast<int64_t>(d));
+                break;
+
+            case LOP_JUMPIFEQK:
+            case LOP_JUMPIFNOTEQK:
+                ok = reg(a) && constant(aux & 0xFFFFFF) && jump(pc + 1 + static_cast<int64_t>(d));
+                break;
+
+            case LOP_JUMPX:
+                ok = jump(pc + 1 + static_cast<int64_t>(e));
+                break;
+
+            case LOP_ADDK:
+            case LOP_SUBK:
+            case LOP_MULK:
+            case LOP_DIVK:
+            case LOP_MODK:
+            case LOP_POWK:
+            case LOP_ANDK:
+            case LOP_ORK:
+                ok = reg(a) && reg(b) && constant(c);
+                break;
+
+            case LOP_CONCAT:
+                ok = reg(a) && reg(c) && (b <= c || fail(VERIFY_BAD_OPERAND, insn));
+                break;
+
+            case LOP_SETLIST:
+                // Values R(B)..R(B+C-2), C = 0 means up to top
+                ok = reg(a) && reg(b) && (c <= 1 || reg(b + c - 2));
+                break;
+
+            case LOP_FORNPREP:
+            case LOP_FORNLOOP:
+                // Limit, step and index live in A..A+2
+                ok = reg(a + 2) && jump(pc + 1 + static_cast<int64_t>(d));
+                break;
+
+            case LOP_FORGLOOP:
+                // Generator state in A..A+2, AUX low byte = variable count
+                ok = reg(a + 2 + (aux & 0xFF)) && jump(pc + 1 + static_cast<int64_t>(d));
+                break;
+
+            case LOP_FASTCALL:
+            case LOP_FASTCALLM:
+            case LOP_FASTCALL2M:
+                // C = instructions to skip to reach the fallback CALL
+                ok = jump(next + static_cast<int64_t>(c));
+                break;
+
+            case LOP_FASTCALL1:
+            case LOP_FASTCALL3:
+                ok = reg(b) && jump(next + static_cast<int64_t>(c));
+                break;
+
+            case LOP_FASTCALL2:
+                ok = reg(b) && reg(aux) && jump(next + static_cast<int64_t>(c));
+                break;
+
+            case LOP_FASTCALL2K:
+                ok = reg(b) && constant(aux) && jump(next + static_cast<int64_t>(c));
+                break;
+
+            case LOP_NEWCLOSURE:
+                // D indexes this proto's child list, checked against sizeP
+                ok = reg(a) && (d >= 0 || fail(VERIFY_BAD_OPERAND, insn));
+                if (ok && static_cast<uint32_t>(d) + 1 > childLimit) childLimit = d + 1;
+                break;
+
+            case LOP_CAPTURE:
+                // A: 0 = value, 1 = reference, 2 = upvalue
+                if (a > 2) ok = fail(VERIFY_BAD_OPERAND, insn);
+                else ok = a == 2 ? upvalue(b) : reg(b);
+                break;
+
+            default:
+                ok = fail(VERIFY_BAD_OPCODE, insn);
+                break;
+        }
+
+        if (!ok) return false;
+        pc = next;
+    }
+
+    for (const auto& [target, from] : forwardJumps) {
+        if (!(boundaries[target >> 6] & (1ull << (target & 63)))) return fail(VERIFY_BAD_JUMP, code + from * 4);
+    }
+
+    return true;
+}
+
+// ==================== DRIVER ====================
+
+VerifyResult Verifier::run(size_t* errorOffset) {
+    bool ok = verifyHeader() && verifyConstants();
+
+    if (ok) {
+        const uint8_t* countAt = pos;
+        uint32_t protoCount = 0;
+        ok = readVarInt(protoCount);
+
+        if (ok && (protoCount == 0 || closureProtoLimit > protoCount)) {
+            ok = fail(VERIFY_BAD_PROTO, countAt);
+        }
+
+        for (uint32_t i = 0; ok && i < protoCount; i++) {
+            ok = verifyProto(i);
+        }
+    }
+
+    if (ok && pos != end) {
+        ok = fail(VERIFY_TRAILING_DATA, pos);
+    }
+
+    // Hash last: the structural walk rejects most garbage faster
+    if (ok) {
+        LuauBytecodeHeader header;
+        std::memcpy(&header, begin, sizeof(header));
+        if (hashBytecode(begin + sizeof(header), header.size) != header.hash) {
+            ok = fail(VERIFY_BAD_HASH, begin + offsetof(LuauBytecodeHeader, hash));
+        }
+    }
+
+    if (!ok && errorOffset) *errorOffset = failureOffset;
+    return failure;
+}
+
+} // namespace
+
+// ==================== PUBLIC API ====================
+
+VerifyResult VerifyBytecode(const uint8_t* data, size_t size, size_t* errorOffset) {
+    Verifier verifier(data, size);
+    return verifier.run(errorOffset);
+}
+
+const char* VerifyResultName(VerifyResult result) {
+    switch (result) {
+        case VERIFY_OK: return "ok";
+        case VERIFY_TRUNCATED: return "truncated";
+        case VERIFY_BAD_HEADER: return "bad header";
+        case VERIFY_BAD_HASH: return "bad hash";
+        case VERIFY_BAD_CONSTANT: return "bad constant";
+        case VERIFY_BAD_PROTO: return "bad proto";
+        case VERIFY_BAD_OPCODE: return "bad opcode";
+        case VERIFY_BAD_REGISTER: return "register out of range";
+        case VERIFY_BAD_CONSTANT_INDEX: return "constant index out of range";
+        case VERIFY_BAD_JUMP: return "bad jump target";
+        case VERIFY_BAD_OPERAND: return "bad operand";
+        case VERIFY_TRAILING_DATA: return "trailing data";
+        default: return "unknown";
+    }
+}
+
+} // namespace Bytecode
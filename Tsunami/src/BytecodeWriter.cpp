@@ -0,0 +1,273 @@
+#include "BytecodeWriter.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Bytecode {
+
+uint8_t encodeHashSize(uint32_t hashSize) {
+    if (hashSize == 0) return 0;
+
+    uint32_t log2 = 0;
+    while ((1ull << log2) < hashSize) log2++;
+    return static_cast<uint8_t>(log2 + 1);
+}
+
+// ==================== CONTAINER FILES ====================
+
+static bool failErrno(std::string* error, const char* what) {
+    if (error) *error = std::string(what) + ": " + std::strerror(errno);
+    return false;
+}
+
+bool MapFile(const char* path, const uint8_t** data, size_t* size, std::string* error) {
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return failErrno(error, "open failed");
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        ::close(fd);
+        return failErrno(error, "stat failed");
+    }
+    if (info.st_size == 0) {
+        ::close(fd);
+        if (error) *error = "empty file";
+        return false;
+    }
+
+    void* mapping = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) return failErrno(error, "mmap failed");
+
+    *data = static_cast<const uint8_t*>(mapping);
+    *size = static_cast<size_t>(info.st_size);
+    return true;
+}
+
+void UnmapFile(const uint8_t* data, size_t size) {
+    munmap(const_cast<uint8_t*>(data), size);
+}
+
+bool WriteFileAtomic(const char* path, std::string_view contents, std::string* error) {
+    std::string temporary = std::string(path) + ".tmp";
+    FILE* handle = std::fopen(temporary.c_str(), "wb");
+    if (!handle) return failErrno(error, "open failed");
+
+    bool written = std::fwrite(contents.data(), 1, contents.size(), handle) == contents.size();
+    if (std::fclose(handle) != 0) written = false;
+    if (!written) {
+        failErrno(error, "write failed");
+        std::remove(temporary.c_str());
+        return false;
+    }
+    if (std::rename(temporary.c_str(), path) != 0) {
+        failErrno(error, "rename failed");
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+// ==================== BYTECODE WRITER ====================
+
+BytecodeWriter::BytecodeWriter(size_t reserveBytes) {
+    if (reserveBytes) buffer.resize(reserveBytes);
+}
+
+void BytecodeWriter::reset(size_t reserveBytes) {
+    pos = 0;
+    if (reserveBytes > buffer.size()) buffer.resize(reserveBytes);
+}
+
+void BytecodeWriter::grow(size_t needed) {
+    size_t capacity = buffer.size() ? buffer.size() * 2 : 64;
+    while (capacity < needed) capacity *= 2;
+    buffer.resize(capacity);
+}
+
+void BytecodeWriter::writeVarInt(uint32_t value) {
+    uint8_t* out = claim(varIntSize(value));
+    do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        if (value != 0) byte |= 0x80;
+        *out++ = byte;
+    } while (value != 0);
+}
+
+void BytecodeWriter::writeUInt32(uint32_t value) {
+    uint8_t* out = claim(4);
+    out[0] = static_cast<uint8_t>(value);
+    out[1] = static_cast<uint8_t>(value >> 8);
+    out[2] = static_cast<uint8_t>(value >> 16);
+    out[3] = static_cast<uint8_t>(value >> 24);
+}
+
+void BytecodeWriter::writeDouble(double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(double));
+
+    uint8_t* out = claim(8);
+    for (int i = 0; i < 8; i++) {
+        out[i] = static_cast<uint8_t>(bits & 0xFF);
+        bits >>= 8;
+    }
+}
+
+void BytecodeWriter::writeBytes(const void* data, size_t size) {
+    if (size) std::memcpy(claim(size), data, size);
+}
+
+void BytecodeWriter::writeConstantBoolean(bool value) {
+    uint8_t* out = claim(2);
+    out[0] = LBC_CONSTANT_BOOLEAN;
+    out[1] = value ? 0x01 : 0x00;
+}
+
+void BytecodeWriter::writeConstantNumber(double value) {
+    writeByte(LBC_CONSTANT_NUMBER);
+    writeDouble(value);
+}
+
+void BytecodeWriter::writeConstantString(const char* data, size_t size) {
+    writeByte(LBC_CONSTANT_STRING);
+    writeVarInt(static_cast<uint32_t>(size));
+    writeBytes(data, size);
+}
+
+void BytecodeWriter::writeConstantTable(const uint32_t* keys, size_t count) {
+    writeByte(LBC_CONSTANT_TABLE);
+    writeVarInt(static_cast<uint32_t>(count));
+    for (size_t i = 0; i < count; i++) writeVarInt(keys[i]);
+}
+
+void BytecodeWriter::beginChunk() {
+    // Header placeholder, patched by finalize()
+    LuauBytecodeHeader header = {0x02, 0x00, 0x08, 0x08, 0, 0};
+    writeBytes(&header, sizeof(header));
+}
+
+void BytecodeWriter::beginProto(uint32_t maxStackSize, uint32_t numParams, uint32_t numUpvalues,
+                                bool isVararg, uint32_t sizeCode) {
+    writeVarInt(maxStackSize);
+    writeVarInt(numParams);
+    writeVarInt(numUpvalues);
+    writeVarInt(isVararg ? 1 : 0);
+    writeVarInt(sizeCode);
+}
+
+void BytecodeWriter::endProto(uint32_t sizeK, const uint32_t* children, uint32_t sizeP) {
+    writeVarInt(sizeK);
+    writeVarInt(sizeP);
+    for (uint32_t i = 0; i < sizeP; i++) {
+        writeVarInt(children[i]);
+    }
+
+    // Debug info
+    uint8_t* out = claim(4);
+    out[0] = 0x00;  // linedefined
+    out[1] = 0x00;  // debugname
+    out[2] = 0x00;  // lineinfo
+    out[3] = 0x00;  // debuginfo
+}
+
+void BytecodeWriter::emitABC(uint8_t opcode, uint8_t a, uint8_t b, uint8_t c) {
+    uint8_t* out = claim(INSTRUCTION_SIZE);
+    out[0] = encodeOpcode(opcode);
+    out[1] = a;
+    out[2] = b;
+    out[3] = c;
+}
+
+void BytecodeWriter::emitAD(uint8_t opcode, uint8_t a, int16_t d) {
+    uint16_t bits = static_cast<uint16_t>(d);
+    uint8_t* out = claim(INSTRUCTION_SIZE);
+    out[0] = encodeOpcode(opcode);
+    out[1] = a;
+    out[2] = static_cast<uint8_t>(bits);
+    out[3] = static_cast<uint8_t>(bits >> 8);
+}
+
+void BytecodeWriter::emitE(uint8_t opcode, int32_t e) {
+    uint32_t bits = static_cast<uint32_t>(e);
+    uint8_t* out = claim(INSTRUCTION_SIZE);
+    out[0] = encodeOpcode(opcode);
+    out[1] = static_cast<uint8_t>(bits);
+    out[2] = static_cast<uint8_t>(bits >> 8);
+    out[3] = static_cast<uint8_t>(bits >> 16);
+}
+
+void BytecodeWriter::emitLoadConstant(uint8_t reg, uint32_t index) {
+    if (index <= LOADK_MAX_INDEX) {
+        emitAD(LOP_LOADK, reg, static_cast<int16_t>(index));
+    } else {
+        emitABC(LOP_LOADKX, reg, 0, 0);
+        emitAux(index);
+    }
+}
+
+void BytecodeWriter::finalize() {
+    finalize(0, FNV_OFFSET_BASIS);
+}
+
+void BytecodeWriter::finalize(size_t hashed, uint32_t state) {
+    LuauBytecodeHeader header;
+    std::memcpy(&header, data(), sizeof(header));
+    header.size = static_cast<uint32_t>(pos - sizeof(header));
+    header.hash = fnv1a(state, data() + sizeof(header) + hashed, header.size - hashed);
+    std::memcpy(data(), &header, sizeof(header));
+}
+
+std::string BytecodeWriter::finish() {
+    return finish(0, FNV_OFFSET_BASIS);
+}
+
+std::string BytecodeWriter::finish(size_t hashed, uint32_t state) {
+    finalize(hashed, state);
+    buffer.resize(pos);
+    pos = 0;
+
+    std::string result = std::move(buffer);
+    buffer.clear();
+    return result;
+}
+
+// ==================== CHUNK TEMPLATE ====================
+
+ChunkTemplate::ChunkTemplate(std::string chunk, size_t offset)
+    : bytes(std::move(chunk)), payloadOffset(offset) {
+    const uint8_t* raw = reinterpret_cast<const uint8_t*>(bytes.data());
+    prefixState = fnv1a(FNV_OFFSET_BASIS, raw + sizeof(LuauBytecodeHeader),
+                        payloadOffset - sizeof(LuauBytecodeHeader));
+}
+
+std::string ChunkTemplate::instantiate(const uint8_t* lead, size_t leadSize,
+                                       const void* payload, size_t payloadSize) const {
+    const uint8_t* raw = reinterpret_cast<const uint8_t*>(bytes.data());
+    size_t suffixSize = bytes.size() - payloadOffset;
+
+    std::string result;
+    result.resize(bytes.size() + leadSize + payloadSize);
+    uint8_t* out = reinterpret_cast<uint8_t*>(&result[0]);
+
+    std::memcpy(out, raw, payloadOffset);
+    uint8_t* patch = out + payloadOffset;
+    if (leadSize) std::memcpy(patch, lead, leadSize);
+    if (payloadSize) std::memcpy(patch + leadSize, payload, payloadSize);
+    std::memcpy(patch + leadSize + payloadSize, raw + payloadOffset, suffixSize);
+
+    // Resume hashing at the first patched byte
+    LuauBytecodeHeader header;
+    std::memcpy(&header, out, sizeof(header));
+    header.size = static_cast<uint32_t>(result.size() - sizeof(header));
+    header.hash = fnv1a(prefixState, patch, leadSize + payloadSize + suffixSize);
+    std::memcpy(out, &header, sizeof(header));
+
+    return result;
+}
+
+} // namespace Bytecode
@@ -0,0 +1,434 @@
+#include "Bytecode.h"
+#include "BytecodeWriter.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+namespace Bytecode {
+
+// ==================== SOURCES ====================
+
+size_t MemorySource::read(char* buffer, size_t capacity) {
+    size_t count = std::min(capacity, remaining.size());
+    std::memcpy(buffer, remaining.data(), count);
+    remaining.remove_prefix(count);
+    return count;
+}
+
+size_t FdSource::read(char* buffer, size_t capacity) {
+    for (;;) {
+        ssize_t count = ::read(fd, buffer, capacity);
+        if (count >= 0) return static_cast<size_t>(count);
+        if (errno != EINTR) {
+            failed = true;
+            return 0;
+        }
+    }
+}
+
+namespace {
+
+// Tables at depth d live in R(d) and an array's pending elements sit just
+// above it, so the frame never exceeds MAX_JSON_DEPTH + SETLIST_BATCH + 1
+constexpr uint32_t MAX_JSON_DEPTH = 128;
+
+// ==================== MARSHALLER ====================
+
+// Recursive descent over a refilled read buffer. Code and constants stream
+// into two writers and are spliced into the chunk at the end; NEWTABLE size
+// hints are patched in place once the container's closing bracket is read.
+class Marshaller {
+private:
+    JsonSource& source;
+    char buffer[16384];
+    size_t pos = 0;
+    size_t end = 0;
+    uint32_t line = 1;
+
+    std::string token;      // Current string or number text
+    std::string error;
+
+    BytecodeWriter code;
+    BytecodeWriter pool;
+    std::unordered_map<std::string, uint32_t> strings;
+    std::unordered_map<uint64_t, uint32_t> numbers;     // Keyed by bit pattern
+    uint32_t constantCount = 0;
+    uint32_t maxStack = 1;
+
+    int peek() {
+        if (pos == end) {
+            pos = 0;
+            end = source.read(buffer, sizeof(buffer));
+            if (end == 0) return -1;
+        }
+        return static_cast<unsigned char>(buffer[pos]);
+    }
+
+    int next() {
+        int c = peek();
+        if (c >= 0) pos++;
+        if (c == '\n') line++;
+        return c;
+    }
+
+    void skipWhitespace() {
+        for (int c = peek(); c == ' ' || c == '\t' || c == '\n' || c == '\r'; c = peek()) next();
+    }
+
+    bool fail(const char* message) {
+        if (error.empty()) error = "line " + std::to_string(line) + ": " + message;
+        return false;
+    }
+
+    bool readString();
+    bool readNumber(double& value);
+    bool readLiteral(const char* word);
+
+    uint32_t internString(const std::string& value);
+    uint32_t internNumber(double value);
+
+    bool value(uint32_t reg, uint32_t depth);
+    bool array(uint32_t reg, uint32_t depth);
+    bool object(uint32_t reg, uint32_t depth);
+
+    size_t beginTable(uint32_t reg);
+    void patchTable(size_t at, uint32_t hashSize, uint32_t arraySize);
+
+public:
+    explicit Marshaller(JsonSource& input) : source(input) {}
+
+    std::string run(std::string* errorOut);
+};
+
+// ==================== LEXING ====================
+
+static void appendUtf8(std::string& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+// Opening quote already consumed; decoded bytes land in token
+bool Marshaller::readString() {
+    token.clear();
+
+    auto hex4 = [this](uint32_t& out) {
+        out = 0;
+        for (int i = 0; i < 4; i++) {
+            int c = next();
+            int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+            if (digit < 0) return fail("malformed \\u escape");
+            out = out * 16 + static_cast<uint32_t>(digit);
+        }
+        return true;
+    };
+
+    for (;;) {
+        int c = next();
+        if (c < 0) return fail("unterminated string");
+        if (c == '"') return true;
+        if (c < 0x20) return fail("control character in string");
+        if (c != '\\') {
+            token += static_cast<char>(c);
+            continue;
+        }
+
+        switch (next()) {
+            case '"': token += '"'; break;
+            case '\\': token += '\\'; break;
+            case '/': token += '/'; break;
+            case 'b': token += '\b'; break;
+            case 'f': token += '\f'; break;
+            case 'n': token += '\n'; break;
+            case 'r': token += '\r'; break;
+            case 't': token += '\t'; break;
+            case 'u': {
+                uint32_t cp;
+                if (!hex4(cp)) return false;
+                if (cp >= 0xD800 && cp < 0xDC00) {
+                    // High surrogate; a low one must follow
+                    uint32_t low;
+                    if (next() != '\\' || next() != 'u' || !hex4(low) || low < 0xDC00 || low >= 0xE000) {
+                        return fail("unpaired surrogate in \\u escape");
+                    }
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                } else if (cp >= 0xDC00 && cp < 0xE000) {
+                    return fail("unpaired surrogate in \\u escape");
+                }
+                appendUtf8(token, cp);
+                break;
+            }
+            default:
+                return fail("invalid escape in string");
+        }
+    }
+}
+
+bool Marshaller::readNumber(double& value) {
+    token.clear();
+    for (int c = peek(); (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E'; c = peek()) {
+        token += static_cast<char>(next());
+    }
+
+    // -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+    const char* p = token.c_str();
+    if (*p == '-') p++;
+    if (*p == '0') {
+        p++;
+    } else if (*p >= '1' && *p <= '9') {
+        while (*p >= '0' && *p <= '9') p++;
+    } else {
+        return fail("malformed number");
+    }
+    if (*p == '.') {
+        if (*++p < '0' || *p > '9') return fail("malformed number");
+        while (*p >= '0' && *p <= '9') p++;
+    }
+    if (*p == 'e' || *p == 'E') {
+        if (*++p == '+' || *p == '-') p++;
+        if (*p < '0' || *p > '9') return fail("malformed number");
+        while (*p >= '0' && *p <= '9') p++;
+    }
+    if (*p) return fail("malformed number");
+
+    value = std::strtod(token.c_str(), nullptr);
+    return true;
+}
+
+bool Marshaller::readLiteral(const char* word) {
+    for (const char* p = word; *p; p++) {
+        if (next() != *p) return fail("invalid literal");
+    }
+    return true;
+}
+
+// ==================== CONSTANTS ====================
+
+uint32_t Marshaller::internString(const std::string& value) {
+    auto it = strings.find(value);
+    if (it != strings.end()) return it->second;
+
+    pool.writeConstantString(value);
+    strings.emplace(value, constantCount);
+    return constantCount++;
+}
+
+uint32_t Marshaller::internNumber(double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    auto it = numbers.find(bits);
+    if (it != numbers.end()) return it->second;
+
+    pool.writeConstantNumber(value);
+    numbers.emplace(bits, constantCount);
+    return constantCount++;
+}
+
+// ==================== VALUES ====================
+
+size_t Marshaller::beginTable(uint32_t reg) {
+    size_t at = code.size();
+    code.emitABC(LOP_NEWTABLE, static_cast<uint8_t>(reg), 0, 0);
+    code.emitAux(0);
+    return at;
+}
+
+// Both counts are known once the closing bracket has been read
+void Marshaller::patchTable(size_t at, uint32_t hashSize, uint32_t arraySize) {
+    uint8_t* insn = code.data() + at;
+    insn[2] = encodeHashSize(hashSize);
+    for (int i = 0; i < 4; i++) insn[4 + i] = static_cast<uint8_t>(arraySize >> (8 * i));
+}
+
+bool Marshaller::value(uint32_t reg, uint32_t depth) {
+    maxStack = std::max(maxStack, reg + 1);
+    uint8_t r = static_cast<uint8_t>(reg);
+
+    skipWhitespace();
+    int c = peek();
+    switch (c) {
+        case '{':
+            return object(reg, depth);
+        case '[':
+            return array(reg, depth);
+        case '"':
+            next();
+            if (!readString()) return false;
+            code.emitLoadConstant(r, internString(token));
+            return true;
+        case 't':
+        case 'f':
+            if (!readLiteral(c == 't' ? "true" : "false")) return false;
+            code.emitABC(LOP_LOADB, r, c == 't' ? 1 : 0, 0);
+            return true;
+        case 'n':
+            if (!readLiteral("null")) return false;
+            code.emitABC(LOP_LOADNIL, r, 0, 0);
+            return true;
+        default: {
+            if (c != '-' && (c < '0' || c > '9')) return fail(c < 0 ? "unexpected end of input" : "unexpected character");
+            double number = 0;
+            if (!readNumber(number)) return false;
+            if (fitsLoadN(number)) code.emitAD(LOP_LOADN, r, static_cast<int16_t>(number));
+            else code.emitLoadConstant(r, internNumber(number));
+            return true;
+        }
+    }
+}
+
+bool Marshaller::array(uint32_t reg, uint32_t depth) {
+    next();
+    if (depth >= MAX_JSON_DEPTH) return fail("nesting too deep");
+
+    size_t at = beginTable(reg);
+    uint32_t count = 0;
+    uint32_t pending = 0;
+
+    // Elements collect above the table and go in with one SETLIST per batch
+    auto flush = [&]() {
+        code.emitABC(LOP_SETLIST, static_cast<uint8_t>(reg), static_cast<uint8_t>(reg + 1), static_cast<uint8_t>(pending + 1));
+        code.emitAux(count - pending + 1);
+        pending = 0;
+    };
+
+    skipWhitespace();
+    if (peek() == ']') {
+        next();
+        return true;
+    }
+
+    for (;;) {
+        skipWhitespace();
+
+        // A nested table builds directly above this one, so store what is pending first
+        int c = peek();
+        if ((c == '[' || c == '{') && pending) flush();
+
+        if (!value(reg + 1 + pending, depth + 1)) return false;
+        pending++;
+        count++;
+        if (pending == SETLIST_BATCH) flush();
+
+        skipWhitespace();
+        c = next();
+        if (c == ']') break;
+        if (c != ',') return fail("expected ',' or ']'");
+    }
+
+    if (pending) flush();
+    patchTable(at, 0, count);
+    return true;
+}
+
+bool Marshaller::object(uint32_t reg, uint32_t depth) {
+    next();
+    if (depth >= MAX_JSON_DEPTH) return fail("nesting too deep");
+
+    size_t at = beginTable(reg);
+    uint32_t keys = 0;
+
+    skipWhitespace();
+    if (peek() == '}') {
+        next();
+        return true;
+    }
+
+    for (;;) {
+        skipWhitespace();
+        if (next() != '"') return fail("expected string key");
+        if (!readString()) return false;
+        uint32_t key = internString(token);
+
+        skipWhitespace();
+        if (next() != ':') return fail("expected ':'");
+        skipWhitespace();
+
+        // Storing nil into a fresh table is a no-op
+        if (peek() == 'n') {
+            if (!readLiteral("null")) return false;
+        } else {
+            if (!value(reg + 1, depth + 1)) return false;
+            code.emitABC(LOP_SETTABLKS, static_cast<uint8_t>(reg + 1), static_cast<uint8_t>(reg), 0);
+            code.emitAux(key);
+            keys++;
+        }
+
+        skipWhitespace();
+        int c = next();
+        if (c == '}') break;
+        if (c != ',') return fail("expected ',' or '}'");
+    }
+
+    patchTable(at, keys, 0);
+    return true;
+}
+
+// ==================== CHUNK ====================
+
+std::string Marshaller::run(std::string* errorOut) {
+    skipWhitespace();
+    bool ok = peek() >= 0 ? value(0, 0) : fail("empty document");
+    if (ok) {
+        skipWhitespace();
+        if (peek() >= 0) ok = fail("unexpected characters after document");
+    }
+    if (!ok) {
+        if (errorOut) *errorOut = error;
+        return std::string();
+    }
+
+    code.emitABC(LOP_RETURN, 0, 2, 0);
+    uint32_t sizeCode = static_cast<uint32_t>(code.size() / BytecodeWriter::INSTRUCTION_SIZE);
+
+    BytecodeWriter writer(BytecodeWriter::chunkSize(constantCount, pool.size(), maxStack, sizeCode));
+    writer.beginChunk();
+
+    writer.writeVarInt(constantCount);
+    writer.writeBytes(pool.data(), pool.size());
+
+    writer.writeVarInt(1);
+    writer.beginProto(maxStack, 0, 0, false, sizeCode);
+    writer.writeBytes(code.data(), code.size());
+
+    writer.endProto(constantCount);
+    return writer.finish();
+}
+
+} // namespace
+
+// ==================== PUBLIC API ====================
+
+std::string MarshalJson(JsonSource& source, std::string* error) {
+    return Marshaller(source).run(error);
+}
+
+std::string MarshalJson(std::string_view json, std::string* error) {
+    MemorySource source(json);
+    return MarshalJson(source, error);
+}
+
+std::string MarshalJsonFile(int fd, std::string* error) {
+    FdSource source(fd);
+    std::string chunk = MarshalJson(source, error);
+    if (source.failed) {
+        if (error) *error = std::string("read failed: ") + std::strerror(errno);
+        return std::string();
+    }
+    return chunk;
+}
+
+} // namespace Bytecode
@@ -0,0 +1,3405 @@
+#include "Bytecode.h"
+#include "BytecodeWriter.h"
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <new>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace Bytecode {
+
+namespace {
+
+// ==================== ARENA ====================
+
+// Bump allocator for the AST. Nodes are trivially destructible, so the tree
+// is released by dropping the blocks. Block sizes double, so a 10k-line
+// script costs a handful of allocations.
+class Arena {
+private:
+    struct Block {
+        Block* next;
+    };
+
+    Block* head = nullptr;
+    char* cursor = nullptr;
+    char* limit = nullptr;
+    size_t nextBlockSize = 16384;
+
+    void grow(size_t needed) {
+        size_t size = nextBlockSize;
+        while (size < needed + sizeof(Block)) size *= 2;
+        if (nextBlockSize < (1u << 20)) nextBlockSize *= 2;
+
+        Block* block = static_cast<Block*>(::operator new(size));
+        block->next = head;
+        head = block;
+        cursor = reinterpret_cast<char*>(block + 1);
+        limit = reinterpret_cast<char*>(block) + size;
+    }
+
+public:
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    ~Arena() {
+        while (head) {
+            Block* next = head->next;
+            ::operator delete(head);
+            head = next;
+        }
+    }
+
+    void* allocate(size_t size, size_t align) {
+        uintptr_t at = (reinterpret_cast<uintptr_t>(cursor) + align - 1) & ~static_cast<uintptr_t>(align - 1);
+        if (!cursor || at + size > reinterpret_cast<uintptr_t>(limit)) {
+            grow(size + align);
+            at = (reinterpret_cast<uintptr_t>(cursor) + align - 1) & ~static_cast<uintptr_t>(align - 1);
+        }
+        cursor = reinterpret_cast<char*>(at + size);
+        return reinterpret_cast<void*>(at);
+    }
+
+    template<typename T>
+    T* make() {
+        return new (allocate(sizeof(T), alignof(T))) T();
+    }
+
+    template<typename T>
+    T* copy(const T* data, size_t count) {
+        if (count == 0) return nullptr;
+        T* out = static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+        std::memcpy(static_cast<void*>(out), data, sizeof(T) * count);
+        return out;
+    }
+
+    char* chars(size_t count) {
+        return static_cast<char*>(allocate(count ? count : 1, 1));
+    }
+};
+
+// ==================== DIAGNOSTICS ====================
+
+// First error wins; everything after it is unwound without further reports
+struct Diagnostics {
+    bool failed = false;
+    uint32_t line = 0;
+    std::string message;
+
+    void report(uint32_t atLine, std::string text) {
+        if (failed) return;
+        failed = true;
+        line = atLine;
+        message = std::move(text);
+    }
+};
+
+// ==================== LEXER ====================
+
+enum TokenType : int {
+    TOKEN_EOF = 0,
+
+    // Single-character tokens use their character code
+    TOKEN_NAME = 256,
+    TOKEN_NUMBER,
+    TOKEN_STRING,
+
+    TOKEN_AND,
+    TOKEN_BREAK,
+    TOKEN_DO,
+    TOKEN_ELSE,
+    TOKEN_ELSEIF,
+    TOKEN_END,
+    TOKEN_FALSE,
+    TOKEN_FOR,
+    TOKEN_FUNCTION,
+    TOKEN_IF,
+    TOKEN_IN,
+    TOKEN_LOCAL,
+    TOKEN_NIL,
+    TOKEN_NOT,
+    TOKEN_OR,
+    TOKEN_REPEAT,
+    TOKEN_RETURN,
+    TOKEN_THEN,
+    TOKEN_TRUE,
+    TOKEN_UNTIL,
+    TOKEN_WHILE,
+
+    TOKEN_EQ,           // ==
+    TOKEN_NE,           // ~=
+    TOKEN_LE,           // <=
+    TOKEN_GE,           // >=
+    TOKEN_CONCAT,       // ..
+    TOKEN_DOTS,         // ...
+    TOKEN_IDIV,         // //
+    TOKEN_DOUBLECOLON,  // ::
+    TOKEN_ARROW,        // ->
+
+    TOKEN_ADD_ASSIGN,
+    TOKEN_SUB_ASSIGN,
+    TOKEN_MUL_ASSIGN,
+    TOKEN_DIV_ASSIGN,
+    TOKEN_IDIV_ASSIGN,
+    TOKEN_MOD_ASSIGN,
+    TOKEN_POW_ASSIGN,
+    TOKEN_CONCAT_ASSIGN,
+};
+
+struct Keyword {
+    const char* text;
+    int token;
+};
+
+constexpr Keyword KEYWORDS[] = {
+    {"and", TOKEN_AND},       {"break", TOKEN_BREAK},   {"do", TOKEN_DO},
+    {"else", TOKEN_ELSE},     {"elseif", TOKEN_ELSEIF}, {"end", TOKEN_END},
+    {"false", TOKEN_FALSE},   {"for", TOKEN_FOR},       {"function", TOKEN_FUNCTION},
+    {"if", TOKEN_IF},         {"in", TOKEN_IN},         {"local", TOKEN_LOCAL},
+    {"nil", TOKEN_NIL},       {"not", TOKEN_NOT},       {"or", TOKEN_OR},
+    {"repeat", TOKEN_REPEAT}, {"return", TOKEN_RETURN}, {"then", TOKEN_THEN},
+    {"true", TOKEN_TRUE},     {"until", TOKEN_UNTIL},   {"while", TOKEN_WHILE},
+};
+
+struct Token {
+    int type = TOKEN_EOF;
+    uint32_t line = 1;
+    std::string_view text;  // Name, or decoded string contents
+    std::string_view raw;   // Source slice, for diagnostics
+    double number = 0;
+};
+
+inline bool isAlpha(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+inline bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+inline bool isHexDigit(char c) {
+    return isDigit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+inline int hexValue(char c) {
+    return isDigit(c) ? c - '0' : (c | 0x20) - 'a' + 10;
+}
+
+// Produces tokens on demand with one token of lookahead. Names and plain
+// strings are views into the source; only escaped strings are copied.
+class Lexer {
+private:
+    const char* pos;
+    const char* end;
+    uint32_t line = 1;
+    Arena& arena;
+    Diagnostics& diag;
+
+    Token token;
+    Token ahead;
+    bool hasAhead = false;
+
+public:
+    Lexer(const char* source, size_t size, Arena& a, Diagnostics& d)
+        : pos(source), end(source + size), arena(a), diag(d) {
+        scan(token);
+    }
+
+    const Token& current() const { return token; }
+
+    const Token& lookahead() {
+        if (!hasAhead) {
+            scan(ahead);
+            hasAhead = true;
+        }
+        return ahead;
+    }
+
+    void next() {
+        if (hasAhead) {
+            token = ahead;
+            hasAhead = false;
+        } else {
+            scan(token);
+        }
+    }
+
+    // Splits a compound token in place (">=" closing a generic list)
+    void replaceCurrent(int type) { token.type = type; }
+
+    // Stop producing tokens after an error so the parser unwinds quickly
+    void abort() {
+        pos = end;
+        hasAhead = false;
+        token.type = TOKEN_EOF;
+        token.raw = std::string_view();
+    }
+
+private:
+    void fail(const char* message) {
+        diag.report(line, message);
+        abort();
+    }
+
+    void scan(Token& out);
+    bool skipComment();
+    int longBracketLevel(const char* at) const;
+    bool readLongBracket(int level, std::string_view& out);
+    void readNumber(Token& out);
+    void readString(Token& out);
+};
+
+int Lexer::longBracketLevel(const char* at) const {
+    // at points at '['; returns the number of '=' for "[==[" or -1
+    const char* p = at + 1;
+    while (p < end && *p == '=') p++;
+    return p < end && *p == '[' ? static_cast<int>(p - at - 1) : -1;
+}
+
+bool Lexer::readLongBracket(int level, std::string_view& out) {
+    pos += level + 2;
+
+    // A newline straight after the opening bracket is not part of the string
+    if (pos < end && *pos == '\r') pos++;
+    if (pos < end && *pos == '\n') {
+        pos++;
+        line++;
+    }
+
+    const char* start = pos;
+    while (pos < end) {
+        char c = *pos;
+        if (c == ']') {
+            const char* p = pos + 1;
+            while (p < end && *p == '=') p++;
+            if (p < end && *p == ']' && p - pos - 1 == level) {
+                out = std::string_view(start, static_cast<size_t>(pos - start));
+                pos = p + 1;
+                return true;
+            }
+            pos++;
+        } else {
+            if (c == '\n') line++;
+            pos++;
+        }
+    }
+    return false;
+}
+
+bool Lexer::skipComment() {
+    // pos is at "--"
+    pos += 2;
+    if (pos < end && *pos == '[') {
+        int level = longBracketLevel(pos);
+        if (level >= 0) {
+            std::string_view body;
+            if (!readLongBracket(level, body)) {
+                fail("unfinished long comment");
+                return false;
+            }
+            return true;
+        }
+    }
+    while (pos < end && *pos != '\n') pos++;
+    return true;
+}
+
+void Lexer::readNumber(Token& out) {
+    const char* start = pos;
+    bool hex = false;
+    bool binary = false;
+
+    if (*pos == '0' && pos + 1 < end && (pos[1] == 'x' || pos[1] == 'X')) {
+        hex = true;
+        pos += 2;
+        while (pos < end && (isHexDigit(*pos) || *pos == '_')) pos++;
+    } else if (*pos == '0' && pos + 1 < end && (pos[1] == 'b' || pos[1] == 'B')) {
+        binary = true;
+        pos += 2;
+        while (pos < end && (*pos == '0' || *pos == '1' || *pos == '_')) pos++;
+    } else {
+        while (pos < end && (isDigit(*pos) || *pos == '_' || *pos == '.')) pos++;
+        if (pos < end && (*pos == 'e' || *pos == 'E')) {
+            pos++;
+            if (pos < end && (*pos == '+' || *pos == '-')) pos++;
+            while (pos < end && (isDigit(*pos) || *pos == '_')) pos++;
+        }
+    }
+
+    if (pos < end && (isAlpha(*pos) || isDigit(*pos))) {
+        fail("malformed number");
+        return;
+    }
+
+    // Strip digit separators into a bounded buffer
+    char buffer[64];
+    size_t length = 0;
+    for (const char* p = start + (hex || binary ? 2 : 0); p < pos; p++) {
+        if (*p == '_') continue;
+        if (length + 1 >= sizeof(buffer)) {
+            fail("malformed number");
+            return;
+        }
+        buffer[length++] = *p;
+    }
+    buffer[length] = '\0';
+
+    char* parsed = nullptr;
+    if (hex || binary) {
+        out.number = length ? static_cast<double>(std::strtoull(buffer, &parsed, hex ? 16 : 2)) : 0;
+    } else {
+        out.number = length ? std::strtod(buffer, &parsed) : 0;
+    }
+
+    if (length == 0 || parsed != buffer + length) {
+        fail("malformed number");
+        return;
+    }
+
+    out.type = TOKEN_NUMBER;
+}
+
+void Lexer::readString(Token& out) {
+    const char quote = *pos++;
+    const char* start = pos;
+
+    // Fast path: no escapes, the token is a view into the source
+    const char* p = start;
+    while (p < end && *p != quote && *p != '\\' && *p != '\n') p++;
+    if (p < end && *p == quote) {
+        out.type = TOKEN_STRING;
+        out.text = std::string_view(start, static_cast<size_t>(p - start));
+        pos = p + 1;
+        return;
+    }
+
+    // Find the closing quote; decoded output is never longer than the input
+    while (p < end && *p != quote) {
+        if (*p == '\n') {
+            fail("unfinished string");
+            return;
+        }
+        if (*p == '\\') {
+            if (p + 1 < end && p[1] == 'z') {
+                p += 2;
+                while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) p++;
+                continue;
+            }
+            p += 2;
+            continue;
+        }
+        p++;
+    }
+    if (p >= end) {
+        fail("unfinished string");
+        return;
+    }
+
+    const char* close = p;
+    char* buffer = arena.chars(static_cast<size_t>(close - start));
+    size_t length = 0;
+
+    for (p = start; p < close;) {
+        char c = *p++;
+        if (c != '\\') {
+            buffer[length++] = c;
+            continue;
+        }
+
+        char e = *p++;
+        switch (e) {
+            case 'a': buffer[length++] = '\a'; break;
+            case 'b': buffer[length++] = '\b'; break;
+            case 'f': buffer[length++] = '\f'; break;
+            case 'n': buffer[length++] = '\n'; break;
+            case 'r': buffer[length++] = '\r'; break;
+            case 't': buffer[length++] = '\t'; break;
+            case 'v': buffer[length++] = '\v'; break;
+            case '\\': buffer[length++] = '\\'; break;
+            case '"': buffer[length++] = '"'; break;
+            case '\'': buffer[length++] = '\''; break;
+
+            case '\n':
+                line++;
+                buffer[length++] = '\n';
+                break;
+
+            case '\r':
+                if (p < close && *p == '\n') p++;
+                line++;
+                buffer[length++] = '\n';
+                break;
+
+            case 'z':
+                while (p < close && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+                    if (*p == '\n') line++;
+                    p++;
+                }
+                break;
+
+            case 'x':
+                if (p + 1 >= close || !isHexDigit(p[0]) || !isHexDigit(p[1])) {
+                    fail("invalid hexadecimal escape");
+                    return;
+                }
+                buffer[length++] = static_cast<char>(hexValue(p[0]) * 16 + hexValue(p[1]));
+                p += 2;
+                break;
+
+            case 'u': {
+                if (p >= close || *p != '{') {
+                    fail("invalid unicode escape");
+                    return;
+                }
+                p++;
+                uint32_t code = 0;
+                int digits = 0;
+                while (p < close && isHexDigit(*p) && digits < 8) {
+                    code = code * 16 + hexValue(*p++);
+                    digits++;
+                }
+                if (digits == 0 || p >= close || *p != '}' || code > 0x10FFFF) {
+                    fail("invalid unicode escape");
+                    return;
+                }
+                p++;
+
+                if (code < 0x80) {
+                    buffer[length++] = static_cast<char>(code);
+                } else if (code < 0x800) {
+                    buffer[length++] = static_cast<char>(0xC0 | (code >> 6));
+                    buffer[length++] = static_cast<char>(0x80 | (code & 0x3F));
+                } else if (code < 0x10000) {
+                    buffer[length++] = static_cast<char>(0xE0 | (code >> 12));
+                    buffer[length++] = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                    buffer[length++] = static_cast<char>(0x80 | (code & 0x3F));
+                } else {
+                    buffer[length++] = static_cast<char>(0xF0 | (code >> 18));
+                    buffer[length++] = static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+                    buffer[length++] = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                    buffer[length++] = static_cast<char>(0x80 | (code & 0x3F));
+                }
+                break;
+            }
+
+            default: {
+                if (!isDigit(e)) {
+                    fail("invalid escape sequence");
+                    return;
+                }
+                uint32_t value = static_cast<uint32_t>(e - '0');
+                for (int i = 0; i < 2 && p < close && isDigit(*p); i++) {
+                    value = value * 10 + static_cast<uint32_t>(*p++ - '0');
+                }
+                if (value > 255) {
+                    fail("decimal escape too large");
+                    return;
+                }
+                buffer[length++] = static_cast<char>(value);
+                break;
+            }
+        }
+    }
+
+    out.type = TOKEN_STRING;
+    out.text = std::string_view(buffer, length);
+    pos = close + 1;
+}
+
+void Lexer::scan(Token& out) {
+    // Whitespace and comments
+    while (pos < end) {
+        char c = *pos;
+        if (c == '\n') {
+            line++;
+            pos++;
+        } else if (c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v') {
+            pos++;
+        } else if (c == '-' && pos + 1 < end && pos[1] == '-') {
+            if (!skipComment()) break;
+        } else {
+            break;
+        }
+    }
+
+    out.line = line;
+    out.text = std::string_view();
+    const char* start = pos;
+
+    if (pos >= end) {
+        out.type = TOKEN_EOF;
+        out.raw = std::string_view();
+        return;
+    }
+
+    char c = *pos;
+    auto twoChar = [&](char second, int compound, int single) {
+        if (pos + 1 < end && pos[1] == second) {
+            pos += 2;
+            return compound;
+        }
+        pos++;
+        return single;
+    };
+
+    if (isAlpha(c)) {
+        while (pos < end && (isAlpha(*pos) || isDigit(*pos))) pos++;
+        out.text = std::string_view(start, static_cast<size_t>(pos - start));
+        out.type = TOKEN_NAME;
+        for (const Keyword& keyword : KEYWORDS) {
+            if (keyword.text[0] == c && out.text == keyword.text) {
+                out.type = keyword.token;
+                break;
+            }
+        }
+    } else if (isDigit(c) || (c == '.' && pos + 1 < end && isDigit(pos[1]))) {
+        readNumber(out);
+    } else {
+        switch (c) {
+            case '"':
+            case '\'':
+                readString(out);
+                break;
+
+            case '[': {
+                int level = longBracketLevel(pos);
+                if (level >= 0) {
+                    if (!readLongBracket(level, out.text)) {
+                        fail("unfinished long string");
+                        break;
+                    }
+                    out.type = TOKEN_STRING;
+                } else {
+                    out.type = '[';
+                    pos++;
+                }
+                break;
+            }
+
+            case '=': out.type = twoChar('=', TOKEN_EQ, '='); break;
+            case '<': out.type = twoChar('=', TOKEN_LE, '<'); break;
+            case '>': out.type = twoChar('=', TOKEN_GE, '>'); break;
+            case '+': out.type = twoChar('=', TOKEN_ADD_ASSIGN, '+'); break;
+            case '*': out.type = twoChar('=', TOKEN_MUL_ASSIGN, '*'); break;
+            case '%': out.type = twoChar('=', TOKEN_MOD_ASSIGN, '%'); break;
+            case '^': out.type = twoChar('=', TOKEN_POW_ASSIGN, '^'); break;
+            case ':': out.type = twoChar(':', TOKEN_DOUBLECOLON, ':'); break;
+
+            case '~':
+                if (pos + 1 < end && pos[1] == '=') {
+                    out.type = TOKEN_NE;
+                    pos += 2;
+                } else {
+                    fail("unexpected character '~'");
+                }
+                break;
+
+            case '-':
+                if (pos + 1 < end && pos[1] == '>') {
+                    out.type = TOKEN_ARROW;
+                    pos += 2;
+                } else {
+                    out.type = twoChar('=', TOKEN_SUB_ASSIGN, '-');
+                }
+                break;
+
+            case '/':
+                if (pos + 1 < end && pos[1] == '/') {
+                    pos++;
+                    out.type = twoChar('=', TOKEN_IDIV_ASSIGN, TOKEN_IDIV);
+                } else {
+                    out.type = twoChar('=', TOKEN_DIV_ASSIGN, '/');
+                }
+                break;
+
+            case '.':
+                if (pos + 2 < end && pos[1] == '.' && pos[2] == '.') {
+                    out.type = TOKEN_DOTS;
+                    pos += 3;
+                } else if (pos + 2 < end && pos[1] == '.' && pos[2] == '=') {
+                    out.type = TOKEN_CONCAT_ASSIGN;
+                    pos += 3;
+                } else {
+                    out.type = twoChar('.', TOKEN_CONCAT, '.');
+                }
+                break;
+
+            case '(': case ')': case '{': case '}': case ']':
+            case ';': case ',': case '#': case '?': case '|': case '&':
+                out.type = c;
+                pos++;
+                break;
+
+            default:
+                fail("unexpected character");
+                break;
+        }
+    }
+
+    if (diag.failed) {
+        out.type = TOKEN_EOF;
+        out.raw = std::string_view();
+        return;
+    }
+    out.raw = std::string_view(start, static_cast<size_t>(pos - start));
+}
+
+// ==================== AST ====================
+
+struct FunctionInfo;
+struct Stmt;
+
+struct Local {
+    std::string_view name;
+    FunctionInfo* owner;
+    uint32_t reg;       // Bound by the code generator
+    bool captured;      // Referenced from a nested function
+    bool written;       // Assigned after its declaration; captured by reference
+};
+
+struct Upvalue {
+    Local* local;
+    int32_t parentUpvalue;  // Index in the enclosing function's upvalues, -1 for its own local
+};
+
+enum ExprKind : uint8_t {
+    EXPR_NIL,
+    EXPR_TRUE,
+    EXPR_FALSE,
+    EXPR_NUMBER,
+    EXPR_STRING,
+    EXPR_LOCAL,
+    EXPR_UPVALUE,
+    EXPR_GLOBAL,
+    EXPR_INDEX,
+    EXPR_INDEX_NAME,
+    EXPR_CALL,
+    EXPR_FUNCTION,
+    EXPR_TABLE,
+    EXPR_UNARY,
+    EXPR_BINARY,
+    EXPR_GROUP,
+    EXPR_IF,
+};
+
+enum UnaryOp : uint8_t {
+    UNARY_NOT,
+    UNARY_MINUS,
+    UNARY_LENGTH,
+};
+
+enum BinaryOp : uint8_t {
+    BINARY_ADD,
+    BINARY_SUB,
+    BINARY_MUL,
+    BINARY_DIV,
+    BINARY_MOD,
+    BINARY_POW,
+    BINARY_CONCAT,
+    BINARY_EQ,
+    BINARY_NE,
+    BINARY_LT,
+    BINARY_LE,
+    BINARY_GT,
+    BINARY_GE,
+    BINARY_AND,
+    BINARY_OR,
+};
+
+struct Expr {
+    ExprKind kind;
+    uint32_t line;
+};
+
+struct ExprNumber : Expr {
+    double value;
+};
+
+struct ExprString : Expr {
+    std::string_view value;
+};
+
+struct ExprLocal : Expr {
+    Local* local;
+};
+
+struct ExprUpvalue : Expr {
+    Local* local;
+    uint32_t index;
+};
+
+struct ExprGlobal : Expr {
+    std::string_view name;
+};
+
+struct ExprIndex : Expr {
+    Expr* object;
+    Expr* key;
+};
+
+struct ExprIndexName : Expr {
+    Expr* object;
+    std::string_view name;
+};
+
+struct ExprCall : Expr {
+    Expr* function;         // Object for method calls
+    Expr** args;
+    uint32_t argCount;
+    bool isMethod;
+    std::string_view method;
+};
+
+struct ExprFunction : Expr {
+    FunctionInfo* function;
+};
+
+enum TableItemKind : uint8_t {
+    ITEM_ARRAY,     // value
+    ITEM_RECORD,    // [key] = value or name = value
+};
+
+struct TableItem {
+    TableItemKind kind;
+    Expr* key;
+    Expr* value;
+};
+
+struct ExprTable : Expr {
+    TableItem* items;
+    uint32_t count;
+    uint32_t arrayCount;
+    uint32_t hashCount;
+};
+
+struct ExprUnary : Expr {
+    UnaryOp op;
+    Expr* operand;
+};
+
+struct ExprBinary : Expr {
+    BinaryOp op;
+    Expr* left;
+    Expr* right;
+};
+
+struct ExprGroup : Expr {
+    Expr* inner;
+};
+
+struct ExprIf : Expr {
+    Expr* condition;
+    Expr* thenValue;
+    Expr* elseValue;
+};
+
+enum StmtKind : uint8_t {
+    STMT_LOCAL,
+    STMT_LOCAL_FUNCTION,
+    STMT_ASSIGN,
+    STMT_COMPOUND,
+    STMT_CALL,
+    STMT_IF,
+    STMT_WHILE,
+    STMT_REPEAT,
+    STMT_FOR,
+    STMT_FOR_IN,
+    STMT_DO,
+    STMT_RETURN,
+    STMT_BREAK,
+    STMT_CONTINUE,
+};
+
+struct Block {
+    Stmt** stmts;
+    uint32_t count;
+};
+
+struct Stmt {
+    StmtKind kind;
+    uint32_t line;
+};
+
+struct StmtLocal : Stmt {
+    Local** vars;
+    uint32_t varCount;
+    Expr** values;
+    uint32_t valueCount;
+};
+
+struct StmtLocalFunction : Stmt {
+    Local* var;
+    ExprFunction* function;
+};
+
+struct StmtAssign : Stmt {
+    Expr** targets;
+    uint32_t targetCount;
+    Expr** values;
+    uint32_t valueCount;
+};
+
+struct StmtCompound : Stmt {
+    BinaryOp op;
+    Expr* target;
+    Expr* value;
+};
+
+struct StmtCall : Stmt {
+    ExprCall* call;
+};
+
+struct StmtIf : Stmt {
+    Expr* condition;
+    Block thenBody;
+    StmtIf* elseIf;     // Next link of an elseif chain
+    Block elseBody;
+};
+
+struct StmtWhile : Stmt {
+    Expr* condition;
+    Block body;
+};
+
+struct StmtRepeat : Stmt {
+    Block body;         // The condition sees the body's locals
+    Expr* condition;
+};
+
+struct StmtFor : Stmt {
+    Local* var;
+    Expr* from;
+    Expr* to;
+    Expr* step;         // nullptr for the default step of 1
+    Block body;
+};
+
+struct StmtForIn : Stmt {
+    Local** vars;
+    uint32_t varCount;
+    Expr** values;
+    uint32_t valueCount;
+    Block body;
+};
+
+struct StmtDo : Stmt {
+    Block body;
+};
+
+struct StmtReturn : Stmt {
+    Expr** values;
+    uint32_t count;
+};
+
+struct FunctionInfo {
+    FunctionInfo* parent;
+    Local** params;
+    uint32_t paramCount;
+    bool vararg;
+    Block body;
+    Upvalue* upvalues;
+    uint32_t upvalueCount;
+    uint32_t line;
+};
+
+struct Priority {
+    uint8_t left;
+    uint8_t right;
+};
+
+// Indexed by BinaryOp; right < left makes an operator right associative
+constexpr Priority BINARY_PRIORITY[] = {
+    {6, 6}, {6, 6}, {7, 7}, {7, 7}, {7, 7}, {10, 9}, {5, 4},    // + - * / % ^ ..
+    {3, 3}, {3, 3}, {3, 3}, {3, 3}, {3, 3}, {3, 3},             // == ~= < <= > >=
+    {2, 2}, {1, 1},                                             // and or
+};
+
+constexpr uint8_t UNARY_PRIORITY = 8;
+
+// ==================== PARSER ====================
+
+class Parser {
+public:
+    Parser(const std::string& source, Arena& arena, Diagnostics& diag);
+
+    FunctionInfo* parseChunk();
+
+private:
+    struct FunctionState {
+        FunctionInfo* info = nullptr;
+        size_t localsBase = 0;
+        uint32_t loopDepth = 0;
+        std::vector<Upvalue> upvalues;
+    };
+
+    // Bounds native stack use on hostile input
+    struct RecursionGuard {
+        Parser& parser;
+        explicit RecursionGuard(Parser& p) : parser(p) {
+            if (++parser.recursion > MAX_RECURSION) parser.error("script is too deeply nested");
+        }
+        ~RecursionGuard() { parser.recursion--; }
+    };
+
+    static constexpr uint32_t MAX_RECURSION = 200;
+
+    Lexer lexer;
+    Arena& arena;
+    Diagnostics& diag;
+
+    std::vector<FunctionState> functions;   // Reused by depth
+    size_t functionDepth = 0;
+    std::vector<Local*> activeLocals;
+
+    // Scratch stacks for lists under construction, copied into the arena
+    std::vector<Expr*> exprStack;
+    std::vector<Stmt*> stmtStack;
+    std::vector<Local*> localStack;
+    std::vector<TableItem> itemStack;
+
+    uint32_t recursion = 0;
+
+    // Token helpers
+    const Token& current() const { return lexer.current(); }
+    bool check(int type) const { return lexer.current().type == type; }
+    bool accept(int type);
+    void expect(int type, const char* what);
+    void expectMatch(int type, const char* what, const char* opener, uint32_t line);
+    std::string_view expectName();
+    void error(const std::string& message);
+    void errorExpected(const char* what);
+    bool blockFollow() const;
+
+    template<typename T>
+    T* commit(std::vector<T>& stack, size_t start, uint32_t& count) {
+        count = static_cast<uint32_t>(stack.size() - start);
+        T* out = arena.copy(stack.data() + start, count);
+        stack.resize(start);
+        return out;
+    }
+
+    template<typename T>
+    T* node(ExprKind kind, uint32_t line) {
+        T* expr = arena.make<T>();
+        expr->kind = kind;
+        expr->line = line;
+        return expr;
+    }
+
+    template<typename T>
+    T* statement(StmtKind kind, uint32_t line) {
+        T* stmt = arena.make<T>();
+        stmt->kind = kind;
+        stmt->line = line;
+        return stmt;
+    }
+
+    // Scopes
+    FunctionState& function() { return functions[functionDepth - 1]; }
+    void enterFunction(FunctionInfo* info);
+    void leaveFunction();
+    Local* newLocal(std::string_view name);
+    Expr* resolveName(std::string_view name, uint32_t line);
+    int32_t addUpvalue(size_t level, Local* local);
+    void markWritten(Expr* target);
+
+    // Types are parsed and discarded
+    void skipType();
+    void skipBalanced(int open, int close);
+    void skipTypeAlias();
+
+    // Statements
+    Block parseBlock();
+    Block parseStatements();
+    Stmt* parseStatement();
+    Stmt* parseIf();
+    Stmt* parseWhile();
+    Stmt* parseRepeat();
+    Stmt* parseFor();
+    Stmt* parseFunctionStatement();
+    Stmt* parseLocal();
+    Stmt* parseReturn();
+    Stmt* parseExpressionStatement();
+    Stmt* parseAssignment(Expr* first);
+
+    // Expressions
+    Expr* parseExpr() { return parseSubExpr(0); }
+    Expr* parseSubExpr(uint8_t limit);
+    Expr* parseSimpleExpr();
+    Expr* parsePrimaryExpr();
+    Expr* parseSuffixedExpr();
+    Expr* parseCallArgs(Expr* function, std::string_view method, bool isMethod);
+    Expr* parseTable();
+    Expr* parseIfExpr();
+    ExprFunction* parseFunctionBody(bool isMethod, uint32_t line);
+    Expr** parseExprList(uint32_t& count);
+    Expr* makeUnary(UnaryOp op, Expr* operand, uint32_t line);
+    Expr* makeBinary(BinaryOp op, Expr* left, Expr* right, uint32_t line);
+    Expr* nilExpr(uint32_t line) { return node<Expr>(EXPR_NIL, line); }
+
+    static bool isAssignable(const Expr* e) {
+        return e->kind == EXPR_LOCAL || e->kind == EXPR_UPVALUE || e->kind == EXPR_GLOBAL ||
+               e->kind == EXPR_INDEX || e->kind == EXPR_INDEX_NAME;
+    }
+};
+
+Parser::Parser(const std::string& source, Arena& a, Diagnostics& d)
+    : lexer(source.data(), source.size(), a, d), arena(a), diag(d) {}
+
+bool Parser::accept(int type) {
+    if (!check(type)) return false;
+    lexer.next();
+    return true;
+}
+
+void Parser::error(const std::string& message) {
+    diag.report(current().line, message);
+    lexer.abort();
+}
+
+void Parser::errorExpected(const char* what) {
+    if (diag.failed) return;
+    std::string message = "expected ";
+    message += what;
+    if (check(TOKEN_EOF)) {
+        message += " near <eof>";
+    } else {
+        message += " near '";
+        message.append(current().raw.data(), current().raw.size());
+        message += "'";
+    }
+    error(message);
+}
+
+void Parser::expect(int type, const char* what) {
+    if (!accept(type)) errorExpected(what);
+}
+
+void Parser::expectMatch(int type, const char* what, const char* opener, uint32_t line) {
+    if (accept(type)) return;
+    if (diag.failed) return;
+
+    if (current().line == line) {
+        errorExpected(what);
+        return;
+    }
+    std::string message = std::string(what) + " (to close '" + opener + "' at line " +
+                          std::to_string(line) + ")";
+    errorExpected(message.c_str());
+}
+
+std::string_view Parser::expectName() {
+    if (!check(TOKEN_NAME)) {
+        errorExpected("identifier");
+        return "_";
+    }
+    std::string_view name = current().text;
+    lexer.next();
+    return name;
+}
+
+bool Parser::blockFollow() const {
+    switch (current().type) {
+        case TOKEN_EOF:
+        case TOKEN_END:
+        case TOKEN_ELSE:
+        case TOKEN_ELSEIF:
+        case TOKEN_UNTIL:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// ==================== SCOPES ====================
+
+void Parser::enterFunction(FunctionInfo* info) {
+    if (functionDepth == functions.size()) functions.emplace_back();
+    FunctionState& state = functions[functionDepth++];
+    state.info = info;
+    state.localsBase = activeLocals.size();
+    state.loopDepth = 0;
+    state.upvalues.clear();
+}
+
+void Parser::leaveFunction() {
+    FunctionState& state = functions[--functionDepth];
+    state.info->upvalues = commit(state.upvalues, 0, state.info->upvalueCount);
+    activeLocals.resize(state.localsBase);
+}
+
+Local* Parser::newLocal(std::string_view name) {
+    Local* local = arena.make<Local>();
+    local->name = name;
+    local->owner = function().info;
+    return local;
+}
+
+Expr* Parser::resolveName(std::string_view name, uint32_t line) {
+    for (size_t i = activeLocals.size(); i-- > 0;) {
+        Local* local = activeLocals[i];
+        if (local->name != name) continue;
+
+        if (local->owner == function().info) {
+            ExprLocal* expr = node<ExprLocal>(EXPR_LOCAL, line);
+            expr->local = local;
+            return expr;
+        }
+
+        local->captured = true;
+        ExprUpvalue* expr = node<ExprUpvalue>(EXPR_UPVALUE, line);
+        expr->local = local;
+        expr->index = static_cast<uint32_t>(addUpvalue(functionDepth - 1, local));
+        return expr;
+    }
+
+    ExprGlobal* expr = node<ExprGlobal>(EXPR_GLOBAL, line);
+    expr->name = name;
+    return expr;
+}
+
+int32_t Parser::addUpvalue(size_t level, Local* local) {
+    std::vector<Upvalue>& upvalues = functions[level].upvalues;
+    for (size_t i = 0; i < upvalues.size(); i++) {
+        if (upvalues[i].local == local) return static_cast<int32_t>(i);
+    }
+
+    // Thread the capture through every function in between
+    int32_t parent = -1;
+    if (functions[level - 1].info != local->owner) parent = addUpvalue(level - 1, local);
+
+    if (upvalues.size() >= 255) {
+        error("too many upvalues");
+        return 0;
+    }
+    upvalues.push_back({local, parent});
+    return static_cast<int32_t>(upvalues.size() - 1);
+}
+
+void Parser::markWritten(Expr* target) {
+    if (target->kind == EXPR_LOCAL) static_cast<ExprLocal*>(target)->local->written = true;
+    if (target->kind == EXPR_UPVALUE) static_cast<ExprUpvalue*>(target)->local->written = true;
+}
+
+// ==================== TYPE ANNOTATIONS ====================
+
+void Parser::skipBalanced(int open, int close) {
+    uint32_t depth = 0;
+    do {
+        if (check(TOKEN_EOF)) {
+            errorExpected(close == '>' ? "'>'" : close == ')' ? "')'" : "'}'");
+            return;
+        }
+        if (check(open)) {
+            depth++;
+        } else if (check(close)) {
+            depth--;
+        } else if (close == '>' && check(TOKEN_GE) && depth == 1) {
+            // "type T<U>= ..." lexes the closing bracket into ">="
+            lexer.replaceCurrent('=');
+            return;
+        }
+        lexer.next();
+    } while (depth > 0);
+}
+
+void Parser::skipType() {
+    RecursionGuard guard(*this);
+    accept('|');
+    accept('&');
+
+    for (;;) {
+        switch (current().type) {
+            case '(':
+                skipBalanced('(', ')');
+                if (accept(TOKEN_ARROW)) skipType();
+                break;
+
+            case '{':
+                skipBalanced('{', '}');
+                break;
+
+            case '<':
+                // Generic function type: <T>(T) -> T
+                skipBalanced('<', '>');
+                continue;
+
+            case TOKEN_DOTS:
+                lexer.next();
+                continue;
+
+            case TOKEN_NAME: {
+                bool isTypeof = current().text == "typeof";
+                lexer.next();
+                if (isTypeof && check('(')) {
+                    skipBalanced('(', ')');
+                    break;
+                }
+                while (accept('.')) expectName();
+                if (check('<')) skipBalanced('<', '>');
+                break;
+            }
+
+            case TOKEN_STRING:
+            case TOKEN_NIL:
+            case TOKEN_TRUE:
+            case TOKEN_FALSE:
+                lexer.next();
+                break;
+
+            default:
+                errorExpected("type");
+                return;
+        }
+
+        while (accept('?')) {}
+        if (!accept('|') && !accept('&')) return;
+    }
+}
+
+void Parser::skipTypeAlias() {
+    // type Name<T...> = Type
+    lexer.next();
+    expectName();
+    if (check('<')) skipBalanced('<', '>');
+    expect('=', "'='");
+    skipType();
+}
+
+// ==================== STATEMENTS ====================
+
+FunctionInfo* Parser::parseChunk() {
+    FunctionInfo* main = arena.make<FunctionInfo>();
+    main->vararg = true;
+    main->line = 1;
+
+    enterFunction(main);
+    main->body = parseBlock();
+    if (!check(TOKEN_EOF)) errorExpected("<eof>");
+    leaveFunction();
+
+    return main;
+}
+
+Block Parser::parseBlock() {
+    size_t localsMark = activeLocals.size();
+    Block block = parseStatements();
+    activeLocals.resize(localsMark);
+    return block;
+}
+
+Block Parser::parseStatements() {
+    RecursionGuard guard(*this);
+
+    size_t start = stmtStack.size();
+    while (!blockFollow()) {
+        if (check(TOKEN_RETURN)) {
+            stmtStack.push_back(parseReturn());
+            break;
+        }
+        if (Stmt* stmt = parseStatement()) stmtStack.push_back(stmt);
+    }
+
+    Block block;
+    block.stmts = commit(stmtStack, start, block.count);
+    return block;
+}
+
+Stmt* Parser::parseStatement() {
+    uint32_t line = current().line;
+
+    switch (current().type) {
+        case ';':
+            lexer.next();
+            return nullptr;
+
+        case TOKEN_IF:
+            return parseIf();
+
+        case TOKEN_WHILE:
+            return parseWhile();
+
+        case TOKEN_REPEAT:
+            return parseRepeat();
+
+        case TOKEN_FOR:
+            return parseFor();
+
+        case TOKEN_FUNCTION:
+            return parseFunctionStatement();
+
+        case TOKEN_LOCAL:
+            return parseLocal();
+
+        case TOKEN_DO: {
+            lexer.next();
+            StmtDo* stmt = statement<StmtDo>(STMT_DO, line);
+            stmt->body = parseBlock();
+            expectMatch(TOKEN_END, "'end'", "do", line);
+            return stmt;
+        }
+
+        case TOKEN_BREAK:
+            if (function().loopDepth == 0) {
+                error("break outside a loop");
+                return nullptr;
+            }
+            lexer.next();
+            return statement<Stmt>(STMT_BREAK, line);
+
+        case TOKEN_NAME: {
+            // Contextual keywords are ordinary names everywhere else
+            std::string_view name = current().text;
+            if (name == "continue") {
+                int next = lexer.lookahead().type;
+                if (next != '(' && next != '.' && next != '[' && next != ':' && next != '=' &&
+                    next != ',' && next != '{' && next != TOKEN_STRING && next < TOKEN_ADD_ASSIGN) {
+                    if (function().loopDepth == 0) {
+                        error("continue outside a loop");
+                        return nullptr;
+                    }
+                    lexer.next();
+                    return statement<Stmt>(STMT_CONTINUE, line);
+                }
+            } else if (name == "type" && lexer.lookahead().type == TOKEN_NAME) {
+                skipTypeAlias();
+                return nullptr;
+            } else if (name == "export" && lexer.lookahead().type == TOKEN_NAME &&
+                       lexer.lookahead().text == "type") {
+                lexer.next();
+                skipTypeAlias();
+                return nullptr;
+            }
+            return parseExpressionStatement();
+        }
+
+        default:
+            return parseExpressionStatement();
+    }
+}
+
+Stmt* Parser::parseIf() {
+    uint32_t line = current().line;
+    lexer.next();
+
+    StmtIf* root = statement<StmtIf>(STMT_IF, line);
+    root->condition = parseExpr();
+    expect(TOKEN_THEN, "'then'");
+    root->thenBody = parseBlock();
+
+    // elseif chains are linked rather than nested so long chains do not recurse
+    StmtIf* tail = root;
+    while (check(TOKEN_ELSEIF)) {
+        StmtIf* link = statement<StmtIf>(STMT_IF, current().line);
+        lexer.next();
+        link->condition = parseExpr();
+        expect(TOKEN_THEN, "'then'");
+        link->thenBody = parseBlock();
+        tail->elseIf = link;
+        tail = link;
+    }
+
+    if (accept(TOKEN_ELSE)) tail->elseBody = parseBlock();
+    expectMatch(TOKEN_END, "'end'", "if", line);
+    return root;
+}
+
+Stmt* Parser::parseWhile() {
+    uint32_t line = current().line;
+    lexer.next();
+
+    StmtWhile* stmt = statement<StmtWhile>(STMT_WHILE, line);
+    stmt->condition = parseExpr();
+    expect(TOKEN_DO, "'do'");
+
+    function().loopDepth++;
+    stmt->body = parseBlock();
+    function().loopDepth--;
+
+    expectMatch(TOKEN_END, "'end'", "while", line);
+    return stmt;
+}
+
+Stmt* Parser::parseRepeat() {
+    uint32_t line = current().line;
+    lexer.next();
+
+    StmtRepeat* stmt = statement<StmtRepeat>(STMT_REPEAT, line);
+    size_t localsMark = activeLocals.size();
+
+    function().loopDepth++;
+    stmt->body = parseStatements();
+    function().loopDepth--;
+
+    expectMatch(TOKEN_UNTIL, "'until'", "repeat", line);
+    stmt->condition = parseExpr();
+
+    activeLocals.resize(localsMark);
+    return stmt;
+}
+
+Stmt* Parser::parseFor() {
+    uint32_t line = current().line;
+    lexer.next();
+
+    std::string_view firstName = expectName();
+    if (accept(':')) skipType();
+
+    if (accept('=')) {
+        StmtFor* stmt = statement<StmtFor>(STMT_FOR, line);
+        stmt->from = parseExpr();
+        expect(',', "','");
+        stmt->to = parseExpr();
+        stmt->step = accept(',') ? parseExpr() : nullptr;
+        expect(TOKEN_DO, "'do'");
+
+        stmt->var = newLocal(firstName);
+        activeLocals.push_back(stmt->var);
+
+        function().loopDepth++;
+        stmt->body = parseBlock();
+        function().loopDepth--;
+
+        activeLocals.pop_back();
+        expectMatch(TOKEN_END, "'end'", "for", line);
+        return stmt;
+    }
+
+    StmtForIn* stmt = statement<StmtForIn>(STMT_FOR_IN, line);
+
+    size_t start = localStack.size();
+    localStack.push_back(newLocal(firstName));
+    while (accept(',')) {
+        localStack.push_back(newLocal(expectName()));
+        if (accept(':')) skipType();
+    }
+    stmt->vars = commit(localStack, start, stmt->varCount);
+
+    expect(TOKEN_IN, "'in'");
+    stmt->values = parseExprList(stmt->valueCount);
+    expect(TOKEN_DO, "'do'");
+
+    size_t localsMark = activeLocals.size();
+    for (uint32_t i = 0; i < stmt->varCount; i++) activeLocals.push_back(stmt->vars[i]);
+
+    function().loopDepth++;
+    stmt->body = parseBlock();
+    function().loopDepth--;
+
+    activeLocals.resize(localsMark);
+    expectMatch(TOKEN_END, "'end'", "for", line);
+    return stmt;
+}
+
+Stmt* Parser::parseFunctionStatement() {
+    uint32_t line = current().line;
+    lexer.next();
+
+    // function a.b.c:m() is an assignment of a closure to the name path
+    Expr* target = resolveName(expectName(), line);
+    bool isMethod = false;
+
+    while (check('.') || check(':')) {
+        isMethod = check(':');
+        lexer.next();
+
+        ExprIndexName* index = node<ExprIndexName>(EXPR_INDEX_NAME, line);
+        index->object = target;
+        index->name = expectName();
+        target = index;
+
+        if (isMethod) break;
+    }
+
+    markWritten(target);
+
+    StmtAssign* stmt = statement<StmtAssign>(STMT_ASSIGN, line);
+    Expr* value = parseFunctionBody(isMethod, line);
+    stmt->targets = arena.copy(&target, 1);
+    stmt->targetCount = 1;
+    stmt->values = arena.copy(&value, 1);
+    stmt->valueCount = 1;
+    return stmt;
+}
+
+Stmt* Parser::parseLocal() {
+    uint32_t line = current().line;
+    lexer.next();
+
+    if (accept(TOKEN_FUNCTION)) {
+        StmtLocalFunction* stmt = statement<StmtLocalFunction>(STMT_LOCAL_FUNCTION, line);
+        stmt->var = newLocal(expectName());
+
+        // Visible inside its own body for recursion
+        activeLocals.push_back(stmt->var);
+        stmt->function = parseFunctionBody(false, line);
+        return stmt;
+    }
+
+    StmtLocal* stmt = statement<StmtLocal>(STMT_LOCAL, line);
+
+    size_t start = localStack.size();
+    do {
+        localStack.push_back(newLocal(expectName()));
+        if (accept(':')) skipType();
+    } while (accept(','));
+    stmt->vars = commit(localStack, start, stmt->varCount);
+
+    if (accept('=')) stmt->values = parseExprList(stmt->valueCount);
+
+    // Names come into scope after their initializers
+    for (uint32_t i = 0; i < stmt->varCount; i++) activeLocals.push_back(stmt->vars[i]);
+    return stmt;
+}
+
+Stmt* Parser::parseReturn() {
+    uint32_t line = current().line;
+    lexer.next();
+
+    StmtReturn* stmt = statement<StmtReturn>(STMT_RETURN, line);
+    if (!blockFollow() && !check(';')) stmt->values = parseExprList(stmt->count);
+
+    accept(';');
+    if (!blockFollow()) errorExpected("end of block after 'return'");
+    return stmt;
+}
+
+Stmt* Parser::parseExpressionStatement() {
+    uint32_t line = current().line;
+    Expr* expr = parseSuffixedExpr();
+
+    if (check('=') || check(',')) return parseAssignment(expr);
+
+    BinaryOp op;
+    switch (current().type) {
+        case TOKEN_ADD_ASSIGN: op = BINARY_ADD; break;
+        case TOKEN_SUB_ASSIGN: op = BINARY_SUB; break;
+        case TOKEN_MUL_ASSIGN: op = BINARY_MUL; break;
+        case TOKEN_DIV_ASSIGN: op = BINARY_DIV; break;
+        case TOKEN_MOD_ASSIGN: op = BINARY_MOD; break;
+        case TOKEN_POW_ASSIGN: op = BINARY_POW; break;
+        case TOKEN_CONCAT_ASSIGN: op = BINARY_CONCAT; break;
+
+        case TOKEN_IDIV_ASSIGN:
+            error("floor division is not supported");
+            return nullptr;
+
+        default:
+            if (expr->kind != EXPR_CALL) {
+                if (!diag.failed) error("syntax error: expected assignment or function call");
+                return nullptr;
+            }
+            StmtCall* stmt = statement<StmtCall>(STMT_CALL, line);
+            stmt->call = static_cast<ExprCall*>(expr);
+            return stmt;
+    }
+
+    lexer.next();
+    if (!isAssignable(expr)) {
+        error("cannot assign to this expression");
+        return nullptr;
+    }
+    markWritten(expr);
+
+    StmtCompound* stmt = statement<StmtCompound>(STMT_COMPOUND, line);
+    stmt->op = op;
+    stmt->target = expr;
+    stmt->value = parseExpr();
+    return stmt;
+}
+
+Stmt* Parser::parseAssignment(Expr* first) {
+    StmtAssign* stmt = statement<StmtAssign>(STMT_ASSIGN, first->line);
+
+    size_t start = exprStack.size();
+    exprStack.push_back(first);
+    while (accept(',')) exprStack.push_back(parseSuffixedExpr());
+
+    for (size_t i = start; i < exprStack.size(); i++) {
+        if (!isAssignable(exprStack[i])) {
+            error("cannot assign to this expression");
+            exprStack.resize(start);
+            return nullptr;
+        }
+        markWritten(exprStack[i]);
+    }
+    stmt->targets = commit(exprStack, start, stmt->targetCount);
+
+    expect('=', "'='");
+    stmt->values = parseExprList(stmt->valueCount);
+    return stmt;
+}
+
+// ==================== EXPRESSIONS ====================
+
+Expr** Parser::parseExprList(uint32_t& count) {
+    size_t start = exprStack.size();
+    exprStack.push_back(parseExpr());
+    while (accept(',')) exprStack.push_back(parseExpr());
+    return commit(exprStack, start, count);
+}
+
+static bool unaryOperator(int token, UnaryOp& op) {
+    switch (token) {
+        case TOKEN_NOT: op = UNARY_NOT; return true;
+        case '-': op = UNARY_MINUS; return true;
+        case '#': op = UNARY_LENGTH; return true;
+        default: return false;
+    }
+}
+
+static bool binaryOperator(int token, BinaryOp& op) {
+    switch (token) {
+        case '+': op = BINARY_ADD; return true;
+        case '-': op = BINARY_SUB; return true;
+        case '*': op = BINARY_MUL; return true;
+        case '/': op = BINARY_DIV; return true;
+        case '%': op = BINARY_MOD; return true;
+        case '^': op = BINARY_POW; return true;
+        case TOKEN_CONCAT: op = BINARY_CONCAT; return true;
+        case TOKEN_EQ: op = BINARY_EQ; return true;
+        case TOKEN_NE: op = BINARY_NE; return true;
+        case '<': op = BINARY_LT; return true;
+        case TOKEN_LE: op = BINARY_LE; return true;
+        case '>': op = BINARY_GT; return true;
+        case TOKEN_GE: op = BINARY_GE; return true;
+        case TOKEN_AND: op = BINARY_AND; return true;
+        case TOKEN_OR: op = BINARY_OR; return true;
+        default: return false;
+    }
+}
+
+Expr* Parser::parseSubExpr(uint8_t limit) {
+    RecursionGuard guard(*this);
+
+    Expr* left;
+    UnaryOp unary;
+    if (unaryOperator(current().type, unary)) {
+        uint32_t line = current().line;
+        lexer.next();
+        left = makeUnary(unary, parseSubExpr(UNARY_PRIORITY), line);
+    } else {
+        left = parseSimpleExpr();
+    }
+
+    BinaryOp op;
+    for (;;) {
+        if (check(TOKEN_IDIV)) {
+            error("floor division is not supported");
+            return left;
+        }
+        if (!binaryOperator(current().type, op) || BINARY_PRIORITY[op].left <= limit) break;
+
+        uint32_t line = current().line;
+        lexer.next();
+        Expr* right = parseSubExpr(BINARY_PRIORITY[op].right);
+        left = makeBinary(op, left, right, line);
+    }
+
+    return left;
+}
+
+Expr* Parser::makeUnary(UnaryOp op, Expr* operand, uint32_t line) {
+    // Negative literals load as immediates instead of MINUS at runtime
+    if (op == UNARY_MINUS && operand->kind == EXPR_NUMBER) {
+        ExprNumber* number = node<ExprNumber>(EXPR_NUMBER, line);
+        number->value = -static_cast<ExprNumber*>(operand)->value;
+        return number;
+    }
+
+    ExprUnary* expr = node<ExprUnary>(EXPR_UNARY, line);
+    expr->op = op;
+    expr->operand = operand;
+    return expr;
+}
+
+Expr* Parser::makeBinary(BinaryOp op, Expr* left, Expr* right, uint32_t line) {
+    if (op <= BINARY_POW && left->kind == EXPR_NUMBER && right->kind == EXPR_NUMBER) {
+        double a = static_cast<ExprNumber*>(left)->value;
+        double b = static_cast<ExprNumber*>(right)->value;
+        double value = 0;
+        switch (op) {
+            case BINARY_ADD: value = a + b; break;
+            case BINARY_SUB: value = a - b; break;
+            case BINARY_MUL: value = a * b; break;
+            case BINARY_DIV: value = a / b; break;
+            case BINARY_MOD: value = a - std::floor(a / b) * b; break;
+            case BINARY_POW: value = std::pow(a, b); break;
+            default: break;
+        }
+        ExprNumber* number = node<ExprNumber>(EXPR_NUMBER, line);
+        number->value = value;
+        return number;
+    }
+
+    ExprBinary* expr = node<ExprBinary>(EXPR_BINARY, line);
+    expr->op = op;
+    expr->left = left;
+    expr->right = right;
+    return expr;
+}
+
+Expr* Parser::parseSimpleExpr() {
+    uint32_t line = current().line;
+    Expr* expr;
+
+    switch (current().type) {
+        case TOKEN_NUMBER: {
+            ExprNumber* number = node<ExprNumber>(EXPR_NUMBER, line);
+            number->value = current().number;
+            lexer.next();
+            expr = number;
+            break;
+        }
+
+        case TOKEN_STRING: {
+            ExprString* string = node<ExprString>(EXPR_STRING, line);
+            string->value = current().text;
+            lexer.next();
+            expr = string;
+            break;
+        }
+
+        case TOKEN_NIL:
+            lexer.next();
+            expr = node<Expr>(EXPR_NIL, line);
+            break;
+
+        case TOKEN_TRUE:
+            lexer.next();
+            expr = node<Expr>(EXPR_TRUE, line);
+            break;
+
+        case TOKEN_FALSE:
+            lexer.next();
+            expr = node<Expr>(EXPR_FALSE, line);
+            break;
+
+        case TOKEN_DOTS:
+            error("'...' is not supported");
+            return nilExpr(line);
+
+        case '{':
+            expr = parseTable();
+            break;
+
+        case TOKEN_FUNCTION:
+            lexer.next();
+            expr = parseFunctionBody(false, line);
+            break;
+
+        case TOKEN_IF:
+            expr = parseIfExpr();
+            break;
+
+        default:
+            expr = parseSuffixedExpr();
+            break;
+    }
+
+    // Type assertion: expr :: Type
+    if (accept(TOKEN_DOUBLECOLON)) skipType();
+    return expr;
+}
+
+Expr* Parser::parsePrimaryExpr() {
+    uint32_t line = current().line;
+
+    if (check(TOKEN_NAME)) {
+        std::string_view name = current().text;
+        lexer.next();
+        return resolveName(name, line);
+    }
+
+    if (check('(')) {
+        lexer.next();
+        ExprGroup* group = node<ExprGroup>(EXPR_GROUP, line);
+        group->inner = parseExpr();
+        expectMatch(')', "')'", "(", line);
+        return group;
+    }
+
+    errorExpected("expression");
+    return nilExpr(line);
+}
+
+Expr* Parser::parseSuffixedExpr() {
+    Expr* expr = parsePrimaryExpr();
+
+    for (;;) {
+        uint32_t line = current().line;
+        switch (current().type) {
+            case '.': {
+                lexer.next();
+                ExprIndexName* index = node<ExprIndexName>(EXPR_INDEX_NAME, line);
+                index->object = expr;
+                index->name = expectName();
+                expr = index;
+                break;
+            }
+
+            case '[': {
+                lexer.next();
+                ExprIndex* index = node<ExprIndex>(EXPR_INDEX, line);
+                index->object = expr;
+                index->key = parseExpr();
+                expect(']', "']'");
+                expr = index;
+                break;
+            }
+
+            case ':': {
+                lexer.next();
+                std::string_view method = expectName();
+                expr = parseCallArgs(expr, method, true);
+                break;
+            }
+
+            case '(':
+            case '{':
+            case TOKEN_STRING:
+                expr = parseCallArgs(expr, std::string_view(), false);
+                break;
+
+            default:
+                return expr;
+        }
+    }
+}
+
+Expr* Parser::parseCallArgs(Expr* function, std::string_view method, bool isMethod) {
+    uint32_t line = current().line;
+    ExprCall* call = node<ExprCall>(EXPR_CALL, line);
+    call->function = function;
+    call->isMethod = isMethod;
+    call->method = method;
+
+    size_t start = exprStack.size();
+    if (check(TOKEN_STRING)) {
+        ExprString* string = node<ExprString>(EXPR_STRING, line);
+        string->value = current().text;
+        lexer.next();
+        exprStack.push_back(string);
+    } else if (check('{')) {
+        exprStack.push_back(parseTable());
+    } else {
+        expect('(', "'('");
+        if (!check(')')) {
+            do {
+                exprStack.push_back(parseExpr());
+            } while (accept(','));
+        }
+        expectMatch(')', "')'", "(", line);
+    }
+
+    call->args = commit(exprStack, start, call->argCount);
+    return call;
+}
+
+Expr* Parser::parseTable() {
+    uint32_t line = current().line;
+    lexer.next();
+
+    ExprTable* table = node<ExprTable>(EXPR_TABLE, line);
+    size_t start = itemStack.size();
+
+    while (!check('}') && !check(TOKEN_EOF)) {
+        TableItem item = {};
+        if (check('[')) {
+            lexer.next();
+            item.kind = ITEM_RECORD;
+            item.key = parseExpr();
+            expect(']', "']'");
+            expect('=', "'='");
+            item.value = parseExpr();
+            table->hashCount++;
+        } else if (check(TOKEN_NAME) && lexer.lookahead().type == '=') {
+            ExprString* key = node<ExprString>(EXPR_STRING, current().line);
+            key->value = current().text;
+            lexer.next();
+            lexer.next();
+            item.kind = ITEM_RECORD;
+            item.key = key;
+            item.value = parseExpr();
+            table->hashCount++;
+        } else {
+            item.kind = ITEM_ARRAY;
+            item.value = parseExpr();
+            table->arrayCount++;
+        }
+        itemStack.push_back(item);
+
+        if (!accept(',') && !accept(';')) break;
+    }
+
+    expectMatch('}', "'}'", "{", line);
+    table->items = commit(itemStack, start, table->count);
+    return table;
+}
+
+Expr* Parser::parseIfExpr() {
+    // if a then b elseif c then d else e; current token is 'if' or 'elseif'
+    uint32_t line = current().line;
+    lexer.next();
+
+    ExprIf* expr = node<ExprIf>(EXPR_IF, line);
+    expr->condition = parseExpr();
+    expect(TOKEN_THEN, "'then'");
+    expr->thenValue = parseExpr();
+
+    if (check(TOKEN_ELSEIF)) {
+        RecursionGuard guard(*this);
+        expr->elseValue = parseIfExpr();
+    } else {
+        expect(TOKEN_ELSE, "'else'");
+        expr->elseValue = parseExpr();
+    }
+    return expr;
+}
+
+ExprFunction* Parser::parseFunctionBody(bool isMethod, uint32_t line) {
+    FunctionInfo* info = arena.make<FunctionInfo>();
+    info->parent = function().info;
+    info->line = line;
+
+    enterFunction(info);
+
+    if (check('<')) skipBalanced('<', '>');
+    expect('(', "'('");
+
+    size_t start = localStack.size();
+    if (isMethod) localStack.push_back(newLocal("self"));
+
+    if (!check(')')) {
+        do {
+            if (accept(TOKEN_DOTS)) {
+                info->vararg = true;
+                if (accept(':')) skipType();
+                break;
+            }
+            localStack.push_back(newLocal(expectName()));
+            if (accept(':')) skipType();
+        } while (accept(','));
+    }
+    expectMatch(')', "')'", "(", line);
+    if (accept(':')) skipType();
+
+    info->params = commit(localStack, start, info->paramCount);
+    for (uint32_t i = 0; i < info->paramCount; i++) activeLocals.push_back(info->params[i]);
+
+    info->body = parseBlock();
+    expectMatch(TOKEN_END, "'end'", "function", line);
+
+    leaveFunction();
+
+    ExprFunction* expr = node<ExprFunction>(EXPR_FUNCTION, line);
+    expr->function = info;
+    return expr;
+}
+
+// ==================== CONSTANT POOL ====================
+
+// One pool per chunk, shared by every proto. Strings are views into the
+// source or the arena, numbers are keyed by bit pattern.
+class ConstantPool {
+private:
+    struct Constant {
+        uint8_t type;
+        bool boolean;
+        double number;
+        std::string_view string;
+    };
+
+    std::vector<Constant> entries;
+    std::unordered_map<std::string_view, uint32_t> strings;
+    std::unordered_map<uint64_t, uint32_t> numbers;
+    int64_t nilIndex = -1;
+    int64_t booleanIndex[2] = {-1, -1};
+    size_t bytes = 0;
+
+    uint32_t push(const Constant& constant, size_t encodedSize) {
+        entries.push_back(constant);
+        bytes += encodedSize;
+        return static_cast<uint32_t>(entries.size() - 1);
+    }
+
+public:
+    uint32_t addNil() {
+        if (nilIndex < 0) nilIndex = push({LBC_CONSTANT_NIL, false, 0, {}}, 1);
+        return static_cast<uint32_t>(nilIndex);
+    }
+
+    uint32_t addBoolean(bool value) {
+        int64_t& index = booleanIndex[value ? 1 : 0];
+        if (index < 0) index = push({LBC_CONSTANT_BOOLEAN, value, 0, {}}, 2);
+        return static_cast<uint32_t>(index);
+    }
+
+    uint32_t addNumber(double value) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        auto it = numbers.find(bits);
+        if (it != numbers.end()) return it->second;
+
+        uint32_t index = push({LBC_CONSTANT_NUMBER, false, value, {}}, BytecodeWriter::numberConstantSize());
+        numbers.emplace(bits, index);
+        return index;
+    }
+
+    uint32_t addString(std::string_view value) {
+        auto it = strings.find(value);
+        if (it != strings.end()) return it->second;
+
+        uint32_t index = push({LBC_CONSTANT_STRING, false, 0, value},
+                              BytecodeWriter::stringConstantSize(value.size()));
+        strings.emplace(value, index);
+        return index;
+    }
+
+    uint32_t size() const { return static_cast<uint32_t>(entries.size()); }
+    size_t encodedSize() const { return bytes; }
+
+    void write(BytecodeWriter& writer) const {
+        for (const Constant& constant : entries) {
+            switch (constant.type) {
+                case LBC_CONSTANT_NIL: writer.writeConstantNil(); break;
+                case LBC_CONSTANT_BOOLEAN: writer.writeConstantBoolean(constant.boolean); break;
+                case LBC_CONSTANT_NUMBER: writer.writeConstantNumber(constant.number); break;
+                case LBC_CONSTANT_STRING:
+                    writer.writeConstantString(constant.string.data(), constant.string.size());
+                    break;
+            }
+        }
+    }
+};
+
+// ==================== CODE GENERATOR ====================
+
+constexpr uint32_t MAX_REGISTERS = 255;
+constexpr uint32_t FIELDS_PER_FLUSH = 16;   // Array items per SETLIST
+
+class CodeGen {
+public:
+    explicit CodeGen(Diagnostics& d) : diag(d) {}
+
+    uint32_t compileFunction(FunctionInfo* function);
+    std::string serialize() const;
+
+private:
+    struct ProtoRecord {
+        uint32_t maxStack;
+        uint32_t numParams;
+        uint32_t numUpvalues;
+        bool vararg;
+        uint32_t codeStart;
+        uint32_t codeSize;
+        uint32_t childStart;
+        uint32_t childCount;
+    };
+
+    struct LoopState {
+        size_t localsStart;         // First local that belongs to the loop
+        bool continueBackward;      // continue target already emitted
+        uint32_t continueTarget;
+        std::vector<uint32_t> breaks;
+        std::vector<uint32_t> continues;
+    };
+
+    // Per-function buffers, reused by nesting depth
+    struct FunctionBuffers {
+        std::vector<uint32_t> code;
+        std::vector<uint32_t> children;
+        std::vector<Local*> locals;
+        std::vector<LoopState> loops;
+    };
+
+    // Addressable assignment target, with its operands already evaluated
+    struct LValue {
+        Expr* expr;
+        uint32_t object;
+        uint32_t key;
+        uint32_t keyConstant;
+        enum : uint8_t { KEY_REGISTER, KEY_STRING, KEY_NUMBER } keyKind;
+    };
+
+    // Restores the register top on scope exit
+    struct RegScope {
+        CodeGen& gen;
+        uint32_t saved;
+        explicit RegScope(CodeGen& g) : gen(g), saved(g.top) {}
+        ~RegScope() { gen.top = saved; }
+    };
+
+    Diagnostics& diag;
+    ConstantPool constants;
+
+    std::vector<ProtoRecord> protos;        // Children complete before parents
+    std::vector<uint32_t> protoCode;
+    std::vector<uint32_t> protoChildren;
+    std::deque<FunctionBuffers> buffers;
+    size_t depth = 0;
+
+    // Current function
+    FunctionBuffers* fb = nullptr;
+    uint32_t top = 0;
+    uint32_t maxStack = 0;
+    uint32_t line = 0;
+
+    void error(const char* message) { diag.report(line, message); }
+
+    // Emission
+    uint32_t pc() const { return static_cast<uint32_t>(fb->code.size()); }
+
+    void emitABC(uint8_t op, uint32_t a, uint32_t b, uint32_t c) {
+        fb->code.push_back(encodeOpcode(op) | (a & 0xFF) << 8 | (b & 0xFF) << 16 | (c & 0xFF) << 24);
+    }
+
+    void emitAD(uint8_t op, uint32_t a, int32_t d) {
+        fb->code.push_back(encodeOpcode(op) | (a & 0xFF) << 8 |
+                           static_cast<uint32_t>(static_cast<uint16_t>(d)) << 16);
+    }
+
+    void emitAux(uint32_t aux) { fb->code.push_back(aux); }
+
+    uint32_t emitJump(uint8_t op, uint32_t a) {
+        uint32_t at = pc();
+        emitAD(op, a, 0);
+        return at;
+    }
+
+    void patchJump(uint32_t at, uint32_t target);
+    void patchJumps(const std::vector<uint32_t>& jumps, uint32_t target) {
+        for (uint32_t at : jumps) patchJump(at, target);
+    }
+
+    // Registers
+    uint32_t allocReg(uint32_t count) {
+        uint32_t reg = top;
+        top += count;
+        if (top > MAX_REGISTERS) {
+            error("out of registers; split the function or use fewer locals");
+            top = MAX_REGISTERS;
+            return 0;
+        }
+        if (top > maxStack) maxStack = top;
+        return reg;
+    }
+
+    void reserveStack(uint32_t limit) {
+        if (limit > MAX_REGISTERS) error("out of registers; split the function or use fewer locals");
+        else if (limit > maxStack) maxStack = limit;
+    }
+
+    void bindLocal(Local* local, uint32_t reg) {
+        local->reg = reg;
+        fb->locals.push_back(local);
+    }
+
+    void closeLocals(size_t from);
+
+    // Constants and loads
+    void loadConstant(uint32_t target, uint32_t index);
+    void loadNumber(uint32_t target, double value);
+    bool constantIndex(Expr* expr, uint32_t& index);
+
+    // Expressions
+    void compileExpr(Expr* expr, uint32_t target);
+    uint32_t compileExprAny(Expr* expr);
+    void compileExprMulti(Expr* expr, uint32_t target, uint32_t count);
+    void compileCall(ExprCall* call, uint32_t target, int32_t results, bool targetTop);
+    void compileClosure(ExprFunction* expr, uint32_t target);
+    void compileTable(ExprTable* table, uint32_t target);
+    void compileBinary(ExprBinary* expr, uint32_t target);
+    void compileArith(BinaryOp op, uint32_t target, uint32_t left, Expr* right);
+    void compileConcat(ExprBinary* expr, uint32_t target);
+    void compileCondition(Expr* expr, bool jumpIf, std::vector<uint32_t>& jumps);
+    void compileCompare(ExprBinary* expr, bool jumpIf, std::vector<uint32_t>& jumps);
+    static bool writesTargetLast(const Expr* expr);
+
+    // Assignment
+    LValue prepareLValue(Expr* target);
+    void loadLValue(const LValue& lvalue, uint32_t reg);
+    void storeLValue(const LValue& lvalue, uint32_t reg);
+
+    // Statements
+    void compileBlock(const Block& block);
+    void compileStatement(Stmt* stmt);
+    void compileLocal(StmtLocal* stmt);
+    void compileAssign(StmtAssign* stmt);
+    void compileCompound(StmtCompound* stmt);
+    void compileIf(StmtIf* stmt);
+    void compileWhile(StmtWhile* stmt);
+    void compileRepeat(StmtRepeat* stmt);
+    void compileFor(StmtFor* stmt);
+    void compileForIn(StmtForIn* stmt);
+    void compileReturn(StmtReturn* stmt);
+    void compileLoopExit(bool isBreak);
+
+    static bool endsWithJump(const Block& block) {
+        if (block.count == 0) return false;
+        StmtKind kind = block.stmts[block.count - 1]->kind;
+        return kind == STMT_RETURN || kind == STMT_BREAK || kind == STMT_CONTINUE;
+    }
+};
+
+void CodeGen::patchJump(uint32_t at, uint32_t target) {
+    int32_t offset = static_cast<int32_t>(target) - static_cast<int32_t>(at + 1);
+    uint32_t& word = fb->code[at];
+
+    if (offset >= INT16_MIN && offset <= INT16_MAX) {
+        word = (word & 0xFFFF) | static_cast<uint32_t>(static_cast<uint16_t>(offset)) << 16;
+        return;
+    }
+
+    // Unconditional jumps widen in place to the 24-bit form
+    uint8_t op = decodeOpcode(static_cast<uint8_t>(word));
+    if ((op == LOP_JUMP || op == LOP_JUMPBACK) && offset >= -(1 << 23) && offset < (1 << 23)) {
+        word = encodeOpcode(LOP_JUMPX) | static_cast<uint32_t>(offset) << 8;
+        return;
+    }
+
+    error("control flow is too long to encode; split the function");
+}
+
+void CodeGen::closeLocals(size_t from) {
+    // Locals captured by reference need fresh upvalues per scope instance
+    uint32_t reg = UINT32_MAX;
+    for (size_t i = from; i < fb->locals.size(); i++) {
+        Local* local = fb->locals[i];
+        if (local->captured && local->written && local->reg < reg) reg = local->reg;
+    }
+    if (reg != UINT32_MAX) emitABC(LOP_CLOSEUPVALS, reg, 0, 0);
+}
+
+// ==================== FUNCTIONS ====================
+
+uint32_t CodeGen::compileFunction(FunctionInfo* function) {
+    FunctionBuffers* savedBuffers = fb;
+    uint32_t savedTop = top;
+    uint32_t savedMaxStack = maxStack;
+
+    if (depth == buffers.size()) buffers.emplace_back();
+    fb = &buffers[depth++];
+    fb->code.clear();
+    fb->children.clear();
+    fb->locals.clear();
+    fb->loops.clear();
+    top = 0;
+    maxStack = 0;
+    line = function->line;
+
+    for (uint32_t i = 0; i < function->paramCount; i++) {
+        bindLocal(function->params[i], allocReg(1));
+    }
+
+    for (uint32_t i = 0; i < function->body.count; i++) {
+        compileStatement(function->body.stmts[i]);
+    }
+
+    if (function->body.count == 0 || function->body.stmts[function->body.count - 1]->kind != STMT_RETURN) {
+        emitABC(LOP_RETURN, 0, 1, 0);
+    }
+
+    ProtoRecord record;
+    record.maxStack = maxStack;
+    record.numParams = function->paramCount;
+    record.numUpvalues = function->upvalueCount;
+    record.vararg = function->vararg;
+    record.codeStart = static_cast<uint32_t>(protoCode.size());
+    record.codeSize = pc();
+    record.childStart = static_cast<uint32_t>(protoChildren.size());
+    record.childCount = static_cast<uint32_t>(fb->children.size());
+
+    protoCode.insert(protoCode.end(), fb->code.begin(), fb->code.end());
+    protoChildren.insert(protoChildren.end(), fb->children.begin(), fb->children.end());
+
+    uint32_t id = static_cast<uint32_t>(protos.size());
+    protos.push_back(record);
+
+    depth--;
+    fb = savedBuffers;
+    top = savedTop;
+    maxStack = savedMaxStack;
+    return id;
+}
+
+void CodeGen::compileClosure(ExprFunction* expr, uint32_t target) {
+    uint32_t savedLine = line;
+    uint32_t id = compileFunction(expr->function);
+    line = savedLine;
+
+    uint32_t child = static_cast<uint32_t>(fb->children.size());
+    if (child > INT16_MAX) {
+        error("too many nested functions");
+        return;
+    }
+    fb->children.push_back(id);
+
+    // The closure is stored in the target before captures run, so a local
+    // function capturing its own register sees itself
+    emitAD(LOP_NEWCLOSURE, target, static_cast<int32_t>(child));
+
+    const FunctionInfo* function = expr->function;
+    for (uint32_t i = 0; i < function->upvalueCount; i++) {
+        const Upvalue& upvalue = function->upvalues[i];
+        if (upvalue.parentUpvalue >= 0) {
+            emitABC(LOP_CAPTURE, 2, static_cast<uint32_t>(upvalue.parentUpvalue), 0);
+        } else {
+            emitABC(LOP_CAPTURE, upvalue.local->written ? 1 : 0, upvalue.local->reg, 0);
+        }
+    }
+}
+
+// ==================== CONSTANTS AND LOADS ====================
+
+void CodeGen::loadConstant(uint32_t target, uint32_t index) {
+    if (index <= static_cast<uint32_t>(INT16_MAX)) {
+        emitAD(LOP_LOADK, target, static_cast<int32_t>(index));
+    } else {
+        emitABC(LOP_LOADKX, target, 0, 0);
+        emitAux(index);
+    }
+}
+
+void CodeGen::loadNumber(uint32_t target, double value) {
+    if (fitsLoadN(value)) {
+        emitAD(LOP_LOADN, target, static_cast<int32_t>(value));
+    } else {
+        loadConstant(target, constants.addNumber(value));
+    }
+}
+
+bool CodeGen::constantIndex(Expr* expr, uint32_t& index) {
+    switch (expr->kind) {
+        case EXPR_NIL: index = constants.addNil(); return true;
+        case EXPR_TRUE: index = constants.addBoolean(true); return true;
+        case EXPR_FALSE: index = constants.addBoolean(false); return true;
+        case EXPR_NUMBER: index = constants.addNumber(static_cast<ExprNumber*>(expr)->value); return true;
+        case EXPR_STRING: index = constants.addString(static_cast<ExprString*>(expr)->value); return true;
+        default: return false;
+    }
+}
+
+static bool isLiteral(const Expr* expr) {
+    return expr->kind <= EXPR_STRING;
+}
+
+static bool smallIndex(const Expr* expr, uint32_t& index) {
+    // Integer keys 1..256 fit GETTABLEN/SETTABLEN's byte operand
+    if (expr->kind != EXPR_NUMBER) return false;
+    double value = static_cast<const ExprNumber*>(expr)->value;
+    if (value < 1 || value > 256 || std::floor(value) != value) return false;
+    index = static_cast<uint32_t>(value) - 1;
+    return true;
+}
+
+// ==================== EXPRESSIONS ====================
+
+bool CodeGen::writesTargetLast(const Expr* expr) {
+    // True when every operand is read before the target register is written,
+    // so the expression can be compiled straight into a live local
+    switch (expr->kind) {
+        case EXPR_NIL:
+        case EXPR_TRUE:
+        case EXPR_FALSE:
+        case EXPR_NUMBER:
+        case EXPR_STRING:
+        case EXPR_LOCAL:
+        case EXPR_UPVALUE:
+        case EXPR_GLOBAL:
+        case EXPR_INDEX:
+        case EXPR_INDEX_NAME:
+        case EXPR_UNARY:
+            return true;
+        case EXPR_BINARY: {
+            BinaryOp op = static_cast<const ExprBinary*>(expr)->op;
+            return op != BINARY_AND && op != BINARY_OR;
+        }
+        case EXPR_GROUP:
+            return writesTargetLast(static_cast<const ExprGroup*>(expr)->inner);
+        default:
+            return false;
+    }
+}
+
+uint32_t CodeGen::compileExprAny(Expr* expr) {
+    if (expr->kind == EXPR_LOCAL) return static_cast<ExprLocal*>(expr)->local->reg;
+    if (expr->kind == EXPR_GROUP) {
+        Expr* inner = static_cast<ExprGroup*>(expr)->inner;
+        if (inner->kind == EXPR_LOCAL) return static_cast<ExprLocal*>(inner)->local->reg;
+    }
+
+    uint32_t reg = allocReg(1);
+    compileExpr(expr, reg);
+    return reg;
+}
+
+void CodeGen::compileExprMulti(Expr* expr, uint32_t target, uint32_t count) {
+    // Fills target..target+count-1; only calls produce more than one value
+    if (expr->kind == EXPR_CALL) {
+        compileCall(static_cast<ExprCall*>(expr), target, static_cast<int32_t>(count), target + count == top);
+        return;
+    }
+
+    compileExpr(expr, target);
+    for (uint32_t i = 1; i < count; i++) emitABC(LOP_LOADNIL, target + i, 0, 0);
+}
+
+void CodeGen::compileExpr(Expr* expr, uint32_t target) {
+    RegScope scope(*this);
+
+    switch (expr->kind) {
+        case EXPR_NIL:
+            emitABC(LOP_LOADNIL, target, 0, 0);
+            break;
+
+        case EXPR_TRUE:
+        case EXPR_FALSE:
+            emitABC(LOP_LOADB, target, expr->kind == EXPR_TRUE ? 1 : 0, 0);
+            break;
+
+        case EXPR_NUMBER:
+            loadNumber(target, static_cast<ExprNumber*>(expr)->value);
+            break;
+
+        case EXPR_STRING:
+            loadConstant(target, constants.addString(static_cast<ExprString*>(expr)->value));
+            break;
+
+        case EXPR_LOCAL: {
+            uint32_t reg = static_cast<ExprLocal*>(expr)->local->reg;
+            if (reg != target) emitABC(LOP_MOVE, target, reg, 0);
+            break;
+        }
+
+        case EXPR_UPVALUE:
+            emitABC(LOP_GETUPVAL, target, static_cast<ExprUpvalue*>(expr)->index, 0);
+            break;
+
+        case EXPR_GLOBAL:
+            emitABC(LOP_GETGLOBAL, target, 0, 0);
+            emitAux(constants.addString(static_cast<ExprGlobal*>(expr)->name));
+            break;
+
+        case EXPR_INDEX_NAME: {
+            ExprIndexName* index = static_cast<ExprIndexName*>(expr);
+            uint32_t object = compileExprAny(index->object);
+            emitABC(LOP_GETTABLKS, target, object, 0);
+            emitAux(constants.addString(index->name));
+            break;
+        }
+
+        case EXPR_INDEX: {
+            ExprIndex* index = static_cast<ExprIndex*>(expr);
+            uint32_t object = compileExprAny(index->object);
+            uint32_t small;
+            if (index->key->kind == EXPR_STRING) {
+                emitABC(LOP_GETTABLKS, target, object, 0);
+                emitAux(constants.addString(static_cast<ExprString*>(index->key)->value));
+            } else if (smallIndex(index->key, small)) {
+                emitABC(LOP_GETTABLEN, target, object, small);
+            } else {
+                uint32_t key = compileExprAny(index->key);
+                emitABC(LOP_GETTABLE, target, object, key);
+            }
+            break;
+        }
+
+        case EXPR_CALL:
+            compileCall(static_cast<ExprCall*>(expr), target, 1, target + 1 == scope.saved);
+            break;
+
+        case EXPR_FUNCTION:
+            compileClosure(static_cast<ExprFunction*>(expr), target);
+            break;
+
+        case EXPR_TABLE:
+            compileTable(static_cast<ExprTable*>(expr), target);
+            break;
+
+        case EXPR_UNARY: {
+            ExprUnary* unary = static_cast<ExprUnary*>(expr);
+            static const uint8_t OPCODES[] = {LOP_NOT, LOP_MINUS, LOP_LENGTH};
+            uint32_t operand = compileExprAny(unary->operand);
+            emitABC(OPCODES[unary->op], target, operand, 0);
+            break;
+        }
+
+        case EXPR_BINARY:
+            compileBinary(static_cast<ExprBinary*>(expr), target);
+            break;
+
+        case EXPR_GROUP:
+            compileExpr(static_cast<ExprGroup*>(expr)->inner, target);
+            break;
+
+        case EXPR_IF: {
+            ExprIf* branch = static_cast<ExprIf*>(expr);
+            std::vector<uint32_t> elseJumps;
+            compileCondition(branch->condition, false, elseJumps);
+            compileExpr(branch->thenValue, target);
+            uint32_t endJump = emitJump(LOP_JUMP, 0);
+            patchJumps(elseJumps, pc());
+            compileExpr(branch->elseValue, target);
+            patchJump(endJump, pc());
+            break;
+        }
+    }
+}
+
+void CodeGen::compileCall(ExprCall* call, uint32_t target, int32_t results, bool targetTop) {
+    // targetTop: target..target+results-1 are the topmost registers, so the
+    // call frame can start at target and results land in place
+    uint32_t savedTop = top;
+    if (targetTop) top = target;
+
+    uint32_t base = allocReg(call->isMethod ? 2 : 1);
+
+    if (call->isMethod) {
+        uint32_t object;
+        if (call->function->kind == EXPR_LOCAL) {
+            object = static_cast<ExprLocal*>(call->function)->local->reg;
+        } else {
+            compileExpr(call->function, base + 1);
+            object = base + 1;
+        }
+        emitABC(LOP_NAMECALL, base, object, 0);
+        emitAux(constants.addString(call->method));
+    } else {
+        compileExpr(call->function, base);
+    }
+
+    bool multret = false;
+    for (uint32_t i = 0; i < call->argCount; i++) {
+        Expr* arg = call->args[i];
+        uint32_t reg = allocReg(1);
+        if (i + 1 == call->argCount && arg->kind == EXPR_CALL) {
+            compileCall(static_cast<ExprCall*>(arg), reg, -1, true);
+            multret = true;
+        } else {
+            compileExpr(arg, reg);
+        }
+    }
+
+    uint32_t args = call->argCount + (call->isMethod ? 1 : 0);
+    emitABC(LOP_CALL, base, multret ? 0 : args + 1, results < 0 ? 0 : static_cast<uint32_t>(results) + 1);
+    if (results > 0) reserveStack(base + static_cast<uint32_t>(results));
+
+    if (!targetTop) {
+        for (int32_t i = 0; i < results; i++) emitABC(LOP_MOVE, target + i, base + i, 0);
+    }
+
+    top = savedTop;
+}
+
+void CodeGen::compileTable(ExprTable* table, uint32_t target) {
+    emitABC(LOP_NEWTABLE, target, encodeHashSize(table->hashCount), 0);
+    emitAux(table->arrayCount);
+
+    uint32_t base = top;
+    uint32_t pending = 0;
+    uint32_t arrayIndex = 1;
+    uint32_t arraySeen = 0;
+
+    auto flush = [&](uint32_t count) {
+        emitABC(LOP_SETLIST, target, base, count);
+        emitAux(arrayIndex);
+        arrayIndex += pending;
+        pending = 0;
+        top = base;
+    };
+
+    for (uint32_t i = 0; i < table->count; i++) {
+        const TableItem& item = table->items[i];
+
+        if (item.kind == ITEM_ARRAY) {
+            uint32_t reg = allocReg(1);
+            if (++arraySeen == table->arrayCount && item.value->kind == EXPR_CALL) {
+                // Trailing call expands to all of its results
+                compileCall(static_cast<ExprCall*>(item.value), reg, -1, true);
+                flush(0);
+                continue;
+            }
+
+            compileExpr(item.value, reg);
+            if (++pending == FIELDS_PER_FLUSH) flush(pending + 1);
+            continue;
+        }
+
+        RegScope scope(*this);
+        uint32_t small;
+        if (item.key->kind == EXPR_STRING) {
+            uint32_t value = compileExprAny(item.value);
+            emitABC(LOP_SETTABLKS, value, target, 0);
+            emitAux(constants.addString(static_cast<ExprString*>(item.key)->value));
+        } else if (smallIndex(item.key, small)) {
+            uint32_t value = compileExprAny(item.value);
+            emitABC(LOP_SETTABLEN, value, target, small);
+        } else {
+            uint32_t key = compileExprAny(item.key);
+            uint32_t value = compileExprAny(item.value);
+            emitABC(LOP_SETTABLE, value, target, key);
+        }
+    }
+
+    if (pending) flush(pending + 1);
+}
+
+void CodeGen::compileBinary(ExprBinary* expr, uint32_t target) {
+    switch (expr->op) {
+        case BINARY_ADD:
+        case BINARY_SUB:
+        case BINARY_MUL:
+        case BINARY_DIV:
+        case BINARY_MOD:
+        case BINARY_POW:
+            compileArith(expr->op, target, compileExprAny(expr->left), expr->right);
+            break;
+
+        case BINARY_CONCAT:
+            compileConcat(expr, target);
+            break;
+
+        case BINARY_AND:
+        case BINARY_OR: {
+            bool isAnd = expr->op == BINARY_AND;
+
+            // Side-effect free right operands use the non-branching forms
+            uint32_t k;
+            if (constantIndex(expr->right, k) && k <= 255) {
+                uint32_t left = compileExprAny(expr->left);
+                emitABC(isAnd ? LOP_ANDK : LOP_ORK, target, left, k);
+                break;
+            }
+            if (expr->right->kind == EXPR_LOCAL) {
+                uint32_t left = compileExprAny(expr->left);
+                emitABC(isAnd ? LOP_AND : LOP_OR, target, left, static_cast<ExprLocal*>(expr->right)->local->reg);
+                break;
+            }
+
+            compileExpr(expr->left, target);
+            uint32_t skip = emitJump(isAnd ? LOP_JUMPIFNOT : LOP_JUMPIF, target);
+            compileExpr(expr->right, target);
+            patchJump(skip, pc());
+            break;
+        }
+
+        default: {
+            // Comparison as a value: jump over the false load when it holds
+            std::vector<uint32_t> trueJumps;
+            compileCompare(expr, true, trueJumps);
+            emitABC(LOP_LOADB, target, 0, 1);
+            patchJumps(trueJumps, pc());
+            emitABC(LOP_LOADB, target, 1, 0);
+            break;
+        }
+    }
+}
+
+void CodeGen::compileArith(BinaryOp op, uint32_t target, uint32_t left, Expr* right) {
+    static const uint8_t OPCODES[] = {LOP_ADD, LOP_SUB, LOP_MUL, LOP_DIV, LOP_MOD, LOP_POW};
+    static const uint8_t CONSTANT_OPCODES[] = {LOP_ADDK, LOP_SUBK, LOP_MULK, LOP_DIVK, LOP_MODK, LOP_POWK};
+
+    if (right->kind == EXPR_NUMBER) {
+        uint32_t k = constants.addNumber(static_cast<ExprNumber*>(right)->value);
+        if (k <= 255) {
+            emitABC(CONSTANT_OPCODES[op], target, left, k);
+            return;
+        }
+    }
+
+    RegScope scope(*this);
+    uint32_t reg = compileExprAny(right);
+    emitABC(OPCODES[op], target, left, reg);
+}
+
+void CodeGen::compileConcat(ExprBinary* expr, uint32_t target) {
+    // a .. b .. c is right associative; flatten the chain into one CONCAT
+    uint32_t count = 1;
+    for (Expr* e = expr; e->kind == EXPR_BINARY && static_cast<ExprBinary*>(e)->op == BINARY_CONCAT;
+         e = static_cast<ExprBinary*>(e)->right) {
+        count++;
+    }
+
+    uint32_t base = allocReg(count);
+    Expr* e = expr;
+    for (uint32_t i = 0; i + 1 < count; i++) {
+        ExprBinary* link = static_cast<ExprBinary*>(e);
+        compileExpr(link->left, base + i);
+        e = link->right;
+    }
+    compileExpr(e, base + count - 1);
+
+    emitABC(LOP_CONCAT, target, base, base + count - 1);
+}
+
+void CodeGen::compileCompare(ExprBinary* expr, bool jumpIf, std::vector<uint32_t>& jumps) {
+    RegScope scope(*this);
+    Expr* left = expr->left;
+    Expr* right = expr->right;
+    BinaryOp op = expr->op;
+
+    if (op == BINARY_EQ || op == BINARY_NE) {
+        // Equality against a literal compares with the constant directly
+        if (isLiteral(left) && !isLiteral(right)) std::swap(left, right);
+
+        uint32_t k;
+        if (isLiteral(right) && constantIndex(right, k) && k <= 0xFFFFFF) {
+            bool equal = (op == BINARY_EQ) == jumpIf;
+            uint32_t reg = compileExprAny(left);
+            jumps.push_back(emitJump(equal ? LOP_JUMPIFEQK : LOP_JUMPIFNOTEQK, reg));
+            emitAux(k);
+            return;
+        }
+
+        bool equal = (op == BINARY_EQ) == jumpIf;
+        uint32_t a = compileExprAny(left);
+        uint32_t b = compileExprAny(right);
+        jumps.push_back(emitJump(equal ? LOP_JUMPIFEQ : LOP_JUMPIFNOTEQ, a));
+        emitAux(b);
+        return;
+    }
+
+    // a > b is b < a; evaluation order stays left to right
+    uint32_t a = compileExprAny(left);
+    uint32_t b = compileExprAny(right);
+    if (op == BINARY_GT || op == BINARY_GE) {
+        std::swap(a, b);
+        op = op == BINARY_GT ? BINARY_LT : BINARY_LE;
+    }
+
+    uint8_t opcode;
+    if (op == BINARY_LT) opcode = jumpIf ? LOP_JUMPIFLT : LOP_JUMPIFNOTLT;
+    else opcode = jumpIf ? LOP_JUMPIFLE : LOP_JUMPIFNOTLE;
+
+    jumps.push_back(emitJump(opcode, a));
+    emitAux(b);
+}
+
+void CodeGen::compileCondition(Expr* expr, bool jumpIf, std::vector<uint32_t>& jumps) {
+    // Emits jumps taken when the condition's truth equals jumpIf
+    switch (expr->kind) {
+        case EXPR_NIL:
+        case EXPR_FALSE:
+            if (!jumpIf) jumps.push_back(emitJump(LOP_JUMP, 0));
+            return;
+
+        case EXPR_TRUE:
+        case EXPR_NUMBER:
+        case EXPR_STRING:
+            if (jumpIf) jumps.push_back(emitJump(LOP_JUMP, 0));
+            return;
+
+        case EXPR_GROUP:
+            compileCondition(static_cast<ExprGroup*>(expr)->inner, jumpIf, jumps);
+            return;
+
+        case EXPR_UNARY: {
+            ExprUnary* unary = static_cast<ExprUnary*>(expr);
+            if (unary->op == UNARY_NOT) {
+                compileCondition(unary->operand, !jumpIf, jumps);
+                return;
+            }
+            break;
+        }
+
+        case EXPR_BINARY: {
+            ExprBinary* binary = static_cast<ExprBinary*>(expr);
+            switch (binary->op) {
+                case BINARY_AND:
+                case BINARY_OR: {
+                    // and: short-circuits on false; or: short-circuits on true
+                    bool shortCircuit = binary->op == BINARY_OR;
+                    if (jumpIf == shortCircuit) {
+                        compileCondition(binary->left, jumpIf, jumps);
+                        compileCondition(binary->right, jumpIf, jumps);
+                    } else {
+                        std::vector<uint32_t> skip;
+                        compileCondition(binary->left, !jumpIf, skip);
+                        compileCondition(binary->right, jumpIf, jumps);
+                        patchJumps(skip, pc());
+                    }
+                    return;
+                }
+
+                case BINARY_EQ:
+                case BINARY_NE:
+                case BINARY_LT:
+                case BINARY_LE:
+                case BINARY_GT:
+                case BINARY_GE:
+                    compileCompare(binary, jumpIf, jumps);
+                    return;
+
+                default:
+                    break;
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+
+    RegScope scope(*this);
+    uint32_t reg = compileExprAny(expr);
+    jumps.push_back(emitJump(jumpIf ? LOP_JUMPIF : LOP_JUMPIFNOT, reg));
+}
+
+// ==================== ASSIGNMENT ====================
+
+CodeGen::LValue CodeGen::prepareLValue(Expr* target) {
+    LValue lvalue = {};
+    lvalue.expr = target;
+
+    if (target->kind == EXPR_INDEX_NAME) {
+        ExprIndexName* index = static_cast<ExprIndexName*>(target);
+        lvalue.object = compileExprAny(index->object);
+        lvalue.keyKind = LValue::KEY_STRING;
+        lvalue.keyConstant = constants.addString(index->name);
+    } else if (target->kind == EXPR_INDEX) {
+        ExprIndex* index = static_cast<ExprIndex*>(target);
+        lvalue.object = compileExprAny(index->object);
+        if (index->key->kind == EXPR_STRING) {
+            lvalue.keyKind = LValue::KEY_STRING;
+            lvalue.keyConstant = constants.addString(static_cast<ExprString*>(index->key)->value);
+        } else if (smallIndex(index->key, lvalue.keyConstant)) {
+            lvalue.keyKind = LValue::KEY_NUMBER;
+        } else {
+            lvalue.keyKind = LValue::KEY_REGISTER;
+            lvalue.key = compileExprAny(index->key);
+        }
+    }
+
+    return lvalue;
+}
+
+void CodeGen::loadLValue(const LValue& lvalue, uint32_t reg) {
+    switch (lvalue.expr->kind) {
+        case EXPR_LOCAL:
+        case EXPR_UPVALUE:
+        case EXPR_GLOBAL:
+            compileExpr(lvalue.expr, reg);
+            break;
+
+        default:
+            if (lvalue.keyKind == LValue::KEY_STRING) {
+                emitABC(LOP_GETTABLKS, reg, lvalue.object, 0);
+                emitAux(lvalue.keyConstant);
+            } else if (lvalue.keyKind == LValue::KEY_NUMBER) {
+                emitABC(LOP_GETTABLEN, reg, lvalue.object, lvalue.keyConstant);
+            } else {
+                emitABC(LOP_GETTABLE, reg, lvalue.object, lvalue.key);
+            }
+            break;
+    }
+}
+
+void CodeGen::storeLValue(const LValue& lvalue, uint32_t reg) {
+    switch (lvalue.expr->kind) {
+        case EXPR_LOCAL: {
+            uint32_t local = static_cast<ExprLocal*>(lvalue.expr)->local->reg;
+            if (local != reg) emitABC(LOP_MOVE, local, reg, 0);
+            break;
+        }
+
+        case EXPR_UPVALUE:
+            emitABC(LOP_SETUPVAL, reg, static_cast<ExprUpvalue*>(lvalue.expr)->index, 0);
+            break;
+
+        case EXPR_GLOBAL:
+            emitABC(LOP_SETGLOBAL, reg, 0, 0);
+            emitAux(constants.addString(static_cast<ExprGlobal*>(lvalue.expr)->name));
+            break;
+
+        default:
+            if (lvalue.keyKind == LValue::KEY_STRING) {
+                emitABC(LOP_SETTABLKS, reg, lvalue.object, 0);
+                emitAux(lvalue.keyConstant);
+            } else if (lvalue.keyKind == LValue::KEY_NUMBER) {
+                emitABC(LOP_SETTABLEN, reg, lvalue.object, lvalue.keyConstant);
+            } else {
+                emitABC(LOP_SETTABLE, reg, lvalue.object, lvalue.key);
+            }
+            break;
+    }
+}
+
+void CodeGen::compileAssign(StmtAssign* stmt) {
+    RegScope scope(*this);
+
+    if (stmt->targetCount == 1 && stmt->valueCount == 1) {
+        Expr* target = stmt->targets[0];
+        Expr* value = stmt->values[0];
+
+        if (target->kind == EXPR_LOCAL) {
+            uint32_t reg = static_cast<ExprLocal*>(target)->local->reg;
+            if (writesTargetLast(value)) {
+                compileExpr(value, reg);
+            } else {
+                uint32_t temp = allocReg(1);
+                compileExpr(value, temp);
+                emitABC(LOP_MOVE, reg, temp, 0);
+            }
+            return;
+        }
+
+        LValue lvalue = prepareLValue(target);
+        storeLValue(lvalue, compileExprAny(value));
+        return;
+    }
+
+    // Evaluate every target's operands, then every value, then store
+    LValue lvalues[16];
+    std::vector<LValue> overflow;
+    LValue* prepared = lvalues;
+    if (stmt->targetCount > 16) {
+        overflow.resize(stmt->targetCount);
+        prepared = overflow.data();
+    }
+
+    for (uint32_t i = 0; i < stmt->targetCount; i++) prepared[i] = prepareLValue(stmt->targets[i]);
+
+    // Stores run in order, so a target indexing through a local that an
+    // earlier target assigns reads a copy taken now, as Luau does
+    for (uint32_t i = 1; i < stmt->targetCount; i++) {
+        LValue& lvalue = prepared[i];
+        if (lvalue.expr->kind != EXPR_INDEX && lvalue.expr->kind != EXPR_INDEX_NAME) continue;
+
+        for (uint32_t j = 0; j < i; j++) {
+            if (prepared[j].expr->kind != EXPR_LOCAL) continue;
+            uint32_t local = static_cast<ExprLocal*>(prepared[j].expr)->local->reg;
+
+            if (lvalue.object == local) {
+                lvalue.object = allocReg(1);
+                emitABC(LOP_MOVE, lvalue.object, local, 0);
+            }
+            if (lvalue.keyKind == LValue::KEY_REGISTER && lvalue.key == local) {
+                lvalue.key = allocReg(1);
+                emitABC(LOP_MOVE, lvalue.key, local, 0);
+            }
+        }
+    }
+
+    uint32_t base = allocReg(stmt->targetCount);
+    for (uint32_t i = 0; i < stmt->valueCount; i++) {
+        Expr* value = stmt->values[i];
+        if (i >= stmt->targetCount) {
+            RegScope discard(*this);
+            compileExpr(value, allocReg(1));
+        } else if (i + 1 == stmt->valueCount && stmt->valueCount < stmt->targetCount) {
+            compileExprMulti(value, base + i, stmt->targetCount - i);
+        } else {
+            compileExpr(value, base + i);
+        }
+    }
+
+    for (uint32_t i = 0; i < stmt->targetCount; i++) storeLValue(prepared[i], base + i);
+}
+
+void CodeGen::compileCompound(StmtCompound* stmt) {
+    RegScope scope(*this);
+
+    if (stmt->target->kind == EXPR_LOCAL) {
+        ExprBinary binary;
+        binary.kind = EXPR_BINARY;
+        binary.line = stmt->line;
+        binary.op = stmt->op;
+        binary.left = stmt->target;
+        binary.right = stmt->value;
+        compileBinary(&binary, static_cast<ExprLocal*>(stmt->target)->local->reg);
+        return;
+    }
+
+    LValue lvalue = prepareLValue(stmt->target);
+
+    if (stmt->op == BINARY_CONCAT) {
+        uint32_t base = allocReg(2);
+        loadLValue(lvalue, base);
+        compileExpr(stmt->value, base + 1);
+        emitABC(LOP_CONCAT, base, base, base + 1);
+        storeLValue(lvalue, base);
+        return;
+    }
+
+    uint32_t reg = allocReg(1);
+    loadLValue(lvalue, reg);
+    compileArith(stmt->op, reg, reg, stmt->value);
+    storeLValue(lvalue, reg);
+}
+
+// ==================== STATEMENTS ====================
+
+void CodeGen::compileBlock(const Block& block) {
+    uint32_t savedTop = top;
+    size_t savedLocals = fb->locals.size();
+
+    for (uint32_t i = 0; i < block.count; i++) compileStatement(block.stmts[i]);
+
+    if (!endsWithJump(block)) closeLocals(savedLocals);
+    fb->locals.resize(savedLocals);
+    top = savedTop;
+}
+
+void CodeGen::compileStatement(Stmt* stmt) {
+    line = stmt->line;
+
+    switch (stmt->kind) {
+        case STMT_LOCAL:
+            compileLocal(static_cast<StmtLocal*>(stmt));
+            break;
+
+        case STMT_LOCAL_FUNCTION: {
+            StmtLocalFunction* local = static_cast<StmtLocalFunction*>(stmt);
+            uint32_t reg = allocReg(1);
+            bindLocal(local->var, reg);
+            compileClosure(local->function, reg);
+            break;
+        }
+
+        case STMT_ASSIGN:
+            compileAssign(static_cast<StmtAssign*>(stmt));
+            break;
+
+        case STMT_COMPOUND:
+            compileCompound(static_cast<StmtCompound*>(stmt));
+            break;
+
+        case STMT_CALL: {
+            RegScope scope(*this);
+            compileCall(static_cast<StmtCall*>(stmt)->call, top, 0, true);
+            break;
+        }
+
+        case STMT_IF:
+            compileIf(static_cast<StmtIf*>(stmt));
+            break;
+
+        case STMT_WHILE:
+            compileWhile(static_cast<StmtWhile*>(stmt));
+            break;
+
+        case STMT_REPEAT:
+            compileRepeat(static_cast<StmtRepeat*>(stmt));
+            break;
+
+        case STMT_FOR:
+            compileFor(static_cast<StmtFor*>(stmt));
+            break;
+
+        case STMT_FOR_IN:
+            compileForIn(static_cast<StmtForIn*>(stmt));
+            break;
+
+        case STMT_DO:
+            compileBlock(static_cast<StmtDo*>(stmt)->body);
+            break;
+
+        case STMT_RETURN:
+            compileReturn(static_cast<StmtReturn*>(stmt));
+            break;
+
+        case STMT_BREAK:
+            compileLoopExit(true);
+            break;
+
+        case STMT_CONTINUE:
+            compileLoopExit(false);
+            break;
+    }
+}
+
+void CodeGen::compileLocal(StmtLocal* stmt) {
+    uint32_t base = allocReg(stmt->varCount);
+
+    for (uint32_t i = 0; i < stmt->valueCount; i++) {
+        Expr* value = stmt->values[i];
+        if (i >= stmt->varCount) {
+            RegScope discard(*this);
+            compileExpr(value, allocReg(1));
+        } else if (i + 1 == stmt->valueCount && stmt->valueCount < stmt->varCount) {
+            compileExprMulti(value, base + i, stmt->varCount - i);
+        } else {
+            compileExpr(value, base + i);
+        }
+    }
+
+    // Registers may hold stale temporaries; locals start out nil
+    for (uint32_t i = stmt->valueCount; i < stmt->varCount && stmt->valueCount == 0; i++) {
+        emitABC(LOP_LOADNIL, base + i, 0, 0);
+    }
+
+    top = base + stmt->varCount;
+    for (uint32_t i = 0; i < stmt->varCount; i++) bindLocal(stmt->vars[i], base + i);
+}
+
+void CodeGen::compileIf(StmtIf* stmt) {
+    std::vector<uint32_t> endJumps;
+
+    for (StmtIf* link = stmt; link; link = link->elseIf) {
+        line = link->line;
+        std::vector<uint32_t> elseJumps;
+        compileCondition(link->condition, false, elseJumps);
+        compileBlock(link->thenBody);
+
+        bool hasElse = link->elseIf || link->elseBody.count;
+        if (hasElse && !endsWithJump(link->thenBody)) endJumps.push_back(emitJump(LOP_JUMP, 0));
+        patchJumps(elseJumps, pc());
+
+        if (!link->elseIf) compileBlock(link->elseBody);
+    }
+
+    patchJumps(endJumps, pc());
+}
+
+void CodeGen::compileLoopExit(bool isBreak) {
+    LoopState& loop = fb->loops.back();
+    closeLocals(loop.localsStart);
+
+    if (isBreak) {
+        loop.breaks.push_back(emitJump(LOP_JUMP, 0));
+    } else if (loop.continueBackward) {
+        patchJump(emitJump(LOP_JUMPBACK, 0), loop.continueTarget);
+    } else {
+        loop.continues.push_back(emitJump(LOP_JUMP, 0));
+    }
+}
+
+void CodeGen::compileWhile(StmtWhile* stmt) {
+    uint32_t start = pc();
+
+    std::vector<uint32_t> exitJumps;
+    compileCondition(stmt->condition, false, exitJumps);
+
+    fb->loops.push_back({fb->locals.size(), true, start, {}, {}});
+    compileBlock(stmt->body);
+    patchJump(emitJump(LOP_JUMPBACK, 0), start);
+
+    patchJumps(exitJumps, pc());
+    patchJumps(fb->loops.back().breaks, pc());
+    fb->loops.pop_back();
+}
+
+void CodeGen::compileRepeat(StmtRepeat* stmt) {
+    uint32_t start = pc();
+    uint32_t savedTop = top;
+    size_t savedLocals = fb->locals.size();
+
+    fb->loops.push_back({savedLocals, false, 0, {}, {}});
+    for (uint32_t i = 0; i < stmt->body.count; i++) compileStatement(stmt->body.stmts[i]);
+
+    line = stmt->line;
+    patchJumps(fb->loops.back().continues, pc());
+
+    bool needsClose = false;
+    for (size_t i = savedLocals; i < fb->locals.size(); i++) {
+        needsClose |= fb->locals[i]->captured && fb->locals[i]->written;
+    }
+
+    if (needsClose) {
+        // Upvalues close on both edges, so the back edge cannot be a single jump
+        std::vector<uint32_t> exitJumps;
+        compileCondition(stmt->condition, true, exitJumps);
+        closeLocals(savedLocals);
+        patchJump(emitJump(LOP_JUMPBACK, 0), start);
+        patchJumps(exitJumps, pc());
+        closeLocals(savedLocals);
+    } else {
+        std::vector<uint32_t> backJumps;
+        compileCondition(stmt->condition, false, backJumps);
+        patchJumps(backJumps, start);
+    }
+
+    fb->locals.resize(savedLocals);
+    top = savedTop;
+
+    patchJumps(fb->loops.back().breaks, pc());
+    fb->loops.pop_back();
+}
+
+void CodeGen::compileFor(StmtFor* stmt) {
+    uint32_t savedTop = top;
+    size_t savedLocals = fb->locals.size();
+
+    // Limit, step and index in base..base+2
+    uint32_t base = allocReg(3);
+    compileExpr(stmt->from, base + 2);
+    compileExpr(stmt->to, base);
+    if (stmt->step) compileExpr(stmt->step, base + 1);
+    else emitAD(LOP_LOADN, base + 1, 1);
+
+    uint32_t prep = emitJump(LOP_FORNPREP, base);
+    uint32_t bodyStart = pc();
+
+    // Assigning the loop variable must not disturb the iteration
+    if (stmt->var->written) {
+        uint32_t copy = allocReg(1);
+        emitABC(LOP_MOVE, copy, base + 2, 0);
+        bindLocal(stmt->var, copy);
+    } else {
+        bindLocal(stmt->var, base + 2);
+    }
+
+    fb->loops.push_back({savedLocals, false, 0, {}, {}});
+    compileBlock(stmt->body);
+
+    line = stmt->line;
+    patchJumps(fb->loops.back().continues, pc());
+    closeLocals(savedLocals);
+
+    patchJump(emitJump(LOP_FORNLOOP, base), bodyStart);
+    patchJump(prep, pc());
+    patchJumps(fb->loops.back().breaks, pc());
+    fb->loops.pop_back();
+
+    fb->locals.resize(savedLocals);
+    top = savedTop;
+}
+
+void CodeGen::compileForIn(StmtForIn* stmt) {
+    uint32_t savedTop = top;
+    size_t savedLocals = fb->locals.size();
+
+    // Generator, state and control in base..base+2, variables after
+    uint32_t base = allocReg(3);
+    for (uint32_t i = 0; i < stmt->valueCount; i++) {
+        Expr* value = stmt->values[i];
+        if (i >= 3) {
+            RegScope discard(*this);
+            compileExpr(value, allocReg(1));
+        } else if (i + 1 == stmt->valueCount && stmt->valueCount < 3) {
+            compileExprMulti(value, base + i, 3 - i);
+        } else {
+            compileExpr(value, base + i);
+        }
+    }
+
+    uint32_t vars = allocReg(stmt->varCount);
+    uint32_t prep = emitJump(LOP_FORGPREP, base);
+    uint32_t bodyStart = pc();
+
+    for (uint32_t i = 0; i < stmt->varCount; i++) bindLocal(stmt->vars[i], vars + i);
+
+    fb->loops.push_back({savedLocals, false, 0, {}, {}});
+    compileBlock(stmt->body);
+
+    line = stmt->line;
+    patchJumps(fb->loops.back().continues, pc());
+    closeLocals(savedLocals);
+
+    patchJump(prep, pc());
+    uint32_t loop = emitJump(LOP_FORGLOOP, base);
+    emitAux(stmt->varCount);
+    patchJump(loop, bodyStart);
+
+    patchJumps(fb->loops.back().breaks, pc());
+    fb->loops.pop_back();
+
+    fb->locals.resize(savedLocals);
+    top = savedTop;
+}
+
+void CodeGen::compileReturn(StmtReturn* stmt) {
+    RegScope scope(*this);
+
+    if (stmt->count == 0) {
+        emitABC(LOP_RETURN, 0, 1, 0);
+        return;
+    }
+
+    if (stmt->count == 1) {
+        Expr* value = stmt->values[0];
+        if (value->kind == EXPR_LOCAL) {
+            emitABC(LOP_RETURN, static_cast<ExprLocal*>(value)->local->reg, 2, 0);
+            return;
+        }
+        if (value->kind == EXPR_CALL) {
+            uint32_t base = top;
+            compileCall(static_cast<ExprCall*>(value), base, -1, true);
+            emitABC(LOP_RETURN, base, 0, 0);
+            return;
+        }
+    }
+
+    uint32_t base = allocReg(stmt->count);
+    bool multret = false;
+    for (uint32_t i = 0; i < stmt->count; i++) {
+        Expr* value = stmt->values[i];
+        if (i + 1 == stmt->count && value->kind == EXPR_CALL) {
+            compileCall(static_cast<ExprCall*>(value), base + i, -1, true);
+            multret = true;
+        } else {
+            compileExpr(value, base + i);
+        }
+    }
+
+    emitABC(LOP_RETURN, base, multret ? 0 : stmt->count + 1, 0);
+}
+
+// ==================== SERIALIZATION ====================
+
+std::string CodeGen::serialize() const {
+    const uint32_t constantCount = constants.size();
+
+    size_t size = BytecodeWriter::HEADER_SIZE + varIntSize(constantCount) + constants.encodedSize() +
+                  varIntSize(static_cast<uint32_t>(protos.size()));
+    for (const ProtoRecord& proto : protos) {
+        size += varIntSize(proto.maxStack) + varIntSize(proto.numParams) + varIntSize(proto.numUpvalues) + 1 +
+                varIntSize(proto.codeSize) + proto.codeSize * BytecodeWriter::INSTRUCTION_SIZE +
+                varIntSize(constantCount) + varIntSize(proto.childCount) + 4;
+        for (uint32_t i = 0; i < proto.childCount; i++) size += varIntSize(protoChildren[proto.childStart + i]);
+    }
+
+    BytecodeWriter writer(size);
+    writer.beginChunk();
+
+    writer.writeVarInt(constantCount);
+    constants.write(writer);
+
+    writer.writeVarInt(static_cast<uint32_t>(protos.size()));
+    for (const ProtoRecord& proto : protos) {
+        writer.beginProto(proto.maxStack, proto.numParams, proto.numUpvalues, proto.vararg, proto.codeSize);
+
+        uint8_t* out = writer.claim(static_cast<size_t>(proto.codeSize) * BytecodeWriter::INSTRUCTION_SIZE);
+        for (uint32_t i = 0; i < proto.codeSize; i++) {
+            uint32_t word = protoCode[proto.codeStart + i];
+            out[0] = static_cast<uint8_t>(word);
+            out[1] = static_cast<uint8_t>(word >> 8);
+            out[2] = static_cast<uint8_t>(word >> 16);
+            out[3] = static_cast<uint8_t>(word >> 24);
+            out += 4;
+        }
+
+        // Every proto sees the whole shared pool
+        writer.endProto(constantCount, protoChildren.data() + proto.childStart, proto.childCount);
+    }
+
+    return writer.finish();
+}
+
+} // namespace
+
+// ==================== PUBLIC API ====================
+
+std::string Compile(const std::string& source, std::string* error) {
+    Arena arena;
+    Diagnostics diag;
+
+    Parser parser(source, arena, diag);
+    FunctionInfo* main = parser.parseChunk();
+
+    if (!diag.failed) {
+        CodeGen codegen(diag);
+        codegen.compileFunction(main);
+        if (!diag.failed) return codegen.serialize();
+    }
+
+    if (error) *error = "line " + std::to_string(diag.line) + ": " + diag.message;
+    return std::string();
+}
+
+} // namespace Bytecode